@@ -0,0 +1,31 @@
+#!/bin/sh
+# Generate the kernel symbol table consumed by src/debug/ksyms.c.
+#
+# Reads `nm -n --defined-only` output on stdin and writes an assembly file
+# with a sorted table of { address, name } pairs for every text symbol.
+# With empty input it produces an empty table, which is used for the first
+# link pass (see the Makefile).
+
+awk '
+BEGIN { n = 0 }
+$2 ~ /^[TtWw]$/ && $3 !~ /^\$/ && $3 !~ /^\.L/ {
+    addr[n] = $1
+    name[n] = $3
+    n++
+}
+END {
+    print "/* Generated by scripts/gen_ksyms.sh - do not edit */"
+    print ".section \".rodata\""
+    print ".balign 8"
+    print ".globl ksyms_count"
+    print "ksyms_count:"
+    printf "    .quad %d\n", n
+    print ".globl ksyms_table"
+    print "ksyms_table:"
+    for (i = 0; i < n; i++) {
+        printf "    .quad 0x%s, .Lksym_name_%d\n", addr[i], i
+    }
+    for (i = 0; i < n; i++) {
+        printf ".Lksym_name_%d: .asciz \"%s\"\n", i, name[i]
+    }
+}'
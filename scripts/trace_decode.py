@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""Decode a kernel trace dump (`trace dump` in the shell).
+
+Reads a captured console log, finds the last dump in it and prints the
+records in timestamp order, one event per line:
+
+    scripts/trace_decode.py console.log
+    scripts/trace_decode.py -e kmalloc,kfree --summary console.log
+    scripts/trace_decode.py --elf build/kernel8.elf console.log
+
+The dump is text framed binary: a header naming the timer frequency and
+the events, then one line per record holding the record's bytes in hex
+(trace_record_t in src/include/debug/trace.h, little-endian).
+"""
+
+import argparse
+import bisect
+import collections
+import os
+import re
+import struct
+import subprocess
+import sys
+
+RECORD = struct.Struct("<QHHIQQ")   # timestamp, event, cpu, seq, arg0, arg1
+HEX_LINE = re.compile(r"^[0-9a-f]{%d}$" % (2 * RECORD.size))
+HEADER = re.compile(r"^# trace v(\d+) freq (\d+) cpus (\d+) ring (\d+)$")
+EVENT = re.compile(r"^# event (\d+) (\S+) (\S+) (\S+)$")
+SUPPORTED_VERSION = 1
+
+# Arguments printed in decimal rather than hex
+DECIMAL_ARGS = {"size", "irq", "refs"}
+
+
+class Dump:
+    def __init__(self, version, freq, cpus, ring):
+        self.version = version
+        self.freq = freq
+        self.cpus = cpus
+        self.ring = ring
+        self.events = {}            # id -> (name, arg0, arg1)
+        self.records = []
+        self.complete = False
+
+
+def parse(lines):
+    """The last dump in the log, or None."""
+    dumps = []
+    current = None
+    for line in lines:
+        line = line.strip()
+        m = HEADER.match(line)
+        if m:
+            current = Dump(*(int(g) for g in m.groups()))
+            dumps.append(current)
+            continue
+        if current is None or current.complete:
+            continue
+        m = EVENT.match(line)
+        if m:
+            current.events[int(m.group(1))] = m.group(2, 3, 4)
+        elif HEX_LINE.match(line):
+            current.records.append(RECORD.unpack(bytes.fromhex(line)))
+        elif line.startswith("# end"):
+            current.complete = True
+    return dumps[-1] if dumps else None
+
+
+def load_symbols(elf):
+    """Sorted (address, name) text symbols of the kernel image."""
+    nm = os.environ.get("NM", "aarch64-linux-gnu-nm")
+    out = subprocess.run([nm, "-n", "--defined-only", elf], check=True,
+                         capture_output=True, text=True).stdout
+    syms = []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in "TtWw":
+            syms.append((int(parts[0], 16), parts[2]))
+    return syms
+
+
+def symbolize(syms, addr):
+    i = bisect.bisect_right(syms, (addr, "\xff")) - 1
+    if i < 0:
+        return None
+    base, name = syms[i]
+    return "%s+0x%x" % (name, addr - base)
+
+
+def format_arg(name, value, syms):
+    if name in DECIMAL_ARGS:
+        return "%s=%d" % (name, value)
+    text = "%s=0x%x" % (name, value)
+    if syms and name == "elr":
+        sym = symbolize(syms, value)
+        if sym:
+            text += " <%s>" % sym
+    return text
+
+
+def lost_records(records):
+    """Records missing per CPU: overwritten or still being written."""
+    by_cpu = collections.defaultdict(list)
+    for rec in records:
+        by_cpu[rec[2]].append(rec[3])
+    lost = {}
+    for cpu, seqs in by_cpu.items():
+        seqs.sort()
+        lost[cpu] = (seqs[-1] - seqs[0] + 1) - len(seqs)
+    return lost
+
+
+def print_summary(dump, records):
+    counts = collections.Counter((dump.events[r[1]][0], r[2]) for r in records)
+    names = sorted({name for name, _ in counts})
+    cpus = sorted({cpu for _, cpu in counts})
+    print("%-14s %s %10s" % ("event", " ".join("%9s" % ("cpu%d" % c) for c in cpus), "total"))
+    for name in names:
+        row = [counts[(name, c)] for c in cpus]
+        print("%-14s %s %10d" % (name, " ".join("%9d" % n for n in row), sum(row)))
+
+    # Allocations whose free is not in the trace
+    for alloc, free in (("kmalloc", "kfree"), ("alloc_frame", "free_frame")):
+        live = {}
+        for rec in records:
+            name, arg0, arg1 = dump.events[rec[1]]
+            if name == alloc:
+                ptr = rec[4] if arg0 in ("ptr", "frame") else rec[5]
+                if ptr:
+                    live[ptr] = rec
+            elif name == free and not (arg1 == "refs" and rec[5]):
+                # A frame with references left is still allocated
+                live.pop(rec[4], None)
+        if live:
+            print("%d %s results not freed within the trace" % (len(live), alloc))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", help="console log (default: stdin)")
+    parser.add_argument("-e", "--events", help="comma-separated events to show")
+    parser.add_argument("-c", "--cpu", type=int, help="only this CPU")
+    parser.add_argument("--summary", action="store_true",
+                        help="per-event counts instead of the event list")
+    parser.add_argument("--elf", help="kernel image to symbolize addresses with")
+    args = parser.parse_args()
+
+    with (open(args.log, errors="replace") if args.log else sys.stdin) as f:
+        dump = parse(f)
+    if dump is None:
+        sys.exit("no trace dump found")
+    if dump.version != SUPPORTED_VERSION:
+        sys.exit("trace format v%d, expected v%d" % (dump.version, SUPPORTED_VERSION))
+    if not dump.complete:
+        print("warning: dump is truncated", file=sys.stderr)
+
+    records = [r for r in dump.records if r[1] in dump.events]
+    if args.events:
+        wanted = set(args.events.split(","))
+        unknown = wanted - {e[0] for e in dump.events.values()}
+        if unknown:
+            sys.exit("unknown events: %s" % ", ".join(sorted(unknown)))
+        records = [r for r in records if dump.events[r[1]][0] in wanted]
+    if args.cpu is not None:
+        records = [r for r in records if r[2] == args.cpu]
+    records.sort(key=lambda r: (r[0], r[2], r[3]))
+    if not records:
+        print("no records")
+        return
+
+    if args.summary:
+        print_summary(dump, records)
+    else:
+        syms = load_symbols(args.elf) if args.elf else None
+        start = records[0][0]
+        for ts, event, cpu, _, arg0, arg1 in records:
+            name, name0, name1 = dump.events[event]
+            fields = [format_arg(n, v, syms) for n, v in ((name0, arg0), (name1, arg1))
+                      if n != "unused"]
+            us = (ts - start) * 1e6 / dump.freq
+            print("%14.3f cpu%d %-12s %s" % (us, cpu, name, " ".join(fields)))
+
+    lost = {cpu: n for cpu, n in lost_records(dump.records).items() if n}
+    if lost and args.events is None and args.cpu is None:
+        print("lost records: %s" % ", ".join("cpu%d %d" % kv for kv in sorted(lost.items())),
+              file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
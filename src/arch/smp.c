@@ -0,0 +1,315 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "kernel.h"
+#include "arch/cpu.h"
+#include "arch/smp.h"
+#include "drivers/gic.h"
+#include "drivers/timer.h"
+#include "drivers/pmu.h"
+#include "drivers/psci.h"
+#include "memory/frame_alloc.h"
+#include "memory/mmu.h"
+#include "lib/fdt.h"
+#include "sched/thread.h"
+#include "sync/atomic.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+// How long to wait for a started CPU to report in
+#define SMP_BOOT_TIMEOUT_US 100000
+
+extern char secondary_entry;
+
+static percpu_t percpu_data[MAX_CPUS];
+static smp_boot_args_t boot_args[MAX_CPUS];
+static unsigned int online_cpus = 1;
+
+// Bring-up handshake for each logical slot: a secondary claims its slot by
+// moving it from BOOTING to ONLINE, and the boot CPU gives up on it by
+// moving it to DEAD, so a CPU that reports in after the timeout stays out
+enum {
+    SMP_SLOT_FREE,
+    SMP_SLOT_BOOTING,
+    SMP_SLOT_ONLINE,
+    SMP_SLOT_DEAD,
+};
+static volatile uint32_t slot_state[MAX_CPUS];
+
+percpu_t *percpu(unsigned int cpu) {
+    return &percpu_data[cpu];
+}
+
+unsigned int smp_num_cpus(void) {
+    return __atomic_load_n(&online_cpus, __ATOMIC_ACQUIRE);
+}
+
+bool cpu_online(unsigned int cpu) {
+    return cpu < MAX_CPUS && percpu_data[cpu].online;
+}
+
+// --- Cross-CPU calls ---
+//
+// Each CPU has a lock-free stack of pending requests. Senders push with a
+// compare-and-swap; the target takes the whole stack with one exchange and
+// runs it oldest first. Only a push onto an empty stack needs an IPI: a
+// non-empty one already has an interrupt on its way, or is being drained
+// by a handler that has not yet taken it.
+
+// Push call onto cpu's queue; true if the queue was empty
+static bool smp_queue_call(unsigned int cpu, smp_call_data_t *call) {
+    volatile uint64_t *head = (volatile uint64_t *)&percpu_data[cpu].call_queue;
+    uint64_t old = *head;
+    while (1) {
+        call->next = (smp_call_data_t *)old;
+        uint64_t seen = atomic_cmpxchg64(head, old, (uint64_t)call);
+        if (seen == old) {
+            return old == 0;
+        }
+        old = seen;
+    }
+}
+
+static void smp_ipi_handler(unsigned int irq, saved_registers_t *context, void *data) {
+    (void)irq;
+    (void)context;
+    (void)data;
+    percpu_t *self = this_cpu();
+    smp_call_data_t *call = (smp_call_data_t *)atomic_xchg64(
+        (volatile uint64_t *)&self->call_queue, 0);
+
+    // Newest first; reverse so calls run in the order they were made
+    smp_call_data_t *ordered = NULL;
+    while (call) {
+        smp_call_data_t *next = call->next;
+        call->next = ordered;
+        ordered = call;
+        call = next;
+    }
+
+    for (call = ordered; call; ) {
+        // The sender may reuse the request once done is set
+        smp_call_data_t *next = call->next;
+        smp_call_func_t func = call->func;
+        void *arg = call->arg;
+        if (call->wait) {
+            func(arg);
+            __atomic_store_n(&call->done, true, __ATOMIC_RELEASE);
+        } else {
+            __atomic_store_n(&call->done, true, __ATOMIC_RELEASE);
+            func(arg);
+        }
+        self->calls_handled++;
+        call = next;
+    }
+}
+
+static void smp_wait_call(smp_call_data_t *call) {
+    while (!__atomic_load_n(&call->done, __ATOMIC_ACQUIRE)) {
+        asm volatile("yield");
+    }
+}
+
+uint32_t smp_online_mask(void) {
+    uint32_t mask = 0;
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpu_online(cpu)) {
+            mask |= 1U << cpu;
+        }
+    }
+    return mask;
+}
+
+void smp_call_function_many(uint32_t cpus, smp_call_func_t func, void *arg, bool wait) {
+    // Without wait the requests still live on this stack, so every target
+    // is waited for until it has at least taken its request
+    smp_call_data_t calls[MAX_CPUS];
+    unsigned int self = cpu_id();
+    uint8_t targets = 0;
+
+    cpus &= smp_online_mask() & ~(1U << self);
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!(cpus & (1U << cpu))) {
+            continue;
+        }
+        calls[cpu].func = func;
+        calls[cpu].arg = arg;
+        calls[cpu].wait = wait;
+        calls[cpu].done = false;
+        if (smp_queue_call(cpu, &calls[cpu])) {
+            targets |= percpu_data[cpu].gic_mask;
+        }
+    }
+    if (targets) {
+        // One SGIR write reaches every target in the list
+        gic_send_sgi(IPI_CALL_FUNC, targets);
+        percpu_data[self].ipis_sent++;
+    }
+
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpus & (1U << cpu)) {
+            smp_wait_call(&calls[cpu]);
+        }
+    }
+}
+
+int smp_call_function_single(unsigned int cpu, smp_call_func_t func, void *arg, bool wait) {
+    if (cpu == cpu_id()) {
+        uint64_t flags = local_irq_save();
+        func(arg);
+        local_irq_restore(flags);
+        return 0;
+    }
+    if (!cpu_online(cpu)) {
+        return -1;
+    }
+    smp_call_function_many(1U << cpu, func, arg, wait);
+    return 0;
+}
+
+void smp_call_function(smp_call_func_t func, void *arg, bool wait) {
+    smp_call_function_many(smp_online_mask(), func, arg, wait);
+}
+
+// --- Bring-up ---
+
+// Per-CPU setup common to the boot CPU and the secondaries
+static void smp_cpu_setup(unsigned int cpu) {
+    percpu_t *self = &percpu_data[cpu];
+    self->cpu = cpu;
+    self->mpidr = read_sysreg(mpidr_el1);
+    write_sysreg(tpidr_el1, (uint64_t)self);
+    isb();
+}
+
+void smp_init_boot_cpu(void) {
+    smp_cpu_setup(0);
+    percpu_data[0].online = true;
+}
+
+void secondary_main(unsigned int cpu) {
+    if (atomic_cmpxchg32(&slot_state[cpu], SMP_SLOT_BOOTING, SMP_SLOT_ONLINE) !=
+        SMP_SLOT_BOOTING) {
+        // Too late: the boot CPU has retired this slot. Park with interrupts
+        // masked rather than touch its per-CPU data.
+        local_irq_disable();
+        while (1) {
+            asm volatile("wfi");
+        }
+    }
+    smp_cpu_setup(cpu);
+
+    gic_cpu_init();
+    percpu_data[cpu].gic_mask = gic_cpu_target_mask();
+    gic_enable_irq(IPI_CALL_FUNC);
+    timer_cpu_init();
+    pmu_cpu_init();
+
+    __atomic_store_n(&percpu_data[cpu].online, true, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&online_cpus, 1, __ATOMIC_ACQ_REL);
+    kprintf("SMP: CPU%u online (MPIDR 0x%llx)\n", cpu, percpu_data[cpu].mpidr);
+
+    sched_init_cpu(cpu);
+    local_irq_enable();
+    sched_idle_loop();
+}
+
+static bool smp_boot_cpu(unsigned int cpu, uint64_t mpidr) {
+    void *stack = alloc_frames(SMP_STACK_PAGES);
+    if (!stack) {
+        kprintf("SMP: No stack for CPU%u\n", cpu);
+        return false;
+    }
+    percpu_data[cpu].stack_base = stack;
+
+    smp_boot_args_t *args = &boot_args[cpu];
+    args->stack_top = (uint64_t)stack + SMP_STACK_PAGES * PAGE_SIZE;
+    mmu_get_cpu_config(&args->mair, &args->tcr, &args->ttbr0, &args->sctlr);
+    args->cpu = cpu;
+    // The CPU reads these with its MMU and caches off
+    mmu_clean_dcache_range((uint64_t)args, sizeof(*args));
+    atomic_store_release32(&slot_state[cpu], SMP_SLOT_BOOTING);
+
+    int ret = psci_cpu_on(mpidr, (uint64_t)&secondary_entry, (uint64_t)args);
+    if (ret != PSCI_SUCCESS) {
+        kprintf("SMP: CPU_ON for MPIDR 0x%llx failed (%d)\n", mpidr, ret);
+        free_frames(stack, SMP_STACK_PAGES);
+        percpu_data[cpu].stack_base = NULL;
+        slot_state[cpu] = SMP_SLOT_FREE;
+        return false;
+    }
+
+    uint64_t deadline = timer_read_counter() + timer_us_to_counter(SMP_BOOT_TIMEOUT_US);
+    while (!__atomic_load_n(&percpu_data[cpu].online, __ATOMIC_ACQUIRE)) {
+        if (timer_read_counter() > deadline &&
+            atomic_cmpxchg32(&slot_state[cpu], SMP_SLOT_BOOTING, SMP_SLOT_DEAD) ==
+            SMP_SLOT_BOOTING) {
+            // The CPU may still be on its way in, on this slot's stack and
+            // boot arguments, so neither is reused
+            kprintf("SMP: CPU%u (MPIDR 0x%llx) did not come online\n", cpu, mpidr);
+            return false;
+        }
+    }
+    return true;
+}
+
+void smp_init(void) {
+    percpu_data[0].gic_mask = gic_cpu_target_mask();
+    irq_register(IPI_CALL_FUNC, smp_ipi_handler, NULL);
+
+    fdt_node_t cpus = fdt_find_node("/cpus");
+    if (cpus < 0 || !psci_init()) {
+        kprintf("SMP: Running on the boot CPU only\n");
+        return;
+    }
+
+    const void *cells = fdt_get_prop(cpus, "#address-cells", NULL);
+    int address_cells = cells ? (int)fdt_read_cells(cells, 1) : 1;
+    uint64_t boot_mpidr = percpu_data[0].mpidr & 0xFF00FFFFFFULL;
+
+    // Logical numbers follow device tree order, skipping the boot CPU
+    unsigned int next_cpu = 1;
+    for (fdt_node_t node = fdt_next_child(cpus, -1); node >= 0; node = fdt_next_child(cpus, node)) {
+        const char *type = fdt_get_string(node, "device_type");
+        const void *reg = fdt_get_prop(node, "reg", NULL);
+        if (!type || strcmp(type, "cpu") != 0 || !reg) {
+            continue;
+        }
+        uint64_t mpidr = fdt_read_cells(reg, address_cells);
+        if (mpidr == boot_mpidr) {
+            continue;
+        }
+        if (next_cpu >= MAX_CPUS) {
+            kprintf("SMP: Ignoring CPUs beyond %d\n", MAX_CPUS);
+            break;
+        }
+        // A CPU that was started but never reported in keeps its slot
+        if (smp_boot_cpu(next_cpu, mpidr) || slot_state[next_cpu] == SMP_SLOT_DEAD) {
+            next_cpu++;
+        }
+    }
+
+    kprintf("SMP: %u CPU(s) online\n", smp_num_cpus());
+}
+
+// --- Diagnostics ---
+
+static void smp_ping(void *arg) {
+    (void)arg;
+}
+
+void smp_print_info(void) {
+    kprintf("CPUs: %u online\n", smp_num_cpus());
+    kprintf("  %-4s %-12s %-8s %10s %10s %12s\n", "CPU", "MPIDR", "GIC", "IPI calls", "IPIs sent", "round trip");
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        percpu_t *p = &percpu_data[cpu];
+        if (!p->online) {
+            continue;
+        }
+        uint64_t start = timer_read_counter();
+        smp_call_function_single(cpu, smp_ping, NULL, true);
+        uint64_t us = timer_counter_to_us(timer_read_counter() - start);
+        kprintf("  %-4u 0x%-10llx 0x%02x     %10llu %10llu %9llu us%s\n", cpu, p->mpidr,
+                p->gic_mask, p->calls_handled, p->ipis_sent, us, cpu == cpu_id() ? " (self)" : "");
+    }
+}
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "arch/smp.h"
+#include "memory/frame_alloc.h"
+#include "memory/kheap.h"
+#include "lib/stdio.h"
+#include "lib/stdlib_stubs.h"
+
+#define ALLOC_BENCH_ITERS 4000
+#define ALLOC_BENCH_BURST 8         // Allocations held at once per CPU
+#define ALLOC_BENCH_OBJECT 64       // kmalloc size
+
+static uint32_t ab_iters;
+static volatile bool ab_failed;
+
+// Allocate a burst, then free it, until iters allocations were made
+static void alloc_bench_frames(void *arg) {
+    (void)arg;
+    void *frames[ALLOC_BENCH_BURST];
+    for (uint32_t i = 0; i < ab_iters; i += ALLOC_BENCH_BURST) {
+        for (int j = 0; j < ALLOC_BENCH_BURST; j++) {
+            frames[j] = alloc_frame();
+            if (!frames[j]) {
+                ab_failed = true;
+            }
+        }
+        for (int j = 0; j < ALLOC_BENCH_BURST; j++) {
+            free_frame(frames[j]);
+        }
+    }
+}
+
+static void alloc_bench_objects(void *arg) {
+    (void)arg;
+    void *objects[ALLOC_BENCH_BURST];
+    for (uint32_t i = 0; i < ab_iters; i += ALLOC_BENCH_BURST) {
+        for (int j = 0; j < ALLOC_BENCH_BURST; j++) {
+            objects[j] = kmalloc(ALLOC_BENCH_OBJECT);
+            if (!objects[j]) {
+                ab_failed = true;
+            }
+        }
+        for (int j = 0; j < ALLOC_BENCH_BURST; j++) {
+            kfree(objects[j]);
+        }
+    }
+}
+
+static void alloc_bench_drain(void *arg) {
+    (void)arg;
+    pmm_cache_drain();
+    kheap_cache_drain();
+}
+
+// Aggregate allocations (each with its free) per millisecond on ncpus
+static uint64_t alloc_bench_run(bench_cpu_func_t body, unsigned int ncpus, bool cached) {
+    pmm_cache_enable(cached);
+    kheap_cache_enable(cached);
+    uint64_t ns = bench_ticks_to_ns(bench_on_cpus(ncpus, body, NULL, NULL));
+    pmm_cache_enable(true);
+    kheap_cache_enable(true);
+    return ns ? (uint64_t)ab_iters * ncpus * 1000000 / ns : 0;
+}
+
+void bench_alloc(int argc, char **argv) {
+    ab_iters = ALLOC_BENCH_ITERS;
+    if (argc > 1) {
+        ab_iters = (uint32_t)simple_strtoull(argv[1], NULL, 0);
+        if (ab_iters < ALLOC_BENCH_BURST) {
+            kprintf("Usage: bench alloc [iterations >= %d]\n", ALLOC_BENCH_BURST);
+            return;
+        }
+    }
+    ab_failed = false;
+
+    kprintf("Allocator scaling: %u alloc/free pairs per CPU in bursts of %d\n",
+            ab_iters, ALLOC_BENCH_BURST);
+    kprintf("(allocations per ms over all CPUs; global = per-CPU caches off)\n");
+    kprintf("  %-5s %14s %14s %16s %16s\n", "CPUs", "frames global", "frames cached",
+            "kmalloc global", "kmalloc cached");
+
+    for (unsigned int ncpus = 1; ncpus <= MAX_CPUS; ncpus *= 2) {
+        if (ncpus > bench_max_cpus(ncpus)) {
+            break;
+        }
+        uint64_t frames_global = alloc_bench_run(alloc_bench_frames, ncpus, false);
+        uint64_t frames_cached = alloc_bench_run(alloc_bench_frames, ncpus, true);
+        uint64_t objects_global = alloc_bench_run(alloc_bench_objects, ncpus, false);
+        uint64_t objects_cached = alloc_bench_run(alloc_bench_objects, ncpus, true);
+        kprintf("  %-5u %14llu %14llu %16llu %16llu\n", ncpus, frames_global, frames_cached,
+                objects_global, objects_cached);
+    }
+
+    // Leave the memory where meminfo and the next run expect it
+    bench_on_cpus(bench_max_cpus(MAX_CPUS), alloc_bench_drain, NULL, NULL);
+    if (ab_failed) {
+        kprintf("Warning: some allocations failed\n");
+    }
+    kprintf("Free memory after drain: %llu KB\n", pmm_get_free_memory() / 1024);
+}
@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "memory/mm.h"
+#include "memory/mmu.h"
+#include "memory/frame_alloc.h"
+#include "drivers/timer.h"
+#include "drivers/pmu.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+#include "lib/stdlib_stubs.h"
+
+#define ASID_BENCH_PAGES    64      // Working set of each address space
+#define ASID_BENCH_SWITCHES 2000
+#define ASID_BENCH_SPARSE   (1024ULL * 1024 * 1024)
+
+// Read one word from every page of the working set
+static uint64_t asid_bench_touch(uint64_t base) {
+    uint64_t sum = 0;
+    for (int i = 0; i < ASID_BENCH_PAGES; i++) {
+        sum += *(volatile uint64_t *)(base + (uint64_t)i * PAGE_SIZE);
+    }
+    return sum;
+}
+
+// Write every page so each is backed by its own frame, not the zero page
+static void asid_bench_populate(uint64_t base) {
+    for (int i = 0; i < ASID_BENCH_PAGES; i++) {
+        *(volatile uint64_t *)(base + (uint64_t)i * PAGE_SIZE) = i;
+    }
+}
+
+// Alternate between two address spaces, touching each working set.
+// With full_flush every switch also invalidates the whole TLB, which is
+// what a switch costs without ASIDs.
+static uint64_t asid_bench_switches(mm_t *a, uint64_t va_a, mm_t *b, uint64_t va_b,
+                                    uint32_t switches, bool full_flush, uint64_t *refills) {
+    pmu_session_t session;
+    memset(&session, 0, sizeof(session));
+    bool counting = pmu_available() && pmu_event_supported(PMU_EVENT_L1D_TLB_REFILL);
+    if (counting) {
+        pmu_session_add_event(&session, PMU_EVENT_L1D_TLB_REFILL);
+        counting = pmu_session_start(&session) == 0;
+    }
+
+    uint64_t start = timer_read_counter();
+    for (uint32_t i = 0; i < switches; i += 2) {
+        mm_switch(a);
+        if (full_flush) {
+            mmu_flush_tlb_local();
+        }
+        asid_bench_touch(va_a);
+
+        mm_switch(b);
+        if (full_flush) {
+            mmu_flush_tlb_local();
+        }
+        asid_bench_touch(va_b);
+    }
+    uint64_t elapsed = timer_read_counter() - start;
+    mm_switch(NULL);
+
+    *refills = 0;
+    if (counting) {
+        pmu_session_stop(&session);
+        *refills = pmu_session_value(&session, 0, NULL);
+    }
+    return bench_ticks_to_ns(elapsed) / switches;
+}
+
+void bench_asid(int argc, char **argv) {
+    uint32_t switches = ASID_BENCH_SWITCHES;
+    if (argc > 1) {
+        switches = (uint32_t)simple_strtoull(argv[1], NULL, 0);
+        if (switches < 2) {
+            kprintf("Usage: bench asid [switches]\n");
+            return;
+        }
+    }
+
+    mm_t *a = mm_create();
+    mm_t *b = mm_create();
+    if (!a || !b) {
+        kprintf("Bench: Unable to create address spaces\n");
+        mm_destroy(a);
+        mm_destroy(b);
+        return;
+    }
+
+    uint64_t size = ASID_BENCH_PAGES * PAGE_SIZE;
+    uint64_t va_a = mm_mmap(a, size, MMU_USER_DATA);
+    uint64_t va_b = mm_mmap(b, size, MMU_USER_DATA);
+
+    // Fault both working sets in before timing
+    mm_switch(a);
+    asid_bench_populate(va_a);
+    mm_switch(b);
+    asid_bench_populate(va_b);
+
+    uint64_t refills_asid, refills_flush;
+    uint64_t ns_asid = asid_bench_switches(a, va_a, b, va_b, switches, false, &refills_asid);
+    uint64_t ns_flush = asid_bench_switches(a, va_a, b, va_b, switches, true, &refills_flush);
+
+    kprintf("Address space switch, %u switches touching %d pages each:\n",
+            switches, ASID_BENCH_PAGES);
+    kprintf("  %-22s %10s %16s\n", "mode", "ns/switch", "l1d-tlb-refill");
+    kprintf("  %-22s %10llu %16llu\n", "ASID (TTBR0 write)", ns_asid, refills_asid);
+    kprintf("  %-22s %10llu %16llu\n", "TTBR0 + TLBI VMALLE1", ns_flush, refills_flush);
+
+    // A large sparse mapping costs nothing until it is touched
+    uint64_t free_before = pmm_get_free_memory();
+    uint64_t sparse = mm_mmap(a, ASID_BENCH_SPARSE, MMU_USER_DATA);
+    mm_switch(a);
+    uint64_t after_mmap = pmm_get_free_memory();
+    for (uint64_t off = 0; off < ASID_BENCH_SPARSE; off += ASID_BENCH_SPARSE / 4) {
+        *(volatile uint64_t *)(sparse + off) = off;
+    }
+    uint64_t after_touch = pmm_get_free_memory();
+    mm_switch(NULL);
+
+    kprintf("Sparse %llu MB mapping: %llu KB used after mmap, %llu KB after touching 4 pages\n",
+            ASID_BENCH_SPARSE >> 20, (free_before - after_mmap) / 1024,
+            (free_before - after_touch) / 1024);
+    kprintf("  (includes page tables; %llu demand faults in total)\n", a->faults);
+
+    mm_destroy(a);
+    mm_destroy(b);
+}
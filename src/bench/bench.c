@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "bench/bench.h"
+#include "arch/smp.h"
+#include "sync/atomic.h"
+#include "drivers/timer.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+
+static const bench_t benchmarks[] = {
+    { "mmu", "alloc_frame and 1 MB memset with the MMU/caches off vs on", bench_mmu },
+    { "tlb", "random 8-byte reads over 128 MB: 4 KB pages vs 2 MB blocks", bench_tlb },
+    { "asid", "address space switch: ASID-tagged TTBR0 write vs full TLB flush", bench_asid },
+    { "cow", "address space duplication: eager copy vs copy-on-write", bench_cow },
+    { "locks", "lock acquisition cost and fairness on all CPUs", bench_locks },
+    { "vmalloc", "vmalloc, lazy vfree and purge cost, then vmalloc/vfree on every CPU at once", bench_vmalloc },
+    { "alloc", "alloc_frame/kmalloc scaling at 1, 2 and 4 CPUs, with and without per-CPU caches", bench_alloc },
+    { "ctxsw", "thread context switch latency in cycles, and timer preemption", bench_ctxsw },
+    { "wake", "thread wake-up latency through wait_on_address and wait queues, same and cross CPU", bench_wake },
+    { "forkjoin", "parallel checksum of all RAM on the work-stealing executor at 1, 2 and 4 CPUs", bench_forkjoin },
+    { "shootdown", "munmap of 1000 pages cached on every CPU: per-page, batched and IPI TLB shootdown", bench_shootdown },
+    { "blk", "virtio-blk 4 KB read IOPS: sequential and random, QD1 and QD32, IRQ and polled", bench_blk },
+    { "ramfs", "page copy routines, ramfs write/read/append throughput and truncate", bench_ramfs },
+    { "console", "console throughput per character, per line and in 4 KB blocks on the bound console", bench_console },
+    { "memprof", "kmalloc and alloc_frame cost with the allocation profiler off, sampling and profiling everything", bench_memprof },
+    { NULL, NULL, NULL }
+};
+
+uint64_t bench_ticks_to_ns(uint64_t ticks) {
+    uint64_t freq = timer_get_frequency();
+    if (freq == 0) return 0;
+    // Split to avoid overflowing ticks * 1e9
+    return (ticks / freq) * 1000000000ULL + ((ticks % freq) * 1000000000ULL) / freq;
+}
+
+// --- Multi-CPU runs ---
+
+typedef struct {
+    bench_cpu_func_t body;
+    void *arg;
+    uint64_t *cpu_ticks;
+    volatile uint32_t ready;
+    volatile uint32_t go;
+    volatile uint32_t done;
+} bench_cpus_t;
+
+static void bench_cpus_body(bench_cpus_t *run) {
+    uint64_t start = timer_read_counter();
+    run->body(run->arg);
+    if (run->cpu_ticks) {
+        run->cpu_ticks[cpu_id()] = timer_read_counter() - start;
+    }
+}
+
+// Runs on the other CPUs from the IPI handler
+static void bench_cpus_worker(void *arg) {
+    bench_cpus_t *run = arg;
+    atomic_fetch_add32(&run->ready, 1);
+    while (!atomic_load_acquire32(&run->go)) {
+        cpu_relax();
+    }
+    bench_cpus_body(run);
+    atomic_fetch_add32(&run->done, 1);
+}
+
+unsigned int bench_max_cpus(unsigned int ncpus) {
+    unsigned int online = smp_num_cpus();
+    return ncpus < online ? ncpus : online;
+}
+
+uint64_t bench_on_cpus(unsigned int ncpus, bench_cpu_func_t body, void *arg,
+                       uint64_t *cpu_ticks) {
+    bench_cpus_t run = { body, arg, cpu_ticks, 0, 0, 0 };
+    if (cpu_ticks) {
+        memset(cpu_ticks, 0, MAX_CPUS * sizeof(uint64_t));
+    }
+
+    unsigned int self = cpu_id();
+    unsigned int started = 1;
+    for (unsigned int cpu = 0; cpu < MAX_CPUS && started < ncpus; cpu++) {
+        if (cpu != self && cpu_online(cpu)) {
+            smp_call_function_single(cpu, bench_cpus_worker, &run, false);
+            started++;
+        }
+    }
+    while (atomic_load_acquire32(&run.ready) != started - 1) {
+        cpu_relax();
+    }
+
+    uint64_t start = timer_read_counter();
+    atomic_store_release32(&run.go, 1);
+    bench_cpus_body(&run);
+    while (atomic_load_acquire32(&run.done) != started - 1) {
+        cpu_relax();
+    }
+    return timer_read_counter() - start;
+}
+
+uint32_t bench_cpu_spread(const uint64_t *cpu_ticks) {
+    uint64_t fastest = UINT64_MAX;
+    uint64_t slowest = 0;
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpu_ticks[cpu] == 0) {
+            continue;
+        }
+        if (cpu_ticks[cpu] < fastest) fastest = cpu_ticks[cpu];
+        if (cpu_ticks[cpu] > slowest) slowest = cpu_ticks[cpu];
+    }
+    return slowest ? (uint32_t)((slowest - fastest) * 100 / fastest) : 0;
+}
+
+static void bench_list(void) {
+    kprintf("Available benchmarks:\n");
+    for (const bench_t *b = benchmarks; b->name; b++) {
+        kprintf("  %-10s - %s\n", b->name, b->description);
+    }
+}
+
+void bench_run(int argc, char **argv) {
+    if (argc < 2) {
+        kprintf("Usage: bench <name> [args]\n");
+        bench_list();
+        return;
+    }
+
+    for (const bench_t *b = benchmarks; b->name; b++) {
+        if (strcmp(argv[1], b->name) == 0) {
+            b->run(argc - 1, argv + 1);
+            return;
+        }
+    }
+
+    kprintf("Unknown benchmark: %s\n", argv[1]);
+    bench_list();
+}
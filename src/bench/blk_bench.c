@@ -0,0 +1,164 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "drivers/virtio_blk.h"
+#include "drivers/timer.h"
+#include "memory/frame_alloc.h"
+#include "sched/wait.h"
+#include "sync/atomic.h"
+#include "lib/stdio.h"
+#include "lib/stdlib_stubs.h"
+
+#define BLK_BENCH_REQUESTS 4096
+#define BLK_BENCH_DEPTH    32
+#define BLK_BENCH_SECTORS  (PAGE_SIZE / VIRTIO_BLK_SECTOR_SIZE)
+
+typedef struct {
+    volatile uint32_t completed;
+    wait_queue_t wait;
+} blk_bench_run_t;
+
+// Too large for a thread stack
+static blk_request_t blk_bench_reqs[BLK_BENCH_DEPTH];
+static void *blk_bench_bufs[BLK_BENCH_DEPTH];
+
+static void blk_bench_done(blk_request_t *req) {
+    blk_bench_run_t *run = req->private;
+    atomic_fetch_add32(&run->completed, 1);
+    wake_up(&run->wait);
+}
+
+// Keep depth 4 KB reads in flight until total have completed; every
+// refill goes to the device as one batch
+static void blk_bench_run(const char *label, uint32_t total, unsigned int depth, bool random,
+                          virtio_blk_mode_t mode) {
+    blk_bench_run_t run;
+    run.completed = 0;
+    wait_queue_init(&run.wait);
+
+    for (unsigned int i = 0; i < depth; i++) {
+        blk_request_t *req = &blk_bench_reqs[i];
+        req->op = BLK_OP_READ;
+        req->nr_segs = 1;
+        req->segs[0].buf = blk_bench_bufs[i];
+        req->segs[0].len = PAGE_SIZE;
+        req->status = 0;
+        req->done = blk_bench_done;
+        req->private = &run;
+    }
+
+    uint64_t blocks = virtio_blk_capacity() / BLK_BENCH_SECTORS;
+    uint64_t next = 0;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    uint32_t issued = 0;
+    uint32_t errors = 0;
+
+    virtio_blk_set_mode(mode);
+    virtio_blk_stats_t before, after;
+    virtio_blk_get_stats(&before);
+    uint64_t start = timer_read_counter();
+
+    while (atomic_load_acquire32(&run.completed) < total) {
+        uint32_t seen = atomic_load_acquire32(&run.completed);
+
+        blk_request_t *batch[BLK_BENCH_DEPTH];
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < depth && issued + count < total; i++) {
+            blk_request_t *req = &blk_bench_reqs[i];
+            if (req->status == BLK_STATUS_PENDING) {
+                continue;
+            }
+            if (req->status != 0) {
+                errors++;
+            }
+            if (random) {
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                req->sector = (seed % blocks) * BLK_BENCH_SECTORS;
+            } else {
+                req->sector = next * BLK_BENCH_SECTORS;
+                next = (next + 1) % blocks;
+            }
+            batch[count++] = req;
+        }
+        if (count) {
+            issued += virtio_blk_submit(batch, count);
+        }
+
+        if (mode == VIRTIO_BLK_POLL) {
+            while (atomic_load_acquire32(&run.completed) == seen) {
+                virtio_blk_poll();
+            }
+        } else {
+            wait_event(&run.wait, atomic_load_acquire32(&run.completed) != seen);
+        }
+    }
+
+    uint64_t us = timer_counter_to_us(timer_read_counter() - start);
+    virtio_blk_get_stats(&after);
+    for (unsigned int i = 0; i < depth; i++) {
+        if (blk_bench_reqs[i].status != 0) {
+            errors++;
+        }
+    }
+    if (us == 0) {
+        us = 1;
+    }
+
+    uint64_t iops = (uint64_t)total * 1000000 / us;
+    kprintf("  %-24s %8llu %8llu %10llu %10llu", label, iops, iops * PAGE_SIZE >> 20,
+            after.notifies - before.notifies, after.interrupts - before.interrupts);
+    if (errors) {
+        kprintf(" (%u errors)", errors);
+    }
+    kprintf("\n");
+}
+
+void bench_blk(int argc, char **argv) {
+    if (!virtio_blk_present()) {
+        kprintf("No virtio-blk disk (make qemu DISK=disk.img)\n");
+        return;
+    }
+    uint32_t total = BLK_BENCH_REQUESTS;
+    if (argc > 1) {
+        total = (uint32_t)simple_strtoull(argv[1], NULL, 0);
+        if (total == 0) {
+            kprintf("Usage: bench blk [requests]\n");
+            return;
+        }
+    }
+    if (virtio_blk_capacity() < BLK_BENCH_SECTORS) {
+        kprintf("Disk too small\n");
+        return;
+    }
+
+    for (unsigned int i = 0; i < BLK_BENCH_DEPTH; i++) {
+        blk_bench_bufs[i] = alloc_frame();
+        if (!blk_bench_bufs[i]) {
+            kprintf("Bench: Out of memory\n");
+            for (unsigned int j = 0; j < i; j++) {
+                free_frame(blk_bench_bufs[j]);
+            }
+            return;
+        }
+    }
+
+    kprintf("%u 4 KB reads from a %llu MB disk:\n", total,
+            virtio_blk_capacity() * VIRTIO_BLK_SECTOR_SIZE >> 20);
+    kprintf("  %-24s %8s %8s %10s %10s\n", "", "IOPS", "MB/s", "notifies", "interrupts");
+    blk_bench_run("sequential, QD1, IRQ", total, 1, false, VIRTIO_BLK_IRQ);
+    blk_bench_run("sequential, QD1, poll", total, 1, false, VIRTIO_BLK_POLL);
+    blk_bench_run("sequential, QD32, IRQ", total, BLK_BENCH_DEPTH, false, VIRTIO_BLK_IRQ);
+    blk_bench_run("sequential, QD32, poll", total, BLK_BENCH_DEPTH, false, VIRTIO_BLK_POLL);
+    blk_bench_run("random, QD1, IRQ", total, 1, true, VIRTIO_BLK_IRQ);
+    blk_bench_run("random, QD1, poll", total, 1, true, VIRTIO_BLK_POLL);
+    blk_bench_run("random, QD32, IRQ", total, BLK_BENCH_DEPTH, true, VIRTIO_BLK_IRQ);
+    blk_bench_run("random, QD32, poll", total, BLK_BENCH_DEPTH, true, VIRTIO_BLK_POLL);
+    virtio_blk_set_mode(VIRTIO_BLK_IRQ);
+
+    for (unsigned int i = 0; i < BLK_BENCH_DEPTH; i++) {
+        free_frame(blk_bench_bufs[i]);
+    }
+}
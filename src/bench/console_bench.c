@@ -0,0 +1,99 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "ui/fbcon.h"
+#include "ui/tui.h"
+#include "drivers/timer.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+#include "lib/stdlib_stubs.h"
+
+#define CONSOLE_BENCH_LINES 100
+#define CONSOLE_BENCH_WIDTH 72      // Characters per line before the '\n'
+#define CONSOLE_BENCH_BLOCK 56      // Lines per bulk write, about 4 KB
+
+#define CONSOLE_BENCH_LINE_BYTES (CONSOLE_BENCH_WIDTH + 1)
+
+typedef enum {
+    CONSOLE_BENCH_PER_CHAR,     // What tui_write used to do
+    CONSOLE_BENCH_PER_LINE,
+    CONSOLE_BENCH_BULK,         // A log dump
+} console_bench_mode_t;
+
+static char console_bench_text[CONSOLE_BENCH_BLOCK * CONSOLE_BENCH_LINE_BYTES];
+
+typedef struct {
+    uint64_t ticks;
+    fbcon_stats_t fb;
+} console_bench_result_t;
+
+static void console_bench_run(uint64_t lines, console_bench_mode_t mode,
+                              console_bench_result_t *res) {
+    fbcon_stats_t before;
+    fbcon_get_stats(&before);
+    uint64_t start = timer_read_counter();
+    uint64_t i = 0;
+    while (i < lines) {
+        uint64_t n = 1;
+        if (mode == CONSOLE_BENCH_PER_CHAR) {
+            for (size_t j = 0; j < CONSOLE_BENCH_LINE_BYTES; j++) {
+                kprintf("%c", console_bench_text[j]);
+            }
+        } else if (mode == CONSOLE_BENCH_PER_LINE) {
+            tui_write(console_bench_text, CONSOLE_BENCH_LINE_BYTES);
+        } else {
+            n = lines - i < CONSOLE_BENCH_BLOCK ? lines - i : CONSOLE_BENCH_BLOCK;
+            kwrite(console_bench_text, n * CONSOLE_BENCH_LINE_BYTES);
+        }
+        i += n;
+    }
+    res->ticks = timer_read_counter() - start;
+    fbcon_get_stats(&res->fb);
+    res->fb.flushes -= before.flushes;
+    res->fb.cells_drawn -= before.cells_drawn;
+    res->fb.scroll_moves -= before.scroll_moves;
+}
+
+static void console_bench_report(const char *label, uint64_t lines, const console_bench_result_t *res) {
+    uint64_t ns = bench_ticks_to_ns(res->ticks);
+    if (ns == 0) {
+        ns = 1;
+    }
+    uint64_t kb_per_s = lines * CONSOLE_BENCH_LINE_BYTES * 1000000000ULL / 1024 / ns;
+    kprintf("  %-18s %8llu us %8llu KB/s", label, ns / 1000, kb_per_s);
+    if (fbcon_active()) {
+        kprintf(" %7llu flushes %8llu cells %5llu moves",
+                res->fb.flushes, res->fb.cells_drawn, res->fb.scroll_moves);
+    }
+    kprintf("\n");
+}
+
+void bench_console(int argc, char **argv) {
+    uint64_t lines = CONSOLE_BENCH_LINES;
+    if (argc > 1) {
+        lines = simple_strtoull(argv[1], NULL, 0);
+        if (lines == 0) {
+            kprintf("Usage: bench console [lines]\n");
+            return;
+        }
+    }
+    for (unsigned int l = 0; l < CONSOLE_BENCH_BLOCK; l++) {
+        char *line = console_bench_text + l * CONSOLE_BENCH_LINE_BYTES;
+        for (unsigned int i = 0; i < CONSOLE_BENCH_WIDTH; i++) {
+            line[i] = (char)('!' + (i + l) % ('~' - '!' + 1));
+        }
+        line[CONSOLE_BENCH_WIDTH] = '\n';
+    }
+
+    console_bench_result_t per_char, per_line, bulk;
+    console_bench_run(lines, CONSOLE_BENCH_PER_CHAR, &per_char);
+    console_bench_run(lines, CONSOLE_BENCH_PER_LINE, &per_line);
+    console_bench_run(lines, CONSOLE_BENCH_BULK, &bulk);
+
+    kprintf("%llu lines of %u characters on the %s console%s:\n", lines, CONSOLE_BENCH_WIDTH,
+            console_name(), fbcon_active() ? " and the framebuffer" : "");
+    console_bench_report("kprintf per char", lines, &per_char);
+    console_bench_report("tui_write per line", lines, &per_line);
+    console_bench_report("kwrite 4 KB blocks", lines, &bulk);
+}
@@ -0,0 +1,117 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "memory/mm.h"
+#include "memory/mmu.h"
+#include "memory/frame_alloc.h"
+#include "drivers/timer.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+#include "lib/stdlib_stubs.h"
+
+#define COW_BENCH_PAGES      1024    // 4 MB parent working set
+#define COW_BENCH_ZERO_SIZE  (64ULL * 1024 * 1024)
+
+// Duplicate an address space by copying every page up front, as a
+// baseline for mm_clone()
+static mm_t *cow_bench_eager_clone(mm_t *parent, uint64_t va, uint64_t pages) {
+    mm_t *child = mm_create();
+    if (!child) {
+        return NULL;
+    }
+    uint64_t child_va = mm_mmap(child, pages * PAGE_SIZE, MMU_USER_DATA);
+    for (uint64_t i = 0; i < pages; i++) {
+        uint64_t src;
+        void *frame = alloc_frame();
+        if (!frame || !mmu_translate(parent->pgd, va + i * PAGE_SIZE, &src)) {
+            free_frame(frame);
+            break;
+        }
+        memcpy(frame, (void *)src, PAGE_SIZE);
+        mmu_map_pages(child->pgd, child_va + i * PAGE_SIZE, (uint64_t)frame, PAGE_SIZE, MMU_USER_DATA);
+        child->rss_pages++;
+    }
+    return child;
+}
+
+static void cow_bench_write_pages(uint64_t va, uint64_t pages, uint64_t stride) {
+    for (uint64_t i = 0; i < pages; i += stride) {
+        *(volatile uint64_t *)(va + i * PAGE_SIZE) = i;
+    }
+}
+
+void bench_cow(int argc, char **argv) {
+    uint64_t pages = COW_BENCH_PAGES;
+    if (argc > 1) {
+        pages = simple_strtoull(argv[1], NULL, 0);
+        if (pages == 0) {
+            kprintf("Usage: bench cow [pages]\n");
+            return;
+        }
+    }
+
+    mm_t *parent = mm_create();
+    if (!parent) {
+        kprintf("Bench: Unable to create address space\n");
+        return;
+    }
+    uint64_t va = mm_mmap(parent, pages * PAGE_SIZE, MMU_USER_DATA);
+    mm_switch(parent);
+    cow_bench_write_pages(va, pages, 1);
+    mm_switch(NULL);
+
+    // Eager duplication
+    uint64_t free_before = pmm_get_free_memory();
+    uint64_t start = timer_read_counter();
+    mm_t *eager = cow_bench_eager_clone(parent, va, pages);
+    uint64_t eager_ns = bench_ticks_to_ns(timer_read_counter() - start);
+    uint64_t eager_kb = (free_before - pmm_get_free_memory()) / 1024;
+    mm_destroy(eager);
+
+    // Copy-on-write duplication
+    free_before = pmm_get_free_memory();
+    start = timer_read_counter();
+    mm_t *child = mm_clone(parent);
+    uint64_t clone_ns = bench_ticks_to_ns(timer_read_counter() - start);
+    uint64_t clone_kb = (free_before - pmm_get_free_memory()) / 1024;
+    if (!child) {
+        kprintf("Bench: mm_clone failed\n");
+        mm_destroy(parent);
+        return;
+    }
+
+    // The child writes to one page in eight: only those are copied
+    mm_switch(child);
+    start = timer_read_counter();
+    cow_bench_write_pages(va, pages, 8);
+    uint64_t write_ns = bench_ticks_to_ns(timer_read_counter() - start);
+    mm_switch(NULL);
+    uint64_t after_write_kb = (free_before - pmm_get_free_memory()) / 1024;
+
+    kprintf("Duplicating a %llu KB address space:\n", pages * PAGE_SIZE / 1024);
+    kprintf("  %-24s %10s %10s\n", "", "time (us)", "memory KB");
+    kprintf("  %-24s %10llu %10llu\n", "eager copy", eager_ns / 1000, eager_kb);
+    kprintf("  %-24s %10llu %10llu\n", "copy-on-write clone", clone_ns / 1000, clone_kb);
+    kprintf("  %-24s %10llu %10llu\n", "  + child writes 1/8", (clone_ns + write_ns) / 1000, after_write_kb);
+    if (child->cow_copies) {
+        kprintf("  COW faults: %llu copies, %llu ns each\n",
+                child->cow_copies, write_ns / child->cow_copies);
+    }
+
+    mm_destroy(child);
+
+    // Reading untouched anonymous memory maps the shared zero page
+    free_before = pmm_get_free_memory();
+    uint64_t zero_va = mm_mmap(parent, COW_BENCH_ZERO_SIZE, MMU_USER_DATA);
+    uint64_t sum = 0;
+    mm_switch(parent);
+    for (uint64_t off = 0; off < COW_BENCH_ZERO_SIZE; off += PAGE_SIZE) {
+        sum += *(volatile uint64_t *)(zero_va + off);
+    }
+    mm_switch(NULL);
+    kprintf("Reading %llu MB of untouched memory: %llu KB used (page tables only), sum %llu\n",
+            COW_BENCH_ZERO_SIZE >> 20, (free_before - pmm_get_free_memory()) / 1024, sum);
+
+    mm_destroy(parent);
+}
@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "sched/thread.h"
+#include "arch/cpu.h"
+#include "sync/atomic.h"
+#include "drivers/pmu.h"
+#include "drivers/timer.h"
+#include "lib/stdio.h"
+#include "lib/stdlib_stubs.h"
+
+#define CTXSW_BENCH_YIELDS  10000
+#define CTXSW_BENCH_SPIN_MS 200
+
+typedef struct {
+    uint32_t yields;
+    volatile uint32_t running;      // Threads not yet finished
+    volatile uint64_t switches;     // Switches into the spinning threads
+    volatile uint64_t start_cycles;
+    volatile uint64_t start_ticks;
+    uint64_t end_cycles;
+    uint64_t end_ticks;
+} ctxsw_run_t;
+
+static uint64_t ctxsw_cycles(void) {
+    return pmu_available() ? pmu_read_cycles() : 0;
+}
+
+// Yield in a loop; the first thread in starts the clock, the last one out
+// stops it
+static void ctxsw_yield_thread(void *arg) {
+    ctxsw_run_t *run = arg;
+    if (run->start_ticks == 0) {
+        run->start_cycles = ctxsw_cycles();
+        run->start_ticks = timer_read_counter();
+    }
+    for (uint32_t i = 0; i < run->yields; i++) {
+        thread_yield();
+    }
+    if (atomic_fetch_add32(&run->running, -1U) == 1) {
+        run->end_cycles = ctxsw_cycles();
+        run->end_ticks = timer_read_counter();
+    }
+}
+
+// Burn CPU without yielding, so only the timer can switch away
+static void ctxsw_spin_thread(void *arg) {
+    ctxsw_run_t *run = arg;
+    uint64_t end = timer_read_counter() + timer_us_to_counter(CTXSW_BENCH_SPIN_MS * 1000);
+    while (timer_read_counter() < end) {
+    }
+    atomic_fetch_add64(&run->switches, thread_current()->switches);
+    atomic_fetch_add32(&run->running, -1U);
+}
+
+// Start nthreads copies of func on this CPU and sleep until they finish
+static bool ctxsw_run(ctxsw_run_t *run, thread_func_t func, int nthreads) {
+    run->running = nthreads;
+    run->switches = 0;
+    run->start_cycles = 0;
+    run->start_ticks = 0;
+    for (int i = 0; i < nthreads; i++) {
+        if (!thread_create("ctxsw", func, run, cpu_id())) {
+            // Let the ones already started finish before run goes away
+            atomic_fetch_add32(&run->running, -(uint32_t)(nthreads - i));
+            while (atomic_load_acquire32(&run->running) != 0) {
+                thread_sleep_ms(10);
+            }
+            kprintf("Failed to create benchmark thread\n");
+            return false;
+        }
+    }
+    while (atomic_load_acquire32(&run->running) != 0) {
+        thread_sleep_ms(10);
+    }
+    return true;
+}
+
+void bench_ctxsw(int argc, char **argv) {
+    ctxsw_run_t run;
+    run.yields = CTXSW_BENCH_YIELDS;
+    if (argc > 1) {
+        run.yields = (uint32_t)simple_strtoull(argv[1], NULL, 0);
+        if (run.yields == 0) {
+            kprintf("Usage: bench ctxsw [yields]\n");
+            return;
+        }
+    }
+
+    kprintf("Context switch benchmark on CPU%u (%u yields per thread)\n", cpu_id(), run.yields);
+    if (!pmu_available()) {
+        kprintf("(no PMU: cycle counts unavailable)\n");
+    }
+
+    // One thread alone: thread_yield() finds nothing else ready, which is
+    // the scheduler's fixed overhead without a switch
+    if (!ctxsw_run(&run, ctxsw_yield_thread, 1)) {
+        return;
+    }
+    uint64_t ops = run.yields;
+    kprintf("  %-22s %8llu cycles %8llu ns\n", "yield, nothing ready",
+            (run.end_cycles - run.start_cycles) / ops,
+            bench_ticks_to_ns(run.end_ticks - run.start_ticks) / ops);
+
+    // Two threads ping-pong: every yield is a full switch
+    if (!ctxsw_run(&run, ctxsw_yield_thread, 2)) {
+        return;
+    }
+    ops = 2ULL * run.yields;
+    kprintf("  %-22s %8llu cycles %8llu ns\n", "yield to other thread",
+            (run.end_cycles - run.start_cycles) / ops,
+            bench_ticks_to_ns(run.end_ticks - run.start_ticks) / ops);
+
+    // Two threads that never yield share the CPU only through preemption
+    if (!ctxsw_run(&run, ctxsw_spin_thread, 2)) {
+        return;
+    }
+    kprintf("  %-22s %8llu switches in %u ms (%u ms slices)\n", "preempted spinners",
+            run.switches, 2 * CTXSW_BENCH_SPIN_MS, SCHED_SLICE_TICKS * 1000 / TIMER_HZ);
+}
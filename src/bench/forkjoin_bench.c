@@ -0,0 +1,124 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "bench/bench.h"
+#include "sched/executor.h"
+#include "arch/smp.h"
+#include "memory/frame_alloc.h"
+#include "drivers/timer.h"
+#include "lib/stdio.h"
+#include "lib/stdlib_stubs.h"
+
+// Ranges at most this long are summed directly instead of split
+#define FORKJOIN_GRAIN (256 * 1024)
+
+typedef struct {
+    const uint64_t *start;
+    size_t words;
+    uint64_t sum;
+} forkjoin_range_t;
+
+// Wrapping sum of 64-bit words; addition commutes, so any split of the
+// range gives the same result
+static uint64_t forkjoin_checksum(const uint64_t *p, size_t words) {
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+        s0 += p[i];
+        s1 += p[i + 1];
+        s2 += p[i + 2];
+        s3 += p[i + 3];
+    }
+    for (; i < words; i++) {
+        s0 += p[i];
+    }
+    return s0 + s1 + s2 + s3;
+}
+
+// Spawn the upper half, sum the lower half here, then join
+static void forkjoin_sum(void *arg) {
+    forkjoin_range_t *range = arg;
+    if (range->words * sizeof(uint64_t) <= FORKJOIN_GRAIN) {
+        range->sum = forkjoin_checksum(range->start, range->words);
+        return;
+    }
+
+    size_t half = range->words / 2;
+    forkjoin_range_t lower = { range->start, half, 0 };
+    forkjoin_range_t upper = { range->start + half, range->words - half, 0 };
+    task_group_t group = TASK_GROUP_INIT;
+    task_t task;
+
+    task_spawn(&group, &task, forkjoin_sum, &upper);
+    forkjoin_sum(&lower);
+    task_group_wait(&group);
+    range->sum = lower.sum + upper.sum;
+}
+
+static uint64_t forkjoin_stolen(void) {
+    uint64_t stolen = 0;
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        executor_stats_t stats;
+        executor_get_stats(cpu, &stats);
+        stolen += stats.stolen;
+    }
+    return stolen;
+}
+
+static uint64_t forkjoin_mb_per_s(uint64_t bytes, uint64_t ticks) {
+    uint64_t us = bench_ticks_to_ns(ticks) / 1000;
+    return us ? bytes / us : 0;    // Bytes per us is MB/s
+}
+
+void bench_forkjoin(int argc, char **argv) {
+    uint64_t base = PMM_RAM_BASE;
+    uint64_t size = pmm_get_highest_usable_address() - base;
+    if (argc > 1) {
+        uint64_t mb = simple_strtoull(argv[1], NULL, 0);
+        if (mb == 0) {
+            kprintf("Usage: bench forkjoin [MB]\n");
+            return;
+        }
+        if (mb * 1024 * 1024 < size) {
+            size = mb * 1024 * 1024;
+        }
+    }
+
+    unsigned int all_cpus = executor_cpus();
+    kprintf("Fork-join checksum of 0x%llx - 0x%llx (%llu MB), %u KB leaves\n",
+            base, base + size, size >> 20, FORKJOIN_GRAIN / 1024);
+
+    // Sequential baseline on this thread, no tasks involved
+    uint64_t start = timer_read_counter();
+    uint64_t expected = forkjoin_checksum((const uint64_t *)base, size / sizeof(uint64_t));
+    uint64_t seq_ticks = timer_read_counter() - start;
+    kprintf("  %-10s %8llu us %6llu MB/s                 sum %016llx\n", "sequential",
+            bench_ticks_to_ns(seq_ticks) / 1000, forkjoin_mb_per_s(size, seq_ticks), expected);
+
+    uint64_t one_cpu_ticks = 0;
+    // 1, 2, 4, ... CPUs, ending with all of them
+    for (unsigned int ncpus = 1; ; ncpus = ncpus * 2 < all_cpus ? ncpus * 2 : all_cpus) {
+        executor_set_cpus(ncpus);
+        uint64_t stolen = forkjoin_stolen();
+
+        forkjoin_range_t range = { (const uint64_t *)base, size / sizeof(uint64_t), 0 };
+        start = timer_read_counter();
+        forkjoin_sum(&range);
+        uint64_t ticks = timer_read_counter() - start;
+        stolen = forkjoin_stolen() - stolen;
+
+        if (ncpus == 1) {
+            one_cpu_ticks = ticks;
+        }
+        uint64_t speedup_x100 = ticks ? one_cpu_ticks * 100 / ticks : 0;
+        kprintf("  %u CPU%-6s %8llu us %6llu MB/s %3llu.%02llux %5llu steals sum %016llx\n",
+                ncpus, ncpus == 1 ? "" : "s", bench_ticks_to_ns(ticks) / 1000,
+                forkjoin_mb_per_s(size, ticks), speedup_x100 / 100, speedup_x100 % 100,
+                stolen, range.sum);
+        if (ncpus == all_cpus) {
+            break;
+        }
+    }
+    executor_set_cpus(all_cpus);
+    // Live kernel data (stacks, counters) is part of RAM too
+    kprintf("  (sums differ slightly where memory changed between passes)\n");
+}
@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "arch/smp.h"
+#include "sync/atomic.h"
+#include "sync/spinlock.h"
+#include "lib/stdio.h"
+#include "lib/stdlib_stubs.h"
+
+#define LOCK_BENCH_ITERS 20000
+
+typedef enum {
+    LOCK_BENCH_ATOMIC,      // Lock-free atomic add, the floor for any lock
+    LOCK_BENCH_TAS,         // Test-and-test-and-set on one word
+    LOCK_BENCH_TICKET,
+    LOCK_BENCH_MCS,
+} lock_bench_mode_t;
+
+static const char *const lock_bench_names[] = { "atomic add", "test-and-set", "ticket", "mcs" };
+
+// State shared by all CPUs, each on its own cache line so the only lines
+// the CPUs fight over are the lock itself and the counter
+static volatile uint32_t lb_tas __attribute__((aligned(64)));
+static spinlock_t lb_ticket __attribute__((aligned(64)));
+static mcs_lock_t lb_mcs __attribute__((aligned(64)));
+static volatile uint64_t lb_counter __attribute__((aligned(64)));
+static lock_bench_mode_t lb_mode;
+static uint32_t lb_iters;
+
+static void lock_bench_body(void *arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < lb_iters; i++) {
+        switch (lb_mode) {
+        case LOCK_BENCH_ATOMIC:
+            atomic_fetch_add64(&lb_counter, 1);
+            break;
+        case LOCK_BENCH_TAS:
+            while (atomic_xchg32(&lb_tas, 1)) {
+                while (lb_tas) {
+                    cpu_relax();
+                }
+            }
+            lb_counter++;
+            atomic_store_release32(&lb_tas, 0);
+            break;
+        case LOCK_BENCH_TICKET:
+            spin_lock(&lb_ticket);
+            lb_counter++;
+            spin_unlock(&lb_ticket);
+            break;
+        case LOCK_BENCH_MCS: {
+            mcs_node_t node;
+            mcs_lock(&lb_mcs, &node);
+            lb_counter++;
+            mcs_unlock(&lb_mcs, &node);
+            break;
+        }
+        }
+    }
+}
+
+// Run one lock type on ncpus CPUs. Returns the mean cost of one
+// acquisition in ns and in *spread how much longer the slowest CPU took
+// than the fastest, which shows how fair the lock is.
+static uint64_t lock_bench_run(lock_bench_mode_t mode, unsigned int ncpus, uint32_t iters,
+                               uint32_t *spread, bool *ok) {
+    uint64_t cpu_ticks[MAX_CPUS];
+    lb_mode = mode;
+    lb_iters = iters;
+    lb_tas = 0;
+    spin_lock_init(&lb_ticket);
+    lb_mcs.tail = NULL;
+    lb_counter = 0;
+
+    uint64_t elapsed = bench_on_cpus(ncpus, lock_bench_body, NULL, cpu_ticks);
+    *spread = bench_cpu_spread(cpu_ticks);
+    *ok = lb_counter == (uint64_t)iters * ncpus;
+    return bench_ticks_to_ns(elapsed) / ((uint64_t)iters * ncpus);
+}
+
+static void lock_bench_table(unsigned int ncpus, uint32_t iters) {
+    kprintf("  %-14s %10s %12s %8s\n", "lock", "1 CPU", "contended", "spread");
+    for (int mode = LOCK_BENCH_ATOMIC; mode <= LOCK_BENCH_MCS; mode++) {
+        uint32_t spread;
+        bool ok_single, ok_all;
+        uint64_t single = lock_bench_run(mode, 1, iters, &spread, &ok_single);
+        uint64_t all = lock_bench_run(mode, ncpus, iters, &spread, &ok_all);
+        kprintf("  %-14s %7llu ns %9llu ns %7u%%%s\n", lock_bench_names[mode], single, all,
+                spread, ok_single && ok_all ? "" : "  COUNT MISMATCH");
+    }
+}
+
+void bench_locks(int argc, char **argv) {
+    uint32_t iters = LOCK_BENCH_ITERS;
+    if (argc > 1) {
+        iters = (uint32_t)simple_strtoull(argv[1], NULL, 0);
+        if (iters == 0) {
+            kprintf("Usage: bench locks [iterations]\n");
+            return;
+        }
+    }
+
+    unsigned int ncpus = smp_num_cpus();
+    kprintf("Lock benchmark: %u acquisitions per CPU, %u CPU(s) contending\n", iters, ncpus);
+    kprintf("(ns per acquisition over all CPUs; spread = slowest CPU vs fastest)\n");
+
+    // Run the LL/SC build first; on LSE hardware repeat with LSE atomics
+    bool has_lse = cpu_has_lse;
+    cpu_has_lse = false;
+    kprintf("LDXR/STXR atomics:\n");
+    lock_bench_table(ncpus, iters);
+    if (has_lse) {
+        cpu_has_lse = true;
+        kprintf("LSE atomics:\n");
+        lock_bench_table(ncpus, iters);
+    } else {
+        kprintf("LSE atomics: not implemented by this CPU (try make qemu CPU=max)\n");
+    }
+    cpu_has_lse = has_lse;
+}
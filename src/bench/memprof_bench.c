@@ -0,0 +1,127 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "debug/memprof.h"
+#include "drivers/timer.h"
+#include "memory/frame_alloc.h"
+#include "memory/kheap.h"
+#include "lib/stdio.h"
+#include "lib/stdlib_stubs.h"
+
+#define MEMPROF_BENCH_ITERS     20000
+#define MEMPROF_BENCH_BURST     8           // Allocations held at once
+#define MEMPROF_BENCH_FRAMES    2000
+#define MEMPROF_BENCH_SAMPLE    (512 * 1024)
+#define MEMPROF_BENCH_MAX_HELD  2048        // Frames held to keep a sample live
+
+// kmalloc sizes cycled through, so that several classes are exercised
+static const size_t mpb_sizes[] = { 16, 24, 64, 100, 256, 512 };
+#define MEMPROF_BENCH_NR_SIZES  (sizeof(mpb_sizes) / sizeof(mpb_sizes[0]))
+
+// Nanoseconds per kmalloc/kfree pair
+static uint64_t memprof_bench_kmalloc(void) {
+    void *objects[MEMPROF_BENCH_BURST];
+    unsigned int next = 0;
+    uint64_t start = timer_read_counter();
+    for (uint32_t i = 0; i < MEMPROF_BENCH_ITERS; i += MEMPROF_BENCH_BURST) {
+        for (int j = 0; j < MEMPROF_BENCH_BURST; j++) {
+            objects[j] = kmalloc(mpb_sizes[next]);
+            next = (next + 1) % MEMPROF_BENCH_NR_SIZES;
+        }
+        for (int j = 0; j < MEMPROF_BENCH_BURST; j++) {
+            kfree(objects[j]);
+        }
+    }
+    return bench_ticks_to_ns(timer_read_counter() - start) / MEMPROF_BENCH_ITERS;
+}
+
+// Nanoseconds per alloc_frame/free_frame pair
+static uint64_t memprof_bench_frames(void) {
+    void *frames[MEMPROF_BENCH_BURST];
+    uint64_t start = timer_read_counter();
+    for (uint32_t i = 0; i < MEMPROF_BENCH_FRAMES; i += MEMPROF_BENCH_BURST) {
+        for (int j = 0; j < MEMPROF_BENCH_BURST; j++) {
+            frames[j] = alloc_frame();
+        }
+        for (int j = 0; j < MEMPROF_BENCH_BURST; j++) {
+            free_frame(frames[j]);
+        }
+    }
+    return bench_ticks_to_ns(timer_read_counter() - start) / MEMPROF_BENCH_FRAMES;
+}
+
+static void memprof_bench_row(const char *label, uint64_t kmalloc_ns, uint64_t frame_ns,
+                              uint64_t base_kmalloc_ns, uint64_t base_frame_ns) {
+    kprintf("  %-26s %8llu ns %8llu ns", label, kmalloc_ns, frame_ns);
+    if (base_kmalloc_ns && base_frame_ns) {
+        // Overhead in tenths of a percent; negative differences are noise
+        uint64_t km = kmalloc_ns > base_kmalloc_ns ?
+                      (kmalloc_ns - base_kmalloc_ns) * 1000 / base_kmalloc_ns : 0;
+        uint64_t fr = frame_ns > base_frame_ns ?
+                      (frame_ns - base_frame_ns) * 1000 / base_frame_ns : 0;
+        kprintf("   +%llu.%llu%% / +%llu.%llu%%", km / 10, km % 10, fr / 10, fr % 10);
+    }
+    kprintf("\n");
+}
+
+void bench_memprof(int argc, char **argv) {
+    uint64_t sample_bytes = MEMPROF_BENCH_SAMPLE;
+    if (argc > 1) {
+        sample_bytes = simple_strtoull(argv[1], NULL, 0);
+        if (sample_bytes == 0) {
+            kprintf("Usage: bench memprof [sample_bytes]\n");
+            return;
+        }
+    }
+    if (memprof_is_running()) {
+        kprintf("Bench: memprof is running, stop it first with 'memprof stop'\n");
+        return;
+    }
+
+    kprintf("Allocation profiler overhead (kmalloc/kfree, alloc_frame/free_frame pairs):\n");
+    kprintf("  %-26s %11s %11s   %s\n", "", "kmalloc", "frame", "overhead");
+
+    // Warm the per-CPU caches first
+    memprof_bench_kmalloc();
+    uint64_t base_km = memprof_bench_kmalloc();
+    uint64_t base_fr = memprof_bench_frames();
+    memprof_bench_row("off", base_km, base_fr, 0, 0);
+
+    memprof_start(sample_bytes, false);
+    uint64_t km = memprof_bench_kmalloc();
+    uint64_t fr = memprof_bench_frames();
+    memprof_stop();
+    memprof_bench_row("sampling", km, fr, base_km, base_fr);
+
+    // Again with a profiled allocation live, as there usually is one: one
+    // run of 2 * sample_bytes is always sampled, and every free then has
+    // to get past the presence filter rather than an empty table
+    size_t held_frames = (size_t)(2 * sample_bytes / PAGE_SIZE + 1);
+    if (held_frames <= MEMPROF_BENCH_MAX_HELD) {
+        memprof_start(sample_bytes, false);
+        void *held = alloc_frames(held_frames);
+        km = memprof_bench_kmalloc();
+        fr = memprof_bench_frames();
+        free_frames(held, held_frames);
+        memprof_stop();
+        if (held) {
+            memprof_bench_row("sampling, one live", km, fr, base_km, base_fr);
+        }
+    }
+
+    memprof_start(0, false);
+    km = memprof_bench_kmalloc();
+    fr = memprof_bench_frames();
+    memprof_stop();
+    memprof_bench_row("every allocation", km, fr, base_km, base_fr);
+
+    memprof_start(0, true);
+    km = memprof_bench_kmalloc();
+    fr = memprof_bench_frames();
+    memprof_stop();
+    memprof_bench_row("every allocation, -g", km, fr, base_km, base_fr);
+
+    kprintf("  (sampling every %llu bytes; 'memprof top' now shows the last run)\n",
+            sample_bytes);
+}
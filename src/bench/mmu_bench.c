@@ -0,0 +1,103 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "memory/frame_alloc.h"
+#include "memory/mmu.h"
+#include "drivers/timer.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+
+#define MMU_BENCH_MEMSET_SIZE   (1024 * 1024)
+#define MMU_BENCH_MEMSET_ROUNDS 4
+#define MMU_BENCH_FRAMES        256
+
+typedef struct {
+    bool valid;
+    uint64_t memset_ns;       // Average time for one 1 MB memset
+    uint64_t alloc_frame_ns;  // Average time for one alloc_frame()
+} mmu_bench_result_t;
+
+// Timings taken at boot before the MMU was turned on
+static mmu_bench_result_t baseline;
+
+static uint64_t bench_memset_ns(void) {
+    uint8_t *buf = alloc_frames(MMU_BENCH_MEMSET_SIZE / PAGE_SIZE);
+    if (!buf) {
+        kprintf("Bench: Unable to allocate 1 MB buffer\n");
+        return 0;
+    }
+
+    uint64_t start = timer_read_counter();
+    for (int i = 0; i < MMU_BENCH_MEMSET_ROUNDS; i++) {
+        memset(buf, i, MMU_BENCH_MEMSET_SIZE);
+    }
+    uint64_t elapsed = timer_read_counter() - start;
+
+    free_frames(buf, MMU_BENCH_MEMSET_SIZE / PAGE_SIZE);
+    return bench_ticks_to_ns(elapsed) / MMU_BENCH_MEMSET_ROUNDS;
+}
+
+static uint64_t bench_alloc_frame_ns(void) {
+    static void *frames[MMU_BENCH_FRAMES];
+    int count = 0;
+
+    uint64_t start = timer_read_counter();
+    for (; count < MMU_BENCH_FRAMES; count++) {
+        frames[count] = alloc_frame();
+        if (!frames[count]) break;
+    }
+    uint64_t elapsed = timer_read_counter() - start;
+
+    for (int i = 0; i < count; i++) {
+        free_frame(frames[i]);
+    }
+    return count ? bench_ticks_to_ns(elapsed) / count : 0;
+}
+
+static void bench_mmu_measure(mmu_bench_result_t *result) {
+    result->memset_ns = bench_memset_ns();
+    result->alloc_frame_ns = bench_alloc_frame_ns();
+    result->valid = true;
+}
+
+void bench_mmu_baseline(void) {
+    if (mmu_is_enabled()) {
+        return;
+    }
+    bench_mmu_measure(&baseline);
+    kprintf("Bench: MMU-off baseline: memset 1 MB %llu us, alloc_frame %llu ns\n",
+            baseline.memset_ns / 1000, baseline.alloc_frame_ns);
+}
+
+static void bench_mmu_print_row(const char *name, uint64_t off_ns, uint64_t on_ns) {
+    if (!baseline.valid || on_ns == 0) {
+        kprintf("  %-16s %12s %12llu %10s\n", name, "-", on_ns, "-");
+        return;
+    }
+    // Speedup as x.yy
+    uint64_t speedup = (off_ns * 100) / on_ns;
+    kprintf("  %-16s %12llu %12llu %6llu.%02llux\n",
+            name, off_ns, on_ns, speedup / 100, speedup % 100);
+}
+
+void bench_mmu(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    mmu_bench_result_t current;
+
+    if (!mmu_is_enabled()) {
+        kprintf("Bench: MMU is not enabled\n");
+        return;
+    }
+
+    bench_mmu_measure(&current);
+
+    kprintf("MMU/cache benchmark (ns per operation):\n");
+    kprintf("  %-16s %12s %12s %10s\n", "operation", "mmu off", "mmu on", "speedup");
+    bench_mmu_print_row("memset 1 MB", baseline.memset_ns, current.memset_ns);
+    bench_mmu_print_row("alloc_frame", baseline.alloc_frame_ns, current.alloc_frame_ns);
+    if (!baseline.valid) {
+        kprintf("  (no MMU-off baseline: build with BENCH_MMU_BASELINE=1 to record one at boot)\n");
+    }
+}
@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "fs/vfs.h"
+#include "fs/ramfs.h"
+#include "drivers/timer.h"
+#include "memory/frame_alloc.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+#include "lib/stdlib_stubs.h"
+
+#define RAMFS_BENCH_MB      16
+#define RAMFS_BENCH_COPIES  4096
+#define RAMFS_BENCH_RECORD  64
+#define RAMFS_BENCH_PATH    "/ramfs_bench"
+
+// The byte-at-a-time copy that memcpy used to be
+static void ramfs_bench_byte_copy(void *dest, const void *src, size_t n) {
+    uint8_t *d = dest;
+    const uint8_t *s = src;
+    while (n-- > 0) {
+        *d++ = *s++;
+    }
+}
+
+static void ramfs_bench_report(const char *label, uint64_t bytes, uint64_t ticks) {
+    uint64_t ns = bench_ticks_to_ns(ticks);
+    if (ns == 0) {
+        ns = 1;
+    }
+    kprintf("  %-30s %8llu MB/s\n", label, bytes * 1000 / ns);
+}
+
+static void ramfs_bench_copies(void *dst, void *src) {
+    uint64_t bytes = (uint64_t)RAMFS_BENCH_COPIES * PAGE_SIZE;
+
+    uint64_t start = timer_read_counter();
+    for (unsigned int i = 0; i < RAMFS_BENCH_COPIES; i++) {
+        ramfs_bench_byte_copy(dst, src, PAGE_SIZE);
+    }
+    ramfs_bench_report("4 KB byte loop", bytes, timer_read_counter() - start);
+
+    start = timer_read_counter();
+    for (unsigned int i = 0; i < RAMFS_BENCH_COPIES; i++) {
+        memcpy(dst, src, PAGE_SIZE);
+    }
+    ramfs_bench_report("4 KB memcpy", bytes, timer_read_counter() - start);
+
+    start = timer_read_counter();
+    for (unsigned int i = 0; i < RAMFS_BENCH_COPIES; i++) {
+        copy_page(dst, src);
+    }
+    ramfs_bench_report("4 KB copy_page", bytes, timer_read_counter() - start);
+}
+
+// Write, overwrite and read back pages pages of a new file, one page per call
+static bool ramfs_bench_file(void *buf, uint64_t pages) {
+    int fd = vfs_open(RAMFS_BENCH_PATH, O_RDWR | O_CREAT | O_TRUNC);
+    if (fd < 0) {
+        kprintf("Bench: %s: %s\n", RAMFS_BENCH_PATH, vfs_strerror(fd));
+        return false;
+    }
+    uint64_t bytes = pages * PAGE_SIZE;
+    bool ok = true;
+
+    const char *labels[] = { "write (allocating)", "overwrite" };
+    for (unsigned int pass = 0; pass < 2 && ok; pass++) {
+        vfs_seek(fd, 0, SEEK_SET);
+        uint64_t start = timer_read_counter();
+        for (uint64_t i = 0; i < pages; i++) {
+            if (vfs_write(fd, buf, PAGE_SIZE) != PAGE_SIZE) {
+                kprintf("Bench: Write failed at page %llu\n", i);
+                ok = false;
+                break;
+            }
+        }
+        if (ok) {
+            ramfs_bench_report(labels[pass], bytes, timer_read_counter() - start);
+        }
+    }
+
+    if (ok) {
+        vfs_seek(fd, 0, SEEK_SET);
+        uint64_t start = timer_read_counter();
+        for (uint64_t i = 0; i < pages; i++) {
+            vfs_read(fd, buf, PAGE_SIZE);
+        }
+        ramfs_bench_report("read", bytes, timer_read_counter() - start);
+
+        vfs_stat_t st;
+        vfs_fstat(fd, &st);
+        start = timer_read_counter();
+        vfs_ftruncate(fd, 0);
+        uint64_t us = timer_counter_to_us(timer_read_counter() - start);
+        kprintf("  %-30s %8llu us (%llu frames freed)\n", "truncate to 0", us, st.frames);
+    }
+    vfs_close(fd);
+    return ok;
+}
+
+// Small appends: the cached leaf makes each one O(1)
+static void ramfs_bench_append(uint64_t bytes) {
+    int fd = vfs_open(RAMFS_BENCH_PATH, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND);
+    if (fd < 0) {
+        kprintf("Bench: %s: %s\n", RAMFS_BENCH_PATH, vfs_strerror(fd));
+        return;
+    }
+    char record[RAMFS_BENCH_RECORD];
+    memset(record, 'r', sizeof(record));
+    uint64_t records = bytes / RAMFS_BENCH_RECORD;
+
+    uint64_t start = timer_read_counter();
+    for (uint64_t i = 0; i < records; i++) {
+        if (vfs_write(fd, record, sizeof(record)) != sizeof(record)) {
+            kprintf("Bench: Append failed at record %llu\n", i);
+            break;
+        }
+    }
+    uint64_t ticks = timer_read_counter() - start;
+    ramfs_bench_report("64-byte appends", bytes, ticks);
+    kprintf("  %-30s %8llu ns\n", "  per append", bench_ticks_to_ns(ticks) / (records ? records : 1));
+    vfs_close(fd);
+}
+
+void bench_ramfs(int argc, char **argv) {
+    uint64_t mb = RAMFS_BENCH_MB;
+    if (argc > 1) {
+        mb = simple_strtoull(argv[1], NULL, 0);
+        if (mb == 0) {
+            kprintf("Usage: bench ramfs [MB]\n");
+            return;
+        }
+    }
+
+    void *src = alloc_frame();
+    void *dst = alloc_frame();
+    if (!src || !dst) {
+        kprintf("Bench: Out of memory\n");
+        if (src) {
+            free_frame(src);
+        }
+        return;
+    }
+    memset(src, 0x5a, PAGE_SIZE);
+
+    kprintf("Page copies:\n");
+    ramfs_bench_copies(dst, src);
+
+    kprintf("ramfs, %llu MB file in 4 KB calls:\n", mb);
+    uint64_t pages = mb * 1024 * 1024 / PAGE_SIZE;
+    if (ramfs_bench_file(src, pages)) {
+        ramfs_bench_append(mb * 1024 * 1024);
+    }
+    vfs_unlink(RAMFS_BENCH_PATH);
+
+    free_frame(dst);
+    free_frame(src);
+}
@@ -0,0 +1,119 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "memory/mm.h"
+#include "memory/mmu.h"
+#include "memory/tlb.h"
+#include "memory/frame_alloc.h"
+#include "arch/smp.h"
+#include "drivers/timer.h"
+#include "lib/stdio.h"
+#include "lib/stdlib_stubs.h"
+
+#define SHOOTDOWN_BENCH_PAGES 1000
+
+typedef struct {
+    mm_t *mm;
+    uint64_t va;
+    uint64_t pages;
+} shootdown_run_t;
+
+// Touch every page under mm so each CPU holds its translations. This runs
+// in the IPI handler on the other CPUs, on top of whatever thread was
+// interrupted, so that thread's address space is put back afterwards.
+static void shootdown_bench_warm(void *arg) {
+    shootdown_run_t *run = arg;
+    uint64_t sum = 0;
+    mm_t *prev = mm_current();
+    mm_switch(run->mm);
+    for (uint64_t i = 0; i < run->pages; i++) {
+        sum += *(volatile uint64_t *)(run->va + i * PAGE_SIZE);
+    }
+    // Back on the previous tables; the ASID's entries stay cached
+    mm_switch(prev);
+    (void)sum;
+}
+
+static uint64_t shootdown_bench_ipis(void) {
+    uint64_t sent = 0;
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpu_online(cpu)) {
+            sent += percpu(cpu)->ipis_sent;
+        }
+    }
+    return sent;
+}
+
+static void shootdown_bench_run(const char *label, uint64_t pages, tlb_flush_mode_t mode,
+                                uint64_t range_limit) {
+    shootdown_run_t run;
+    run.mm = mm_create();
+    if (!run.mm) {
+        kprintf("Bench: Unable to create address space\n");
+        return;
+    }
+    run.pages = pages;
+    run.va = mm_mmap(run.mm, pages * PAGE_SIZE, MMU_USER_DATA);
+    if (!run.va) {
+        kprintf("Bench: mm_mmap failed\n");
+        mm_destroy(run.mm);
+        return;
+    }
+
+    // Populate, then cache the translations on every CPU
+    mm_switch(run.mm);
+    for (uint64_t i = 0; i < pages; i++) {
+        *(volatile uint64_t *)(run.va + i * PAGE_SIZE) = i;
+    }
+    mm_switch(NULL);
+    bench_on_cpus(bench_max_cpus(MAX_CPUS), shootdown_bench_warm, &run, NULL);
+
+    tlb_set_flush_mode(mode);
+    tlb_set_range_limit(range_limit);
+    tlb_stats_t before, after;
+    tlb_get_stats(&before);
+    uint64_t ipis = shootdown_bench_ipis();
+
+    uint64_t start = timer_read_counter();
+    int ret = mm_munmap(run.mm, run.va, pages * PAGE_SIZE);
+    uint64_t ns = bench_ticks_to_ns(timer_read_counter() - start);
+
+    ipis = shootdown_bench_ipis() - ipis;
+    tlb_get_stats(&after);
+    tlb_set_flush_mode(TLB_FLUSH_BATCHED);
+    tlb_set_range_limit(TLB_RANGE_LIMIT_DEFAULT);
+
+    if (ret != 0) {
+        kprintf("Bench: mm_munmap failed\n");
+    } else {
+        kprintf("  %-28s %10llu %10llu %8llu %8llu\n", label, ns / 1000,
+                after.pages - before.pages, after.full_flushes - before.full_flushes, ipis);
+    }
+    mm_destroy(run.mm);
+}
+
+void bench_shootdown(int argc, char **argv) {
+    uint64_t pages = SHOOTDOWN_BENCH_PAGES;
+    if (argc > 1) {
+        pages = simple_strtoull(argv[1], NULL, 0);
+        if (pages == 0) {
+            kprintf("Usage: bench shootdown [pages]\n");
+            return;
+        }
+    }
+
+    kprintf("Unmapping %llu pages cached in the TLBs of %u CPUs:\n",
+            pages, bench_max_cpus(MAX_CPUS));
+    kprintf("  %-28s %10s %10s %8s %8s\n", "", "time (us)", "TLBI pages", "full", "IPIs");
+    shootdown_bench_run("broadcast, each page", pages, TLB_FLUSH_EACH_PAGE,
+                        TLB_RANGE_LIMIT_DEFAULT);
+    shootdown_bench_run("broadcast, batched range", pages, TLB_FLUSH_BATCHED, UINT64_MAX);
+    shootdown_bench_run("broadcast, batched (default)", pages, TLB_FLUSH_BATCHED,
+                        TLB_RANGE_LIMIT_DEFAULT);
+    shootdown_bench_run("IPI, each page", pages, TLB_FLUSH_IPI_EACH_PAGE,
+                        TLB_RANGE_LIMIT_DEFAULT);
+    shootdown_bench_run("IPI, batched (default limit)", pages, TLB_FLUSH_IPI_BATCHED,
+                        TLB_RANGE_LIMIT_DEFAULT);
+    kprintf("  (batches flush early every %u frames to release them)\n", TLB_GATHER_BATCH);
+}
@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "memory/frame_alloc.h"
+#include "memory/mmu.h"
+#include "drivers/timer.h"
+#include "drivers/pmu.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+#include "lib/stdlib_stubs.h"
+
+// Two temporary aliases of the same RAM, far from anything else mapped:
+// one built from 4 KB pages, one from 2 MB blocks
+#define TLB_BENCH_PAGE_VA   0x2000000000ULL
+#define TLB_BENCH_BLOCK_VA  0x3000000000ULL
+#define TLB_BENCH_MAX_SIZE  (128ULL * 1024 * 1024)
+#define TLB_BENCH_READS     (1U << 20)
+
+typedef struct {
+    uint64_t ps_per_read;
+    uint64_t dtlb_refills;
+    uint64_t l2tlb_refills;
+    bool have_counts;
+} tlb_bench_result_t;
+
+// Random 8-byte aligned reads across [base, base + size); size is a power of two
+static uint64_t tlb_bench_reads(uint64_t base, uint64_t size, uint32_t reads) {
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    uint64_t mask = (size - 1) & ~7ULL;
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < reads; i++) {
+        // xorshift64
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        sum += *(volatile uint64_t *)(base + (state & mask));
+    }
+    return sum;
+}
+
+static void tlb_bench_run_window(uint64_t base, uint64_t size, uint32_t reads,
+                                 tlb_bench_result_t *result) {
+    pmu_session_t session;
+    memset(&session, 0, sizeof(session));
+    memset(result, 0, sizeof(*result));
+
+    bool counting = pmu_available() &&
+                    pmu_event_supported(PMU_EVENT_L1D_TLB_REFILL) &&
+                    pmu_event_supported(PMU_EVENT_L2D_TLB_REFILL);
+    if (counting) {
+        pmu_session_add_event(&session, PMU_EVENT_L1D_TLB_REFILL);
+        pmu_session_add_event(&session, PMU_EVENT_L2D_TLB_REFILL);
+        counting = pmu_session_start(&session) == 0;
+    }
+
+    // Warm up so both windows start with the same cache state
+    tlb_bench_reads(base, size, reads / 16);
+
+    uint64_t start = timer_read_counter();
+    tlb_bench_reads(base, size, reads);
+    uint64_t elapsed = timer_read_counter() - start;
+
+    if (counting) {
+        pmu_session_stop(&session);
+        result->dtlb_refills = pmu_session_value(&session, 0, NULL);
+        result->l2tlb_refills = pmu_session_value(&session, 1, NULL);
+        result->have_counts = true;
+    }
+    result->ps_per_read = bench_ticks_to_ns(elapsed * 1000) / reads;
+}
+
+static void tlb_bench_print(const char *name, const tlb_bench_result_t *r) {
+    kprintf("  %-14s %6llu.%03llu ns", name, r->ps_per_read / 1000, r->ps_per_read % 1000);
+    if (r->have_counts) {
+        kprintf(" %14llu %14llu", r->dtlb_refills, r->l2tlb_refills);
+    }
+    kprintf("\n");
+}
+
+void bench_tlb(int argc, char **argv) {
+    uint32_t reads = TLB_BENCH_READS;
+    if (argc > 1) {
+        reads = (uint32_t)simple_strtoull(argv[1], NULL, 0);
+        if (reads == 0) {
+            kprintf("Usage: bench tlb [reads]\n");
+            return;
+        }
+    }
+
+    if (!mmu_is_enabled()) {
+        kprintf("Bench: MMU is not enabled\n");
+        return;
+    }
+
+    // Largest power of two of RAM, up to 128 MB, starting at the RAM base
+    uint64_t ram_size = pmm_get_highest_usable_address() - PMM_RAM_BASE;
+    uint64_t size = TLB_BENCH_MAX_SIZE;
+    while (size > ram_size) {
+        size >>= 1;
+    }
+    if (size < 2 * 1024 * 1024) {
+        kprintf("Bench: Not enough RAM for the TLB benchmark\n");
+        return;
+    }
+
+    uint64_t *root = mmu_kernel_table();
+    if (mmu_map_pages(root, TLB_BENCH_PAGE_VA, PMM_RAM_BASE, size, MMU_KERNEL_RODATA) != 0 ||
+        mmu_map_range(root, TLB_BENCH_BLOCK_VA, PMM_RAM_BASE, size, MMU_KERNEL_RODATA) != 0) {
+        kprintf("Bench: Unable to map benchmark windows\n");
+        mmu_unmap_range(root, TLB_BENCH_PAGE_VA, size);
+        mmu_unmap_range(root, TLB_BENCH_BLOCK_VA, size);
+        return;
+    }
+
+    tlb_bench_result_t pages, blocks;
+    tlb_bench_run_window(TLB_BENCH_PAGE_VA, size, reads, &pages);
+    tlb_bench_run_window(TLB_BENCH_BLOCK_VA, size, reads, &blocks);
+
+    mmu_unmap_range(root, TLB_BENCH_PAGE_VA, size);
+    mmu_unmap_range(root, TLB_BENCH_BLOCK_VA, size);
+
+    kprintf("TLB benchmark: %u random 8-byte reads over %llu MB\n", reads, size >> 20);
+    kprintf("  %-14s %13s", "mapping", "per read");
+    if (pages.have_counts) {
+        kprintf(" %14s %14s", "l1d-tlb-refill", "l2d-tlb-refill");
+    }
+    kprintf("\n");
+    tlb_bench_print("4 KB pages", &pages);
+    tlb_bench_print("2 MB blocks", &blocks);
+    if (blocks.ps_per_read) {
+        uint64_t speedup = (pages.ps_per_read * 100) / blocks.ps_per_read;
+        kprintf("  Block speedup: %llu.%02llux\n", speedup / 100, speedup % 100);
+    }
+}
@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "arch/smp.h"
+#include "memory/vmalloc.h"
+#include "memory/frame_alloc.h"
+#include "drivers/timer.h"
+#include "lib/stdio.h"
+#include "lib/stdlib_stubs.h"
+
+#define VMALLOC_BENCH_AREAS     256
+#define VMALLOC_BENCH_MAX_PAGES 16      // Area sizes cycle through 1..16 pages
+#define VMALLOC_BENCH_ROUNDS    64      // Per CPU in the concurrent run
+#define VMALLOC_BENCH_HELD      8       // Areas each CPU holds at once
+
+static void *vb_areas[VMALLOC_BENCH_AREAS];
+static uint32_t vb_rounds;
+static volatile uint32_t vb_failed;
+static volatile uint32_t vb_corrupt;
+
+static size_t vmalloc_bench_size(unsigned int i) {
+    return (size_t)(i % VMALLOC_BENCH_MAX_PAGES + 1) * PAGE_SIZE;
+}
+
+// Tag the first word of every page with its address and the owner
+static void vmalloc_bench_fill(void *area, size_t size, uint64_t tag) {
+    for (size_t off = 0; off < size; off += PAGE_SIZE) {
+        uint64_t *word = (uint64_t *)((uint8_t *)area + off);
+        *word = (uint64_t)word ^ tag;
+    }
+}
+
+static bool vmalloc_bench_check(void *area, size_t size, uint64_t tag) {
+    for (size_t off = 0; off < size; off += PAGE_SIZE) {
+        uint64_t *word = (uint64_t *)((uint8_t *)area + off);
+        if (*word != ((uint64_t)word ^ tag)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every CPU allocates, tags, checks and frees its own areas at once, so
+// the trees, the lazy list and purges are all contended
+static void vmalloc_bench_concurrent(void *arg) {
+    (void)arg;
+    void *held[VMALLOC_BENCH_HELD];
+    uint64_t tag = ((uint64_t)cpu_id() + 1) << 56;
+    for (uint32_t round = 0; round < vb_rounds; round++) {
+        for (unsigned int i = 0; i < VMALLOC_BENCH_HELD; i++) {
+            held[i] = vmalloc(vmalloc_bench_size(round + i));
+            if (held[i]) {
+                vmalloc_bench_fill(held[i], vmalloc_bench_size(round + i), tag);
+            } else {
+                vb_failed++;
+            }
+        }
+        for (unsigned int i = 0; i < VMALLOC_BENCH_HELD; i++) {
+            if (!held[i]) {
+                continue;
+            }
+            if (!vmalloc_bench_check(held[i], vmalloc_bench_size(round + i), tag)) {
+                vb_corrupt++;
+            }
+            vfree(held[i]);
+        }
+    }
+}
+
+void bench_vmalloc(int argc, char **argv) {
+    vb_rounds = VMALLOC_BENCH_ROUNDS;
+    if (argc > 1) {
+        vb_rounds = (uint32_t)simple_strtoull(argv[1], NULL, 0);
+        if (vb_rounds == 0) {
+            kprintf("Usage: bench vmalloc [rounds]\n");
+            return;
+        }
+    }
+    vb_failed = 0;
+    vb_corrupt = 0;
+
+    // One CPU: the costs of allocation, the lazy free and the purge
+    kprintf("vmalloc, %d areas of 1-%d pages on one CPU:\n",
+            VMALLOC_BENCH_AREAS, VMALLOC_BENCH_MAX_PAGES);
+    vmalloc_purge();
+    uint64_t start = timer_read_counter();
+    for (unsigned int i = 0; i < VMALLOC_BENCH_AREAS; i++) {
+        vb_areas[i] = vmalloc(vmalloc_bench_size(i));
+        if (vb_areas[i]) {
+            vmalloc_bench_fill(vb_areas[i], vmalloc_bench_size(i), 0);
+        } else {
+            vb_failed++;
+        }
+    }
+    uint64_t alloc_ns = bench_ticks_to_ns(timer_read_counter() - start);
+
+    start = timer_read_counter();
+    for (unsigned int i = 0; i < VMALLOC_BENCH_AREAS; i++) {
+        if (vb_areas[i] && !vmalloc_bench_check(vb_areas[i], vmalloc_bench_size(i), 0)) {
+            vb_corrupt++;
+        }
+        vfree(vb_areas[i]);
+    }
+    uint64_t free_ns = bench_ticks_to_ns(timer_read_counter() - start);
+
+    start = timer_read_counter();
+    vmalloc_purge();
+    uint64_t purge_ns = bench_ticks_to_ns(timer_read_counter() - start);
+
+    kprintf("  %-30s %8llu ns\n", "vmalloc + touch, per area", alloc_ns / VMALLOC_BENCH_AREAS);
+    kprintf("  %-30s %8llu ns\n", "vfree (lazy), per area", free_ns / VMALLOC_BENCH_AREAS);
+    kprintf("  %-30s %8llu us\n", "final purge", purge_ns / 1000);
+
+    // Every online CPU at once
+    unsigned int ncpus = bench_max_cpus(MAX_CPUS);
+    kprintf("vmalloc/vfree on %u CPUs, %u rounds of %d areas each:\n",
+            ncpus, vb_rounds, VMALLOC_BENCH_HELD);
+    uint64_t ticks = bench_on_cpus(ncpus, vmalloc_bench_concurrent, NULL, NULL);
+    vmalloc_purge();
+    uint64_t pairs = (uint64_t)ncpus * vb_rounds * VMALLOC_BENCH_HELD;
+    kprintf("  %-30s %8llu ns\n", "vmalloc + vfree, per pair",
+            bench_ticks_to_ns(ticks) / (pairs ? pairs : 1));
+
+    if (vb_failed || vb_corrupt) {
+        kprintf("Warning: %u allocations failed, %u areas corrupted\n", vb_failed, vb_corrupt);
+    }
+    vmalloc_print_info();
+}
@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench/bench.h"
+#include "sched/thread.h"
+#include "sched/wait.h"
+#include "arch/cpu.h"
+#include "arch/smp.h"
+#include "sync/atomic.h"
+#include "drivers/timer.h"
+#include "lib/stdio.h"
+#include "lib/stdlib_stubs.h"
+
+#define WAKE_BENCH_ROUNDS 2000
+
+// Two threads take turns: each waits until turn is its own, then hands it
+// to the other and wakes it. The counter is read just before the wake and
+// again when the woken thread gets going; CNTVCT_EL0 is the same clock on
+// every CPU.
+typedef struct {
+    volatile uint32_t turn;     // 0: ping runs next, 1: pong
+    uint32_t rounds;
+    bool use_queue;             // wait queue instead of wait_on_address()
+    wait_queue_t queue;
+    volatile uint64_t woken_at; // Counter just before the last wake
+    uint64_t samples;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    volatile uint32_t running;
+    wait_queue_t done;
+} wake_run_t;
+
+static void wake_bench_turn(wake_run_t *run, uint32_t me) {
+    if (run->use_queue) {
+        wait_event(&run->queue, atomic_load_acquire32(&run->turn) == me);
+    } else {
+        while (atomic_load_acquire32(&run->turn) != me) {
+            wait_on_address(&run->turn, !me, 0);
+        }
+    }
+
+    // Only the thread holding the turn touches the statistics
+    uint64_t now = timer_read_counter();
+    if (run->woken_at) {
+        uint64_t ticks = now - run->woken_at;
+        run->samples++;
+        run->total += ticks;
+        if (ticks < run->min) run->min = ticks;
+        if (ticks > run->max) run->max = ticks;
+    }
+
+    run->woken_at = timer_read_counter();
+    atomic_store_release32(&run->turn, !me);
+    if (run->use_queue) {
+        wake_up(&run->queue);
+    } else {
+        wake_address(&run->turn, 1);
+    }
+}
+
+static void wake_bench_thread(wake_run_t *run, uint32_t me) {
+    for (uint32_t i = 0; i < run->rounds; i++) {
+        wake_bench_turn(run, me);
+    }
+    if (atomic_fetch_add32(&run->running, -1U) == 1) {
+        wake_up(&run->done);
+    }
+}
+
+static void wake_bench_ping(void *arg) {
+    wake_bench_thread(arg, 0);
+}
+
+static void wake_bench_pong(void *arg) {
+    wake_bench_thread(arg, 1);
+}
+
+static void wake_bench_run(const char *label, uint32_t rounds, bool use_queue,
+                           unsigned int ping_cpu, unsigned int pong_cpu) {
+    wake_run_t run;
+    run.turn = 0;
+    run.rounds = rounds;
+    run.use_queue = use_queue;
+    wait_queue_init(&run.queue);
+    run.woken_at = 0;
+    run.samples = 0;
+    run.total = 0;
+    run.min = UINT64_MAX;
+    run.max = 0;
+    run.running = 2;
+    wait_queue_init(&run.done);
+
+    // pong first, so it is already waiting when ping hands over
+    if (!thread_create("pong", wake_bench_pong, &run, pong_cpu)) {
+        kprintf("Failed to create benchmark thread\n");
+        return;
+    }
+    if (!thread_create("ping", wake_bench_ping, &run, ping_cpu)) {
+        // pong is waiting for a turn that never comes; hand it every one
+        kprintf("Failed to create benchmark thread\n");
+        run.rounds = 0;
+        atomic_fetch_add32(&run.running, -1U);
+        atomic_store_release32(&run.turn, 1);
+        wake_up(&run.queue);
+        wake_address(&run.turn, 1);
+    }
+    // The caller sleeps here without using its CPU
+    wait_event(&run.done, atomic_load_acquire32(&run.running) == 0);
+
+    if (run.samples == 0) {
+        return;
+    }
+    uint64_t avg = run.total / run.samples;
+    kprintf("  %-28s %6llu ticks avg %6llu min %8llu max (%llu ns avg)\n", label,
+            avg, run.min, run.max, bench_ticks_to_ns(avg));
+}
+
+void bench_wake(int argc, char **argv) {
+    uint32_t rounds = WAKE_BENCH_ROUNDS;
+    if (argc > 1) {
+        rounds = (uint32_t)simple_strtoull(argv[1], NULL, 0);
+        if (rounds == 0) {
+            kprintf("Usage: bench wake [rounds]\n");
+            return;
+        }
+    }
+
+    kprintf("Wake-up latency, %u round trips, in CNTVCT_EL0 ticks (%llu Hz)\n",
+            rounds, timer_get_frequency());
+
+    unsigned int self = cpu_id();
+    wake_bench_run("same CPU, wait_on_address", rounds, false, self, self);
+    wake_bench_run("same CPU, wait queue", rounds, true, self, self);
+
+    // Away from the caller's CPU where possible, so the wakee's CPU is
+    // idle in WFI and the wake-up takes an IPI
+    unsigned int ncpus = smp_num_cpus();
+    if (ncpus < 2) {
+        kprintf("  (one CPU online: no cross-CPU wake-ups)\n");
+        return;
+    }
+    unsigned int ping_cpu = ncpus > 2 ? (self + 1) % ncpus : self;
+    unsigned int pong_cpu = (ping_cpu + 1) % ncpus;
+    if (pong_cpu == self && ncpus > 2) {
+        pong_cpu = (pong_cpu + 1) % ncpus;
+    }
+    wake_bench_run("cross-CPU, wait_on_address", rounds, false, ping_cpu, pong_cpu);
+    wake_bench_run("cross-CPU, wait queue", rounds, true, ping_cpu, pong_cpu);
+}
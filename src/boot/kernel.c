@@ -1,5 +1,30 @@
 #include "kernel.h"
 #include "lib/stdio.h"
+#include "drivers/gic.h"
+#include "drivers/timer.h"
+#include "drivers/pmu.h"
+#include "drivers/fw_cfg.h"
+#include "drivers/virtio.h"
+#include "drivers/virtio_blk.h"
+#include "drivers/virtio_console.h"
+#include "debug/bootchart.h"
+#include "fs/bcache.h"
+#include "fs/initramfs.h"
+#include "fs/vfs.h"
+#include "memory/mmu.h"
+#include "memory/vmalloc.h"
+#include "memory/mm.h"
+#include "bench/bench.h"
+#include "arch/cpu.h"
+#include "arch/smp.h"
+#include "lib/fdt.h"
+#include "lib/uart.h"
+#include "sync/atomic.h"
+#include "memory/frame_alloc.h"
+#include "sched/thread.h"
+#include "sched/executor.h"
+#include "sched/softirq.h"
+#include "sched/workqueue.h"
 
 // External functions we'll implement later
 extern void frame_alloc_init(const KERNEL_BOOT_PARAMS *params);
@@ -7,60 +32,18 @@ extern void kheap_init(void);
 extern int tui_init(void);
 extern void shell_loop(void);
 
-// Debug function called from boot code before UART is initialized
-// We need a direct hardware access version
-static void early_debug_print(const char *str) {
-    // UART direct access (PL011)
-    volatile uint32_t *uart_dr = (volatile uint32_t*)0x09000000;
-    volatile uint32_t *uart_fr = (volatile uint32_t*)0x09000018;
-    
-    while (*str) {
-        // Wait for FIFO to have space
-        while ((*uart_fr) & (1 << 5)); // TXFF bit
-        
-        // Send character
-        *uart_dr = (uint32_t)*str++;
-    }
-}
-
-// Debug function for section copying, called from assembly
-void boot_debug_copy(void *dest, void *src, size_t size) {
-    // Print directly using early UART access
-    early_debug_print("[BOOT] Copying section: ");
-    
-    // Convert size to string manually (very simple)
-    char size_str[16];
-    int i = 0;
-    int tmp = (int)size;
-    
-    // Handle special case of zero
-    if (tmp == 0) {
-        size_str[0] = '0';
-        size_str[1] = '\0';
-    } else {
-        // Convert integer to string (backwards)
-        while (tmp > 0) {
-            size_str[i++] = '0' + (tmp % 10);
-            tmp /= 10;
-        }
-        size_str[i] = '\0';
-        
-        // Reverse the string
-        for (int j = 0; j < i/2; j++) {
-            char c = size_str[j];
-            size_str[j] = size_str[i-j-1];
-            size_str[i-j-1] = c;
-        }
-    }
-    
-    early_debug_print(size_str);
-    early_debug_print(" bytes\n");
+static void shell_thread(void *arg) {
+    (void)arg;
+    bootchart_mark("shell");
+    bootchart_print();
+    shell_loop();
 }
 
 // Kernel entry point
 void kernel_main(KERNEL_BOOT_PARAMS *params) {
-    // Early initialization - placeholder for UART setup
-    // We'll assume kprintf writes to a UART for now
+    // Per-CPU data first: kprintf's console lock uses it. Output goes to
+    // the kernel log until console_start().
+    smp_init_boot_cpu();
     
     kprintf("MeringueOS starting...\n");
     kprintf("Kernel loaded at physical address: 0x%llx\n", 
@@ -73,12 +56,76 @@ void kernel_main(KERNEL_BOOT_PARAMS *params) {
     kprintf("  .data:   %p to %p (load: %p)\n", &_data_start, &_data_end, &_data_load);
     kprintf("  .bss:    %p to %p\n", &_bss_start, &_bss_end);
     
+    atomics_init();
+    
+    // Locate the device tree; QEMU puts it at the start of RAM when it
+    // does not pass it in x0
+    if (!fdt_init(boot_dtb) && !fdt_init(PMM_RAM_BASE)) {
+        kprintf("No device tree found, using built-in defaults\n");
+    }
+    console_start();
+    bootchart_mark("early init and console");
+    
     // Initialize memory management subsystem
     kprintf("Initializing Physical Memory Manager...\n");
     frame_alloc_init(params);
+    bootchart_mark("PMM init");
+    
+#ifdef CONFIG_BENCH_MMU_BASELINE
+    // Time the uncached case once so `bench mmu` can report the speedup
+    bench_mmu_baseline();
+#endif
+    
+    kprintf("Initializing MMU...\n");
+    mmu_init();
+    bootchart_mark("MMU init");
     
     kprintf("Initializing Kernel Heap Allocator...\n");
     kheap_init();
+    bootchart_mark("heap init");
+    
+    kprintf("Initializing vmalloc...\n");
+    vmalloc_init();
+    mm_init();
+    bootchart_mark("vmalloc and mm");
+    
+    // Bring up interrupt delivery and the periodic tick
+    kprintf("Initializing interrupt controller...\n");
+    gic_init();
+    softirq_init();
+    
+    kprintf("Initializing timer...\n");
+    timer_init();
+    local_irq_enable();
+    
+    kprintf("Initializing performance monitors...\n");
+    pmu_init();
+    bootchart_mark("interrupts and timer");
+    
+    kprintf("Initializing scheduler...\n");
+    sched_init();
+    
+    kprintf("Starting secondary CPUs...\n");
+    smp_init();
+    
+    kprintf("Starting task executor...\n");
+    executor_init();
+    bootchart_mark("scheduler and SMP");
+    
+    // Console input through the RX interrupt from here on
+    kprintf("Starting workqueues...\n");
+    workqueue_init();
+    uart_enable_rx_irq();
+    
+    kprintf("Probing fw_cfg and virtio devices...\n");
+    fw_cfg_init();
+    virtio_init();
+    virtio_blk_init();
+    virtio_console_init();
+    bcache_init();
+    initramfs_init();
+    vfs_init();
+    bootchart_mark("devices and file systems");
     
     // Initialize Text User Interface
     kprintf("Initializing TUI subsystem...\n");
@@ -86,15 +133,13 @@ void kernel_main(KERNEL_BOOT_PARAMS *params) {
         kprintf("Failed to initialize TUI subsystem!\n");
         // Continue without TUI for now
     }
+    bootchart_mark("TUI init");
     
-    // Enter the shell
+    // The shell is just another thread; this context becomes CPU0's idle
+    // thread
     kprintf("Starting shell...\n");
-    shell_loop();
-    
-    // If shell returns, halt
-    kprintf("Kernel halting.\n");
-    while(1) {
-        // This is equivalent to a halt
-        asm volatile("wfi");
+    if (!thread_create("shell", shell_thread, NULL, 0)) {
+        kprintf("Failed to start the shell thread!\n");
     }
+    sched_idle_loop();
 }
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "debug/bootchart.h"
+#include "drivers/timer.h"
+#include "arch/cpu.h"
+#include "lib/stdio.h"
+
+typedef struct {
+    const char *name;
+    uint64_t end;               // CNTVCT
+} boot_phase_t;
+
+uint64_t bootchart_asm_stamps[BOOTCHART_ASM_STAMPS];
+
+static const char *const bootchart_asm_phases[BOOTCHART_ASM_STAMPS] = {
+    "firmware and loader", "section copy", "BSS clear"
+};
+
+static boot_phase_t phases[BOOTCHART_MAX_PHASES];
+static unsigned int nr_phases = 0;
+
+void bootchart_mark(const char *phase) {
+    if (nr_phases < BOOTCHART_MAX_PHASES) {
+        phases[nr_phases].name = phase;
+        phases[nr_phases].end = read_sysreg(cntvct_el0);
+        nr_phases++;
+    }
+}
+
+static void bootchart_row(const char *name, uint64_t start, uint64_t end) {
+    kprintf("  %-28s %10llu %10llu\n", name, timer_counter_to_us(end),
+            timer_counter_to_us(end - start));
+}
+
+void bootchart_print(void) {
+    kprintf("Bootchart (CNTVCT at %llu Hz):\n", timer_get_frequency());
+    kprintf("  %-28s %10s %10s\n", "phase", "end (us)", "took (us)");
+
+    // The counter starts from zero when the machine does, so the time
+    // before _start belongs to the firmware and loader
+    uint64_t prev = 0;
+    for (unsigned int i = 0; i < BOOTCHART_ASM_STAMPS; i++) {
+        bootchart_row(bootchart_asm_phases[i], prev, bootchart_asm_stamps[i]);
+        prev = bootchart_asm_stamps[i];
+    }
+    for (unsigned int i = 0; i < nr_phases; i++) {
+        bootchart_row(phases[i].name, prev, phases[i].end);
+        prev = phases[i].end;
+    }
+
+    uint64_t kernel = prev - bootchart_asm_stamps[0];
+    kprintf("bootchart: kernel %llu us (from _start), total %llu us\n",
+            timer_counter_to_us(kernel), timer_counter_to_us(prev));
+}
@@ -0,0 +1,51 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "kernel.h"
+#include "debug/ksyms.h"
+
+// Provided by the generated build/ksyms.S, sorted by address
+extern const uint64_t ksyms_count;
+extern const ksym_t ksyms_table[];
+
+long ksym_index(uint64_t addr) {
+    if (ksyms_count == 0 ||
+        addr < ksyms_table[0].addr ||
+        addr >= (uint64_t)&_text_end) {
+        return -1;
+    }
+
+    // Binary search for the last symbol starting at or below addr
+    uint64_t lo = 0;
+    uint64_t hi = ksyms_count - 1;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo + 1) / 2;
+        if (ksyms_table[mid].addr <= addr) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return (long)lo;
+}
+
+const char *ksym_lookup(uint64_t addr, uint64_t *offset) {
+    long index = ksym_index(addr);
+    if (index < 0) {
+        return NULL;
+    }
+    if (offset) {
+        *offset = addr - ksyms_table[index].addr;
+    }
+    return ksyms_table[index].name;
+}
+
+const ksym_t *ksym_get(long index) {
+    if (index < 0 || (uint64_t)index >= ksyms_count) {
+        return NULL;
+    }
+    return &ksyms_table[index];
+}
+
+uint64_t ksym_count(void) {
+    return ksyms_count;
+}
@@ -0,0 +1,389 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "debug/memprof.h"
+#include "debug/ksyms.h"
+#include "debug/stackwalk.h"
+#include "drivers/timer.h"
+#include "sync/spinlock.h"
+#include "arch/cpu.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+// Most call sites printed by one report
+#define MEMPROF_REPORT_MAX 32
+
+// Call site slot (open addressing on the site and its callers)
+typedef struct {
+    uint64_t site;                          // Return address, 0 = empty slot
+    uint64_t callers[MEMPROF_STACK_DEPTH];  // 0-terminated, with -g only
+    memprof_kind_t kind;
+    uint64_t allocs;                        // Allocations made
+    uint64_t bytes;                         // Bytes allocated in them
+    uint64_t live_count;                    // Of those, not freed yet
+    uint64_t live_bytes;
+    uint64_t peak_bytes;                    // Highest live_bytes seen
+} memprof_site_t;
+
+// A profiled allocation that has not been freed (open addressing on ptr)
+typedef struct {
+    uint64_t ptr;                           // 0 = empty slot
+    uint64_t bytes;                         // Weighted, as charged to the site
+    uint64_t count;
+    uint32_t site;                          // Index into memprof_sites
+} memprof_live_t;
+
+// Byte countdown to the next sample, per CPU
+typedef struct {
+    int64_t countdown;
+    uint64_t rng;                           // xorshift64 state
+} __attribute__((aligned(64))) memprof_cpu_t;
+
+volatile bool memprof_running = false;
+
+static spinlock_t memprof_lock = SPINLOCK_INIT;
+static memprof_site_t memprof_sites[MEMPROF_SITE_SLOTS];
+static memprof_live_t memprof_live[MEMPROF_LIVE_SLOTS];
+static memprof_cpu_t memprof_cpus[MAX_CPUS];
+
+// Profiled allocations live per hash bucket of their pointer. Changed
+// under memprof_lock; memprof_free() reads it without the lock, so that
+// the frees of allocations that were never sampled stay per-CPU. A free
+// follows its allocation, so it cannot see the count before the
+// increment, and the live table holds fewer entries than a counter can.
+static volatile uint16_t memprof_filter[MEMPROF_FILTER_SLOTS];
+static memprof_site_t memprof_top[MEMPROF_REPORT_MAX];
+
+static uint64_t memprof_sample_bytes = 0;   // 0: profile every allocation
+static bool memprof_callstacks = false;
+static uint64_t memprof_start_ticks = 0;
+static uint64_t memprof_elapsed_ticks = 0;
+
+// Totals, under memprof_lock
+static uint32_t memprof_nr_live = 0;
+static uint64_t memprof_live_bytes = 0;
+static uint64_t memprof_peak_bytes = 0;
+static uint64_t memprof_nr_sites = 0;
+static uint64_t memprof_untracked = 0;      // Live table was full
+static uint64_t memprof_dropped = 0;        // Site table was full
+
+static inline uint32_t memprof_hash(uint64_t key) {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static inline volatile uint16_t *memprof_filter_slot(uint64_t ptr) {
+    return &memprof_filter[memprof_hash(ptr) & (MEMPROF_FILTER_SLOTS - 1)];
+}
+
+// --- Recording ---
+
+// Gap to the next sample, uniform in [1, 2 * sample_bytes] so that
+// allocation patterns cannot line up with it
+static int64_t memprof_next_gap(memprof_cpu_t *pc) {
+    uint64_t x = pc->rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    pc->rng = x;
+    return (int64_t)(1 + x % (2 * memprof_sample_bytes));
+}
+
+static bool memprof_same_callers(const uint64_t *a, const uint64_t *b) {
+    for (int d = 0; d < MEMPROF_STACK_DEPTH; d++) {
+        if (a[d] != b[d]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static memprof_site_t *memprof_site_slot(memprof_kind_t kind, uint64_t site,
+                                         const uint64_t *callers) {
+    uint64_t key = site;
+    for (int d = 0; d < MEMPROF_STACK_DEPTH; d++) {
+        key = key * 31 + callers[d];
+    }
+    uint32_t slot = memprof_hash(key);
+    for (uint32_t probe = 0; probe < MEMPROF_SITE_SLOTS; probe++) {
+        memprof_site_t *entry = &memprof_sites[(slot + probe) & (MEMPROF_SITE_SLOTS - 1)];
+        if (entry->site == site && memprof_same_callers(entry->callers, callers)) {
+            return entry;
+        }
+        if (entry->site == 0) {
+            entry->site = site;
+            memcpy(entry->callers, callers, sizeof(entry->callers));
+            entry->kind = kind;
+            memprof_nr_sites++;
+            return entry;
+        }
+    }
+    return NULL; // Table full
+}
+
+static memprof_live_t *memprof_live_insert(uint64_t ptr) {
+    uint32_t slot = memprof_hash(ptr);
+    for (uint32_t probe = 0; probe < MEMPROF_LIVE_SLOTS; probe++) {
+        memprof_live_t *entry = &memprof_live[(slot + probe) & (MEMPROF_LIVE_SLOTS - 1)];
+        if (entry->ptr == 0) {
+            entry->ptr = ptr;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Remove the entry in slot i, moving later entries of its probe run back
+// so that lookups never stop short at the hole
+static void memprof_live_remove(uint32_t i) {
+    uint32_t hole = i;
+    for (uint32_t j = (i + 1) & (MEMPROF_LIVE_SLOTS - 1);
+         memprof_live[j].ptr != 0;
+         j = (j + 1) & (MEMPROF_LIVE_SLOTS - 1)) {
+        uint32_t home = memprof_hash(memprof_live[j].ptr) & (MEMPROF_LIVE_SLOTS - 1);
+        // Move j into the hole unless its home lies after the hole and
+        // up to j, in the circular sense
+        bool stays = (hole <= j) ? (home > hole && home <= j)
+                                 : (home > hole || home <= j);
+        if (!stays) {
+            memprof_live[hole] = memprof_live[j];
+            hole = j;
+        }
+    }
+    memprof_live[hole].ptr = 0;
+}
+
+void memprof_alloc(memprof_kind_t kind, void *ptr, size_t size, uint64_t site, uint64_t fp) {
+    uint64_t bytes = size;
+    uint64_t count = 1;
+    if (memprof_sample_bytes) {
+        // A thread moved to another CPU midway only skews the countdowns
+        memprof_cpu_t *pc = &memprof_cpus[cpu_id()];
+        pc->countdown -= (int64_t)size;
+        if (pc->countdown > 0) {
+            return;
+        }
+        pc->countdown = memprof_next_gap(pc);
+        // This allocation stands for sample_bytes of them on average
+        if (size < memprof_sample_bytes) {
+            bytes = memprof_sample_bytes;
+            count = size ? memprof_sample_bytes / size : 1;
+        }
+    }
+
+    uint64_t callers[MEMPROF_STACK_DEPTH] = { 0 };
+    if (memprof_callstacks) {
+        // fp is the allocator's own record, whose return address is the
+        // site; keep the ones above it
+        uint64_t stack[MEMPROF_STACK_DEPTH + 1];
+        stack_walk(fp, stack, MEMPROF_STACK_DEPTH + 1);
+        memcpy(callers, stack + 1, sizeof(callers));
+    }
+
+    uint64_t flags = spin_lock_irqsave(&memprof_lock);
+    memprof_site_t *entry = memprof_site_slot(kind, site, callers);
+    if (!entry) {
+        memprof_dropped++;
+        spin_unlock_irqrestore(&memprof_lock, flags);
+        return;
+    }
+    entry->allocs += count;
+    entry->bytes += bytes;
+
+    memprof_live_t *live = memprof_live_insert((uint64_t)ptr);
+    if (live) {
+        live->bytes = bytes;
+        live->count = count;
+        live->site = (uint32_t)(entry - memprof_sites);
+        (*memprof_filter_slot((uint64_t)ptr))++;
+        memprof_nr_live++;
+        entry->live_count += count;
+        entry->live_bytes += bytes;
+        if (entry->live_bytes > entry->peak_bytes) {
+            entry->peak_bytes = entry->live_bytes;
+        }
+        memprof_live_bytes += bytes;
+        if (memprof_live_bytes > memprof_peak_bytes) {
+            memprof_peak_bytes = memprof_live_bytes;
+        }
+    } else {
+        memprof_untracked++;
+    }
+    spin_unlock_irqrestore(&memprof_lock, flags);
+}
+
+void memprof_free(void *ptr) {
+    // Most frees in sampling mode find nothing; skip the lock unless the
+    // filter says ptr may be profiled
+    if (!ptr || *memprof_filter_slot((uint64_t)ptr) == 0) {
+        return;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&memprof_lock);
+    uint32_t slot = memprof_hash((uint64_t)ptr);
+    for (uint32_t probe = 0; probe < MEMPROF_LIVE_SLOTS; probe++) {
+        uint32_t i = (slot + probe) & (MEMPROF_LIVE_SLOTS - 1);
+        memprof_live_t *live = &memprof_live[i];
+        if (live->ptr == 0) {
+            break;
+        }
+        if (live->ptr == (uint64_t)ptr) {
+            memprof_site_t *entry = &memprof_sites[live->site];
+            entry->live_count -= live->count;
+            entry->live_bytes -= live->bytes;
+            memprof_live_bytes -= live->bytes;
+            (*memprof_filter_slot((uint64_t)ptr))--;
+            memprof_nr_live--;
+            memprof_live_remove(i);
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&memprof_lock, flags);
+}
+
+// --- Control ---
+
+void memprof_start(uint64_t sample_bytes, bool callstacks) {
+    memprof_running = false;
+
+    uint64_t flags = spin_lock_irqsave(&memprof_lock);
+    memset(memprof_sites, 0, sizeof(memprof_sites));
+    memset(memprof_live, 0, sizeof(memprof_live));
+    memset((void *)memprof_filter, 0, sizeof(memprof_filter));
+    memprof_nr_live = 0;
+    memprof_live_bytes = 0;
+    memprof_peak_bytes = 0;
+    memprof_nr_sites = 0;
+    memprof_untracked = 0;
+    memprof_dropped = 0;
+
+    memprof_sample_bytes = sample_bytes;
+    memprof_callstacks = callstacks;
+    uint64_t seed = read_sysreg(cntvct_el0);
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        memprof_cpus[cpu].rng = (seed + (uint64_t)cpu + 1) * 0x9E3779B97F4A7C15ULL;
+        memprof_cpus[cpu].countdown = sample_bytes ? memprof_next_gap(&memprof_cpus[cpu]) : 0;
+    }
+    memprof_start_ticks = timer_get_ticks();
+    memprof_elapsed_ticks = 0;
+    spin_unlock_irqrestore(&memprof_lock, flags);
+
+    memprof_running = true;
+    if (sample_bytes) {
+        kprintf("Memprof: Sampling every %llu bytes allocated%s\n", sample_bytes,
+                callstacks ? " with call stacks" : "");
+    } else {
+        kprintf("Memprof: Profiling every allocation%s\n",
+                callstacks ? " with call stacks" : "");
+    }
+}
+
+void memprof_stop(void) {
+    if (!memprof_running) {
+        return;
+    }
+    memprof_running = false;
+    memprof_elapsed_ticks = timer_get_ticks() - memprof_start_ticks;
+    kprintf("Memprof: Stopped after %llu ms\n", memprof_elapsed_ticks * 1000 / TIMER_HZ);
+}
+
+bool memprof_is_running(void) {
+    return memprof_running;
+}
+
+// --- Reporting ---
+
+static void memprof_print_addr(uint64_t ret) {
+    // Return addresses point past the call; show the call itself
+    uint64_t offset;
+    const char *name = ksym_lookup(ret - 4, &offset);
+    if (name) {
+        kprintf("%s+0x%llx", name, offset);
+    } else {
+        kprintf("0x%llx", ret - 4);
+    }
+}
+
+void memprof_report(unsigned int top_n) {
+    if (top_n == 0) {
+        top_n = 20;
+    }
+    if (top_n > MEMPROF_REPORT_MAX) {
+        top_n = MEMPROF_REPORT_MAX;
+    }
+
+    // Copy the top sites out so that nothing is printed under the lock
+    uint64_t flags = spin_lock_irqsave(&memprof_lock);
+    unsigned int n = 0;
+    for (; n < top_n; n++) {
+        memprof_site_t *best = NULL;
+        for (int i = 0; i < MEMPROF_SITE_SLOTS; i++) {
+            memprof_site_t *entry = &memprof_sites[i];
+            if (entry->site == 0 || entry->allocs == 0) {
+                continue;
+            }
+            bool taken = false;
+            for (unsigned int j = 0; j < n && !taken; j++) {
+                taken = memprof_top[j].site == entry->site &&
+                        memprof_same_callers(memprof_top[j].callers, entry->callers);
+            }
+            if (taken) {
+                continue;
+            }
+            if (!best || entry->live_bytes > best->live_bytes ||
+                (entry->live_bytes == best->live_bytes && entry->bytes > best->bytes)) {
+                best = entry;
+            }
+        }
+        if (!best) {
+            break;
+        }
+        memprof_top[n] = *best;
+    }
+    uint64_t live_bytes = memprof_live_bytes;
+    uint64_t peak_bytes = memprof_peak_bytes;
+    uint64_t nr_live = memprof_nr_live;
+    uint64_t nr_sites = memprof_nr_sites;
+    uint64_t untracked = memprof_untracked;
+    uint64_t dropped = memprof_dropped;
+    spin_unlock_irqrestore(&memprof_lock, flags);
+
+    uint64_t ms = (memprof_running ? timer_get_ticks() - memprof_start_ticks
+                                   : memprof_elapsed_ticks) * 1000 / TIMER_HZ;
+    kprintf("Memprof: %s for %llu ms, ", memprof_running ? "running" : "stopped", ms);
+    if (memprof_sample_bytes) {
+        kprintf("sampling every %llu bytes (figures are estimates)\n", memprof_sample_bytes);
+    } else {
+        kprintf("every allocation\n");
+    }
+    kprintf("  %llu bytes live (peak %llu) in %llu profiled allocations from %llu sites\n",
+            live_bytes, peak_bytes, nr_live, nr_sites);
+    if (untracked) {
+        kprintf("  %llu allocations not tracked to their free: live table full\n", untracked);
+    }
+    if (dropped) {
+        kprintf("  %llu allocations not profiled: site table full\n", dropped);
+    }
+    if (n == 0) {
+        return;
+    }
+    if (ksym_count() == 0) {
+        kprintf("Memprof: No symbol table embedded, addresses cannot be resolved\n");
+    }
+
+    kprintf("  %12s %12s %8s %10s %12s  %-7s %s\n",
+            "Live bytes", "Peak bytes", "Live", "Allocs", "Bytes", "Kind", "Call site");
+    for (unsigned int i = 0; i < n; i++) {
+        memprof_site_t *entry = &memprof_top[i];
+        kprintf("  %12llu %12llu %8llu %10llu %12llu  %-7s ",
+                entry->live_bytes, entry->peak_bytes, entry->live_count,
+                entry->allocs, entry->bytes,
+                entry->kind == MEMPROF_FRAME ? "frame" : "kmalloc");
+        memprof_print_addr(entry->site);
+        kprintf("\n");
+        for (int d = 0; d < MEMPROF_STACK_DEPTH && entry->callers[d]; d++) {
+            kprintf("  %66s <- ", "");
+            memprof_print_addr(entry->callers[d]);
+            kprintf("\n");
+        }
+    }
+}
@@ -0,0 +1,251 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "debug/profiler.h"
+#include "debug/ksyms.h"
+#include "debug/stackwalk.h"
+#include "drivers/timer.h"
+#include "exceptions/exceptions.h"
+#include "arch/cpu.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+typedef struct {
+    uint64_t pc;                          // Interrupted ELR_EL1
+    uint64_t callers[PROF_STACK_DEPTH];   // Return addresses, 0-terminated
+} prof_sample_t;
+
+// Per-CPU sample buffer, only ever written by its own CPU's tick
+typedef struct {
+    prof_sample_t samples[PROF_MAX_SAMPLES];
+    uint32_t count;
+    uint32_t dropped;
+    uint32_t phase;                       // Ticks since the last sample
+} prof_buffer_t;
+
+// Histogram slot for the report (open addressing on symbol index)
+typedef struct {
+    long sym;                             // Symbol index + 1, 0 = empty slot
+    uint32_t self;                        // Samples with the PC in this symbol
+    uint32_t total;                       // Samples with this symbol anywhere on the stack
+} prof_hist_t;
+
+static prof_buffer_t prof_buffers[MAX_CPUS];
+static prof_hist_t prof_hist[PROF_HIST_SLOTS];
+
+static volatile bool prof_running = false;
+static bool prof_callstacks = false;
+static uint32_t prof_divider = 1;         // Sample every prof_divider ticks
+static uint64_t prof_start_ticks = 0;
+static uint64_t prof_elapsed_ticks = 0;
+
+// --- Sampling (IRQ context) ---
+
+static void prof_tick(saved_registers_t *context) {
+    if (!prof_running) {
+        return;
+    }
+
+    unsigned int cpu = cpu_id();
+    if (cpu >= MAX_CPUS) {
+        return;
+    }
+    prof_buffer_t *buf = &prof_buffers[cpu];
+
+    if (++buf->phase < prof_divider) {
+        return;
+    }
+    buf->phase = 0;
+
+    if (buf->count >= PROF_MAX_SAMPLES) {
+        buf->dropped++;
+        return;
+    }
+
+    prof_sample_t *sample = &buf->samples[buf->count];
+    sample->pc = context->elr_el1;
+    if (prof_callstacks) {
+        stack_walk(context->regs[29], sample->callers, PROF_STACK_DEPTH);
+    } else {
+        sample->callers[0] = 0;
+    }
+    buf->count++;
+}
+
+// --- Control ---
+
+int profiler_start(unsigned int hz, bool callstacks) {
+    if (hz == 0 || hz > TIMER_HZ) {
+        hz = TIMER_HZ;
+    }
+
+    prof_running = false;
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        prof_buffers[cpu].count = 0;
+        prof_buffers[cpu].dropped = 0;
+        prof_buffers[cpu].phase = 0;
+    }
+    prof_divider = TIMER_HZ / hz;
+    prof_callstacks = callstacks;
+    prof_start_ticks = timer_get_ticks();
+    prof_elapsed_ticks = 0;
+
+    if (timer_add_tick_handler(prof_tick) != 0) {
+        return -1;
+    }
+    prof_running = true;
+
+    kprintf("Profiler: Sampling at %u Hz%s\n", TIMER_HZ / prof_divider,
+            callstacks ? " with call stacks" : "");
+    return 0;
+}
+
+void profiler_stop(void) {
+    if (!prof_running) {
+        return;
+    }
+    prof_running = false;
+    timer_remove_tick_handler(prof_tick);
+    prof_elapsed_ticks = timer_get_ticks() - prof_start_ticks;
+    kprintf("Profiler: Stopped after %llu ms\n", prof_elapsed_ticks * 1000 / TIMER_HZ);
+}
+
+bool profiler_is_running(void) {
+    return prof_running;
+}
+
+// --- Reporting ---
+
+static prof_hist_t *prof_hist_slot(long sym) {
+    uint64_t key = (uint64_t)(sym + 1);
+    uint32_t slot = (uint32_t)((key * 2654435761ULL) % PROF_HIST_SLOTS);
+    for (uint32_t probe = 0; probe < PROF_HIST_SLOTS; probe++) {
+        prof_hist_t *entry = &prof_hist[(slot + probe) % PROF_HIST_SLOTS];
+        if (entry->sym == (long)key) {
+            return entry;
+        }
+        if (entry->sym == 0) {
+            entry->sym = (long)key;
+            return entry;
+        }
+    }
+    return NULL; // Table full
+}
+
+static void prof_print_percent(uint64_t part, uint64_t whole) {
+    uint64_t basis_points = whole ? (part * 10000) / whole : 0;
+    kprintf("%3llu.%02llu%%", basis_points / 100, basis_points % 100);
+}
+
+void profiler_report(unsigned int top_n) {
+    if (prof_running) {
+        kprintf("Profiler: Still running, stop it first with 'prof stop'\n");
+        return;
+    }
+    if (top_n == 0) {
+        top_n = 20;
+    }
+
+    memset(prof_hist, 0, sizeof(prof_hist));
+
+    uint64_t total = 0, dropped = 0, unknown = 0, overflow = 0;
+    int cpus = 0;
+
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        prof_buffer_t *buf = &prof_buffers[cpu];
+        if (buf->count == 0 && buf->dropped == 0) {
+            continue;
+        }
+        cpus++;
+        dropped += buf->dropped;
+
+        for (uint32_t i = 0; i < buf->count; i++) {
+            prof_sample_t *sample = &buf->samples[i];
+            total++;
+
+            long self = ksym_index(sample->pc);
+            if (self < 0) {
+                unknown++;
+                continue;
+            }
+            prof_hist_t *entry = prof_hist_slot(self);
+            if (!entry) {
+                overflow++;
+                continue;
+            }
+            entry->self++;
+            entry->total++;
+
+            // Inclusive counts: each caller symbol once per sample
+            long seen[PROF_STACK_DEPTH + 1];
+            int nseen = 1;
+            seen[0] = self;
+            for (int d = 0; d < PROF_STACK_DEPTH && sample->callers[d]; d++) {
+                // Return addresses point past the call; look up the call itself
+                long sym = ksym_index(sample->callers[d] - 4);
+                bool dup = (sym < 0);
+                for (int s = 0; s < nseen && !dup; s++) {
+                    dup = (seen[s] == sym);
+                }
+                if (dup) {
+                    continue;
+                }
+                seen[nseen++] = sym;
+                prof_hist_t *caller = prof_hist_slot(sym);
+                if (caller) {
+                    caller->total++;
+                }
+            }
+        }
+    }
+
+    kprintf("Profile: %llu samples on %d CPU(s) over %llu ms at %u Hz (%llu dropped)\n",
+            total, cpus, prof_elapsed_ticks * 1000 / TIMER_HZ,
+            TIMER_HZ / prof_divider, dropped);
+    if (total == 0) {
+        return;
+    }
+    if (ksym_count() == 0) {
+        kprintf("Profile: No symbol table embedded, addresses cannot be resolved\n");
+    }
+
+    kprintf("   Self%%   Samples%s  Symbol\n", prof_callstacks ? "   Total%" : "");
+
+    // Selection of the top entries by self samples (top_n is small)
+    for (unsigned int rank = 0; rank < top_n; rank++) {
+        prof_hist_t *best = NULL;
+        for (int i = 0; i < PROF_HIST_SLOTS; i++) {
+            prof_hist_t *entry = &prof_hist[i];
+            if (entry->sym == 0 || entry->self == 0) {
+                continue;
+            }
+            if (!best || entry->self > best->self) {
+                best = entry;
+            }
+        }
+        if (!best) {
+            break;
+        }
+
+        const ksym_t *sym = ksym_get(best->sym - 1);
+        kprintf("  ");
+        prof_print_percent(best->self, total);
+        kprintf("  %8u", best->self);
+        if (prof_callstacks) {
+            kprintf("  ");
+            prof_print_percent(best->total, total);
+        }
+        kprintf("  %s\n", sym ? sym->name : "?");
+
+        best->self = 0; // Exclude from the next round
+    }
+
+    if (unknown) {
+        kprintf("  ");
+        prof_print_percent(unknown, total);
+        kprintf("  %8llu  [outside kernel text]\n", unknown);
+    }
+    if (overflow) {
+        kprintf("  (%llu samples not binned: histogram full)\n", overflow);
+    }
+}
@@ -0,0 +1,32 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "debug/stackwalk.h"
+#include "memory/frame_alloc.h"
+
+static bool stack_valid_frame(uint64_t fp) {
+    // AArch64 frame records are 16-byte aligned and live in kernel RAM
+    return fp != 0 && (fp & 0xF) == 0 &&
+           fp >= PMM_RAM_BASE &&
+           fp + 16 <= pmm_get_highest_usable_address();
+}
+
+int stack_walk(uint64_t fp, uint64_t *callers, int depth) {
+    int found = 0;
+    while (found < depth && stack_valid_frame(fp)) {
+        uint64_t *record = (uint64_t *)fp;   // { previous fp, return address }
+        uint64_t ret = record[1];
+        if (ret == 0) {
+            break;
+        }
+        callers[found++] = ret;
+        // Stacks grow down, so the caller's record must be higher up
+        if (record[0] <= fp) {
+            break;
+        }
+        fp = record[0];
+    }
+    for (int d = found; d < depth; d++) {
+        callers[d] = 0;
+    }
+    return found;
+}
@@ -0,0 +1,164 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "debug/trace.h"
+#include "drivers/timer.h"
+#include "arch/cpu.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+#define TRACE_FORMAT_VERSION    1
+
+// Hex dump lines are the record's bytes in memory order plus a newline
+#define TRACE_LINE_LEN          (2 * sizeof(trace_record_t) + 1)
+#define TRACE_DUMP_BUF_SIZE     4096
+
+typedef struct {
+    const char *name;
+    const char *arg0;
+    const char *arg1;
+} trace_event_info_t;
+
+static const trace_event_info_t trace_events[TRACE_NR_EVENTS] = {
+    [TRACE_EVENT_NONE] = { "none", "", "" },
+#define TRACE_EVENT_INFO(name, arg0, arg1) [TRACE_EVENT_##name] = { #name, #arg0, #arg1 },
+    TRACE_EVENTS(TRACE_EVENT_INFO)
+#undef TRACE_EVENT_INFO
+};
+
+// Records reserved so far in each CPU's ring, on its own cache line
+typedef struct {
+    volatile uint64_t head;
+} __attribute__((aligned(64))) trace_head_t;
+
+static trace_record_t trace_rings[MAX_CPUS][TRACE_RING_RECORDS];
+static trace_head_t trace_heads[MAX_CPUS];
+static char trace_dump_buf[TRACE_DUMP_BUF_SIZE];
+
+volatile uint32_t trace_enabled_mask = 0;
+
+// The slot is claimed atomically, so an interrupt or a thread that moved
+// to another CPU in between only takes the next one. A record becomes
+// valid when its event is stored, last.
+void trace_record(trace_event_t event, uint64_t arg0, uint64_t arg1) {
+    unsigned int cpu = cpu_id();
+    uint64_t seq = __atomic_fetch_add(&trace_heads[cpu].head, 1, __ATOMIC_RELAXED);
+    trace_record_t *rec = &trace_rings[cpu][seq % TRACE_RING_RECORDS];
+
+    __atomic_store_n(&rec->event, TRACE_EVENT_NONE, __ATOMIC_RELAXED);
+    rec->timestamp = read_sysreg(cntvct_el0);
+    rec->cpu = cpu;
+    rec->seq = (uint32_t)seq;
+    rec->arg0 = arg0;
+    rec->arg1 = arg1;
+    __atomic_store_n(&rec->event, (uint16_t)event, __ATOMIC_RELEASE);
+}
+
+bool trace_set_enabled(const char *name, bool enabled) {
+    uint32_t bits = 0;
+    if (strcmp(name, "all") == 0) {
+        bits = ((1U << TRACE_NR_EVENTS) - 1) & ~(1U << TRACE_EVENT_NONE);
+    } else {
+        for (unsigned int i = TRACE_EVENT_NONE + 1; i < TRACE_NR_EVENTS; i++) {
+            if (strcmp(name, trace_events[i].name) == 0) {
+                bits = 1U << i;
+                break;
+            }
+        }
+    }
+    if (!bits) {
+        return false;
+    }
+    if (enabled) {
+        __atomic_fetch_or(&trace_enabled_mask, bits, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_and(&trace_enabled_mask, ~bits, __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+// Stop new records; ones being written right now may still land
+static uint32_t trace_pause(void) {
+    return __atomic_exchange_n(&trace_enabled_mask, 0, __ATOMIC_ACQ_REL);
+}
+
+static void trace_resume(uint32_t mask) {
+    __atomic_store_n(&trace_enabled_mask, mask, __ATOMIC_RELEASE);
+}
+
+void trace_clear(void) {
+    uint32_t mask = trace_pause();
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        trace_heads[cpu].head = 0;
+    }
+    memset(trace_rings, 0, sizeof(trace_rings));
+    trace_resume(mask);
+}
+
+void trace_print_status(void) {
+    kprintf("Events:");
+    for (unsigned int i = TRACE_EVENT_NONE + 1; i < TRACE_NR_EVENTS; i++) {
+        kprintf(" %s%s", trace_events[i].name,
+                (trace_enabled_mask & (1U << i)) ? "(on)" : "");
+    }
+    kprintf("\n");
+    kprintf("CPU     records  overwritten\n");
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        uint64_t head = trace_heads[cpu].head;
+        uint64_t kept = head < TRACE_RING_RECORDS ? head : TRACE_RING_RECORDS;
+        kprintf("%3u %11llu %12llu\n", cpu, kept, head - kept);
+    }
+}
+
+// --- Dump ---
+
+static void trace_hex_record(char *out, const trace_record_t *rec) {
+    static const char digits[] = "0123456789abcdef";
+    const uint8_t *bytes = (const uint8_t *)rec;
+    for (size_t i = 0; i < sizeof(*rec); i++) {
+        *out++ = digits[bytes[i] >> 4];
+        *out++ = digits[bytes[i] & 0xf];
+    }
+    *out = '\n';
+}
+
+void trace_dump(void) {
+    uint32_t mask = trace_pause();
+
+    kprintf("# trace v%u freq %llu cpus %u ring %u\n", TRACE_FORMAT_VERSION,
+            timer_get_frequency(), MAX_CPUS, TRACE_RING_RECORDS);
+    for (unsigned int i = TRACE_EVENT_NONE + 1; i < TRACE_NR_EVENTS; i++) {
+        kprintf("# event %u %s %s %s\n", i, trace_events[i].name,
+                trace_events[i].arg0, trace_events[i].arg1);
+    }
+
+    // Whole lines go out in console-sized blocks
+    uint64_t dumped = 0;
+    uint64_t overwritten = 0;
+    size_t used = 0;
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        uint64_t head = trace_heads[cpu].head;
+        uint64_t first = head > TRACE_RING_RECORDS ? head - TRACE_RING_RECORDS : 0;
+        overwritten += first;
+        for (uint64_t seq = first; seq < head; seq++) {
+            const trace_record_t *rec = &trace_rings[cpu][seq % TRACE_RING_RECORDS];
+            if (__atomic_load_n(&rec->event, __ATOMIC_ACQUIRE) == TRACE_EVENT_NONE ||
+                rec->seq != (uint32_t)seq) {
+                continue;           // Was still being written
+            }
+            if (used + TRACE_LINE_LEN > sizeof(trace_dump_buf)) {
+                kwrite(trace_dump_buf, used);
+                used = 0;
+            }
+            trace_hex_record(trace_dump_buf + used, rec);
+            used += TRACE_LINE_LEN;
+            dumped++;
+        }
+    }
+    if (used) {
+        kwrite(trace_dump_buf, used);
+    }
+    kprintf("# end %llu records, %llu overwritten\n", dumped, overwritten);
+
+    trace_resume(mask);
+}
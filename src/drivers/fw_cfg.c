@@ -0,0 +1,140 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "drivers/fw_cfg.h"
+#include "arch/cpu.h"
+#include "sync/atomic.h"
+#include "lib/fdt.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+// FW_CFG_FILE_DIR entry, big-endian
+typedef struct {
+    uint32_t size;
+    uint16_t select;
+    uint16_t reserved;
+    char name[56];
+} fw_cfg_file_t;
+
+static uint64_t fw_cfg_base = 0;
+static bool fw_cfg_dma = false;
+
+// The device reads the descriptor from RAM; one request at a time
+static fw_cfg_dma_t dma_desc;
+
+static inline uint64_t cpu_to_be64(uint64_t v) {
+    return __builtin_bswap64(v);
+}
+
+static inline uint32_t cpu_to_be32(uint32_t v) {
+    return __builtin_bswap32(v);
+}
+
+static inline uint32_t be32_to_cpu(uint32_t v) {
+    return __builtin_bswap32(v);
+}
+
+static void fw_cfg_select(uint16_t select) {
+    *(volatile uint16_t *)(fw_cfg_base + FW_CFG_SELECTOR) = __builtin_bswap16(select);
+}
+
+// Read len bytes from the selected blob through the data register
+static void fw_cfg_read_pio(void *buf, uint32_t len) {
+    uint8_t *out = buf;
+    for (uint32_t i = 0; i < len; i++) {
+        out[i] = *(volatile uint8_t *)(fw_cfg_base + FW_CFG_DATA);
+    }
+}
+
+// Run one DMA request and wait for the device to finish it
+static bool fw_cfg_dma_transfer(uint16_t select, void *buf, uint32_t len, uint32_t op) {
+    dma_desc.control = cpu_to_be32(((uint32_t)select << 16) | FW_CFG_DMA_SELECT | op);
+    dma_desc.length = cpu_to_be32(len);
+    dma_desc.address = cpu_to_be64((uint64_t)buf);
+    __asm__ volatile("dsb sy" ::: "memory");
+
+    // The write to the low half starts the transfer
+    uint64_t desc = (uint64_t)&dma_desc;
+    *(volatile uint32_t *)(fw_cfg_base + FW_CFG_DMA) = cpu_to_be32((uint32_t)(desc >> 32));
+    *(volatile uint32_t *)(fw_cfg_base + FW_CFG_DMA + 4) = cpu_to_be32((uint32_t)desc);
+
+    // The device clears control when done, leaving only ERROR on failure
+    uint32_t control;
+    while ((control = be32_to_cpu(*(volatile uint32_t *)&dma_desc.control)) & ~FW_CFG_DMA_ERROR) {
+        cpu_relax();
+    }
+    __asm__ volatile("dsb sy" ::: "memory");
+    return control == 0;
+}
+
+void fw_cfg_init(void) {
+    uint64_t base = FW_CFG_MMIO_BASE;
+    fdt_node_t node = fdt_find_compatible(-1, "qemu,fw-cfg-mmio");
+    if (node >= 0) {
+        fdt_get_reg(node, 0, &base, NULL);
+    }
+
+    fw_cfg_base = base;
+    char signature[4];
+    fw_cfg_select(FW_CFG_SIGNATURE);
+    fw_cfg_read_pio(signature, sizeof(signature));
+    if (strncmp(signature, "QEMU", 4) != 0) {
+        fw_cfg_base = 0;
+        return;
+    }
+
+    uint32_t id;
+    fw_cfg_select(FW_CFG_ID);
+    fw_cfg_read_pio(&id, sizeof(id));     // Little-endian
+    fw_cfg_dma = (id & FW_CFG_ID_DMA) != 0;
+    kprintf("fw_cfg: At 0x%llx%s\n", base, fw_cfg_dma ? ", DMA" : "");
+}
+
+bool fw_cfg_present(void) {
+    return fw_cfg_base != 0;
+}
+
+bool fw_cfg_has_dma(void) {
+    return fw_cfg_dma;
+}
+
+bool fw_cfg_find_file(const char *name, uint16_t *select, uint32_t *size) {
+    if (!fw_cfg_base) {
+        return false;
+    }
+    // The directory is a count followed by the entries; read it through
+    // the data register, which keeps its position between reads
+    uint32_t count;
+    fw_cfg_select(FW_CFG_FILE_DIR);
+    fw_cfg_read_pio(&count, sizeof(count));
+    count = be32_to_cpu(count);
+    for (uint32_t i = 0; i < count; i++) {
+        fw_cfg_file_t file;
+        fw_cfg_read_pio(&file, sizeof(file));
+        if (strncmp(file.name, name, sizeof(file.name)) == 0) {
+            *select = __builtin_bswap16(file.select);
+            *size = be32_to_cpu(file.size);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool fw_cfg_read(uint16_t select, void *buf, uint32_t len) {
+    if (!fw_cfg_base) {
+        return false;
+    }
+    if (fw_cfg_dma) {
+        return fw_cfg_dma_transfer(select, buf, len, FW_CFG_DMA_READ);
+    }
+    fw_cfg_select(select);
+    fw_cfg_read_pio(buf, len);
+    return true;
+}
+
+bool fw_cfg_write(uint16_t select, const void *buf, uint32_t len) {
+    if (!fw_cfg_base || !fw_cfg_dma) {
+        return false;
+    }
+    return fw_cfg_dma_transfer(select, (void *)buf, len, FW_CFG_DMA_WRITE);
+}
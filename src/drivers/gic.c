@@ -0,0 +1,164 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "drivers/gic.h"
+#include "arch/cpu.h"
+#include "lib/stdio.h"
+#include "debug/trace.h"
+
+// Distributor registers
+#define GICD_CTLR       ((volatile uint32_t*)(GICD_BASE + 0x000))
+#define GICD_TYPER      ((volatile uint32_t*)(GICD_BASE + 0x004))
+#define GICD_ISENABLER  ((volatile uint32_t*)(GICD_BASE + 0x100))
+#define GICD_ICENABLER  ((volatile uint32_t*)(GICD_BASE + 0x180))
+#define GICD_ICPENDR    ((volatile uint32_t*)(GICD_BASE + 0x280))
+#define GICD_IPRIORITYR ((volatile uint8_t*)(GICD_BASE + 0x400))
+#define GICD_ITARGETSR  ((volatile uint8_t*)(GICD_BASE + 0x800))
+#define GICD_ICFGR      ((volatile uint32_t*)(GICD_BASE + 0xC00))
+#define GICD_SGIR       ((volatile uint32_t*)(GICD_BASE + 0xF00))
+
+// CPU interface registers
+#define GICC_CTLR       ((volatile uint32_t*)(GICC_BASE + 0x000))
+#define GICC_PMR        ((volatile uint32_t*)(GICC_BASE + 0x004))
+#define GICC_BPR        ((volatile uint32_t*)(GICC_BASE + 0x008))
+#define GICC_IAR        ((volatile uint32_t*)(GICC_BASE + 0x00C))
+#define GICC_EOIR       ((volatile uint32_t*)(GICC_BASE + 0x010))
+
+// Control register bits (no security extensions: group 0 and group 1)
+#define GIC_CTLR_ENABLE_GRP0 0x1
+#define GIC_CTLR_ENABLE_GRP1 0x2
+
+#define GIC_DEFAULT_PRIORITY 0xA0
+
+typedef struct {
+    irq_handler_t handler;
+    void *data;
+} irq_entry_t;
+
+static irq_entry_t irq_table[GIC_MAX_IRQS];
+static uint64_t irq_counts[GIC_MAX_IRQS];
+static unsigned int gic_num_irqs = 0;
+
+void gic_init(void) {
+    // Disable the distributor while configuring
+    *GICD_CTLR = 0;
+
+    // ITLinesNumber encodes the number of implemented IDs in units of 32
+    gic_num_irqs = ((*GICD_TYPER & 0x1F) + 1) * 32;
+    if (gic_num_irqs > GIC_MAX_IRQS) {
+        gic_num_irqs = GIC_MAX_IRQS;
+    }
+    kprintf("GIC: Distributor supports %u interrupt IDs\n", gic_num_irqs);
+
+    // Disable and clear all shared interrupts, route them to CPU 0
+    for (unsigned int i = GIC_SPI_BASE; i < gic_num_irqs; i += 32) {
+        GICD_ICENABLER[i / 32] = 0xFFFFFFFF;
+        GICD_ICPENDR[i / 32] = 0xFFFFFFFF;
+    }
+    for (unsigned int i = GIC_SPI_BASE; i < gic_num_irqs; i++) {
+        GICD_IPRIORITYR[i] = GIC_DEFAULT_PRIORITY;
+        GICD_ITARGETSR[i] = 0x01;
+    }
+
+    *GICD_CTLR = GIC_CTLR_ENABLE_GRP0 | GIC_CTLR_ENABLE_GRP1;
+
+    gic_cpu_init();
+}
+
+void gic_cpu_init(void) {
+    // SGIs and PPIs are banked per CPU: disable them and set priorities
+    GICD_ICENABLER[0] = 0xFFFFFFFF;
+    GICD_ICPENDR[0] = 0xFFFFFFFF;
+    for (unsigned int i = 0; i < GIC_SPI_BASE; i++) {
+        GICD_IPRIORITYR[i] = GIC_DEFAULT_PRIORITY;
+    }
+
+    // Accept every priority, no preemption grouping
+    *GICC_PMR = 0xFF;
+    *GICC_BPR = 0;
+    *GICC_CTLR = GIC_CTLR_ENABLE_GRP0 | GIC_CTLR_ENABLE_GRP1;
+}
+
+uint8_t gic_cpu_target_mask(void) {
+    // ITARGETSR0-7 are banked and read as the calling CPU's interface bit
+    for (unsigned int i = 0; i < 8; i++) {
+        uint8_t mask = GICD_ITARGETSR[i];
+        if (mask) {
+            return mask;
+        }
+    }
+    return 1U << cpu_id();
+}
+
+int irq_register(unsigned int irq, irq_handler_t handler, void *data) {
+    if (irq >= GIC_MAX_IRQS || (gic_num_irqs && irq >= gic_num_irqs)) {
+        kprintf("GIC: Cannot register handler for invalid IRQ %u\n", irq);
+        return -1;
+    }
+    if (irq_table[irq].handler && irq_table[irq].handler != handler) {
+        kprintf("GIC: IRQ %u already has a handler\n", irq);
+        return -1;
+    }
+
+    irq_table[irq].data = data;
+    irq_table[irq].handler = handler;
+    gic_enable_irq(irq);
+    return 0;
+}
+
+void gic_enable_irq(unsigned int irq) {
+    GICD_ISENABLER[irq / 32] = 1U << (irq % 32);
+}
+
+void gic_disable_irq(unsigned int irq) {
+    GICD_ICENABLER[irq / 32] = 1U << (irq % 32);
+}
+
+void gic_set_priority(unsigned int irq, uint8_t priority) {
+    GICD_IPRIORITYR[irq] = priority;
+}
+
+void gic_set_edge_triggered(unsigned int irq, bool edge) {
+    // Two configuration bits per interrupt; bit 1 of each pair selects edge
+    uint32_t shift = (irq % 16) * 2 + 1;
+    uint32_t cfg = GICD_ICFGR[irq / 16];
+    if (edge) {
+        cfg |= (1U << shift);
+    } else {
+        cfg &= ~(1U << shift);
+    }
+    GICD_ICFGR[irq / 16] = cfg;
+}
+
+void gic_send_sgi(unsigned int sgi, uint8_t target_mask) {
+    // Make prior memory writes visible before the target takes the interrupt
+    dsb(ishst);
+    *GICD_SGIR = ((uint32_t)target_mask << 16) | (sgi & 0xF);
+}
+
+void gic_handle_irq(saved_registers_t *context) {
+    while (1) {
+        uint32_t iar = *GICC_IAR;
+        unsigned int irq = iar & 0x3FF;
+
+        if (irq >= 1020) {
+            break; // Spurious: nothing (more) pending
+        }
+
+        irq_counts[irq]++;
+        TRACE(irq, irq, context->elr_el1);
+        if (irq_table[irq].handler) {
+            irq_table[irq].handler(irq, context, irq_table[irq].data);
+        } else {
+            kprintf("GIC: Unhandled IRQ %u on CPU %u, disabling it\n", irq, cpu_id());
+            gic_disable_irq(irq);
+        }
+
+        // EOIR takes the full IAR value (including the SGI source CPU)
+        *GICC_EOIR = iar;
+    }
+}
+
+uint64_t gic_get_irq_count(unsigned int irq) {
+    return (irq < GIC_MAX_IRQS) ? irq_counts[irq] : 0;
+}
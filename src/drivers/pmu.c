@@ -0,0 +1,269 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "drivers/pmu.h"
+#include "drivers/timer.h"
+#include "arch/cpu.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+// PMCR_EL0 bits
+#define PMCR_E          (1 << 0)    // Enable all counters
+#define PMCR_P          (1 << 1)    // Reset event counters
+#define PMCR_LC         (1 << 6)    // 64-bit cycle counter overflow
+#define PMCR_N_SHIFT    11
+#define PMCR_N_MASK     0x1F
+
+#define PMU_CYCLE_COUNTER_BIT (1U << 31)
+
+// ID_AA64DFR0_EL1.PMUVer
+#define PMUVER_SHIFT    8
+#define PMUVER_MASK     0xF
+#define PMUVER_NONE     0x0
+#define PMUVER_IMPDEF   0xF
+
+typedef struct {
+    uint16_t event;
+    const char *name;
+} pmu_event_desc_t;
+
+static const pmu_event_desc_t pmu_event_names[] = {
+    { PMU_EVENT_SW_INCR,          "sw-incr" },
+    { PMU_EVENT_L1I_CACHE_REFILL, "l1i-refill" },
+    { PMU_EVENT_L1I_TLB_REFILL,   "l1i-tlb-refill" },
+    { PMU_EVENT_L1D_CACHE_REFILL, "l1d-refill" },
+    { PMU_EVENT_L1D_CACHE,        "l1d-access" },
+    { PMU_EVENT_L1D_TLB_REFILL,   "l1d-tlb-refill" },
+    { PMU_EVENT_INST_RETIRED,     "instructions" },
+    { PMU_EVENT_BR_MIS_PRED,      "branch-misses" },
+    { PMU_EVENT_CPU_CYCLES,       "cycles" },
+    { PMU_EVENT_MEM_ACCESS,       "mem-access" },
+    { PMU_EVENT_L2D_CACHE_REFILL, "l2d-refill" },
+    { PMU_EVENT_L2D_TLB_REFILL,   "l2d-tlb-refill" },
+};
+
+#define PMU_NUM_EVENT_NAMES (sizeof(pmu_event_names) / sizeof(pmu_event_names[0]))
+
+static bool pmu_present = false;
+static unsigned int pmu_counters = 0;
+static uint64_t pmu_ceid = 0;         // PMCEID1:PMCEID0, events 0-63
+
+// Active session state, touched by the owning CPU only
+static pmu_session_t *volatile active_session = NULL;
+static int group_first = 0;           // First event index of the scheduled group
+static int group_size = 0;
+static uint64_t group_start_cycles = 0;
+
+// --- Counter access ---
+
+static void pmu_select(unsigned int counter) {
+    write_sysreg(pmselr_el0, counter);
+    isb();
+}
+
+static void pmu_write_type(unsigned int counter, uint16_t event) {
+    pmu_select(counter);
+    write_sysreg(pmxevtyper_el0, event); // Count at EL0 and EL1
+}
+
+static uint64_t pmu_read_counter(unsigned int counter) {
+    pmu_select(counter);
+    return read_sysreg(pmxevcntr_el0) & 0xFFFFFFFF;
+}
+
+static void pmu_write_counter(unsigned int counter, uint64_t value) {
+    pmu_select(counter);
+    write_sysreg(pmxevcntr_el0, value);
+}
+
+// --- Setup ---
+
+void pmu_cpu_init(void) {
+    if (!pmu_present) {
+        return;
+    }
+    // Event counters off, no overflow interrupts, cycle counter free-running
+    write_sysreg(pmcntenclr_el0, ~PMU_CYCLE_COUNTER_BIT & 0xFFFFFFFF);
+    write_sysreg(pmintenclr_el1, 0xFFFFFFFF);
+    write_sysreg(pmovsclr_el0, 0xFFFFFFFF);
+    write_sysreg(pmccfiltr_el0, 0);  // Count cycles at EL0 and EL1
+    write_sysreg(pmcr_el0, PMCR_E | PMCR_LC);
+    write_sysreg(pmcntenset_el0, PMU_CYCLE_COUNTER_BIT);
+    isb();
+}
+
+bool pmu_init(void) {
+    uint64_t pmuver = (read_sysreg(id_aa64dfr0_el1) >> PMUVER_SHIFT) & PMUVER_MASK;
+    if (pmuver == PMUVER_NONE || pmuver == PMUVER_IMPDEF) {
+        kprintf("PMU: No architectural PMU (PMUVer 0x%llx)\n", pmuver);
+        return false;
+    }
+
+    pmu_present = true;
+    pmu_counters = (read_sysreg(pmcr_el0) >> PMCR_N_SHIFT) & PMCR_N_MASK;
+    pmu_ceid = (read_sysreg(pmceid0_el0) & 0xFFFFFFFF) |
+               (read_sysreg(pmceid1_el0) << 32);
+
+    pmu_cpu_init();
+
+    kprintf("PMU: PMUv3 (PMUVer 0x%llx), %u event counters, events 0x%016llx\n",
+            pmuver, pmu_counters, pmu_ceid);
+    return true;
+}
+
+bool pmu_available(void) {
+    return pmu_present;
+}
+
+unsigned int pmu_num_counters(void) {
+    return pmu_counters;
+}
+
+bool pmu_event_supported(uint16_t event) {
+    if (!pmu_present) {
+        return false;
+    }
+    if (event >= 64) {
+        return true; // Not described by PMCEID; let the hardware decide
+    }
+    return (pmu_ceid & (1ULL << event)) != 0;
+}
+
+const char *pmu_event_name(uint16_t event) {
+    for (size_t i = 0; i < PMU_NUM_EVENT_NAMES; i++) {
+        if (pmu_event_names[i].event == event) {
+            return pmu_event_names[i].name;
+        }
+    }
+    return NULL;
+}
+
+int pmu_event_by_name(const char *name) {
+    for (size_t i = 0; i < PMU_NUM_EVENT_NAMES; i++) {
+        if (strcmp(pmu_event_names[i].name, name) == 0) {
+            return pmu_event_names[i].event;
+        }
+    }
+    return -1;
+}
+
+// --- Multiplexing ---
+
+// Program the next group of events starting at index first
+static void pmu_schedule_group(pmu_session_t *session, int first) {
+    group_first = first;
+    group_size = session->num_events;
+    if (group_size > (int)pmu_counters) {
+        group_size = (int)pmu_counters;
+    }
+
+    uint32_t enable_mask = 0;
+    for (int i = 0; i < group_size; i++) {
+        int idx = (first + i) % session->num_events;
+        pmu_write_type(i, session->events[idx]);
+        pmu_write_counter(i, 0);
+        enable_mask |= 1U << i;
+    }
+    group_start_cycles = pmu_read_cycles();
+    write_sysreg(pmcntenset_el0, enable_mask);
+    isb();
+}
+
+// Stop the scheduled group and fold its counts into the session
+static void pmu_collect_group(pmu_session_t *session) {
+    write_sysreg(pmcntenclr_el0, ~PMU_CYCLE_COUNTER_BIT & 0xFFFFFFFF);
+    isb();
+
+    uint64_t elapsed = pmu_read_cycles() - group_start_cycles;
+    for (int i = 0; i < group_size; i++) {
+        int idx = (group_first + i) % session->num_events;
+        session->counts[idx] += pmu_read_counter(i);
+        session->enabled[idx] += elapsed;
+    }
+}
+
+// Tick callback: drain the 32-bit counters before they can wrap and rotate
+// to the next group of events
+static void pmu_tick(saved_registers_t *context) {
+    (void)context;
+    pmu_session_t *session = active_session;
+    if (!session || cpu_id() != session->cpu) {
+        return;
+    }
+    pmu_collect_group(session);
+    int next = group_first;
+    if (session->num_events > (int)pmu_counters) {
+        next = (group_first + group_size) % session->num_events;
+    }
+    pmu_schedule_group(session, next);
+}
+
+// --- Sessions ---
+
+int pmu_session_add_event(pmu_session_t *session, uint16_t event) {
+    if (session->num_events >= PMU_MAX_EVENTS) {
+        return -1;
+    }
+    session->events[session->num_events++] = event;
+    return 0;
+}
+
+int pmu_session_start(pmu_session_t *session) {
+    if (!pmu_present || pmu_counters == 0) {
+        return -1;
+    }
+    if (active_session) {
+        kprintf("PMU: A counting session is already active\n");
+        return -1;
+    }
+
+    for (int i = 0; i < session->num_events; i++) {
+        session->counts[i] = 0;
+        session->enabled[i] = 0;
+    }
+    session->cpu = cpu_id();
+
+    uint64_t flags = local_irq_save();
+    if (session->num_events > 0) {
+        pmu_schedule_group(session, 0);
+    }
+    active_session = session;
+    timer_add_tick_handler(pmu_tick);
+    session->start_cycles = pmu_read_cycles();
+    local_irq_restore(flags);
+    return 0;
+}
+
+void pmu_session_stop(pmu_session_t *session) {
+    uint64_t end = pmu_read_cycles();
+
+    uint64_t flags = local_irq_save();
+    if (active_session == session) {
+        if (session->num_events > 0) {
+            pmu_collect_group(session);
+        }
+        active_session = NULL;
+        timer_remove_tick_handler(pmu_tick);
+    }
+    local_irq_restore(flags);
+
+    session->cycles = end - session->start_cycles;
+}
+
+uint64_t pmu_session_value(const pmu_session_t *session, int i, bool *scaled) {
+    uint64_t count = session->counts[i];
+    uint64_t enabled = session->enabled[i];
+    if (scaled) {
+        *scaled = (enabled < session->cycles);
+    }
+    if (enabled == 0) {
+        return 0;
+    }
+    if (enabled >= session->cycles) {
+        return count;
+    }
+    // Extrapolate from the fraction of the session the event was counted,
+    // using a 16.16 fixed-point ratio
+    uint64_t ratio = (session->cycles << 16) / enabled;
+    return (count * ratio) >> 16;
+}
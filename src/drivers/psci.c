@@ -0,0 +1,71 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "drivers/psci.h"
+#include "lib/fdt.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+static bool psci_use_smc = false;
+static bool psci_present = false;
+
+// SMC Calling Convention: arguments in x0-x3, result in x0, x4-x17 clobbered
+static int64_t psci_call(uint64_t fn, uint64_t a1, uint64_t a2, uint64_t a3) {
+    register uint64_t x0 asm("x0") = fn;
+    register uint64_t x1 asm("x1") = a1;
+    register uint64_t x2 asm("x2") = a2;
+    register uint64_t x3 asm("x3") = a3;
+
+    if (psci_use_smc) {
+        asm volatile("smc #0"
+                     : "+r" (x0), "+r" (x1), "+r" (x2), "+r" (x3)
+                     :
+                     : "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11",
+                       "x12", "x13", "x14", "x15", "x16", "x17", "memory");
+    } else {
+        asm volatile("hvc #0"
+                     : "+r" (x0), "+r" (x1), "+r" (x2), "+r" (x3)
+                     :
+                     : "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11",
+                       "x12", "x13", "x14", "x15", "x16", "x17", "memory");
+    }
+    return (int64_t)x0;
+}
+
+bool psci_init(void) {
+    fdt_node_t node = fdt_find_node("/psci");
+    const char *method = fdt_get_string(node, "method");
+    if (!method) {
+        kprintf("PSCI: No /psci node in the device tree\n");
+        return false;
+    }
+    if (strcmp(method, "smc") == 0) {
+        psci_use_smc = true;
+    } else if (strcmp(method, "hvc") != 0) {
+        kprintf("PSCI: Unknown conduit '%s'\n", method);
+        return false;
+    }
+    psci_present = true;
+
+    uint32_t version = (uint32_t)psci_call(PSCI_FN_VERSION, 0, 0, 0);
+    kprintf("PSCI: Version %u.%u via %s\n", version >> 16, version & 0xFFFF, method);
+    return true;
+}
+
+int psci_cpu_on(uint64_t mpidr, uint64_t entry, uint64_t context_id) {
+    if (!psci_present) {
+        return PSCI_NOT_SUPPORTED;
+    }
+    return (int)psci_call(PSCI_FN64_CPU_ON, mpidr, entry, context_id);
+}
+
+void psci_system_off(void) {
+    if (psci_present) {
+        psci_call(PSCI_FN_SYSTEM_OFF, 0, 0, 0);
+    }
+}
+
+void psci_system_reset(void) {
+    if (psci_present) {
+        psci_call(PSCI_FN_SYSTEM_RESET, 0, 0, 0);
+    }
+}
@@ -0,0 +1,59 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "drivers/ramfb.h"
+#include "drivers/fw_cfg.h"
+#include "memory/frame_alloc.h"
+#include "lib/stdio.h"
+
+// The etc/ramfb mode, all fields big-endian
+typedef struct {
+    uint64_t addr;
+    uint32_t fourcc;
+    uint32_t flags;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+} __attribute__((packed)) ramfb_cfg_t;
+
+// DMA source, so it must not live on a (possibly vmalloc'd) stack
+static ramfb_cfg_t ramfb_cfg;
+
+bool ramfb_init(uint32_t width, uint32_t height, framebuffer_t *fb) {
+    uint16_t select;
+    uint32_t size;
+    if (!fw_cfg_find_file(RAMFB_FILE, &select, &size)) {
+        return false;
+    }
+    if (!fw_cfg_has_dma() || size != sizeof(ramfb_cfg)) {
+        kprintf("ramfb: Needs fw_cfg DMA\n");
+        return false;
+    }
+
+    uint32_t stride = width * RAMFB_BPP;
+    size_t frames = ((size_t)stride * height + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t *pixels = alloc_frames(frames);      // Zeroed: starts black
+    if (!pixels) {
+        kprintf("ramfb: No memory for a %ux%u framebuffer\n", width, height);
+        return false;
+    }
+
+    ramfb_cfg.addr = __builtin_bswap64((uint64_t)pixels);
+    ramfb_cfg.fourcc = __builtin_bswap32(RAMFB_FORMAT_XRGB8888);
+    ramfb_cfg.flags = 0;
+    ramfb_cfg.width = __builtin_bswap32(width);
+    ramfb_cfg.height = __builtin_bswap32(height);
+    ramfb_cfg.stride = __builtin_bswap32(stride);
+    if (!fw_cfg_write(select, &ramfb_cfg, sizeof(ramfb_cfg))) {
+        kprintf("ramfb: fw_cfg write failed\n");
+        free_frames(pixels, frames);
+        return false;
+    }
+
+    fb->pixels = pixels;
+    fb->width = width;
+    fb->height = height;
+    fb->stride = stride;
+    kprintf("ramfb: %ux%u at 0x%llx\n", width, height, (uint64_t)pixels);
+    return true;
+}
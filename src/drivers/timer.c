@@ -0,0 +1,113 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "drivers/timer.h"
+#include "drivers/gic.h"
+#include "arch/cpu.h"
+#include "lib/stdio.h"
+
+// CNTV_CTL_EL0 bits
+#define CNTV_CTL_ENABLE  0x1
+#define CNTV_CTL_IMASK   0x2
+
+static uint64_t timer_frequency = 0;
+static uint64_t timer_interval = 0;   // Counter ticks per kernel tick
+static volatile uint64_t tick_count = 0;
+
+static tick_handler_t tick_handlers[TIMER_MAX_TICK_HANDLERS];
+
+uint64_t timer_read_counter(void) {
+    // Prevent the counter read from being speculated ahead of earlier code
+    isb();
+    return read_sysreg(cntvct_el0);
+}
+
+uint64_t timer_get_frequency(void) {
+    if (timer_frequency == 0) {
+        timer_frequency = read_sysreg(cntfrq_el0);
+    }
+    return timer_frequency;
+}
+
+uint64_t timer_counter_to_us(uint64_t counts) {
+    uint64_t freq = timer_get_frequency();
+    if (freq == 0) return 0;
+    // Split to avoid overflowing counts * 1000000
+    return (counts / freq) * 1000000ULL + ((counts % freq) * 1000000ULL) / freq;
+}
+
+uint64_t timer_us_to_counter(uint64_t us) {
+    uint64_t freq = timer_get_frequency();
+    return (us / 1000000ULL) * freq + ((us % 1000000ULL) * freq) / 1000000ULL;
+}
+
+// Tick interrupt: re-arm relative to the previous deadline so the tick
+// does not drift, then run the registered callbacks
+static void timer_irq_handler(unsigned int irq, saved_registers_t *context, void *data) {
+    (void)irq;
+    (void)data;
+    uint64_t next = read_sysreg(cntv_cval_el0) + timer_interval;
+    uint64_t now = read_sysreg(cntvct_el0);
+    if (next <= now) {
+        // We fell behind (e.g. IRQs were masked for a long time)
+        next = now + timer_interval;
+    }
+    write_sysreg(cntv_cval_el0, next);
+
+    if (cpu_id() == 0) {
+        tick_count++;
+    }
+
+    for (int i = 0; i < TIMER_MAX_TICK_HANDLERS; i++) {
+        tick_handler_t handler = tick_handlers[i];
+        if (handler) {
+            handler(context);
+        }
+    }
+}
+
+void timer_cpu_init(void) {
+    write_sysreg(cntv_cval_el0, read_sysreg(cntvct_el0) + timer_interval);
+    write_sysreg(cntv_ctl_el0, CNTV_CTL_ENABLE);
+    isb();
+    gic_enable_irq(TIMER_IRQ);
+}
+
+void timer_init(void) {
+    timer_get_frequency();
+    timer_interval = timer_frequency / TIMER_HZ;
+
+    kprintf("Timer: Counter frequency %llu Hz, tick %u Hz (%llu counts)\n",
+            timer_frequency, TIMER_HZ, timer_interval);
+
+    irq_register(TIMER_IRQ, timer_irq_handler, NULL);
+    timer_cpu_init();
+}
+
+int timer_add_tick_handler(tick_handler_t handler) {
+    for (int i = 0; i < TIMER_MAX_TICK_HANDLERS; i++) {
+        if (tick_handlers[i] == handler) {
+            return 0; // Already registered
+        }
+    }
+    for (int i = 0; i < TIMER_MAX_TICK_HANDLERS; i++) {
+        if (tick_handlers[i] == NULL) {
+            tick_handlers[i] = handler;
+            return 0;
+        }
+    }
+    kprintf("Timer: No free tick handler slot\n");
+    return -1;
+}
+
+void timer_remove_tick_handler(tick_handler_t handler) {
+    for (int i = 0; i < TIMER_MAX_TICK_HANDLERS; i++) {
+        if (tick_handlers[i] == handler) {
+            tick_handlers[i] = NULL;
+        }
+    }
+}
+
+uint64_t timer_get_ticks(void) {
+    return tick_count;
+}
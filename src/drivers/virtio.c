@@ -0,0 +1,371 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "drivers/virtio.h"
+#include "drivers/gic.h"
+#include "memory/frame_alloc.h"
+#include "memory/kheap.h"
+#include "arch/cpu.h"
+#include "sync/atomic.h"
+#include "lib/fdt.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+static virtio_dev_t devices[VIRTIO_MAX_DEVICES];
+static unsigned int num_devices = 0;
+
+static inline uint32_t virtio_read(virtio_dev_t *dev, unsigned int reg) {
+    return *(volatile uint32_t *)(dev->base + reg);
+}
+
+static inline void virtio_write(virtio_dev_t *dev, unsigned int reg, uint32_t value) {
+    *(volatile uint32_t *)(dev->base + reg) = value;
+}
+
+// --- Discovery ---
+
+// Record the transport at base if a device sits behind it
+static void virtio_probe(uint64_t base, unsigned int irq) {
+    if (num_devices == VIRTIO_MAX_DEVICES) {
+        return;
+    }
+    virtio_dev_t *dev = &devices[num_devices];
+    dev->base = base;
+    if (virtio_read(dev, VIRTIO_MMIO_MAGIC_VALUE) != VIRTIO_MMIO_MAGIC) {
+        return;
+    }
+    dev->version = virtio_read(dev, VIRTIO_MMIO_VERSION);
+    dev->device_id = virtio_read(dev, VIRTIO_MMIO_DEVICE_ID);
+    if (dev->device_id == 0 || (dev->version != 1 && dev->version != 2)) {
+        return;             // Empty slot, or a layout we do not know
+    }
+    dev->vendor_id = virtio_read(dev, VIRTIO_MMIO_VENDOR_ID);
+    dev->irq = irq;
+    dev->features = 0;
+    dev->claimed = false;
+    num_devices++;
+}
+
+void virtio_init(void) {
+    // QEMU lists the transports highest address first; probing in the
+    // order found is fine, as drivers only ask for a device type
+    fdt_node_t node = fdt_find_compatible(-1, "virtio,mmio");
+    bool from_fdt = node >= 0;
+    for (; node >= 0; node = fdt_find_compatible(node, "virtio,mmio")) {
+        uint64_t base, size;
+        uint32_t len;
+        const uint32_t *irqs = fdt_get_prop(node, "interrupts", &len);
+        if (!fdt_get_reg(node, 0, &base, &size) || !irqs || len < 3 * sizeof(uint32_t)) {
+            continue;
+        }
+        // <type number flags>, type 0 being an SPI
+        unsigned int irq = fdt32_to_cpu(irqs[1]) + (fdt32_to_cpu(irqs[0]) == 0 ? GIC_SPI_BASE : GIC_PPI_BASE);
+        virtio_probe(base, irq);
+    }
+    if (!from_fdt) {
+        for (unsigned int i = 0; i < VIRTIO_MMIO_SLOTS; i++) {
+            virtio_probe(VIRTIO_MMIO_BASE + i * VIRTIO_MMIO_STRIDE, VIRTIO_MMIO_IRQ_BASE + i);
+        }
+    }
+
+    kprintf("virtio: %u device%s\n", num_devices, num_devices == 1 ? "" : "s");
+}
+
+virtio_dev_t *virtio_claim(uint32_t device_id) {
+    for (unsigned int i = 0; i < num_devices; i++) {
+        if (devices[i].device_id == device_id && !devices[i].claimed) {
+            devices[i].claimed = true;
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+// --- Initialization ---
+
+static void virtio_set_status(virtio_dev_t *dev, uint32_t bits) {
+    virtio_write(dev, VIRTIO_MMIO_STATUS, virtio_read(dev, VIRTIO_MMIO_STATUS) | bits);
+}
+
+void virtio_fail(virtio_dev_t *dev) {
+    virtio_set_status(dev, VIRTIO_STATUS_FAILED);
+}
+
+bool virtio_negotiate(virtio_dev_t *dev, uint64_t wanted) {
+    virtio_write(dev, VIRTIO_MMIO_STATUS, 0);
+    while (virtio_read(dev, VIRTIO_MMIO_STATUS) != 0) {
+        cpu_relax();
+    }
+    virtio_set_status(dev, VIRTIO_STATUS_ACKNOWLEDGE);
+    virtio_set_status(dev, VIRTIO_STATUS_DRIVER);
+
+    virtio_write(dev, VIRTIO_MMIO_DEVICE_FEATURES_SEL, 0);
+    uint64_t offered = virtio_read(dev, VIRTIO_MMIO_DEVICE_FEATURES);
+    if (dev->version == 2) {
+        virtio_write(dev, VIRTIO_MMIO_DEVICE_FEATURES_SEL, 1);
+        offered |= (uint64_t)virtio_read(dev, VIRTIO_MMIO_DEVICE_FEATURES) << 32;
+        if (!(offered & VIRTIO_FEATURE(VIRTIO_F_VERSION_1))) {
+            virtio_fail(dev);
+            return false;
+        }
+        wanted |= VIRTIO_FEATURE(VIRTIO_F_VERSION_1);
+    }
+
+    dev->features = offered & wanted;
+    virtio_write(dev, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 0);
+    virtio_write(dev, VIRTIO_MMIO_DRIVER_FEATURES, (uint32_t)dev->features);
+    virtio_write(dev, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 1);
+    virtio_write(dev, VIRTIO_MMIO_DRIVER_FEATURES, (uint32_t)(dev->features >> 32));
+
+    if (dev->version == 1) {
+        // Legacy queues are given as page frame numbers
+        virtio_write(dev, VIRTIO_MMIO_GUEST_PAGE_SIZE, PAGE_SIZE);
+        return true;
+    }
+    virtio_set_status(dev, VIRTIO_STATUS_FEATURES_OK);
+    if (!(virtio_read(dev, VIRTIO_MMIO_STATUS) & VIRTIO_STATUS_FEATURES_OK)) {
+        virtio_fail(dev);
+        return false;
+    }
+    return true;
+}
+
+void virtio_driver_ok(virtio_dev_t *dev) {
+    virtio_set_status(dev, VIRTIO_STATUS_DRIVER_OK);
+}
+
+uint32_t virtio_ack_irq(virtio_dev_t *dev) {
+    uint32_t status = virtio_read(dev, VIRTIO_MMIO_INTERRUPT_STATUS);
+    if (status) {
+        virtio_write(dev, VIRTIO_MMIO_INTERRUPT_ACK, status);
+    }
+    return status;
+}
+
+uint32_t virtio_config_read32(virtio_dev_t *dev, unsigned int offset) {
+    return virtio_read(dev, VIRTIO_MMIO_CONFIG + offset);
+}
+
+uint64_t virtio_config_read64(virtio_dev_t *dev, unsigned int offset) {
+    // Two 32-bit halves; the generation counter is not worth checking
+    // for fields that never change at run time
+    return virtio_config_read32(dev, offset) |
+           ((uint64_t)virtio_config_read32(dev, offset + 4) << 32);
+}
+
+// --- Virtqueues ---
+
+virtqueue_t *virtqueue_create(virtio_dev_t *dev, unsigned int index, unsigned int max_size) {
+    virtio_write(dev, VIRTIO_MMIO_QUEUE_SEL, index);
+    unsigned int offered = virtio_read(dev, VIRTIO_MMIO_QUEUE_NUM_MAX);
+    bool in_use = dev->version == 1 ? virtio_read(dev, VIRTIO_MMIO_QUEUE_PFN) != 0
+                                    : virtio_read(dev, VIRTIO_MMIO_QUEUE_READY) != 0;
+    if (offered == 0 || in_use) {
+        return NULL;
+    }
+
+    unsigned int size = offered;
+    if (size > max_size) size = max_size;
+    if (size > VIRTQ_MAX_SIZE) size = VIRTQ_MAX_SIZE;
+    while (size & (size - 1)) {
+        size &= size - 1;   // Round down to a power of two
+    }
+
+    // Descriptors, then the available ring, then the used ring on the
+    // next page boundary
+    uint64_t avail_offset = size * sizeof(virtq_desc_t);
+    uint64_t used_offset = avail_offset + sizeof(virtq_avail_t) + (size + 1) * sizeof(uint16_t);
+    used_offset = (used_offset + VIRTQ_LEGACY_ALIGN - 1) & ~(uint64_t)(VIRTQ_LEGACY_ALIGN - 1);
+    uint64_t bytes = used_offset + sizeof(virtq_used_t) + size * sizeof(virtq_used_elem_t) +
+                     sizeof(uint16_t);
+    unsigned int frames = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    virtqueue_t *vq = kmalloc(sizeof(virtqueue_t));
+    void *ring = alloc_frames(frames);
+    void **cookies = kmalloc(size * sizeof(void *));
+    if (!vq || !ring || !cookies) {
+        kfree(vq);
+        kfree(cookies);
+        if (ring) {
+            free_frames(ring, frames);
+        }
+        return NULL;
+    }
+    memset(vq, 0, sizeof(virtqueue_t));
+    memset(ring, 0, frames * PAGE_SIZE);
+    memset(cookies, 0, size * sizeof(void *));
+
+    vq->dev = dev;
+    vq->index = index;
+    vq->size = size;
+    vq->ring_mem = ring;
+    vq->ring_frames = frames;
+    vq->desc = ring;
+    vq->avail = (virtq_avail_t *)((uint64_t)ring + avail_offset);
+    vq->used = (virtq_used_t *)((uint64_t)ring + used_offset);
+    vq->cookies = cookies;
+    for (unsigned int i = 0; i < size; i++) {
+        vq->desc[i].next = i + 1;
+    }
+    vq->free_head = 0;
+    vq->num_free = size;
+
+    uint64_t base = (uint64_t)ring;
+    virtio_write(dev, VIRTIO_MMIO_QUEUE_NUM, size);
+    if (dev->version == 1) {
+        virtio_write(dev, VIRTIO_MMIO_QUEUE_ALIGN, VIRTQ_LEGACY_ALIGN);
+        virtio_write(dev, VIRTIO_MMIO_QUEUE_PFN, base / PAGE_SIZE);
+    } else {
+        uint64_t avail = (uint64_t)vq->avail;
+        uint64_t used = (uint64_t)vq->used;
+        virtio_write(dev, VIRTIO_MMIO_QUEUE_DESC_LOW, (uint32_t)base);
+        virtio_write(dev, VIRTIO_MMIO_QUEUE_DESC_HIGH, (uint32_t)(base >> 32));
+        virtio_write(dev, VIRTIO_MMIO_QUEUE_AVAIL_LOW, (uint32_t)avail);
+        virtio_write(dev, VIRTIO_MMIO_QUEUE_AVAIL_HIGH, (uint32_t)(avail >> 32));
+        virtio_write(dev, VIRTIO_MMIO_QUEUE_USED_LOW, (uint32_t)used);
+        virtio_write(dev, VIRTIO_MMIO_QUEUE_USED_HIGH, (uint32_t)(used >> 32));
+        virtio_write(dev, VIRTIO_MMIO_QUEUE_READY, 1);
+    }
+    return vq;
+}
+
+// Put a chain whose head descriptor is head on the available ring
+static void virtqueue_publish(virtqueue_t *vq, uint16_t head, void *cookie) {
+    vq->cookies[head] = cookie;
+    vq->avail->ring[vq->avail_idx % vq->size] = head;
+    vq->avail_idx++;
+    vq->unkicked++;
+    vq->chains++;
+}
+
+int virtqueue_add(virtqueue_t *vq, const virtq_buf_t *bufs, unsigned int count, void *cookie) {
+    if (count == 0 || count > vq->num_free) {
+        return -1;
+    }
+    uint16_t head = vq->free_head;
+    uint16_t idx = head;
+    for (unsigned int i = 0; i < count; i++) {
+        virtq_desc_t *desc = &vq->desc[idx];
+        desc->addr = bufs[i].addr;
+        desc->len = bufs[i].len;
+        desc->flags = bufs[i].device_writes ? VIRTQ_DESC_F_WRITE : 0;
+        if (i + 1 < count) {
+            desc->flags |= VIRTQ_DESC_F_NEXT;
+            idx = desc->next;
+        } else {
+            vq->free_head = desc->next;
+        }
+    }
+    vq->num_free -= count;
+    virtqueue_publish(vq, head, cookie);
+    return head;
+}
+
+int virtqueue_add_indirect(virtqueue_t *vq, virtq_desc_t *table, const virtq_buf_t *bufs,
+                           unsigned int count, void *cookie) {
+    if (count == 0 || vq->num_free == 0) {
+        return -1;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        table[i].addr = bufs[i].addr;
+        table[i].len = bufs[i].len;
+        table[i].flags = bufs[i].device_writes ? VIRTQ_DESC_F_WRITE : 0;
+        table[i].next = i + 1;
+        if (i + 1 < count) {
+            table[i].flags |= VIRTQ_DESC_F_NEXT;
+        }
+    }
+
+    uint16_t head = vq->free_head;
+    virtq_desc_t *desc = &vq->desc[head];
+    vq->free_head = desc->next;
+    vq->num_free--;
+    desc->addr = (uint64_t)table;
+    desc->len = count * sizeof(virtq_desc_t);
+    desc->flags = VIRTQ_DESC_F_INDIRECT;
+    virtqueue_publish(vq, head, cookie);
+    return head;
+}
+
+void virtqueue_kick(virtqueue_t *vq) {
+    if (vq->unkicked == 0) {
+        return;
+    }
+    // Descriptors and ring entries before the index that publishes them
+    dmb(ishst);
+    vq->avail->idx = vq->avail_idx;
+    vq->unkicked = 0;
+    vq->kicks++;
+
+    // The index store before reading whether the device wants a notify
+    dmb(ish);
+    if (!(vq->used->flags & VIRTQ_USED_F_NO_NOTIFY)) {
+        dsb(st);
+        virtio_write(vq->dev, VIRTIO_MMIO_QUEUE_NOTIFY, vq->index);
+        vq->notifies++;
+    }
+}
+
+bool virtqueue_has_used(virtqueue_t *vq) {
+    return vq->last_used != vq->used->idx;
+}
+
+void *virtqueue_get_used(virtqueue_t *vq, uint32_t *len) {
+    if (!virtqueue_has_used(vq)) {
+        return NULL;
+    }
+    // The entry is read after the index that covers it
+    dmb(ishld);
+    virtq_used_elem_t *elem = &vq->used->ring[vq->last_used % vq->size];
+    uint16_t head = (uint16_t)elem->id;
+    if (len) {
+        *len = elem->len;
+    }
+    vq->last_used++;
+
+    // Return the chain to the free list
+    uint16_t tail = head;
+    unsigned int freed = 1;
+    while (vq->desc[tail].flags & VIRTQ_DESC_F_NEXT) {
+        tail = vq->desc[tail].next;
+        freed++;
+    }
+    vq->desc[tail].next = vq->free_head;
+    vq->free_head = head;
+    vq->num_free += freed;
+
+    void *cookie = vq->cookies[head];
+    vq->cookies[head] = NULL;
+    return cookie;
+}
+
+void virtqueue_disable_irq(virtqueue_t *vq) {
+    vq->avail->flags |= VIRTQ_AVAIL_F_NO_INTERRUPT;
+}
+
+void virtqueue_enable_irq(virtqueue_t *vq) {
+    vq->avail->flags &= ~VIRTQ_AVAIL_F_NO_INTERRUPT;
+    // Callers check for completions again after this
+    dmb(ish);
+}
+
+// --- Diagnostics ---
+
+static const char *virtio_device_name(uint32_t device_id) {
+    switch (device_id) {
+    case VIRTIO_ID_NET:     return "net";
+    case VIRTIO_ID_BLOCK:   return "block";
+    case VIRTIO_ID_CONSOLE: return "console";
+    default:                return "other";
+    }
+}
+
+void virtio_print_info(void) {
+    kprintf("virtio-mmio devices: %u\n", num_devices);
+    for (unsigned int i = 0; i < num_devices; i++) {
+        virtio_dev_t *dev = &devices[i];
+        kprintf("  0x%08llx IRQ %-3u v%u %-8s (id %u) features 0x%llx%s\n", dev->base, dev->irq,
+                dev->version, virtio_device_name(dev->device_id), dev->device_id, dev->features,
+                dev->claimed ? "" : " (no driver)");
+    }
+}
@@ -0,0 +1,379 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "drivers/virtio_blk.h"
+#include "drivers/virtio.h"
+#include "drivers/gic.h"
+#include "memory/frame_alloc.h"
+#include "arch/cpu.h"
+#include "sched/thread.h"
+#include "sched/wait.h"
+#include "sync/spinlock.h"
+#include "sync/atomic.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+// Request types and status values
+#define VIRTIO_BLK_T_IN     0
+#define VIRTIO_BLK_T_OUT    1
+#define VIRTIO_BLK_T_FLUSH  4
+#define VIRTIO_BLK_S_OK     0
+
+// Configuration space offsets
+#define VIRTIO_BLK_CFG_CAPACITY 0
+#define VIRTIO_BLK_CFG_SEG_MAX  12
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) virtio_blk_hdr_t;
+
+// Everything the device reads or writes for one request besides the data:
+// the indirect table, the header and the status byte
+typedef struct blk_slot {
+    virtq_desc_t table[VIRTIO_BLK_MAX_SEGS + 2];
+    virtio_blk_hdr_t hdr;
+    volatile uint8_t status;
+    blk_request_t *req;
+    struct blk_slot *next_free;
+} blk_slot_t;
+
+static virtio_dev_t *blk_dev = NULL;
+static virtqueue_t *blk_vq = NULL;
+static spinlock_t blk_lock = SPINLOCK_INIT;     // Queue and slots, IRQs masked
+static blk_slot_t *blk_free_slots = NULL;
+static uint64_t blk_capacity = 0;
+static unsigned int blk_max_segs = VIRTIO_BLK_MAX_SEGS;
+static bool blk_read_only = false;
+static bool blk_indirect = false;
+static virtio_blk_mode_t blk_mode = VIRTIO_BLK_IRQ;
+static wait_queue_t blk_waiters = WAIT_QUEUE_INIT;
+static virtio_blk_stats_t blk_stats;
+static block_device_t blk_device = { "vda", 0, virtio_blk_submit, virtio_blk_wait };
+
+// --- Completion ---
+
+// Finish requests reaped under the lock, after dropping it: callbacks may
+// submit again. The status store is the last access to a request without
+// a callback, whose owner may reuse it as soon as it sees it.
+static void virtio_blk_complete(blk_request_t *list) {
+    while (list) {
+        blk_request_t *req = list;
+        list = req->next;
+        if (req->done) {
+            req->status = req->result;
+            req->done(req);
+        } else {
+            __atomic_store_n(&req->status, req->result, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+unsigned int virtio_blk_poll(void) {
+    if (!blk_vq) {
+        return 0;
+    }
+    blk_request_t *done = NULL;
+    blk_request_t **tail = &done;
+    unsigned int reaped = 0;
+
+    uint64_t flags = spin_lock_irqsave(&blk_lock);
+    blk_slot_t *slot;
+    while ((slot = virtqueue_get_used(blk_vq, NULL)) != NULL) {
+        blk_request_t *req = slot->req;
+        req->result = slot->status == VIRTIO_BLK_S_OK ? 0 : -1;
+        if (req->result) {
+            blk_stats.errors++;
+        }
+        req->next = NULL;
+        *tail = req;
+        tail = &req->next;
+        slot->req = NULL;
+        slot->next_free = blk_free_slots;
+        blk_free_slots = slot;
+        reaped++;
+    }
+    blk_stats.completions += reaped;
+    spin_unlock_irqrestore(&blk_lock, flags);
+
+    if (reaped) {
+        virtio_blk_complete(done);
+        wake_up(&blk_waiters);
+    }
+    return reaped;
+}
+
+static void virtio_blk_irq_handler(unsigned int irq, saved_registers_t *context, void *data) {
+    (void)irq;
+    (void)context;
+    (void)data;
+    virtio_ack_irq(blk_dev);
+    blk_stats.interrupts++;
+    virtio_blk_poll();
+}
+
+// --- Submission ---
+
+// True if req needs the device; otherwise req->result is its outcome
+static bool virtio_blk_check(blk_request_t *req) {
+    req->result = -1;
+    if (!blk_vq) {
+        return false;
+    }
+    if (req->op == BLK_OP_FLUSH) {
+        // Without the feature the device has no write cache to flush
+        req->result = 0;
+        return virtio_has_feature(blk_dev, VIRTIO_BLK_F_FLUSH);
+    }
+    if (req->op == BLK_OP_WRITE && blk_read_only) {
+        return false;
+    }
+    if (req->nr_segs == 0 || req->nr_segs > blk_max_segs) {
+        return false;
+    }
+    uint64_t bytes = 0;
+    for (unsigned int i = 0; i < req->nr_segs; i++) {
+        if (req->segs[i].len == 0 || req->segs[i].len % VIRTIO_BLK_SECTOR_SIZE) {
+            return false;
+        }
+        bytes += req->segs[i].len;
+    }
+    uint64_t sectors = bytes / VIRTIO_BLK_SECTOR_SIZE;
+    return req->sector < blk_capacity && sectors <= blk_capacity - req->sector;
+}
+
+// blk_lock held. Put req on the ring; false if there is no room.
+static bool virtio_blk_queue(blk_request_t *req) {
+    blk_slot_t *slot = blk_free_slots;
+    if (!slot) {
+        return false;
+    }
+    slot->hdr.type = req->op == BLK_OP_READ ? VIRTIO_BLK_T_IN :
+                     req->op == BLK_OP_WRITE ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_FLUSH;
+    slot->hdr.reserved = 0;
+    slot->hdr.sector = req->op == BLK_OP_FLUSH ? 0 : req->sector;
+    slot->status = 0xFF;
+
+    virtq_buf_t bufs[VIRTIO_BLK_MAX_SEGS + 2];
+    unsigned int count = 0;
+    bufs[count++] = (virtq_buf_t){ (uint64_t)&slot->hdr, sizeof(virtio_blk_hdr_t), false };
+    if (req->op != BLK_OP_FLUSH) {
+        for (unsigned int i = 0; i < req->nr_segs; i++) {
+            bufs[count++] = (virtq_buf_t){ (uint64_t)req->segs[i].buf, req->segs[i].len,
+                                           req->op == BLK_OP_READ };
+        }
+    }
+    bufs[count++] = (virtq_buf_t){ (uint64_t)&slot->status, 1, true };
+
+    // Without indirect descriptors the request takes count ring entries
+    int head = blk_indirect ? virtqueue_add_indirect(blk_vq, slot->table, bufs, count, slot)
+                            : virtqueue_add(blk_vq, bufs, count, slot);
+    if (head < 0) {
+        return false;
+    }
+    blk_free_slots = slot->next_free;
+    slot->req = req;
+    return true;
+}
+
+unsigned int virtio_blk_submit(blk_request_t **reqs, unsigned int count) {
+    blk_request_t *rejected = NULL;
+    blk_request_t **tail = &rejected;
+    unsigned int taken = 0;
+    unsigned int queued = 0;
+
+    uint64_t flags = spin_lock_irqsave(&blk_lock);
+    for (; taken < count; taken++) {
+        blk_request_t *req = reqs[taken];
+        if (!virtio_blk_check(req)) {
+            req->next = NULL;
+            *tail = req;
+            tail = &req->next;
+            continue;
+        }
+        if (!virtio_blk_queue(req)) {
+            break;
+        }
+        // The device sees nothing before the kick below
+        req->status = BLK_STATUS_PENDING;
+        queued++;
+    }
+    if (queued) {
+        // One doorbell for the whole batch
+        virtqueue_kick(blk_vq);
+        blk_stats.requests += queued;
+        blk_stats.batches++;
+    }
+    spin_unlock_irqrestore(&blk_lock, flags);
+
+    virtio_blk_complete(rejected);
+    return taken;
+}
+
+static bool virtio_blk_polling(void) {
+    return blk_mode == VIRTIO_BLK_POLL || !sched_active() || irqs_disabled();
+}
+
+int virtio_blk_wait(blk_request_t *req) {
+    if (virtio_blk_polling()) {
+        while (__atomic_load_n(&req->status, __ATOMIC_ACQUIRE) == BLK_STATUS_PENDING) {
+            if (!virtio_blk_poll()) {
+                cpu_relax();
+            }
+        }
+    } else {
+        wait_event(&blk_waiters,
+                   __atomic_load_n(&req->status, __ATOMIC_ACQUIRE) != BLK_STATUS_PENDING);
+    }
+    return req->status;
+}
+
+// Submit a single request, waiting for room on the ring, and wait for it
+static int virtio_blk_sync(blk_request_t *req) {
+    req->done = NULL;
+    while (1) {
+        uint64_t seen = blk_stats.completions;
+        if (virtio_blk_submit(&req, 1) == 1) {
+            break;
+        }
+        // Ring full: the next completion frees a slot
+        if (virtio_blk_polling()) {
+            virtio_blk_poll();
+        } else {
+            wait_event(&blk_waiters, blk_stats.completions != seen);
+        }
+    }
+    return virtio_blk_wait(req);
+}
+
+static int virtio_blk_transfer(blk_op_t op, uint64_t sector, void *buf, uint32_t sectors) {
+    blk_request_t req;
+    req.op = op;
+    req.sector = sector;
+    req.nr_segs = 1;
+    req.segs[0].buf = buf;
+    req.segs[0].len = sectors * VIRTIO_BLK_SECTOR_SIZE;
+    return virtio_blk_sync(&req);
+}
+
+int virtio_blk_read(uint64_t sector, void *buf, uint32_t sectors) {
+    return virtio_blk_transfer(BLK_OP_READ, sector, buf, sectors);
+}
+
+int virtio_blk_write(uint64_t sector, const void *buf, uint32_t sectors) {
+    return virtio_blk_transfer(BLK_OP_WRITE, sector, (void *)buf, sectors);
+}
+
+int virtio_blk_flush(void) {
+    blk_request_t req;
+    req.op = BLK_OP_FLUSH;
+    req.sector = 0;
+    req.nr_segs = 0;
+    return virtio_blk_sync(&req);
+}
+
+// --- Setup ---
+
+void virtio_blk_init(void) {
+    blk_dev = virtio_claim(VIRTIO_ID_BLOCK);
+    if (!blk_dev) {
+        return;
+    }
+    uint64_t wanted = VIRTIO_FEATURE(VIRTIO_F_INDIRECT_DESC) | VIRTIO_FEATURE(VIRTIO_BLK_F_SEG_MAX) |
+                      VIRTIO_FEATURE(VIRTIO_BLK_F_RO) | VIRTIO_FEATURE(VIRTIO_BLK_F_FLUSH);
+    if (!virtio_negotiate(blk_dev, wanted)) {
+        kprintf("virtio-blk: Device rejected the features\n");
+        blk_dev = NULL;
+        return;
+    }
+
+    blk_capacity = virtio_config_read64(blk_dev, VIRTIO_BLK_CFG_CAPACITY);
+    blk_device.sectors = blk_capacity;
+    blk_read_only = virtio_has_feature(blk_dev, VIRTIO_BLK_F_RO);
+    blk_indirect = virtio_has_feature(blk_dev, VIRTIO_F_INDIRECT_DESC);
+    if (virtio_has_feature(blk_dev, VIRTIO_BLK_F_SEG_MAX)) {
+        uint32_t seg_max = virtio_config_read32(blk_dev, VIRTIO_BLK_CFG_SEG_MAX);
+        if (seg_max && seg_max < blk_max_segs) {
+            blk_max_segs = seg_max;
+        }
+    }
+
+    virtqueue_t *vq = virtqueue_create(blk_dev, 0, VIRTIO_BLK_QUEUE_SIZE);
+    unsigned int slot_frames = vq ? (vq->size * sizeof(blk_slot_t) + PAGE_SIZE - 1) / PAGE_SIZE : 0;
+    blk_slot_t *slots = vq ? alloc_frames(slot_frames) : NULL;
+    if (!slots) {
+        kprintf("virtio-blk: Unable to set up the request queue\n");
+        virtio_fail(blk_dev);
+        blk_dev = NULL;
+        return;
+    }
+    memset(slots, 0, slot_frames * PAGE_SIZE);
+    for (unsigned int i = 0; i < vq->size; i++) {
+        slots[i].next_free = blk_free_slots;
+        blk_free_slots = &slots[i];
+    }
+
+    irq_register(blk_dev->irq, virtio_blk_irq_handler, NULL);
+    virtio_driver_ok(blk_dev);
+    blk_vq = vq;
+
+    kprintf("virtio-blk: %llu MB (%llu sectors)%s, %u-entry queue, %s descriptors\n",
+            blk_capacity * VIRTIO_BLK_SECTOR_SIZE >> 20, blk_capacity,
+            blk_read_only ? " read-only" : "", vq->size, blk_indirect ? "indirect" : "direct");
+}
+
+bool virtio_blk_present(void) {
+    return blk_vq != NULL;
+}
+
+block_device_t *virtio_blk_device(void) {
+    return blk_vq ? &blk_device : NULL;
+}
+
+uint64_t virtio_blk_capacity(void) {
+    return blk_capacity;
+}
+
+bool virtio_blk_read_only(void) {
+    return blk_read_only;
+}
+
+void virtio_blk_set_mode(virtio_blk_mode_t mode) {
+    if (!blk_vq) {
+        return;
+    }
+    uint64_t flags = spin_lock_irqsave(&blk_lock);
+    blk_mode = mode;
+    if (mode == VIRTIO_BLK_POLL) {
+        virtqueue_disable_irq(blk_vq);
+    } else {
+        virtqueue_enable_irq(blk_vq);
+    }
+    spin_unlock_irqrestore(&blk_lock, flags);
+    // Anything that completed while interrupts were off
+    virtio_blk_poll();
+}
+
+virtio_blk_mode_t virtio_blk_get_mode(void) {
+    return blk_mode;
+}
+
+void virtio_blk_get_stats(virtio_blk_stats_t *stats) {
+    *stats = blk_stats;
+    stats->notifies = blk_vq ? blk_vq->notifies : 0;
+}
+
+void virtio_blk_print_info(void) {
+    if (!blk_vq) {
+        kprintf("virtio-blk: No disk\n");
+        return;
+    }
+    kprintf("virtio-blk: %llu sectors%s, %u-entry queue, %u segments, %s descriptors, %s completion\n",
+            blk_capacity, blk_read_only ? " (read-only)" : "", blk_vq->size, blk_max_segs,
+            blk_indirect ? "indirect" : "direct", blk_mode == VIRTIO_BLK_POLL ? "polled" : "IRQ");
+    kprintf("  Requests:    %llu in %llu batches, %llu notifies\n",
+            blk_stats.requests, blk_stats.batches, blk_vq->notifies);
+    kprintf("  Completions: %llu (%llu errors), %llu interrupts\n",
+            blk_stats.completions, blk_stats.errors, blk_stats.interrupts);
+}
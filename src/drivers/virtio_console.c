@@ -0,0 +1,273 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "drivers/virtio_console.h"
+#include "drivers/virtio.h"
+#include "drivers/gic.h"
+#include "drivers/timer.h"
+#include "memory/frame_alloc.h"
+#include "arch/cpu.h"
+#include "sched/thread.h"
+#include "sched/wait.h"
+#include "sched/softirq.h"
+#include "sync/spinlock.h"
+#include "sync/atomic.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+// Port 0's queues; without VIRTIO_CONSOLE_F_MULTIPORT there are no others
+#define VIRTIO_CONSOLE_RXQ      0
+#define VIRTIO_CONSOLE_TXQ      1
+
+#define VIRTIO_CONSOLE_TX_SIZE  (VIRTIO_CONSOLE_TX_FRAMES * PAGE_SIZE)
+
+static virtio_dev_t *con_dev = NULL;
+static virtqueue_t *con_rxq = NULL;
+static virtqueue_t *con_txq = NULL;
+static spinlock_t con_tx_lock = SPINLOCK_INIT;  // Transmit queue and ring, IRQs masked
+
+// Output ring: bytes [tx_tail, tx_head) are owned by the device. Both
+// count bytes ever written, so the ring offset is the count mod its size.
+static char *tx_buf;
+static uint64_t tx_head = 0;
+static uint64_t tx_tail = 0;
+
+// The ring position after each chain in flight, as its cookie. The device
+// consumes port 0's chains in order, so the chain reaped last is the
+// newest and its end is the new tail.
+static uint64_t tx_chain_end[VIRTIO_CONSOLE_QUEUE_SIZE];
+static unsigned int tx_chain_next = 0;
+
+// Posted input buffers, and the characters taken from them for readers
+static char rx_bufs[VIRTIO_CONSOLE_RX_BUFS][VIRTIO_CONSOLE_RX_BUF_SIZE];
+static volatile char rx_ring[VIRTIO_CONSOLE_RX_RING_SIZE];
+static volatile uint32_t rx_head;
+static volatile uint32_t rx_tail;
+static wait_queue_t rx_wait = WAIT_QUEUE_INIT;
+static tasklet_t rx_tasklet;
+
+static virtio_console_stats_t con_stats;
+
+// Set when the device stopped consuming output; writes then drop at once
+// instead of waiting out the timeout every time
+static bool tx_stuck = false;
+
+static bool virtio_console_wait_rx(void);
+
+static const console_dev_t con_console = {
+    "virtio", virtio_console_write, virtio_console_getc, virtio_console_wait_rx
+};
+
+// --- Output ---
+
+// con_tx_lock held. Take back the ring space of consumed chains.
+static void virtio_console_reap(void) {
+    uint64_t *end;
+    while ((end = virtqueue_get_used(con_txq, NULL)) != NULL) {
+        tx_tail = *end;
+        tx_stuck = false;
+    }
+}
+
+// con_tx_lock held. Wait until the ring and the queue have room; false
+// once the device has consumed nothing for the timeout.
+static bool virtio_console_wait_tx(void) {
+    con_stats.stalls++;
+    virtqueue_kick(con_txq);
+    uint64_t deadline = timer_read_counter() + timer_us_to_counter(VIRTIO_CONSOLE_TX_TIMEOUT_US);
+    while (1) {
+        uint64_t tail = tx_tail;
+        virtio_console_reap();
+        if (tx_head - tx_tail < VIRTIO_CONSOLE_TX_SIZE && con_txq->num_free >= 2) {
+            return true;
+        }
+        if (tx_stuck) {
+            return false;
+        }
+        if (tx_tail != tail) {
+            deadline = timer_read_counter() + timer_us_to_counter(VIRTIO_CONSOLE_TX_TIMEOUT_US);
+        } else if (timer_read_counter() > deadline) {
+            tx_stuck = true;
+            return false;
+        }
+        cpu_relax();
+    }
+}
+
+void virtio_console_write(const char *buf, size_t len) {
+    if (!con_txq || len == 0) {
+        return;
+    }
+    uint64_t flags = spin_lock_irqsave(&con_tx_lock);
+    con_stats.writes++;
+    virtio_console_reap();
+    while (len > 0) {
+        uint64_t space = VIRTIO_CONSOLE_TX_SIZE - (tx_head - tx_tail);
+        if (space == 0 || con_txq->num_free < 2) {
+            if (!virtio_console_wait_tx()) {
+                con_stats.dropped += len;
+                break;
+            }
+            continue;
+        }
+
+        // Copy what fits; a span that wraps is a chain of two buffers
+        size_t n = len < space ? len : space;
+        size_t offset = tx_head % VIRTIO_CONSOLE_TX_SIZE;
+        size_t first = VIRTIO_CONSOLE_TX_SIZE - offset;
+        if (first > n) {
+            first = n;
+        }
+        memcpy(tx_buf + offset, buf, first);
+        memcpy(tx_buf, buf + first, n - first);
+
+        virtq_buf_t bufs[2];
+        unsigned int count = 0;
+        bufs[count++] = (virtq_buf_t){ (uint64_t)(tx_buf + offset), first, false };
+        if (n > first) {
+            bufs[count++] = (virtq_buf_t){ (uint64_t)tx_buf, n - first, false };
+        }
+        tx_head += n;
+        uint64_t *end = &tx_chain_end[tx_chain_next++ % VIRTIO_CONSOLE_QUEUE_SIZE];
+        *end = tx_head;
+        virtqueue_add(con_txq, bufs, count, end);
+        con_stats.chains++;
+        con_stats.bytes += n;
+        buf += n;
+        len -= n;
+    }
+    virtqueue_kick(con_txq);
+    spin_unlock_irqrestore(&con_tx_lock, flags);
+}
+
+// --- Input ---
+
+static void virtio_console_rx_tasklet(void *data) {
+    (void)data;
+    wake_up(&rx_wait);
+}
+
+static void virtio_console_irq_handler(unsigned int irq, saved_registers_t *context, void *data) {
+    (void)irq;
+    (void)context;
+    (void)data;
+    virtio_ack_irq(con_dev);
+
+    // Only this handler touches the receive queue once it is set up
+    uint32_t head = rx_head;
+    char *rx;
+    uint32_t len;
+    bool reposted = false;
+    while ((rx = virtqueue_get_used(con_rxq, &len)) != NULL) {
+        for (uint32_t i = 0; i < len && i < VIRTIO_CONSOLE_RX_BUF_SIZE; i++) {
+            if (head - rx_tail < VIRTIO_CONSOLE_RX_RING_SIZE) {
+                rx_ring[head % VIRTIO_CONSOLE_RX_RING_SIZE] = rx[i];
+                head++;
+            } else {
+                con_stats.rx_dropped++;
+            }
+        }
+        con_stats.rx_bytes += len;
+        virtq_buf_t buf = { (uint64_t)rx, VIRTIO_CONSOLE_RX_BUF_SIZE, true };
+        virtqueue_add(con_rxq, &buf, 1, rx);
+        reposted = true;
+    }
+    if (reposted) {
+        virtqueue_kick(con_rxq);
+    }
+    if (head != rx_head) {
+        atomic_store_release32(&rx_head, head);
+        tasklet_schedule(&rx_tasklet);
+    }
+}
+
+static bool virtio_console_rx_available(void) {
+    return rx_tail != atomic_load_acquire32(&rx_head);
+}
+
+char virtio_console_getc(void) {
+    uint32_t tail = rx_tail;
+    if (tail == atomic_load_acquire32(&rx_head)) {
+        return 0;
+    }
+    char c = rx_ring[tail % VIRTIO_CONSOLE_RX_RING_SIZE];
+    atomic_store_release32(&rx_tail, tail + 1);
+    return c;
+}
+
+static bool virtio_console_wait_rx(void) {
+    if (!sched_active()) {
+        return false;
+    }
+    wait_event(&rx_wait, virtio_console_rx_available());
+    return true;
+}
+
+// --- Setup ---
+
+void virtio_console_init(void) {
+    con_dev = virtio_claim(VIRTIO_ID_CONSOLE);
+    if (!con_dev) {
+        return;
+    }
+    if (!virtio_negotiate(con_dev, 0)) {
+        kprintf("virtio-console: Device rejected the features\n");
+        con_dev = NULL;
+        return;
+    }
+
+    virtqueue_t *rxq = virtqueue_create(con_dev, VIRTIO_CONSOLE_RXQ, VIRTIO_CONSOLE_QUEUE_SIZE);
+    virtqueue_t *txq = virtqueue_create(con_dev, VIRTIO_CONSOLE_TXQ, VIRTIO_CONSOLE_QUEUE_SIZE);
+    tx_buf = (rxq && txq) ? alloc_frames(VIRTIO_CONSOLE_TX_FRAMES) : NULL;
+    if (!tx_buf) {
+        kprintf("virtio-console: Unable to set up the queues\n");
+        virtio_fail(con_dev);
+        con_dev = NULL;
+        return;
+    }
+
+    for (unsigned int i = 0; i < VIRTIO_CONSOLE_RX_BUFS; i++) {
+        virtq_buf_t buf = { (uint64_t)rx_bufs[i], VIRTIO_CONSOLE_RX_BUF_SIZE, true };
+        virtqueue_add(rxq, &buf, 1, rx_bufs[i]);
+    }
+    virtqueue_disable_irq(txq);
+    con_rxq = rxq;
+
+    tasklet_init(&rx_tasklet, virtio_console_rx_tasklet, NULL);
+    irq_register(con_dev->irq, virtio_console_irq_handler, NULL);
+    virtio_driver_ok(con_dev);
+    virtqueue_kick(rxq);
+    con_txq = txq;
+
+    kprintf("virtio-console: %u KB output ring, %u-entry queues (`console virtio` to use it)\n",
+            VIRTIO_CONSOLE_TX_SIZE / 1024, txq->size);
+}
+
+bool virtio_console_present(void) {
+    return con_txq != NULL;
+}
+
+const console_dev_t *virtio_console_device(void) {
+    return con_txq ? &con_console : NULL;
+}
+
+void virtio_console_get_stats(virtio_console_stats_t *stats) {
+    *stats = con_stats;
+    stats->notifies = con_txq ? con_txq->notifies : 0;
+}
+
+void virtio_console_print_info(void) {
+    if (!con_txq) {
+        kprintf("virtio-console: No device\n");
+        return;
+    }
+    virtio_console_stats_t st;
+    virtio_console_get_stats(&st);
+    kprintf("virtio-console: %u KB output ring, %llu bytes in flight\n",
+            VIRTIO_CONSOLE_TX_SIZE / 1024, tx_head - tx_tail);
+    kprintf("  Output: %llu bytes in %llu writes, %llu chains, %llu notifies\n",
+            st.bytes, st.writes, st.chains, st.notifies);
+    kprintf("          %llu stalls, %llu bytes dropped%s\n", st.stalls, st.dropped,
+            tx_stuck ? " (device not consuming)" : "");
+    kprintf("  Input:  %llu bytes, %llu dropped\n", st.rx_bytes, st.rx_dropped);
+}
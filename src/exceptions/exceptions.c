@@ -1,6 +1,10 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "exceptions/exceptions.h"
+#include "drivers/gic.h"
+#include "memory/mm.h"
+#include "sched/thread.h"
+#include "sched/softirq.h"
 #include "lib/stdio.h"
 
 // Helper function to read ESR_EL1
@@ -26,6 +30,7 @@ static inline uint64_t read_far_el1(void) {
 
 // Simple panic function
 void panic(const char *message) {
+    console_panic();
     kprintf("\nKERNEL PANIC: %s\n", message);
     kprintf("System halted.\n");
     // Disable interrupts here
@@ -59,6 +64,16 @@ void handle_sync_exception(saved_registers_t *context) {
     uint32_t ec = (esr >> 26) & 0x3F; // Extract Exception Class (bits 31:26)
     uint32_t iss = esr & 0x1FFFFFF;   // Extract Instruction Specific Syndrome (bits 24:0)
 
+    // Translation faults on demand-paged memory are resolved here and the
+    // faulting instruction is retried
+    if (mm_handle_fault(far, esr)) {
+        return;
+    }
+
+    // Everything but BRK and SVC ends in a panic: report it on the UART
+    if (ec != 0b111100 && ec != 0b010101) {
+        console_panic();
+    }
     kprintf("\n--- Synchronous Exception Taken ---\n");
     kprintf(" ESR_EL1: %016llx (EC: 0x%x, ISS: 0x%x)\n", esr, ec, iss);
     kprintf(" ELR_EL1: %016llx (Return Address)\n", elr);
@@ -75,11 +90,11 @@ void handle_sync_exception(saved_registers_t *context) {
         case 0b010101: ec_str = "SVC instruction execution in AArch64 state"; break;
         case 0b011000: ec_str = "Trapped MSR, MRS or System instruction execution in AArch64 state"; break;
         case 0b011001: ec_str = "Access to SVE functionality trapped"; break; // Added in ARMv8.2
-        case 0b100000: ec_str = "Instruction Abort from a lower Exception level (AArch32)"; far_valid = true; break;
-        case 0b100001: ec_str = "Instruction Abort from a lower Exception level (AArch64)"; far_valid = true; break;
+        case 0b100000: ec_str = "Instruction Abort from a lower Exception level"; far_valid = true; break;
+        case 0b100001: ec_str = "Instruction Abort from current EL"; far_valid = true; break;
         case 0b100010: ec_str = "PC alignment fault exception"; break;
-        case 0b100100: ec_str = "Data Abort from a lower Exception level (AArch32)"; far_valid = true; break;
-        case 0b100101: ec_str = "Data Abort from a lower Exception level (AArch64)"; far_valid = true; break;
+        case 0b100100: ec_str = "Data Abort from a lower Exception level"; far_valid = true; break;
+        case 0b100101: ec_str = "Data Abort from current EL"; far_valid = true; break;
         case 0b100110: ec_str = "SP alignment fault exception"; break;
         case 0b101000: ec_str = "Trapped floating-point exception (AArch32)"; break;
         case 0b101100: ec_str = "Trapped floating-point exception (AArch64)"; break;
@@ -91,15 +106,23 @@ void handle_sync_exception(saved_registers_t *context) {
         case 0b111000: ec_str = "Watchpoint exception from a lower Exception level (AArch32)"; break;
         case 0b111001: ec_str = "Watchpoint exception from a lower Exception level (AArch64)"; break;
         case 0b111100: ec_str = "BRK instruction execution in AArch64 state"; break;
-        // Exceptions from current EL
-        case 0b100011: ec_str = "Instruction Abort from current EL"; far_valid = true; break;
-        case 0b100111: ec_str = "Data Abort from current EL"; far_valid = true; break;
         default: ec_str = "Unhandled Exception Class"; break;
     }
 
     kprintf(" Type: %s\n", ec_str);
     if (far_valid) {
+        static const char *const fault_types[] = {
+            "address size", "translation", "access flag", "permission"
+        };
+        uint32_t fsc = ESR_ISS_FSC(esr);
         kprintf(" FAR_EL1: %016llx (Faulting Virtual Address)\n", far);
+        if (FSC_TYPE(fsc) < 4) {
+            kprintf(" Fault:   %s fault, level %u%s\n", fault_types[FSC_TYPE(fsc)], FSC_LEVEL(fsc),
+                    (ec == ESR_EC_DABT_CUR || ec == ESR_EC_DABT_LOWER) ?
+                    ((esr & ESR_ISS_WNR) ? " (write)" : " (read)") : "");
+        } else {
+            kprintf(" Fault:   status code 0x%x\n", fsc);
+        }
     }
     print_registers(context);
     kprintf("-------------------------------------\n");
@@ -125,20 +148,20 @@ void handle_sync_exception(saved_registers_t *context) {
 
 // Called by assembly wrapper for IRQ exceptions
 void handle_irq(saved_registers_t *context) {
-    kprintf("\n--- IRQ Received ---\n");
-    // TODO: Interact with the Generic Interrupt Controller (GIC)
-    // 1. Read Interrupt Acknowledge Register (IAR) from CPU interface (GICC_IAR)
-    //    to get the interrupt ID and acknowledge the interrupt.
-    // 2. Dispatch to the appropriate driver/handler based on the ID.
-    // 3. Write to End Of Interrupt Register (EOIR) (GICC_EOIR) to signal completion.
-    kprintf(" (No GIC driver implemented yet)\n");
-    print_registers(context);
-    kprintf("--------------------\n");
-    // For now, just return via restore_context -> eret
+    // Acknowledge, dispatch and complete everything pending at the GIC,
+    // then run the bottom halves the handlers raised
+    irq_enter();
+    gic_handle_irq(context);
+    irq_exit();
+    
+    // Everything is acknowledged, so switching threads here is safe; the
+    // interrupted thread resumes through this frame when switched back
+    sched_irq_exit();
 }
 
 // Placeholder for FIQ
 void handle_fiq(saved_registers_t *context) {
+    console_panic();
     kprintf("\n--- FIQ Received ---\n");
     print_registers(context);
     panic("FIQ handling not implemented");
@@ -146,6 +169,7 @@ void handle_fiq(saved_registers_t *context) {
 
 // Placeholder for SError
 void handle_serror(saved_registers_t *context) {
+    console_panic();
     uint64_t esr = read_esr_el1();
     kprintf("\n--- SError Received ---\n");
     kprintf(" ESR_EL1: %016llx\n", esr);
@@ -0,0 +1,597 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "fs/bcache.h"
+#include "memory/frame_alloc.h"
+#include "memory/kheap.h"
+#include "sched/thread.h"
+#include "sync/spinlock.h"
+#include "drivers/timer.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+#define BCACHE_A1IN     0
+#define BCACHE_AM       1
+#define BCACHE_A1OUT    2
+#define BCACHE_QUEUES   3
+
+// Largest number of requests submitted together
+#define BCACHE_BATCH_MAX (BCACHE_RA_MAX + 1)
+
+typedef struct {
+    bcache_buf_t *head;
+    bcache_buf_t *tail;
+    uint64_t count;
+} bcache_queue_t;
+
+// Sequential read detection for one device
+typedef struct {
+    block_device_t *dev;
+    uint64_t next;              // Block a sequential reader reads next
+    uint64_t ra_end;            // End of what has been read ahead
+    uint32_t window;
+} bcache_ra_t;
+
+// Everything below is protected by bcache_lock, which is never held
+// across I/O
+static spinlock_t bcache_lock = SPINLOCK_INIT;
+static bcache_buf_t *bcache_hash[1U << BCACHE_HASH_BITS];
+static bcache_queue_t bcache_queues[BCACHE_QUEUES];
+static bcache_ra_t bcache_ra[BCACHE_MAX_DEVICES];
+static uint64_t frame_limit = BCACHE_DEFAULT_FRAMES;
+static uint64_t frames_used = 0;
+static uint64_t nr_dirty = 0;
+static bcache_stats_t stats;
+
+static const char *const queue_names[BCACHE_QUEUES] = { "A1in", "Am", "A1out" };
+
+// --- Hash and queues ---
+
+static bcache_buf_t **bcache_bucket(block_device_t *dev, uint64_t block) {
+    uint64_t hash = (block ^ ((uint64_t)dev >> 6)) * 0x9E3779B97F4A7C15ULL;
+    return &bcache_hash[hash >> (64 - BCACHE_HASH_BITS)];
+}
+
+static bcache_buf_t *bcache_hash_find(block_device_t *dev, uint64_t block) {
+    for (bcache_buf_t *buf = *bcache_bucket(dev, block); buf; buf = buf->hash_next) {
+        if (buf->dev == dev && buf->block == block) {
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+static void bcache_hash_remove(bcache_buf_t *buf) {
+    bcache_buf_t **link = bcache_bucket(buf->dev, buf->block);
+    while (*link != buf) {
+        link = &(*link)->hash_next;
+    }
+    *link = buf->hash_next;
+}
+
+static void bcache_queue_add(unsigned int q, bcache_buf_t *buf) {
+    bcache_queue_t *queue = &bcache_queues[q];
+    buf->queue = q;
+    buf->prev = NULL;
+    buf->next = queue->head;
+    if (queue->head) {
+        queue->head->prev = buf;
+    } else {
+        queue->tail = buf;
+    }
+    queue->head = buf;
+    queue->count++;
+}
+
+static void bcache_queue_remove(bcache_buf_t *buf) {
+    bcache_queue_t *queue = &bcache_queues[buf->queue];
+    if (buf->prev) {
+        buf->prev->next = buf->next;
+    } else {
+        queue->head = buf->next;
+    }
+    if (buf->next) {
+        buf->next->prev = buf->prev;
+    } else {
+        queue->tail = buf->prev;
+    }
+    queue->count--;
+}
+
+// --- I/O state ---
+
+static void bcache_start_io(bcache_buf_t *buf, blk_op_t op) {
+    buf->flags |= BCACHE_IO;
+    buf->req.op = op;
+    buf->req.sector = buf->block * BCACHE_BLOCK_SECTORS;
+    buf->req.nr_segs = 1;
+    buf->req.segs[0].buf = buf->data;
+    buf->req.segs[0].len = BCACHE_BLOCK_SIZE;
+    buf->req.done = NULL;
+    // Pending from here, so that anyone who finds the buffer waits for it
+    buf->req.status = BLK_STATUS_PENDING;
+}
+
+// Lock held. Fold a finished request into the flags; whoever notices first
+// does it, whether the thread that issued it or not.
+static void bcache_end_io(bcache_buf_t *buf) {
+    if (!(buf->flags & BCACHE_IO) ||
+        __atomic_load_n(&buf->req.status, __ATOMIC_ACQUIRE) == BLK_STATUS_PENDING) {
+        return;
+    }
+    buf->flags &= ~BCACHE_IO;
+    bool ok = buf->req.status == 0;
+    if (!ok) {
+        stats.io_errors++;
+    }
+
+    if (buf->req.op == BLK_OP_READ) {
+        if (ok) {
+            buf->flags |= BCACHE_VALID;
+        }
+        return;
+    }
+
+    if (!ok || (buf->flags & BCACHE_REDIRTY)) {
+        // Write it again later
+        buf->flags &= ~BCACHE_REDIRTY;
+        buf->dirtied_at = timer_read_counter();
+    } else {
+        buf->flags &= ~BCACHE_DIRTY;
+        nr_dirty--;
+    }
+}
+
+// Queue bufs, as few doorbells as the ring allows
+static void bcache_submit(block_device_t *dev, bcache_buf_t **bufs, unsigned int count) {
+    blk_request_t *reqs[BCACHE_BATCH_MAX];
+    for (unsigned int i = 0; i < count; i++) {
+        reqs[i] = &bufs[i]->req;
+    }
+    unsigned int done = 0;
+    while (done < count) {
+        unsigned int taken = dev->submit(reqs + done, count - done);
+        done += taken;
+        if (!taken) {
+            // Ring full: wait for one of ours to free a slot, if any
+            if (done) {
+                dev->wait(reqs[done - 1]);
+            } else {
+                thread_yield();
+            }
+        }
+    }
+}
+
+// Wait for buf's request and fold it in
+static void bcache_wait_io(bcache_buf_t *buf) {
+    buf->dev->wait(&buf->req);
+    spin_lock(&bcache_lock);
+    bcache_end_io(buf);
+    spin_unlock(&bcache_lock);
+}
+
+// --- Replacement ---
+
+// Lock held. Drop the oldest A1out keys beyond keep.
+static void bcache_trim_ghosts(uint64_t keep) {
+    bcache_queue_t *ghosts = &bcache_queues[BCACHE_A1OUT];
+    while (ghosts->count > keep) {
+        bcache_buf_t *buf = ghosts->tail;
+        bcache_queue_remove(buf);
+        bcache_hash_remove(buf);
+        kfree(buf);
+    }
+}
+
+// Lock held. Take the frame of the least recently used idle buffer of
+// queue q, or return NULL if every buffer there is busy.
+static void *bcache_evict_from(unsigned int q) {
+    for (bcache_buf_t *buf = bcache_queues[q].tail; buf; buf = buf->prev) {
+        bcache_end_io(buf);     // Read-ahead nobody has waited for
+        if (buf->refs || (buf->flags & (BCACHE_DIRTY | BCACHE_IO))) {
+            continue;
+        }
+        void *frame = buf->data;
+        bcache_queue_remove(buf);
+        stats.evictions++;
+        if (q == BCACHE_A1IN) {
+            // Seen once: remember the key in case it comes back soon
+            buf->data = NULL;
+            buf->flags = 0;
+            bcache_queue_add(BCACHE_A1OUT, buf);
+            bcache_trim_ghosts(frame_limit / 2);
+        } else {
+            bcache_hash_remove(buf);
+            kfree(buf);
+        }
+        return frame;
+    }
+    return NULL;
+}
+
+// Lock held. A frame for a new buffer: fresh while under the limit and
+// the PMM has one, otherwise taken from A1in once it is over a quarter
+// of the cache, else from the Am LRU.
+static void *bcache_alloc_frame(void) {
+    if (frames_used < frame_limit) {
+        void *frame = alloc_frame();
+        if (frame) {
+            frames_used++;
+            return frame;
+        }
+    }
+    bool a1_first = bcache_queues[BCACHE_A1IN].count > frame_limit / 4 ||
+                    bcache_queues[BCACHE_AM].count == 0;
+    void *frame = bcache_evict_from(a1_first ? BCACHE_A1IN : BCACHE_AM);
+    if (!frame) {
+        frame = bcache_evict_from(a1_first ? BCACHE_AM : BCACHE_A1IN);
+    }
+    return frame;
+}
+
+// Lock held. Find or create the buffer for a block; NULL if out of
+// memory. *created is set if it is new (and so not valid).
+static bcache_buf_t *bcache_lookup(block_device_t *dev, uint64_t block, bool *created) {
+    bcache_buf_t *buf = bcache_hash_find(dev, block);
+    *created = false;
+    if (buf && buf->data) {
+        if (buf->queue == BCACHE_AM) {
+            bcache_queue_remove(buf);
+            bcache_queue_add(BCACHE_AM, buf);
+        }
+        return buf;
+    }
+
+    // A key still in A1out was evicted recently: it goes to Am. Off the
+    // queue first, so that trimming for the frame below cannot free it.
+    unsigned int q = BCACHE_A1IN;
+    if (buf) {
+        bcache_queue_remove(buf);
+        q = BCACHE_AM;
+    }
+    void *frame = bcache_alloc_frame();
+    if (!frame) {
+        if (buf) {
+            bcache_hash_remove(buf);
+            kfree(buf);
+        }
+        return NULL;
+    }
+    if (!buf) {
+        buf = kmalloc(sizeof(bcache_buf_t));
+        if (!buf) {
+            free_frame(frame);
+            frames_used--;
+            return NULL;
+        }
+        memset(buf, 0, sizeof(bcache_buf_t));
+        buf->dev = dev;
+        buf->block = block;
+        bcache_buf_t **bucket = bcache_bucket(dev, block);
+        buf->hash_next = *bucket;
+        *bucket = buf;
+    } else {
+        stats.ghost_hits++;
+    }
+    buf->data = frame;
+    buf->flags = 0;
+    buf->refs = 0;
+    bcache_queue_add(q, buf);
+    *created = true;
+    return buf;
+}
+
+// --- Read-ahead ---
+
+static bcache_ra_t *bcache_ra_state(block_device_t *dev) {
+    bcache_ra_t *free_slot = NULL;
+    for (int i = 0; i < BCACHE_MAX_DEVICES; i++) {
+        if (bcache_ra[i].dev == dev) {
+            return &bcache_ra[i];
+        }
+        if (!bcache_ra[i].dev && !free_slot) {
+            free_slot = &bcache_ra[i];
+        }
+    }
+    if (free_slot) {
+        free_slot->dev = dev;
+    }
+    return free_slot;
+}
+
+// Lock held. Note a demand read of block and start reading ahead of a
+// sequential reader: the window doubles on every sequential read and is
+// topped up once less than half of it is left. Returns the buffers to
+// submit in out.
+static unsigned int bcache_readahead(block_device_t *dev, uint64_t block, bcache_buf_t **out) {
+    bcache_ra_t *ra = bcache_ra_state(dev);
+    if (!ra) {
+        return 0;
+    }
+    if (block == ra->next) {
+        ra->window = ra->window ? ra->window * 2 : BCACHE_RA_MIN;
+        if (ra->window > BCACHE_RA_MAX) {
+            ra->window = BCACHE_RA_MAX;
+        }
+    } else {
+        ra->window = 0;
+        ra->ra_end = 0;
+    }
+    ra->next = block + 1;
+    if (ra->window == 0 || ra->ra_end > block + ra->window / 2) {
+        return 0;
+    }
+
+    uint64_t blocks = dev->sectors / BCACHE_BLOCK_SECTORS;
+    uint64_t start = ra->ra_end > block + 1 ? ra->ra_end : block + 1;
+    uint64_t end = block + 1 + ra->window;
+    if (end > blocks) {
+        end = blocks;
+    }
+    unsigned int count = 0;
+    uint64_t b;
+    for (b = start; b < end; b++) {
+        bool created;
+        bcache_buf_t *buf = bcache_lookup(dev, b, &created);
+        if (!buf) {
+            break;
+        }
+        if (created) {
+            buf->flags |= BCACHE_READAHEAD;
+            bcache_start_io(buf, BLK_OP_READ);
+            out[count++] = buf;
+        }
+    }
+    ra->ra_end = b;
+    stats.readahead += count;
+    return count;
+}
+
+// --- Buffers ---
+
+static unsigned int bcache_writeback(uint64_t cutoff);
+
+// Find or create the buffer for a block and take a reference, returning
+// with the lock held. When every frame is dirty, one round of write-back
+// makes room. NULL (and unlocked) if out of memory.
+static bcache_buf_t *bcache_getblk(block_device_t *dev, uint64_t block, bool *created) {
+    spin_lock(&bcache_lock);
+    bcache_buf_t *buf = bcache_lookup(dev, block, created);
+    if (!buf && nr_dirty) {
+        spin_unlock(&bcache_lock);
+        bcache_writeback(timer_read_counter());
+        spin_lock(&bcache_lock);
+        buf = bcache_lookup(dev, block, created);
+    }
+    if (!buf) {
+        spin_unlock(&bcache_lock);
+        return NULL;
+    }
+    buf->refs++;
+    stats.lookups++;
+    if (*created) {
+        stats.misses++;
+    } else {
+        stats.hits++;
+        bcache_end_io(buf);
+    }
+    return buf;
+}
+
+bcache_buf_t *bcache_read(block_device_t *dev, uint64_t block) {
+    if (!dev || block >= dev->sectors / BCACHE_BLOCK_SECTORS) {
+        return NULL;
+    }
+    bcache_buf_t *batch[BCACHE_BATCH_MAX];
+    unsigned int count = 0;
+    bool created;
+
+    bcache_buf_t *buf = bcache_getblk(dev, block, &created);
+    if (!buf) {
+        return NULL;
+    }
+    if (buf->flags & BCACHE_READAHEAD) {
+        buf->flags &= ~BCACHE_READAHEAD;
+        stats.readahead_hits++;
+    }
+    if (!(buf->flags & (BCACHE_VALID | BCACHE_IO))) {
+        bcache_start_io(buf, BLK_OP_READ);
+        batch[count++] = buf;
+    }
+    // The demand read goes first; read-ahead shares its doorbell
+    count += bcache_readahead(dev, block, batch + count);
+    spin_unlock(&bcache_lock);
+
+    if (count) {
+        bcache_submit(dev, batch, count);
+    }
+    if (!(buf->flags & BCACHE_VALID)) {
+        bcache_wait_io(buf);
+    }
+    if (!(buf->flags & BCACHE_VALID)) {
+        bcache_release(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+bcache_buf_t *bcache_get(block_device_t *dev, uint64_t block) {
+    if (!dev || block >= dev->sectors / BCACHE_BLOCK_SECTORS) {
+        return NULL;
+    }
+    bool created;
+    bcache_buf_t *buf = bcache_getblk(dev, block, &created);
+    if (!buf) {
+        return NULL;
+    }
+    buf->flags &= ~BCACHE_READAHEAD;
+    spin_unlock(&bcache_lock);
+    if ((buf->flags & BCACHE_IO) && buf->req.op == BLK_OP_READ) {
+        // A read would land on top of the new contents
+        bcache_wait_io(buf);
+    }
+    return buf;
+}
+
+void bcache_mark_dirty(bcache_buf_t *buf) {
+    spin_lock(&bcache_lock);
+    buf->flags |= BCACHE_VALID;
+    if (!(buf->flags & BCACHE_DIRTY)) {
+        buf->flags |= BCACHE_DIRTY;
+        buf->dirtied_at = timer_read_counter();
+        nr_dirty++;
+    } else if (buf->flags & BCACHE_IO) {
+        // The write in flight may have missed this change
+        buf->flags |= BCACHE_REDIRTY;
+    }
+    spin_unlock(&bcache_lock);
+}
+
+void bcache_release(bcache_buf_t *buf) {
+    spin_lock(&bcache_lock);
+    buf->refs--;
+    spin_unlock(&bcache_lock);
+}
+
+// --- Write-back ---
+
+// Lock held. Up to BCACHE_FLUSH_BATCH idle dirty buffers of one device
+// dirtied before cutoff, sorted by block and marked in flight
+static unsigned int bcache_collect_dirty(uint64_t cutoff, bcache_buf_t **batch) {
+    unsigned int count = 0;
+    block_device_t *dev = NULL;
+    for (unsigned int q = BCACHE_A1IN; q <= BCACHE_AM; q++) {
+        for (bcache_buf_t *buf = bcache_queues[q].head; buf; buf = buf->next) {
+            if (count == BCACHE_FLUSH_BATCH) {
+                break;
+            }
+            bcache_end_io(buf);
+            if ((buf->flags & (BCACHE_DIRTY | BCACHE_IO)) != BCACHE_DIRTY ||
+                buf->dirtied_at > cutoff || (dev && buf->dev != dev)) {
+                continue;
+            }
+            dev = buf->dev;
+            unsigned int i = count++;
+            while (i > 0 && batch[i - 1]->block > buf->block) {
+                batch[i] = batch[i - 1];
+                i--;
+            }
+            batch[i] = buf;
+        }
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        batch[i]->refs++;
+        bcache_start_io(batch[i], BLK_OP_WRITE);
+    }
+    return count;
+}
+
+// Write every buffer dirtied before cutoff; returns the failed writes.
+// A failed buffer counts as dirtied now, so it is not retried this pass.
+static unsigned int bcache_writeback(uint64_t cutoff) {
+    unsigned int errors = 0;
+    while (1) {
+        bcache_buf_t *batch[BCACHE_FLUSH_BATCH];
+        spin_lock(&bcache_lock);
+        unsigned int count = bcache_collect_dirty(cutoff, batch);
+        spin_unlock(&bcache_lock);
+        if (count == 0) {
+            return errors;
+        }
+
+        bcache_submit(batch[0]->dev, batch, count);
+        for (unsigned int i = 0; i < count; i++) {
+            batch[i]->dev->wait(&batch[i]->req);
+        }
+
+        spin_lock(&bcache_lock);
+        for (unsigned int i = 0; i < count; i++) {
+            if (batch[i]->req.status != 0) {
+                errors++;
+            }
+            bcache_end_io(batch[i]);
+            batch[i]->refs--;
+        }
+        stats.writebacks += count;
+        spin_unlock(&bcache_lock);
+    }
+}
+
+int bcache_sync(void) {
+    return bcache_writeback(timer_read_counter()) ? -1 : 0;
+}
+
+static void bcache_flush_thread(void *arg) {
+    (void)arg;
+    uint64_t expire = timer_us_to_counter(BCACHE_DIRTY_EXPIRE_MS * 1000ULL);
+    while (1) {
+        thread_sleep_ms(BCACHE_FLUSH_INTERVAL_MS);
+        uint64_t now = timer_read_counter();
+        if (nr_dirty && now > expire) {
+            bcache_writeback(now - expire);
+        }
+    }
+}
+
+// Lock held. Free idle buffers' frames until at most target remain.
+static void bcache_shrink(uint64_t target) {
+    while (frames_used > target) {
+        void *frame = bcache_evict_from(BCACHE_A1IN);
+        if (!frame) {
+            frame = bcache_evict_from(BCACHE_AM);
+        }
+        if (!frame) {
+            break;
+        }
+        free_frame(frame);
+        frames_used--;
+    }
+    bcache_trim_ghosts(frame_limit / 2);
+}
+
+void bcache_drop(void) {
+    bcache_sync();
+    spin_lock(&bcache_lock);
+    bcache_shrink(0);
+    // Forget the ghosts too, so that nothing counts as recently seen
+    bcache_trim_ghosts(0);
+    for (int i = 0; i < BCACHE_MAX_DEVICES; i++) {
+        bcache_ra[i].window = 0;
+        bcache_ra[i].ra_end = 0;
+    }
+    spin_unlock(&bcache_lock);
+}
+
+void bcache_set_limit(uint64_t frames) {
+    spin_lock(&bcache_lock);
+    frame_limit = frames;
+    bcache_shrink(frames);
+    spin_unlock(&bcache_lock);
+}
+
+void bcache_init(void) {
+    if (!thread_create("bcache_flush", bcache_flush_thread, NULL, THREAD_ANY_CPU)) {
+        kprintf("BCache: Unable to start the flusher; call bcache_sync() to write back\n");
+    }
+}
+
+// --- Statistics ---
+
+void bcache_get_stats(bcache_stats_t *out) {
+    *out = stats;
+}
+
+void bcache_print_stats(void) {
+    kprintf("Buffer cache: %llu of %llu frames (%llu KB), %llu dirty\n",
+            frames_used, frame_limit, frames_used * BCACHE_BLOCK_SIZE / 1024, nr_dirty);
+    for (unsigned int q = 0; q < BCACHE_QUEUES; q++) {
+        kprintf("  %-6s %llu buffers\n", queue_names[q], bcache_queues[q].count);
+    }
+    uint64_t ratio = stats.lookups ? stats.hits * 100 / stats.lookups : 0;
+    kprintf("  Lookups:    %llu (%llu hits, %llu misses, %llu%% hit rate)\n",
+            stats.lookups, stats.hits, stats.misses, ratio);
+    kprintf("  Evictions:  %llu (%llu misses found in A1out)\n", stats.evictions, stats.ghost_hits);
+    kprintf("  Read-ahead: %llu blocks, %llu used\n", stats.readahead, stats.readahead_hits);
+    kprintf("  Writeback:  %llu blocks, %llu I/O errors\n", stats.writebacks, stats.io_errors);
+}
@@ -0,0 +1,533 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "fs/initramfs.h"
+#include "drivers/timer.h"
+#include "memory/kheap.h"
+#include "lib/fdt.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+
+// The index is built once before any other thread runs and never changes
+// afterwards, so lookups take no lock.
+
+#define INITRAMFS_HASH_SIZE (1u << INITRAMFS_HASH_BITS)
+
+#define CPIO_HEADER_SIZE    110
+#define CPIO_TRAILER        "TRAILER!!!"
+#define TAR_BLOCK_SIZE      512
+
+static initramfs_node_t *hash_table[INITRAMFS_HASH_SIZE];
+static initramfs_node_t root = {
+    .path = "",
+    .name = "",
+    .mode = INITRAMFS_S_IFDIR | 0755,
+};
+
+static const uint8_t *archive = NULL;
+static uint64_t archive_size = 0;
+static const char *archive_format = "none";
+
+static struct {
+    uint64_t files;
+    uint64_t dirs;
+    uint64_t links;
+    uint64_t bytes;             // File data
+    uint64_t skipped;           // Entries the index cannot use
+    uint64_t index_us;
+} stats;
+
+// --- Path index ---
+
+// FNV-1a
+static uint32_t initramfs_hash(const char *path, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)path[i]) * 16777619u;
+    }
+    return hash & (INITRAMFS_HASH_SIZE - 1);
+}
+
+// Strip leading "/" and "./" and trailing "/"; "." is the root
+static const char *initramfs_clean(const char *path, size_t *len) {
+    size_t n = *len;
+    for (;;) {
+        if (n >= 1 && path[0] == '/') {
+            path++;
+            n--;
+        } else if (n >= 2 && path[0] == '.' && path[1] == '/') {
+            path += 2;
+            n -= 2;
+        } else {
+            break;
+        }
+    }
+    while (n > 0 && path[n - 1] == '/') {
+        n--;
+    }
+    if (n == 1 && path[0] == '.') {
+        n = 0;
+    }
+    *len = n;
+    return path;
+}
+
+static initramfs_node_t *initramfs_find(const char *path, size_t len) {
+    if (len == 0) {
+        return &root;
+    }
+    initramfs_node_t *node = hash_table[initramfs_hash(path, len)];
+    for (; node; node = node->hash_next) {
+        if (strncmp(node->path, path, len) == 0 && node->path[len] == '\0') {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+// A new node for path, linked into the hash and under its directory.
+// The path is used in place when the archive already NUL-terminates it.
+static initramfs_node_t *initramfs_add(const char *path, size_t len, bool terminated);
+
+// The directory for path, created if the archive did not list it; NULL
+// if path is something else
+static initramfs_node_t *initramfs_dir(const char *path, size_t len) {
+    initramfs_node_t *dir = initramfs_find(path, len);
+    if (dir && !initramfs_is_dir(dir)) {
+        return NULL;
+    }
+    if (!dir) {
+        dir = initramfs_add(path, len, false);
+        if (dir) {
+            dir->mode = INITRAMFS_S_IFDIR | 0755;
+            stats.dirs++;
+        }
+    }
+    return dir;
+}
+
+static initramfs_node_t *initramfs_add(const char *path, size_t len, bool terminated) {
+    size_t parent_len = 0;
+    for (size_t i = len; i > 0; i--) {
+        if (path[i - 1] == '/') {
+            parent_len = i - 1;
+            break;
+        }
+    }
+    initramfs_node_t *parent = initramfs_dir(path, parent_len);
+    if (!parent) {
+        return NULL;
+    }
+
+    initramfs_node_t *node = kmalloc(sizeof(*node));
+    if (!node) {
+        return NULL;
+    }
+    memset(node, 0, sizeof(*node));
+    if (terminated) {
+        node->path = path;
+    } else {
+        char *copy = kmalloc(len + 1);
+        if (!copy) {
+            kfree(node);
+            return NULL;
+        }
+        memcpy(copy, path, len);
+        copy[len] = '\0';
+        node->path = copy;
+    }
+    node->name = node->path + (parent_len ? parent_len + 1 : 0);
+
+    uint32_t bucket = initramfs_hash(path, len);
+    node->hash_next = hash_table[bucket];
+    hash_table[bucket] = node;
+    node->parent = parent;
+    node->sibling = parent->children;
+    parent->children = node;
+    return node;
+}
+
+// Index one archive entry; a repeated path replaces the earlier entry
+static bool initramfs_insert(const char *name, size_t len, bool terminated, uint32_t mode,
+                             uint32_t uid, uint32_t gid, uint64_t mtime,
+                             const void *data, uint64_t size) {
+    size_t raw_len = len;
+    const char *path = initramfs_clean(name, &len);
+    // Stripping a trailing '/' leaves the path unterminated
+    terminated = terminated && path + len == name + raw_len;
+
+    initramfs_node_t *node = initramfs_find(path, len);
+    if (!node) {
+        // Out of memory, or a path below something that is not a directory
+        node = initramfs_add(path, len, terminated);
+        if (!node) {
+            stats.skipped++;
+            return true;
+        }
+    } else if (initramfs_is_dir(node) != ((mode & INITRAMFS_S_IFMT) == INITRAMFS_S_IFDIR)) {
+        kprintf("initramfs: /%s changes type; keeping the first entry\n", node->path);
+        stats.skipped++;
+        return true;
+    }
+
+    // A new node has mode 0 until here
+    bool known = node->mode != 0;
+    bool was_dir = known && initramfs_is_dir(node);
+    if (known && (node->mode & INITRAMFS_S_IFMT) == INITRAMFS_S_IFREG) {
+        stats.bytes -= node->size;
+    }
+    node->mode = mode;
+    node->uid = uid;
+    node->gid = gid;
+    node->mtime = mtime;
+    node->data = data;
+    node->size = size;
+
+    switch (mode & INITRAMFS_S_IFMT) {
+        case INITRAMFS_S_IFDIR:
+            if (!was_dir && node != &root) {
+                stats.dirs++;
+            }
+            break;
+        case INITRAMFS_S_IFLNK:
+            if (!known) {
+                stats.links++;
+            }
+            break;
+        default:
+            if (!known) {
+                stats.files++;
+            }
+            stats.bytes += size;
+            break;
+    }
+    return true;
+}
+
+// --- Archive formats ---
+
+static uint64_t parse_number(const uint8_t *field, unsigned int len, unsigned int base) {
+    uint64_t value = 0;
+    for (unsigned int i = 0; i < len; i++) {
+        uint8_t c = field[i];
+        unsigned int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else if (c == ' ' && value == 0) {
+            continue;           // tar pads numbers on the left too
+        } else {
+            break;
+        }
+        if (digit >= base) {
+            break;
+        }
+        value = value * base + digit;
+    }
+    return value;
+}
+
+static inline uint64_t align_up(uint64_t value, uint64_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+// SVR4 "newc" cpio (cpio -H newc): 110-byte hex headers, name and data
+// each padded to 4 bytes, ended by TRAILER!!!
+static bool initramfs_parse_cpio(void) {
+    uint64_t offset = 0;
+    while (offset + CPIO_HEADER_SIZE <= archive_size) {
+        const uint8_t *hdr = archive + offset;
+        if (strncmp((const char *)hdr, "07070", 5) != 0 || (hdr[5] != '1' && hdr[5] != '2')) {
+            kprintf("initramfs: Bad cpio header at offset %llu\n", offset);
+            return false;
+        }
+        // Fields after the magic: ino mode uid gid nlink mtime filesize
+        // devmajor devminor rdevmajor rdevminor namesize check
+        uint64_t field[13];
+        for (unsigned int i = 0; i < 13; i++) {
+            field[i] = parse_number(hdr + 6 + 8 * i, 8, 16);
+        }
+        uint64_t namesize = field[11];
+        uint64_t filesize = field[6];
+        uint64_t data_offset = align_up(offset + CPIO_HEADER_SIZE + namesize, 4);
+        if (namesize == 0 || data_offset + filesize > archive_size) {
+            kprintf("initramfs: Truncated cpio entry at offset %llu\n", offset);
+            return false;
+        }
+
+        const char *name = (const char *)hdr + CPIO_HEADER_SIZE;
+        if (name[namesize - 1] != '\0') {
+            kprintf("initramfs: Bad cpio name at offset %llu\n", offset);
+            return false;
+        }
+        if (strcmp(name, CPIO_TRAILER) == 0) {
+            return true;
+        }
+        if (!initramfs_insert(name, namesize - 1, true, (uint32_t)field[1], (uint32_t)field[2],
+                              (uint32_t)field[3], field[5], archive + data_offset, filesize)) {
+            return false;
+        }
+        offset = align_up(data_offset + filesize, 4);
+    }
+    kprintf("initramfs: cpio archive has no trailer\n");
+    return true;
+}
+
+// Whether a tar header's checksum (the byte sum with the checksum field
+// taken as spaces) matches
+static bool tar_checksum_ok(const uint8_t *hdr) {
+    uint64_t sum = 0;
+    for (unsigned int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        sum += (i >= 148 && i < 156) ? ' ' : hdr[i];
+    }
+    return sum == parse_number(hdr + 148, 8, 8);
+}
+
+static size_t bounded_strlen(const uint8_t *s, size_t max) {
+    size_t len = 0;
+    while (len < max && s[len]) {
+        len++;
+    }
+    return len;
+}
+
+// ustar: 512-byte headers with octal fields, data padded to 512 bytes,
+// ended by a zero block
+static bool initramfs_parse_tar(void) {
+    uint64_t offset = 0;
+    while (offset + TAR_BLOCK_SIZE <= archive_size) {
+        const uint8_t *hdr = archive + offset;
+        if (hdr[0] == '\0') {
+            return true;
+        }
+        if (!tar_checksum_ok(hdr)) {
+            kprintf("initramfs: Bad tar checksum at offset %llu\n", offset);
+            return false;
+        }
+
+        uint64_t size = parse_number(hdr + 124, 12, 8);
+        uint64_t data_offset = offset + TAR_BLOCK_SIZE;
+        char type = (char)hdr[156];
+        // Hard and symbolic links carry no data whatever size says
+        uint64_t stored = (type == '1' || type == '2' || type == '5') ? 0 : size;
+        if (data_offset + stored > archive_size) {
+            kprintf("initramfs: Truncated tar entry at offset %llu\n", offset);
+            return false;
+        }
+
+        // The name is NUL-terminated unless it fills its field; a ustar
+        // prefix goes in front of it
+        const char *name = (const char *)hdr;
+        size_t name_len = bounded_strlen(hdr, 100);
+        bool terminated = name_len < 100;
+        char joined[257];
+        size_t prefix_len = bounded_strlen(hdr + 345, 155);
+        if (prefix_len && strncmp((const char *)hdr + 257, "ustar", 5) == 0) {
+            memcpy(joined, hdr + 345, prefix_len);
+            joined[prefix_len] = '/';
+            memcpy(joined + prefix_len + 1, hdr, name_len);
+            name_len += prefix_len + 1;
+            joined[name_len] = '\0';
+            name = joined;
+            terminated = false;
+        }
+
+        uint32_t mode = (uint32_t)parse_number(hdr + 100, 8, 8) & ~INITRAMFS_S_IFMT;
+        uint32_t uid = (uint32_t)parse_number(hdr + 108, 8, 8);
+        uint32_t gid = (uint32_t)parse_number(hdr + 116, 8, 8);
+        uint64_t mtime = parse_number(hdr + 136, 12, 8);
+        const void *data = archive + data_offset;
+        bool ok = true;
+        switch (type) {
+            case '\0':
+            case '0':
+            case '7':
+                ok = initramfs_insert(name, name_len, terminated, INITRAMFS_S_IFREG | mode,
+                                      uid, gid, mtime, data, size);
+                break;
+            case '5':
+                ok = initramfs_insert(name, name_len, terminated, INITRAMFS_S_IFDIR | mode,
+                                      uid, gid, mtime, NULL, 0);
+                break;
+            case '2':
+                ok = initramfs_insert(name, name_len, terminated, INITRAMFS_S_IFLNK | mode,
+                                      uid, gid, mtime, hdr + 157, bounded_strlen(hdr + 157, 100));
+                break;
+            case '1': {
+                // A hard link shares the data of an earlier entry
+                size_t target_len = bounded_strlen(hdr + 157, 100);
+                const char *target = initramfs_clean((const char *)hdr + 157, &target_len);
+                const initramfs_node_t *node = initramfs_find(target, target_len);
+                if (node && !initramfs_is_dir(node)) {
+                    ok = initramfs_insert(name, name_len, terminated, node->mode, uid, gid,
+                                          mtime, node->data, node->size);
+                } else {
+                    stats.skipped++;
+                }
+                break;
+            }
+            default:
+                // Devices, FIFOs and pax/GNU extension headers
+                stats.skipped++;
+                break;
+        }
+        if (!ok) {
+            return false;
+        }
+        offset = data_offset + align_up(stored, TAR_BLOCK_SIZE);
+    }
+    return true;
+}
+
+// --- Public API ---
+
+void initramfs_init(void) {
+    uint64_t start, end;
+    if (!fdt_available() || !fdt_get_initrd(&start, &end)) {
+        return;
+    }
+    archive = (const uint8_t *)start;
+    archive_size = end - start;
+
+    uint64_t t0 = timer_read_counter();
+    bool ok;
+    if (archive_size >= CPIO_HEADER_SIZE && strncmp((const char *)archive, "07070", 5) == 0) {
+        archive_format = "cpio";
+        ok = initramfs_parse_cpio();
+    } else if (archive_size >= TAR_BLOCK_SIZE && strncmp((const char *)archive + 257, "ustar", 5) == 0) {
+        archive_format = "tar";
+        ok = initramfs_parse_tar();
+    } else {
+        if (archive_size >= 2 && archive[0] == 0x1f && archive[1] == 0x8b) {
+            kprintf("initramfs: initrd is gzip-compressed; pass an uncompressed archive\n");
+        } else {
+            kprintf("initramfs: initrd at 0x%llx is neither newc cpio nor ustar\n", start);
+        }
+        archive = NULL;
+        return;
+    }
+    stats.index_us = timer_counter_to_us(timer_read_counter() - t0);
+
+    kprintf("initramfs: %llu KB %s archive at 0x%llx: %llu files, %llu directories in %llu us%s\n",
+            archive_size / 1024, archive_format, start, stats.files, stats.dirs,
+            stats.index_us, ok ? "" : " (incomplete)");
+}
+
+bool initramfs_present(void) {
+    return archive != NULL;
+}
+
+const initramfs_node_t *initramfs_lookup(const char *path) {
+    if (!archive) {
+        return NULL;
+    }
+    size_t len = strlen(path);
+    path = initramfs_clean(path, &len);
+    return initramfs_find(path, len);
+}
+
+const initramfs_node_t *initramfs_next_child(const initramfs_node_t *dir,
+                                             const initramfs_node_t *prev) {
+    return prev ? prev->sibling : dir->children;
+}
+
+uint64_t initramfs_read(const initramfs_node_t *node, uint64_t offset, const void **data) {
+    if (initramfs_is_dir(node) || offset >= node->size) {
+        *data = NULL;
+        return 0;
+    }
+    *data = (const uint8_t *)node->data + offset;
+    return node->size - offset;
+}
+
+void initramfs_print_info(void) {
+    if (!archive) {
+        kprintf("No initramfs (make qemu INITRD=initrd.cpio)\n");
+        return;
+    }
+    kprintf("initramfs: %s archive at 0x%llx, %llu bytes\n",
+            archive_format, (uint64_t)archive, archive_size);
+    kprintf("  %llu files (%llu KB), %llu directories, %llu symlinks, %llu entries skipped\n",
+            stats.files, stats.bytes / 1024, stats.dirs, stats.links, stats.skipped);
+    kprintf("  Indexed in %llu us\n", stats.index_us);
+}
+
+// --- VFS glue ---
+
+static int initramfs_vfs_lookup(const char *path, void **node) {
+    *node = (void *)initramfs_lookup(path);
+    return *node ? 0 : VFS_ENOENT;
+}
+
+static void initramfs_vfs_put(void *node) {
+    (void)node;                 // Nodes live forever
+}
+
+static void initramfs_fill_stat(const initramfs_node_t *node, vfs_stat_t *st) {
+    switch (node->mode & INITRAMFS_S_IFMT) {
+        case INITRAMFS_S_IFDIR:
+            st->type = VFS_DIR;
+            break;
+        case INITRAMFS_S_IFLNK:
+            st->type = VFS_SYMLINK;
+            break;
+        default:
+            st->type = VFS_FILE;
+            break;
+    }
+    st->mode = node->mode & 07777;
+    st->size = node->size;
+    st->frames = 0;
+}
+
+static void initramfs_vfs_stat(void *node, vfs_stat_t *st) {
+    initramfs_fill_stat(node, st);
+}
+
+static int64_t initramfs_vfs_read(void *node, uint64_t offset, void *buf, uint64_t len) {
+    if (initramfs_is_dir(node)) {
+        return VFS_EISDIR;
+    }
+    const void *data;
+    uint64_t avail = initramfs_read(node, offset, &data);
+    if (len > avail) {
+        len = avail;
+    }
+    memcpy(buf, data, len);
+    return (int64_t)len;
+}
+
+static int initramfs_vfs_readdir(void *node, uint64_t index, vfs_dirent_t *ent) {
+    const initramfs_node_t *dir = node;
+    if (!initramfs_is_dir(dir)) {
+        return VFS_ENOTDIR;
+    }
+    const initramfs_node_t *child = initramfs_next_child(dir, NULL);
+    for (; child && index > 0; index--) {
+        child = initramfs_next_child(dir, child);
+    }
+    if (!child) {
+        return VFS_ENOENT;
+    }
+    size_t len = strlen(child->name);
+    if (len >= VFS_NAME_MAX) {
+        len = VFS_NAME_MAX - 1;
+    }
+    memcpy(ent->name, child->name, len);
+    ent->name[len] = '\0';
+    initramfs_fill_stat(child, &ent->stat);
+    return 0;
+}
+
+const vfs_ops_t initramfs_ops = {
+    .name = "initramfs",
+    .lookup = initramfs_vfs_lookup,
+    .put = initramfs_vfs_put,
+    .stat = initramfs_vfs_stat,
+    .read = initramfs_vfs_read,
+    .readdir = initramfs_vfs_readdir,
+    .print_info = initramfs_print_info,
+};
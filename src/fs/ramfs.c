@@ -0,0 +1,494 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "fs/ramfs.h"
+#include "memory/frame_alloc.h"
+#include "memory/kheap.h"
+#include "sync/spinlock.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+
+typedef struct ramfs_node {
+    char name[VFS_NAME_MAX];
+    vfs_type_t type;
+    uint32_t mode;
+    uint32_t refs;              // Open files and the directory entry
+    uint64_t size;
+    uint64_t frames;            // Data and radix frames
+    // Files: pages of the file, height levels deep; at height 0 the root
+    // is page 0 itself
+    void *root;
+    unsigned int height;
+    void **leaf;                // Last bottom-level node walked through ...
+    uint64_t leaf_base;         // ... and the page index of its slot 0
+    // Directories: children sorted by name
+    struct ramfs_node *parent;
+    struct ramfs_node *children;
+    struct ramfs_node *sibling;
+} ramfs_node_t;
+
+static spinlock_t ramfs_lock = SPINLOCK_INIT;
+static ramfs_node_t root_dir = {
+    .name = "",
+    .type = VFS_DIR,
+    .mode = 0755,
+    .refs = 1,
+};
+static ramfs_stats_t stats;
+
+// --- Page radix tree ---
+
+static inline uint64_t ramfs_capacity(unsigned int height) {
+    return 1ULL << (RAMFS_RADIX_BITS * height);
+}
+
+// The page for index; with create, missing pages and radix nodes are
+// allocated (zeroed). NULL for a hole, or if out of memory.
+static void *ramfs_page(ramfs_node_t *file, uint64_t index, bool create) {
+    void **slot;
+    if (file->leaf && index - file->leaf_base < RAMFS_RADIX_SLOTS) {
+        slot = &file->leaf[index - file->leaf_base];
+    } else {
+        if (index >= ramfs_capacity(file->height)) {
+            if (!create) {
+                return NULL;
+            }
+            // Add levels on top: the old tree becomes slot 0 of the new root
+            while (index >= ramfs_capacity(file->height)) {
+                if (file->root) {
+                    void **node = alloc_frame();
+                    if (!node) {
+                        return NULL;
+                    }
+                    node[0] = file->root;
+                    file->root = node;
+                    file->frames++;
+                    stats.radix_frames++;
+                }
+                file->height++;
+            }
+        }
+
+        slot = &file->root;
+        for (unsigned int level = file->height; level > 0; level--) {
+            if (!*slot) {
+                if (!create || !(*slot = alloc_frame())) {
+                    return NULL;
+                }
+                file->frames++;
+                stats.radix_frames++;
+            }
+            void **node = *slot;
+            if (level == 1) {
+                file->leaf = node;
+                file->leaf_base = index & ~(uint64_t)(RAMFS_RADIX_SLOTS - 1);
+            }
+            slot = &node[(index >> ((level - 1) * RAMFS_RADIX_BITS)) & (RAMFS_RADIX_SLOTS - 1)];
+        }
+    }
+
+    if (!*slot && create && (*slot = alloc_frame())) {
+        file->frames++;
+        stats.data_frames++;
+    }
+    return *slot;
+}
+
+static void ramfs_free_tree(ramfs_node_t *file, void *node, unsigned int level) {
+    if (level > 0) {
+        void **slots = node;
+        for (unsigned int i = 0; i < RAMFS_RADIX_SLOTS; i++) {
+            if (slots[i]) {
+                ramfs_free_tree(file, slots[i], level - 1);
+            }
+        }
+        stats.radix_frames--;
+    } else {
+        stats.data_frames--;
+    }
+    free_frame(node);
+    file->frames--;
+}
+
+// Free the pages from index keep on under *slot, which covers the
+// ramfs_capacity(level) pages from base
+static void ramfs_free_from(ramfs_node_t *file, void **slot, unsigned int level,
+                            uint64_t base, uint64_t keep) {
+    if (!*slot) {
+        return;
+    }
+    if (base >= keep) {
+        ramfs_free_tree(file, *slot, level);
+        *slot = NULL;
+        return;
+    }
+    if (level == 0) {
+        return;
+    }
+    void **node = *slot;
+    uint64_t span = ramfs_capacity(level - 1);
+    for (unsigned int i = 0; i < RAMFS_RADIX_SLOTS; i++) {
+        uint64_t child = base + i * span;
+        if (child + span > keep) {
+            ramfs_free_from(file, &node[i], level - 1, child, keep);
+        }
+    }
+}
+
+static int ramfs_truncate_locked(ramfs_node_t *file, uint64_t size) {
+    if (size > RAMFS_MAX_SIZE) {
+        return VFS_EFBIG;
+    }
+    if (size < file->size) {
+        uint64_t keep = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+        ramfs_free_from(file, &file->root, file->height, 0, keep);
+
+        // Everything left is under slot 0 of each level that is no longer
+        // needed
+        while (file->height > 0 && keep <= ramfs_capacity(file->height - 1)) {
+            void **node = file->root;
+            if (node) {
+                file->root = node[0];
+                free_frame(node);
+                file->frames--;
+                stats.radix_frames--;
+            }
+            file->height--;
+        }
+        file->leaf = NULL;
+
+        // Clear the rest of a partly kept page, which growing the file
+        // again must read as zeros
+        uint64_t in_page = size % PAGE_SIZE;
+        uint8_t *page = in_page ? ramfs_page(file, size / PAGE_SIZE, false) : NULL;
+        if (page) {
+            memset(page + in_page, 0, PAGE_SIZE - in_page);
+        }
+    }
+    file->size = size;
+    return 0;
+}
+
+// --- Namespace ---
+
+// The node named by the first len bytes of path, or NULL; *err says why
+static ramfs_node_t *ramfs_walk(const char *path, size_t len, int *err) {
+    ramfs_node_t *node = &root_dir;
+    const char *end = path + len;
+    while (path < end) {
+        if (*path == '/') {
+            path++;
+            continue;
+        }
+        const char *next = path;
+        while (next < end && *next != '/') {
+            next++;
+        }
+        size_t name_len = (size_t)(next - path);
+        if (node->type != VFS_DIR) {
+            *err = VFS_ENOTDIR;
+            return NULL;
+        }
+        if (name_len >= VFS_NAME_MAX) {
+            *err = VFS_ENAMETOOLONG;
+            return NULL;
+        }
+        ramfs_node_t *child = node->children;
+        while (child && !(strncmp(child->name, path, name_len) == 0 &&
+                          child->name[name_len] == '\0')) {
+            child = child->sibling;
+        }
+        if (!child) {
+            *err = VFS_ENOENT;
+            return NULL;
+        }
+        node = child;
+        path = next;
+    }
+    return node;
+}
+
+static void ramfs_free_node(ramfs_node_t *node) {
+    if (node->type == VFS_DIR) {
+        stats.dirs--;
+    } else {
+        ramfs_truncate_locked(node, 0);
+        stats.files--;
+    }
+    kfree(node);
+}
+
+static int ramfs_lookup(const char *path, void **out) {
+    int err = 0;
+    spin_lock(&ramfs_lock);
+    ramfs_node_t *node = ramfs_walk(path, strlen(path), &err);
+    if (node) {
+        node->refs++;
+    }
+    spin_unlock(&ramfs_lock);
+    *out = node;
+    return err;
+}
+
+static int ramfs_create(const char *path, vfs_type_t type, void **out) {
+    // Split off the last component
+    size_t len = strlen(path);
+    while (len > 0 && path[len - 1] == '/') {
+        len--;
+    }
+    size_t start = len;
+    while (start > 0 && path[start - 1] != '/') {
+        start--;
+    }
+    const char *name = path + start;
+    size_t name_len = len - start;
+    if (name_len == 0) {
+        return VFS_EEXIST;      // The root
+    }
+    if (name_len >= VFS_NAME_MAX) {
+        return VFS_ENAMETOOLONG;
+    }
+    if ((name_len == 1 && name[0] == '.') || (name_len == 2 && name[0] == '.' && name[1] == '.')) {
+        return VFS_EINVAL;
+    }
+
+    ramfs_node_t *node = kmalloc(sizeof(*node));
+    if (!node) {
+        return VFS_ENOMEM;
+    }
+    memset(node, 0, sizeof(*node));
+    memcpy(node->name, name, name_len);
+    node->name[name_len] = '\0';
+    node->type = type;
+    node->mode = type == VFS_DIR ? 0755 : 0644;
+    node->refs = 2;             // The directory entry and the caller
+
+    int err = 0;
+    spin_lock(&ramfs_lock);
+    ramfs_node_t *dir = ramfs_walk(path, start, &err);
+    if (dir && dir->type != VFS_DIR) {
+        err = VFS_ENOTDIR;
+    }
+    if (err) {
+        spin_unlock(&ramfs_lock);
+        kfree(node);
+        return err;
+    }
+    ramfs_node_t **link = &dir->children;
+    while (*link && strcmp((*link)->name, node->name) < 0) {
+        link = &(*link)->sibling;
+    }
+    if (*link && strcmp((*link)->name, node->name) == 0) {
+        spin_unlock(&ramfs_lock);
+        kfree(node);
+        return VFS_EEXIST;
+    }
+    node->parent = dir;
+    node->sibling = *link;
+    *link = node;
+    if (type == VFS_DIR) {
+        stats.dirs++;
+    } else {
+        stats.files++;
+    }
+    spin_unlock(&ramfs_lock);
+    *out = node;
+    return 0;
+}
+
+static int ramfs_unlink(const char *path) {
+    int err = 0;
+    spin_lock(&ramfs_lock);
+    ramfs_node_t *node = ramfs_walk(path, strlen(path), &err);
+    if (node == &root_dir) {
+        err = VFS_EBUSY;
+    } else if (node && node->type == VFS_DIR && node->children) {
+        err = VFS_ENOTEMPTY;
+    }
+    if (err) {
+        spin_unlock(&ramfs_lock);
+        return err;
+    }
+
+    ramfs_node_t **link = &node->parent->children;
+    while (*link != node) {
+        link = &(*link)->sibling;
+    }
+    *link = node->sibling;
+    node->parent = NULL;
+    // Open files keep the data until they close it
+    if (--node->refs == 0) {
+        ramfs_free_node(node);
+    }
+    spin_unlock(&ramfs_lock);
+    return 0;
+}
+
+static void ramfs_put(void *n) {
+    ramfs_node_t *node = n;
+    spin_lock(&ramfs_lock);
+    if (--node->refs == 0) {
+        ramfs_free_node(node);
+    }
+    spin_unlock(&ramfs_lock);
+}
+
+static void ramfs_fill_stat(const ramfs_node_t *node, vfs_stat_t *st) {
+    st->type = node->type;
+    st->mode = node->mode;
+    st->size = node->size;
+    st->frames = node->frames;
+}
+
+static void ramfs_stat(void *n, vfs_stat_t *st) {
+    spin_lock(&ramfs_lock);
+    ramfs_fill_stat(n, st);
+    spin_unlock(&ramfs_lock);
+}
+
+static int ramfs_readdir(void *n, uint64_t index, vfs_dirent_t *ent) {
+    ramfs_node_t *dir = n;
+    if (dir->type != VFS_DIR) {
+        return VFS_ENOTDIR;
+    }
+    spin_lock(&ramfs_lock);
+    ramfs_node_t *child = dir->children;
+    for (; child && index > 0; index--) {
+        child = child->sibling;
+    }
+    if (child) {
+        memcpy(ent->name, child->name, VFS_NAME_MAX);
+        ramfs_fill_stat(child, &ent->stat);
+    }
+    spin_unlock(&ramfs_lock);
+    return child ? 0 : VFS_ENOENT;
+}
+
+// --- File data ---
+
+static int64_t ramfs_read(void *n, uint64_t offset, void *buf, uint64_t len) {
+    ramfs_node_t *file = n;
+    if (file->type == VFS_DIR) {
+        return VFS_EISDIR;
+    }
+    spin_lock(&ramfs_lock);
+    if (offset >= file->size) {
+        spin_unlock(&ramfs_lock);
+        return 0;
+    }
+    if (len > file->size - offset) {
+        len = file->size - offset;
+    }
+
+    uint8_t *out = buf;
+    for (uint64_t done = 0; done < len;) {
+        uint64_t in_page = offset % PAGE_SIZE;
+        uint64_t chunk = PAGE_SIZE - in_page;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        uint8_t *page = ramfs_page(file, offset / PAGE_SIZE, false);
+        if (!page) {
+            memset(out, 0, chunk);
+        } else if (chunk == PAGE_SIZE && ((uintptr_t)out & (PAGE_SIZE - 1)) == 0) {
+            copy_page(out, page);
+        } else {
+            memcpy(out, page + in_page, chunk);
+        }
+        out += chunk;
+        offset += chunk;
+        done += chunk;
+    }
+    spin_unlock(&ramfs_lock);
+    return (int64_t)len;
+}
+
+static int64_t ramfs_write(void *n, uint64_t *offset, const void *buf, uint64_t len, bool append) {
+    ramfs_node_t *file = n;
+    if (file->type == VFS_DIR) {
+        return VFS_EISDIR;
+    }
+    spin_lock(&ramfs_lock);
+    uint64_t pos = append ? file->size : *offset;
+    if (pos > RAMFS_MAX_SIZE || len > RAMFS_MAX_SIZE - pos) {
+        spin_unlock(&ramfs_lock);
+        return VFS_EFBIG;
+    }
+
+    const uint8_t *in = buf;
+    uint64_t done = 0;
+    while (done < len) {
+        uint64_t in_page = pos % PAGE_SIZE;
+        uint64_t chunk = PAGE_SIZE - in_page;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        uint8_t *page = ramfs_page(file, pos / PAGE_SIZE, true);
+        if (!page) {
+            break;
+        }
+        if (chunk == PAGE_SIZE && ((uintptr_t)in & (PAGE_SIZE - 1)) == 0) {
+            copy_page(page, in);
+        } else {
+            memcpy(page + in_page, in, chunk);
+        }
+        in += chunk;
+        pos += chunk;
+        done += chunk;
+    }
+    if (done && pos > file->size) {
+        file->size = pos;
+    }
+    spin_unlock(&ramfs_lock);
+
+    *offset = pos;
+    if (done == 0 && len > 0) {
+        return VFS_ENOMEM;
+    }
+    return (int64_t)done;
+}
+
+static int ramfs_truncate(void *n, uint64_t size) {
+    ramfs_node_t *file = n;
+    if (file->type == VFS_DIR) {
+        return VFS_EISDIR;
+    }
+    spin_lock(&ramfs_lock);
+    int err = ramfs_truncate_locked(file, size);
+    spin_unlock(&ramfs_lock);
+    return err;
+}
+
+// --- Public API ---
+
+const vfs_ops_t ramfs_ops = {
+    .name = "ramfs",
+    .lookup = ramfs_lookup,
+    .create = ramfs_create,
+    .unlink = ramfs_unlink,
+    .put = ramfs_put,
+    .stat = ramfs_stat,
+    .read = ramfs_read,
+    .write = ramfs_write,
+    .truncate = ramfs_truncate,
+    .readdir = ramfs_readdir,
+    .print_info = ramfs_print_info,
+};
+
+void ramfs_init(void) {
+    stats.dirs = 1;             // The root
+}
+
+void ramfs_get_stats(ramfs_stats_t *out) {
+    spin_lock(&ramfs_lock);
+    *out = stats;
+    spin_unlock(&ramfs_lock);
+}
+
+void ramfs_print_info(void) {
+    ramfs_stats_t s;
+    ramfs_get_stats(&s);
+    kprintf("  %llu files, %llu directories, %llu KB in %llu data frames and %llu radix frames\n",
+            s.files, s.dirs, (s.data_frames + s.radix_frames) * PAGE_SIZE / 1024,
+            s.data_frames, s.radix_frames);
+}
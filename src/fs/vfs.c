@@ -0,0 +1,347 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "fs/vfs.h"
+#include "fs/ramfs.h"
+#include "fs/initramfs.h"
+#include "sync/spinlock.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+
+// Mounts are only added during boot, so resolving a path reads the table
+// without the lock. A descriptor belongs to the thread that opened it.
+
+typedef struct {
+    char path[VFS_NAME_MAX];
+    size_t len;
+    const vfs_ops_t *ops;
+} vfs_mount_t;
+
+typedef struct {
+    const vfs_ops_t *ops;       // NULL while the slot is free
+    void *node;
+    uint64_t offset;
+    int flags;
+} vfs_file_t;
+
+static spinlock_t vfs_lock = SPINLOCK_INIT;
+static vfs_mount_t mounts[VFS_MAX_MOUNTS];
+static unsigned int nr_mounts = 0;
+static vfs_file_t files[VFS_MAX_FDS];
+
+// The mount covering an absolute path, and the rest of the path
+static int vfs_resolve(const char *path, const vfs_mount_t **mount, const char **rel) {
+    if (!path || path[0] != '/') {
+        return VFS_EINVAL;
+    }
+    const vfs_mount_t *best = NULL;
+    for (unsigned int i = 0; i < nr_mounts; i++) {
+        const vfs_mount_t *m = &mounts[i];
+        bool covers = m->len == 1 ||
+                      (strncmp(path, m->path, m->len) == 0 &&
+                       (path[m->len] == '/' || path[m->len] == '\0'));
+        if (covers && (!best || m->len > best->len)) {
+            best = m;
+        }
+    }
+    if (!best) {
+        return VFS_ENOENT;
+    }
+    const char *p = path + (best->len == 1 ? 0 : best->len);
+    while (*p == '/') {
+        p++;
+    }
+    *mount = best;
+    *rel = p;
+    return 0;
+}
+
+static vfs_file_t *vfs_file(int fd) {
+    if (fd < 0 || fd >= VFS_MAX_FDS || !files[fd].ops) {
+        return NULL;
+    }
+    return &files[fd];
+}
+
+int vfs_mount(const char *path, const vfs_ops_t *ops) {
+    size_t len = strlen(path);
+    if (path[0] != '/' || len >= VFS_NAME_MAX) {
+        return VFS_EINVAL;
+    }
+    if (len > 1) {
+        vfs_stat_t st;
+        int err = vfs_stat(path, &st);
+        if (err) {
+            return err;
+        }
+        if (st.type != VFS_DIR) {
+            return VFS_ENOTDIR;
+        }
+    }
+
+    spin_lock(&vfs_lock);
+    if (nr_mounts == VFS_MAX_MOUNTS) {
+        spin_unlock(&vfs_lock);
+        return VFS_ENOMEM;
+    }
+    vfs_mount_t *m = &mounts[nr_mounts];
+    memcpy(m->path, path, len + 1);
+    m->len = len;
+    m->ops = ops;
+    nr_mounts++;
+    spin_unlock(&vfs_lock);
+    return 0;
+}
+
+int vfs_open(const char *path, int flags) {
+    const vfs_mount_t *m;
+    const char *rel;
+    int err = vfs_resolve(path, &m, &rel);
+    if (err) {
+        return err;
+    }
+    bool writing = (flags & O_ACCMODE) != O_RDONLY;
+    if ((writing || (flags & (O_CREAT | O_TRUNC))) && !m->ops->write) {
+        return VFS_EROFS;
+    }
+
+    void *node;
+    err = m->ops->lookup(rel, &node);
+    if (err == VFS_ENOENT && (flags & O_CREAT)) {
+        err = m->ops->create(rel, VFS_FILE, &node);
+        if (err == VFS_EEXIST) {
+            err = m->ops->lookup(rel, &node);   // Someone else created it
+        }
+    }
+    if (err) {
+        return err;
+    }
+
+    vfs_stat_t st;
+    m->ops->stat(node, &st);
+    if (st.type == VFS_DIR && (writing || (flags & O_TRUNC))) {
+        m->ops->put(node);
+        return VFS_EISDIR;
+    }
+    if (flags & O_TRUNC) {
+        err = m->ops->truncate(node, 0);
+        if (err) {
+            m->ops->put(node);
+            return err;
+        }
+    }
+
+    spin_lock(&vfs_lock);
+    for (int fd = 0; fd < VFS_MAX_FDS; fd++) {
+        if (!files[fd].ops) {
+            files[fd].ops = m->ops;
+            files[fd].node = node;
+            files[fd].offset = 0;
+            files[fd].flags = flags;
+            spin_unlock(&vfs_lock);
+            return fd;
+        }
+    }
+    spin_unlock(&vfs_lock);
+    m->ops->put(node);
+    return VFS_EMFILE;
+}
+
+int vfs_close(int fd) {
+    vfs_file_t *file = vfs_file(fd);
+    if (!file) {
+        return VFS_EBADF;
+    }
+    const vfs_ops_t *ops = file->ops;
+    void *node = file->node;
+    spin_lock(&vfs_lock);
+    file->ops = NULL;
+    spin_unlock(&vfs_lock);
+    ops->put(node);
+    return 0;
+}
+
+int64_t vfs_read(int fd, void *buf, uint64_t len) {
+    vfs_file_t *file = vfs_file(fd);
+    if (!file || (file->flags & O_ACCMODE) == O_WRONLY) {
+        return VFS_EBADF;
+    }
+    int64_t n = file->ops->read(file->node, file->offset, buf, len);
+    if (n > 0) {
+        file->offset += (uint64_t)n;
+    }
+    return n;
+}
+
+int64_t vfs_write(int fd, const void *buf, uint64_t len) {
+    vfs_file_t *file = vfs_file(fd);
+    if (!file || (file->flags & O_ACCMODE) == O_RDONLY) {
+        return VFS_EBADF;
+    }
+    return file->ops->write(file->node, &file->offset, buf, len, file->flags & O_APPEND);
+}
+
+int64_t vfs_seek(int fd, int64_t offset, int whence) {
+    vfs_file_t *file = vfs_file(fd);
+    if (!file) {
+        return VFS_EBADF;
+    }
+    int64_t base;
+    switch (whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = (int64_t)file->offset;
+            break;
+        case SEEK_END: {
+            vfs_stat_t st;
+            file->ops->stat(file->node, &st);
+            base = (int64_t)st.size;
+            break;
+        }
+        default:
+            return VFS_EINVAL;
+    }
+    if (base + offset < 0) {
+        return VFS_EINVAL;
+    }
+    file->offset = (uint64_t)(base + offset);
+    return (int64_t)file->offset;
+}
+
+int vfs_fstat(int fd, vfs_stat_t *st) {
+    vfs_file_t *file = vfs_file(fd);
+    if (!file) {
+        return VFS_EBADF;
+    }
+    file->ops->stat(file->node, st);
+    return 0;
+}
+
+int vfs_ftruncate(int fd, uint64_t size) {
+    vfs_file_t *file = vfs_file(fd);
+    if (!file || (file->flags & O_ACCMODE) == O_RDONLY) {
+        return VFS_EBADF;
+    }
+    return file->ops->truncate(file->node, size);
+}
+
+int vfs_readdir(int fd, vfs_dirent_t *ent) {
+    vfs_file_t *file = vfs_file(fd);
+    if (!file) {
+        return VFS_EBADF;
+    }
+    int err = file->ops->readdir(file->node, file->offset, ent);
+    if (err == 0) {
+        file->offset++;
+    }
+    return err;
+}
+
+int vfs_stat(const char *path, vfs_stat_t *st) {
+    const vfs_mount_t *m;
+    const char *rel;
+    int err = vfs_resolve(path, &m, &rel);
+    if (err) {
+        return err;
+    }
+    void *node;
+    err = m->ops->lookup(rel, &node);
+    if (err) {
+        return err;
+    }
+    m->ops->stat(node, st);
+    m->ops->put(node);
+    return 0;
+}
+
+int vfs_mkdir(const char *path) {
+    const vfs_mount_t *m;
+    const char *rel;
+    int err = vfs_resolve(path, &m, &rel);
+    if (err) {
+        return err;
+    }
+    if (*rel == '\0') {
+        return VFS_EEXIST;      // A mount point
+    }
+    if (!m->ops->create) {
+        return VFS_EROFS;
+    }
+    void *node;
+    err = m->ops->create(rel, VFS_DIR, &node);
+    if (err == 0) {
+        m->ops->put(node);
+    }
+    return err;
+}
+
+int vfs_unlink(const char *path) {
+    const vfs_mount_t *m;
+    const char *rel;
+    int err = vfs_resolve(path, &m, &rel);
+    if (err) {
+        return err;
+    }
+    if (*rel == '\0') {
+        return VFS_EBUSY;       // A mount point
+    }
+    if (!m->ops->unlink) {
+        return VFS_EROFS;
+    }
+    return m->ops->unlink(rel);
+}
+
+int vfs_truncate(const char *path, uint64_t size) {
+    int fd = vfs_open(path, O_WRONLY);
+    if (fd < 0) {
+        return fd;
+    }
+    int err = vfs_ftruncate(fd, size);
+    vfs_close(fd);
+    return err;
+}
+
+const char *vfs_strerror(int err) {
+    switch (err) {
+        case 0:                 return "Success";
+        case VFS_ENOENT:        return "No such file or directory";
+        case VFS_EBADF:         return "Bad file descriptor";
+        case VFS_ENOMEM:        return "Out of memory";
+        case VFS_EBUSY:         return "Mount point busy";
+        case VFS_EEXIST:        return "File exists";
+        case VFS_ENOTDIR:       return "Not a directory";
+        case VFS_EISDIR:        return "Is a directory";
+        case VFS_EINVAL:        return "Invalid argument";
+        case VFS_EMFILE:        return "Too many open files";
+        case VFS_EFBIG:         return "File too large";
+        case VFS_EROFS:         return "Read-only file system";
+        case VFS_ENAMETOOLONG:  return "File name too long";
+        case VFS_ENOTEMPTY:     return "Directory not empty";
+        default:                return "Unknown error";
+    }
+}
+
+void vfs_print_mounts(void) {
+    for (unsigned int i = 0; i < nr_mounts; i++) {
+        kprintf("%-10s %s\n", mounts[i].path, mounts[i].ops->name);
+        if (mounts[i].ops->print_info) {
+            mounts[i].ops->print_info();
+        }
+    }
+}
+
+void vfs_init(void) {
+    ramfs_init();
+    vfs_mount("/", &ramfs_ops);
+    if (initramfs_present()) {
+        int err = vfs_mkdir("/initrd");
+        if (err == 0) {
+            err = vfs_mount("/initrd", &initramfs_ops);
+        }
+        if (err) {
+            kprintf("VFS: Unable to mount the initramfs on /initrd: %s\n", vfs_strerror(err));
+        }
+    }
+}
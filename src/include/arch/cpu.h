@@ -0,0 +1,56 @@
+#ifndef ARCH_CPU_H
+#define ARCH_CPU_H
+
+#include <stdint.h>
+
+// Maximum number of CPUs the kernel keeps per-CPU state for
+#define MAX_CPUS 4
+
+// Read/write a system register by name, e.g. read_sysreg(cntvct_el0)
+#define read_sysreg(reg) ({                                 \
+    uint64_t __val;                                         \
+    asm volatile("mrs %0, " #reg : "=r" (__val));           \
+    __val;                                                  \
+})
+
+#define write_sysreg(reg, val) \
+    asm volatile("msr " #reg ", %0" : : "r" ((uint64_t)(val)) : "memory")
+
+#define isb()       asm volatile("isb" : : : "memory")
+#define dsb(opt)    asm volatile("dsb " #opt : : : "memory")
+#define dmb(opt)    asm volatile("dmb " #opt : : : "memory")
+
+// Logical index of the executing CPU. TPIDR_EL1 points at the CPU's
+// per-CPU data, whose first member is that index (see arch/smp.h); it is
+// zero on the boot CPU until smp_init_boot_cpu() runs.
+static inline unsigned int cpu_id(void) {
+    uint64_t percpu = read_sysreg(tpidr_el1);
+    return percpu ? *(const unsigned int *)percpu : 0;
+}
+
+// --- Local interrupt masking (DAIF.I) ---
+
+static inline void local_irq_enable(void) {
+    asm volatile("msr daifclr, #2" : : : "memory");
+}
+
+static inline void local_irq_disable(void) {
+    asm volatile("msr daifset, #2" : : : "memory");
+}
+
+// Mask IRQs and return the previous DAIF value for local_irq_restore()
+static inline uint64_t local_irq_save(void) {
+    uint64_t flags = read_sysreg(daif);
+    local_irq_disable();
+    return flags;
+}
+
+static inline void local_irq_restore(uint64_t flags) {
+    write_sysreg(daif, flags);
+}
+
+static inline int irqs_disabled(void) {
+    return (read_sysreg(daif) & (1 << 7)) != 0;
+}
+
+#endif // ARCH_CPU_H
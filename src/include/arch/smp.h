@@ -0,0 +1,107 @@
+#ifndef ARCH_SMP_H
+#define ARCH_SMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "arch/cpu.h"
+
+// Stack of each secondary CPU, in pages
+#define SMP_STACK_PAGES 4
+
+// SGIs used for inter-processor interrupts
+#define IPI_CALL_FUNC   1
+#define IPI_RESCHEDULE  2
+
+typedef void (*smp_call_func_t)(void *arg);
+
+// Arguments for secondary_entry in boot.S, read with the MMU off.
+// The layout is fixed by the offsets used there.
+typedef struct {
+    uint64_t stack_top;
+    uint64_t mair;
+    uint64_t tcr;
+    uint64_t ttbr0;
+    uint64_t sctlr;
+    uint64_t cpu;
+} __attribute__((aligned(64))) smp_boot_args_t;
+
+// A cross-CPU function call request, queued on the target CPU
+typedef struct smp_call_data {
+    struct smp_call_data *next;
+    smp_call_func_t func;
+    void *arg;
+    bool wait;                  // Sender waits for done; data lives on its stack
+    volatile bool done;
+} smp_call_data_t;
+
+struct thread;
+
+// Per-CPU data, pointed to by TPIDR_EL1. cpu must stay the first member:
+// cpu_id() reads it directly.
+typedef struct {
+    unsigned int cpu;           // Logical CPU number
+    uint64_t mpidr;
+    uint8_t gic_mask;           // GIC CPU interface bit for SGI targeting
+    volatile bool online;
+    void *stack_base;           // NULL on the boot CPU (linker stack)
+    smp_call_data_t *volatile call_queue;  // Pending cross-calls, newest first
+    uint64_t calls_handled;
+    uint64_t ipis_sent;         // IPI_CALL_FUNC interrupts raised by this CPU
+    struct thread *current;     // Thread running on this CPU
+    uint32_t preempt_count;     // Preemption is off while non-zero
+    uint32_t irq_depth;         // Inside a hard IRQ handler while non-zero
+    bool in_softirq;            // Running softirq handlers
+    volatile uint32_t softirq_pending;  // Raised softirq vectors, one bit each
+} __attribute__((aligned(64))) percpu_t;
+
+// Per-CPU data of the executing CPU
+static inline percpu_t *this_cpu(void) {
+    return (percpu_t *)read_sysreg(tpidr_el1);
+}
+
+// Keep the scheduler from switching threads on this CPU at IRQ exit.
+// Spinlocks do this for their holders. Nests.
+static inline void preempt_disable(void) {
+    this_cpu()->preempt_count++;
+    asm volatile("" : : : "memory");
+}
+
+static inline void preempt_enable(void) {
+    asm volatile("" : : : "memory");
+    this_cpu()->preempt_count--;
+}
+
+// Per-CPU data of any CPU
+percpu_t *percpu(unsigned int cpu);
+
+// Set up per-CPU data for the boot CPU; must run before anything per-CPU
+void smp_init_boot_cpu(void);
+
+// Start every other CPU listed in the device tree through PSCI
+void smp_init(void);
+
+// C entry point of secondary CPUs (called from boot.S)
+void secondary_main(unsigned int cpu);
+
+// Number of CPUs that are online
+unsigned int smp_num_cpus(void);
+
+bool cpu_online(unsigned int cpu);
+
+// Run func(arg) on one CPU, on the CPUs in a mask (bit n for CPU n, the
+// caller's own bit ignored), or on every other online CPU, from their IPI
+// handler. Requests go on lock-free per-CPU queues and a CPU is only
+// interrupted when its queue was empty, so back-to-back calls share one
+// IPI, and the targets of one call get a single SGI write. With wait,
+// return only after func has finished everywhere. Must be called with IRQs
+// enabled so that concurrent calls cannot deadlock.
+int smp_call_function_single(unsigned int cpu, smp_call_func_t func, void *arg, bool wait);
+void smp_call_function_many(uint32_t cpus, smp_call_func_t func, void *arg, bool wait);
+void smp_call_function(smp_call_func_t func, void *arg, bool wait);
+
+// Mask of the online CPUs
+uint32_t smp_online_mask(void);
+
+void smp_print_info(void);
+
+#endif // ARCH_SMP_H
@@ -0,0 +1,121 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+// A named micro-benchmark runnable from the shell with `bench <name>`
+typedef struct {
+    const char *name;
+    const char *description;
+    void (*run)(int argc, char **argv);
+} bench_t;
+
+// Shell entry point: `bench` lists benchmarks, `bench <name> [args]` runs one
+void bench_run(int argc, char **argv);
+
+// Counter ticks to nanoseconds, for per-operation timings
+uint64_t bench_ticks_to_ns(uint64_t ticks);
+
+// --- Multi-CPU runs (bench.c) ---
+
+typedef void (*bench_cpu_func_t)(void *arg);
+
+// ncpus clamped to the number of online CPUs
+unsigned int bench_max_cpus(unsigned int ncpus);
+
+// Run body(arg) on the calling CPU and ncpus - 1 other online CPUs, all
+// released together once every CPU is ready. The others run it from their
+// IPI handler. Returns the wall-clock ticks until the last CPU finished and
+// fills cpu_ticks[MAX_CPUS] (if not NULL) with each CPU's own time, 0 for
+// CPUs that did not take part. ncpus must not exceed bench_max_cpus().
+uint64_t bench_on_cpus(unsigned int ncpus, bench_cpu_func_t body, void *arg,
+                       uint64_t *cpu_ticks);
+
+// How much longer the slowest CPU took than the fastest, in percent
+uint32_t bench_cpu_spread(const uint64_t *cpu_ticks);
+
+// --- MMU benchmark (mmu_bench.c) ---
+
+// Record MMU-off timings; must run before mmu_init(). Only called at boot
+// in kernels built with CONFIG_BENCH_MMU_BASELINE.
+void bench_mmu_baseline(void);
+void bench_mmu(int argc, char **argv);
+
+// --- TLB benchmark (tlb_bench.c) ---
+
+// Random reads through a page-mapped and a block-mapped alias of RAM
+void bench_tlb(int argc, char **argv);
+
+// --- Address space benchmark (asid_bench.c) ---
+
+// Address space switch cost with ASIDs vs a full TLB flush
+void bench_asid(int argc, char **argv);
+
+// --- Copy-on-write benchmark (cow_bench.c) ---
+
+// Eager address space copy vs mm_clone() and the zero page
+void bench_cow(int argc, char **argv);
+
+// --- vmalloc benchmark (vmalloc_bench.c) ---
+
+// Allocation, lazy free and purge of 1-16 page areas, then every online
+// CPU allocating, checking and freeing areas at once
+void bench_vmalloc(int argc, char **argv);
+
+// --- Lock benchmark (lock_bench.c) ---
+
+// Test-and-set vs ticket vs MCS locks contended by every online CPU
+void bench_locks(int argc, char **argv);
+
+// --- Allocator benchmark (alloc_bench.c) ---
+
+// Frame and kmalloc throughput on 1, 2 and 4 CPUs, with and without the
+// per-CPU caches
+void bench_alloc(int argc, char **argv);
+
+// --- Context switch benchmark (ctxsw_bench.c) ---
+
+// Yield round trips between threads on one CPU, and preemption of threads
+// that never yield
+void bench_ctxsw(int argc, char **argv);
+
+// --- Wake-up benchmark (wake_bench.c) ---
+
+// Ping-pong between two blocked threads, reporting wake-up latency
+void bench_wake(int argc, char **argv);
+
+// --- Fork-join benchmark (forkjoin_bench.c) ---
+
+// Recursive parallel checksum of RAM on 1, 2 and 4 executor CPUs
+void bench_forkjoin(int argc, char **argv);
+
+// --- TLB shootdown benchmark (shootdown_bench.c) ---
+
+// mm_munmap() of pages cached on every CPU under each tlb_flush_mode_t
+void bench_shootdown(int argc, char **argv);
+
+// --- Block device benchmark (blk_bench.c) ---
+
+// 4 KB read IOPS from the virtio-blk disk by pattern, depth and completion mode
+void bench_blk(int argc, char **argv);
+
+// --- ramfs benchmark (ramfs_bench.c) ---
+
+// Byte loop vs memcpy vs copy_page, then ramfs sequential write, overwrite,
+// read, small appends and truncate
+void bench_ramfs(int argc, char **argv);
+
+// --- Console benchmark (console_bench.c) ---
+
+// Console output as one kprintf per character, one write per line and
+// 4 KB blocks on the bound console, with the framebuffer console's flush
+// and blit counts
+void bench_console(int argc, char **argv);
+
+// --- Allocation profiler benchmark (memprof_bench.c) ---
+
+// kmalloc/kfree and alloc_frame/free_frame pairs with the allocation
+// profiler off, sampling, profiling every allocation and with call stacks
+void bench_memprof(int argc, char **argv);
+
+#endif // BENCH_H
@@ -0,0 +1,25 @@
+#ifndef BOOTCHART_H
+#define BOOTCHART_H
+
+#include <stdint.h>
+
+// Boot phase timing from CNTVCT_EL0
+//
+// boot.S stamps its own phases (entry, section copy, BSS clear) in
+// registers and stores them once .bss is zeroed. kernel_main marks the
+// end of each later phase. The chart is printed when the shell starts,
+// ending with a "bootchart:" line that is easy to compare across builds.
+
+#define BOOTCHART_MAX_PHASES    24
+#define BOOTCHART_ASM_STAMPS    3
+
+// CNTVCT at _start, after the section copy and after the BSS clear,
+// written by boot.S
+extern uint64_t bootchart_asm_stamps[BOOTCHART_ASM_STAMPS];
+
+// The phase that ran since the previous mark ends now; name must be static
+void bootchart_mark(const char *phase);
+
+void bootchart_print(void);
+
+#endif // BOOTCHART_H
@@ -0,0 +1,25 @@
+#ifndef KSYMS_H
+#define KSYMS_H
+
+#include <stdint.h>
+
+// One entry of the link-time symbol table (generated by scripts/gen_ksyms.sh)
+typedef struct {
+    uint64_t addr;
+    const char *name;
+} ksym_t;
+
+// Find the function containing addr. Returns its name and stores the offset
+// of addr within it, or returns NULL if addr is not kernel text.
+const char *ksym_lookup(uint64_t addr, uint64_t *offset);
+
+// Index of the symbol containing addr in the table, or -1
+long ksym_index(uint64_t addr);
+
+// Symbol by table index
+const ksym_t *ksym_get(long index);
+
+// Number of symbols in the table
+uint64_t ksym_count(void);
+
+#endif // KSYMS_H
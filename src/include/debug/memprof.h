@@ -0,0 +1,67 @@
+#ifndef MEMPROF_H
+#define MEMPROF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Allocation profiler: live memory per call site of kmalloc and alloc_frame
+//
+// While stopped, MEMPROF_ALLOC and MEMPROF_FREE cost one load and a
+// not-taken branch. Running, a profiled allocation is charged to its call
+// site (the allocator's return address, and with -g the return addresses
+// of a few frames above it) in a fixed-size hash table, and remembered by
+// pointer in a second one so that its free can be charged back.
+//
+// Profiling every allocation takes the profiler's lock on each one. In
+// sampling mode an allocation is profiled about once per sample_bytes
+// allocated on a CPU, weighted by sample_bytes, so a site's figures are
+// estimates and most allocations cost a per-CPU countdown. Frees check a
+// lock-free presence filter first and only take the lock when it says
+// the pointer may be profiled.
+
+#define MEMPROF_SITE_SLOTS      512     // Distinct call sites, a power of two
+#define MEMPROF_LIVE_SLOTS      4096    // Profiled allocations alive at once, a power of two
+#define MEMPROF_STACK_DEPTH     3       // Callers above the site recorded with -g
+#define MEMPROF_FILTER_SLOTS    16384   // Presence filter counters, a power of two
+
+typedef enum {
+    MEMPROF_KMALLOC,
+    MEMPROF_FRAME,
+} memprof_kind_t;
+
+extern volatile bool memprof_running;
+
+void memprof_alloc(memprof_kind_t kind, void *ptr, size_t size, uint64_t site, uint64_t fp);
+void memprof_free(void *ptr);
+
+// For the allocators themselves: charge ptr to whoever called them
+#define MEMPROF_ALLOC(kind, ptr, size)                                          \
+    do {                                                                        \
+        if (__builtin_expect(memprof_running, 0) && (ptr)) {                    \
+            memprof_alloc(kind, ptr, size,                                      \
+                          (uint64_t)__builtin_return_address(0),                \
+                          (uint64_t)__builtin_frame_address(0));                \
+        }                                                                       \
+    } while (0)
+
+#define MEMPROF_FREE(ptr)                                                       \
+    do {                                                                        \
+        if (__builtin_expect(memprof_running, 0)) {                             \
+            memprof_free(ptr);                                                  \
+        }                                                                       \
+    } while (0)
+
+// Start profiling, every allocation if sample_bytes is 0, optionally
+// recording callers. Clears previous results.
+void memprof_start(uint64_t sample_bytes, bool callstacks);
+
+// Stop profiling; what was live at that point is kept for the report
+void memprof_stop(void);
+
+bool memprof_is_running(void);
+
+// Print the top_n call sites by live bytes, symbolized
+void memprof_report(unsigned int top_n);
+
+#endif // MEMPROF_H
@@ -0,0 +1,28 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Samples kept per CPU; further samples are counted as dropped
+#define PROF_MAX_SAMPLES 4096
+
+// Return addresses recorded per sample when call stacks are enabled
+#define PROF_STACK_DEPTH 4
+
+// Distinct symbols tracked by the report histogram
+#define PROF_HIST_SLOTS 512
+
+// Start sampling at hz (rounded to a divisor of TIMER_HZ), optionally
+// walking frame pointers to record callers. Clears previous samples.
+int profiler_start(unsigned int hz, bool callstacks);
+
+// Stop sampling; samples are kept for profiler_report()
+void profiler_stop(void);
+
+// Print a histogram of the top_n functions by self samples
+void profiler_report(unsigned int top_n);
+
+bool profiler_is_running(void);
+
+#endif // PROFILER_H
@@ -0,0 +1,17 @@
+#ifndef STACKWALK_H
+#define STACKWALK_H
+
+#include <stdint.h>
+
+// Frame-pointer stack walking, for the profilers
+//
+// fp is an AArch64 frame record { previous fp, return address }. Records
+// are only followed while they are 16-byte aligned, inside kernel RAM and
+// higher up the stack than the last one, so a corrupt chain ends the walk
+// instead of faulting.
+
+// Store up to depth return addresses, starting with fp's own, and zero
+// the rest of callers. Returns how many were found.
+int stack_walk(uint64_t fp, uint64_t *callers, int depth);
+
+#endif // STACKWALK_H
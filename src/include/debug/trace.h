@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Static tracepoints into per-CPU binary ring buffers
+//
+// TRACE(kmalloc, size, ptr) costs one load and a not-taken branch while
+// the event is disabled. Enabled, it reserves a slot in the running CPU's
+// ring with one atomic add, which nests safely with interrupts and
+// preemption, and fills in a fixed-size record with a CNTVCT timestamp.
+// Nothing locks and nothing is formatted; the rings overwrite their
+// oldest records. `trace dump` prints the rings as hex lines for
+// scripts/trace_decode.py to turn back into events.
+
+#define TRACE_RING_RECORDS  4096    // Per CPU, a power of two
+
+// Every tracepoint: name and what its two arguments are
+#define TRACE_EVENTS(X)                  \
+    X(kmalloc,      size,   ptr)         \
+    X(kfree,        ptr,    unused)      \
+    X(alloc_frame,  frame,  unused)      \
+    X(free_frame,   frame,  refs)        \
+    X(irq,          irq,    elr)
+
+typedef enum {
+    TRACE_EVENT_NONE,           // A slot not yet (or still being) written
+#define TRACE_EVENT_ID(name, arg0, arg1) TRACE_EVENT_##name,
+    TRACE_EVENTS(TRACE_EVENT_ID)
+#undef TRACE_EVENT_ID
+    TRACE_NR_EVENTS
+} trace_event_t;
+
+// The binary format trace_decode.py reads, little-endian
+typedef struct {
+    uint64_t timestamp;         // CNTVCT
+    uint16_t event;             // trace_event_t
+    uint16_t cpu;
+    uint32_t seq;               // Position in the CPU's ring, to spot gaps
+    uint64_t arg0;
+    uint64_t arg1;
+} trace_record_t;
+
+// Bit per event, set while it is enabled
+extern volatile uint32_t trace_enabled_mask;
+
+void trace_record(trace_event_t event, uint64_t arg0, uint64_t arg1);
+
+#define TRACE(name, arg0, arg1)                                                 \
+    do {                                                                        \
+        if (__builtin_expect(trace_enabled_mask & (1U << TRACE_EVENT_##name), 0)) { \
+            trace_record(TRACE_EVENT_##name, (uint64_t)(arg0), (uint64_t)(arg1)); \
+        }                                                                       \
+    } while (0)
+
+// Enable or disable an event by name ("all" for every one); false if
+// there is no such event
+bool trace_set_enabled(const char *name, bool enabled);
+
+// Empty every CPU's ring
+void trace_clear(void);
+
+// Print the enabled events and what each ring holds
+void trace_print_status(void);
+
+// Stream every ring's records through the console in the format of
+// scripts/trace_decode.py. Tracing is paused meanwhile.
+void trace_dump(void);
+
+#endif // TRACE_H
@@ -0,0 +1,60 @@
+#ifndef FW_CFG_H
+#define FW_CFG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// QEMU firmware configuration (fw_cfg) device
+//
+// fw_cfg exposes named blobs ("files") such as etc/ramfb. On the virt
+// machine it is an MMIO device with a big-endian 16-bit selector, a data
+// register that reads a blob one byte at a time, and a DMA register. A
+// DMA transfer moves a whole blob in one request, and it is the only way
+// to write one.
+
+#define FW_CFG_MMIO_BASE    0x09020000ULL   // Without a device tree node
+
+// Register offsets
+#define FW_CFG_DATA         0x00
+#define FW_CFG_SELECTOR     0x08
+#define FW_CFG_DMA          0x10
+
+// Fixed selectors
+#define FW_CFG_SIGNATURE    0x0000
+#define FW_CFG_ID           0x0001
+#define FW_CFG_FILE_DIR     0x0019
+
+// FW_CFG_ID feature bits
+#define FW_CFG_ID_TRADITIONAL   0x01
+#define FW_CFG_ID_DMA           0x02
+
+// fw_cfg_dma_t.control bits
+#define FW_CFG_DMA_ERROR    0x01
+#define FW_CFG_DMA_READ     0x02
+#define FW_CFG_DMA_SKIP     0x04
+#define FW_CFG_DMA_SELECT   0x08
+#define FW_CFG_DMA_WRITE    0x10
+
+// DMA descriptor, all fields big-endian
+typedef struct {
+    uint32_t control;
+    uint32_t length;
+    uint64_t address;
+} __attribute__((packed, aligned(8))) fw_cfg_dma_t;
+
+// Find the device and check its signature
+void fw_cfg_init(void);
+
+bool fw_cfg_present(void);
+bool fw_cfg_has_dma(void);
+
+// The selector and size of a named blob; false if there is no such file
+bool fw_cfg_find_file(const char *name, uint16_t *select, uint32_t *size);
+
+// Read len bytes of a blob from its start; by DMA when available
+bool fw_cfg_read(uint16_t select, void *buf, uint32_t len);
+
+// Write len bytes to a blob by DMA; buf must be in identity-mapped RAM
+bool fw_cfg_write(uint16_t select, const void *buf, uint32_t len);
+
+#endif // FW_CFG_H
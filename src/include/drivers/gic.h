@@ -0,0 +1,56 @@
+#ifndef GIC_H
+#define GIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "exceptions/exceptions.h"
+
+// GICv2 on the QEMU virt machine
+#define GICD_BASE 0x08000000
+#define GICC_BASE 0x08010000
+
+// Architectural limit on interrupt IDs (1020-1023 are special)
+#define GIC_MAX_IRQS 1020
+#define GIC_SPURIOUS_IRQ 1023
+
+// Interrupt ID ranges
+#define GIC_SGI_BASE 0   // Software generated, 0-15
+#define GIC_PPI_BASE 16  // Private peripheral, 16-31
+#define GIC_SPI_BASE 32  // Shared peripheral, 32+
+
+// Handler invoked with the interrupt ID, the interrupted context and the
+// cookie passed at registration time
+typedef void (*irq_handler_t)(unsigned int irq, saved_registers_t *context, void *data);
+
+// Initialize the distributor and the boot CPU's interface
+void gic_init(void);
+
+// Initialize the banked per-CPU interface (every CPU, including the boot CPU)
+void gic_cpu_init(void);
+
+// GIC CPU interface bit of the calling CPU, for gic_send_sgi() targets
+uint8_t gic_cpu_target_mask(void);
+
+// Register a handler for an interrupt ID and enable it
+int irq_register(unsigned int irq, irq_handler_t handler, void *data);
+
+// Enable/disable forwarding of an interrupt
+void gic_enable_irq(unsigned int irq);
+void gic_disable_irq(unsigned int irq);
+
+// Set interrupt priority (0 = highest, 0xFF = lowest)
+void gic_set_priority(unsigned int irq, uint8_t priority);
+
+// Configure an SPI as edge (true) or level (false) triggered
+void gic_set_edge_triggered(unsigned int irq, bool edge);
+
+// Send a software generated interrupt to the CPUs in target_mask
+void gic_send_sgi(unsigned int sgi, uint8_t target_mask);
+
+// Acknowledge and dispatch all pending interrupts (called from handle_irq)
+void gic_handle_irq(saved_registers_t *context);
+
+// Number of times an interrupt ID has been dispatched
+uint64_t gic_get_irq_count(unsigned int irq);
+
+#endif // GIC_H
@@ -0,0 +1,72 @@
+#ifndef PMU_H
+#define PMU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "arch/cpu.h"
+
+// Common architectural PMUv3 event numbers
+#define PMU_EVENT_SW_INCR           0x00
+#define PMU_EVENT_L1I_CACHE_REFILL  0x01
+#define PMU_EVENT_L1I_TLB_REFILL    0x02
+#define PMU_EVENT_L1D_CACHE_REFILL  0x03
+#define PMU_EVENT_L1D_CACHE         0x04
+#define PMU_EVENT_L1D_TLB_REFILL    0x05
+#define PMU_EVENT_INST_RETIRED      0x08
+#define PMU_EVENT_BR_MIS_PRED       0x10
+#define PMU_EVENT_CPU_CYCLES        0x11
+#define PMU_EVENT_MEM_ACCESS        0x13
+#define PMU_EVENT_L2D_CACHE_REFILL  0x17
+#define PMU_EVENT_L2D_TLB_REFILL    0x2D
+
+// Events a single session can count (multiplexed over the hardware counters)
+#define PMU_MAX_EVENTS 8
+
+// A counting session on the calling CPU. Counts are accumulated on every
+// timer tick, which also rotates event groups when there are more events
+// than hardware counters.
+typedef struct {
+    int num_events;
+    uint16_t events[PMU_MAX_EVENTS];
+    uint64_t counts[PMU_MAX_EVENTS];   // Raw counts while scheduled
+    uint64_t enabled[PMU_MAX_EVENTS];  // Cycles each event was scheduled
+    uint64_t cycles;                   // Cycles over the whole session
+    uint64_t start_cycles;
+    unsigned int cpu;
+} pmu_session_t;
+
+// Detect the PMU and start the free-running cycle counter on the boot CPU
+bool pmu_init(void);
+
+// Start the cycle counter on the calling CPU
+void pmu_cpu_init(void);
+
+bool pmu_available(void);
+
+// Number of programmable event counters (PMCR_EL0.N)
+unsigned int pmu_num_counters(void);
+
+// Whether the implementation counts a common event (PMCEID0/1_EL0)
+bool pmu_event_supported(uint16_t event);
+
+// Short name of a common event, or NULL
+const char *pmu_event_name(uint16_t event);
+
+// Look up an event number by name; returns -1 if unknown
+int pmu_event_by_name(const char *name);
+
+// Session control (one active session at a time)
+int pmu_session_add_event(pmu_session_t *session, uint16_t event);
+int pmu_session_start(pmu_session_t *session);
+void pmu_session_stop(pmu_session_t *session);
+
+// Count for event index i, scaled up if it was multiplexed
+uint64_t pmu_session_value(const pmu_session_t *session, int i, bool *scaled);
+
+// Free-running 64-bit cycle counter of the calling CPU
+static inline uint64_t pmu_read_cycles(void) {
+    isb();
+    return read_sysreg(pmccntr_el0);
+}
+
+#endif // PMU_H
@@ -0,0 +1,33 @@
+#ifndef PSCI_H
+#define PSCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// PSCI 0.2+ function IDs (SMC64 where an address is passed)
+#define PSCI_FN_VERSION         0x84000000
+#define PSCI_FN_CPU_OFF         0x84000002
+#define PSCI_FN64_CPU_ON        0xC4000003
+#define PSCI_FN_SYSTEM_OFF      0x84000008
+#define PSCI_FN_SYSTEM_RESET    0x84000009
+
+// Return codes
+#define PSCI_SUCCESS            0
+#define PSCI_NOT_SUPPORTED      -1
+#define PSCI_INVALID_PARAMS     -2
+#define PSCI_DENIED             -3
+#define PSCI_ALREADY_ON         -4
+#define PSCI_ON_PENDING         -5
+#define PSCI_INTERNAL_FAILURE   -6
+
+// Pick the HVC or SMC conduit from the device tree's /psci node
+bool psci_init(void);
+
+// Start the CPU with the given MPIDR at entry (physical address, MMU off)
+// with context_id in x0
+int psci_cpu_on(uint64_t mpidr, uint64_t entry, uint64_t context_id);
+
+void psci_system_off(void);
+void psci_system_reset(void);
+
+#endif // PSCI_H
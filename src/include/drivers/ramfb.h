@@ -0,0 +1,28 @@
+#ifndef RAMFB_H
+#define RAMFB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// QEMU ramfb display (-device ramfb)
+//
+// The framebuffer is ordinary guest RAM. The driver allocates it from the
+// PMM and tells QEMU where it is by writing a mode to the fw_cfg file
+// etc/ramfb, which needs fw_cfg DMA. QEMU scans the memory out on its own,
+// so drawing is plain stores with no flush or doorbell.
+
+#define RAMFB_FILE              "etc/ramfb"
+#define RAMFB_FORMAT_XRGB8888   0x34325258  // DRM fourcc "XR24"
+#define RAMFB_BPP               4
+
+typedef struct {
+    uint32_t *pixels;           // 0x00RRGGBB
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;            // Bytes per scanline
+} framebuffer_t;
+
+// Set up a width x height XRGB8888 display; false without ramfb
+bool ramfb_init(uint32_t width, uint32_t height, framebuffer_t *fb);
+
+#endif // RAMFB_H
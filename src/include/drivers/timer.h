@@ -0,0 +1,42 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include "exceptions/exceptions.h"
+
+// Periodic tick rate of the kernel timer
+#define TIMER_HZ 1000
+
+// EL1 virtual timer PPI on the QEMU virt machine
+#define TIMER_IRQ 27
+
+// Maximum number of callbacks run on every tick
+#define TIMER_MAX_TICK_HANDLERS 8
+
+// Called in IRQ context on every tick with the interrupted context
+typedef void (*tick_handler_t)(saved_registers_t *context);
+
+// Register the tick interrupt and start the boot CPU's timer
+void timer_init(void);
+
+// Start the periodic tick on the calling CPU
+void timer_cpu_init(void);
+
+// Add a callback to run on every tick (on every CPU)
+int timer_add_tick_handler(tick_handler_t handler);
+
+// Remove a previously added tick callback
+void timer_remove_tick_handler(tick_handler_t handler);
+
+// Number of ticks the boot CPU has taken since timer_init()
+uint64_t timer_get_ticks(void);
+
+// Raw counter access (CNTVCT_EL0 / CNTFRQ_EL0)
+uint64_t timer_read_counter(void);
+uint64_t timer_get_frequency(void);
+
+// Convert between counter ticks and wall-clock units
+uint64_t timer_counter_to_us(uint64_t counts);
+uint64_t timer_us_to_counter(uint64_t us);
+
+#endif // TIMER_H
@@ -0,0 +1,212 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// virtio over the MMIO transport, as on the QEMU virt machine
+//
+// Both the legacy (version 1) register layout QEMU uses by default and the
+// version 2 layout (-global virtio-mmio.force-legacy=false) are driven.
+// Queues are split virtqueues laid out contiguously in the legacy format,
+// which a version 2 device accepts as three separate addresses.
+
+// Transport slots when the device tree has no virtio,mmio nodes
+#define VIRTIO_MMIO_BASE      0x0a000000ULL
+#define VIRTIO_MMIO_STRIDE    0x200
+#define VIRTIO_MMIO_SLOTS     32
+#define VIRTIO_MMIO_IRQ_BASE  48
+
+#define VIRTIO_MAX_DEVICES    8
+
+// --- MMIO registers ---
+
+#define VIRTIO_MMIO_MAGIC_VALUE         0x000   // "virt"
+#define VIRTIO_MMIO_VERSION             0x004
+#define VIRTIO_MMIO_DEVICE_ID           0x008
+#define VIRTIO_MMIO_VENDOR_ID           0x00c
+#define VIRTIO_MMIO_DEVICE_FEATURES     0x010
+#define VIRTIO_MMIO_DEVICE_FEATURES_SEL 0x014
+#define VIRTIO_MMIO_DRIVER_FEATURES     0x020
+#define VIRTIO_MMIO_DRIVER_FEATURES_SEL 0x024
+#define VIRTIO_MMIO_GUEST_PAGE_SIZE     0x028   // Legacy only
+#define VIRTIO_MMIO_QUEUE_SEL           0x030
+#define VIRTIO_MMIO_QUEUE_NUM_MAX       0x034
+#define VIRTIO_MMIO_QUEUE_NUM           0x038
+#define VIRTIO_MMIO_QUEUE_ALIGN         0x03c   // Legacy only
+#define VIRTIO_MMIO_QUEUE_PFN           0x040   // Legacy only
+#define VIRTIO_MMIO_QUEUE_READY         0x044
+#define VIRTIO_MMIO_QUEUE_NOTIFY        0x050
+#define VIRTIO_MMIO_INTERRUPT_STATUS    0x060
+#define VIRTIO_MMIO_INTERRUPT_ACK       0x064
+#define VIRTIO_MMIO_STATUS              0x070
+#define VIRTIO_MMIO_QUEUE_DESC_LOW      0x080
+#define VIRTIO_MMIO_QUEUE_DESC_HIGH     0x084
+#define VIRTIO_MMIO_QUEUE_AVAIL_LOW     0x090
+#define VIRTIO_MMIO_QUEUE_AVAIL_HIGH    0x094
+#define VIRTIO_MMIO_QUEUE_USED_LOW      0x0a0
+#define VIRTIO_MMIO_QUEUE_USED_HIGH     0x0a4
+#define VIRTIO_MMIO_CONFIG              0x100
+
+#define VIRTIO_MMIO_MAGIC 0x74726976
+
+// Device status bits
+#define VIRTIO_STATUS_ACKNOWLEDGE   0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FEATURES_OK   0x08
+#define VIRTIO_STATUS_FAILED        0x80
+
+// InterruptStatus bits
+#define VIRTIO_INT_USED_RING        0x01
+#define VIRTIO_INT_CONFIG           0x02
+
+// Device IDs
+#define VIRTIO_ID_NET               1
+#define VIRTIO_ID_BLOCK             2
+#define VIRTIO_ID_CONSOLE           3
+
+// Transport feature bits
+#define VIRTIO_F_INDIRECT_DESC      28
+#define VIRTIO_F_VERSION_1          32
+
+#define VIRTIO_FEATURE(bit) (1ULL << (bit))
+
+// --- Split virtqueues ---
+
+#define VIRTQ_DESC_F_NEXT           1
+#define VIRTQ_DESC_F_WRITE          2   // Device writes the buffer
+#define VIRTQ_DESC_F_INDIRECT       4   // Buffer is a table of descriptors
+
+#define VIRTQ_AVAIL_F_NO_INTERRUPT  1
+#define VIRTQ_USED_F_NO_NOTIFY      1
+
+// Largest queue this driver sets up, whatever the device offers
+#define VIRTQ_MAX_SIZE              256
+
+// The legacy layout puts the used ring on the next page boundary
+#define VIRTQ_LEGACY_ALIGN          4096
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) virtq_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    volatile uint16_t idx;
+    uint16_t ring[];
+} __attribute__((packed)) virtq_avail_t;
+
+typedef struct {
+    uint32_t id;                // Head descriptor of the completed chain
+    uint32_t len;               // Bytes the device wrote
+} __attribute__((packed)) virtq_used_elem_t;
+
+typedef struct {
+    volatile uint16_t flags;
+    volatile uint16_t idx;
+    virtq_used_elem_t ring[];
+} __attribute__((packed)) virtq_used_t;
+
+// One buffer of a request, as handed to virtqueue_add()
+typedef struct {
+    uint64_t addr;              // Physical (= virtual) address
+    uint32_t len;
+    bool device_writes;
+} virtq_buf_t;
+
+struct virtio_dev;
+
+typedef struct {
+    struct virtio_dev *dev;
+    unsigned int index;
+    uint16_t size;
+    virtq_desc_t *desc;
+    virtq_avail_t *avail;
+    virtq_used_t *used;
+    void *ring_mem;
+    unsigned int ring_frames;
+    void **cookies;             // Per head descriptor, returned on completion
+    uint16_t free_head;         // Free descriptors are chained through next
+    uint16_t num_free;
+    uint16_t avail_idx;         // Published to the device by virtqueue_kick()
+    uint16_t last_used;
+    uint16_t unkicked;          // Chains added since the last kick
+    uint64_t chains;
+    uint64_t kicks;
+    uint64_t notifies;          // Kicks that reached the device
+} virtqueue_t;
+
+// --- Devices ---
+
+typedef struct virtio_dev {
+    uint64_t base;
+    unsigned int irq;
+    uint32_t version;
+    uint32_t device_id;
+    uint32_t vendor_id;
+    uint64_t features;          // Negotiated
+    bool claimed;
+} virtio_dev_t;
+
+// Find the transports from the device tree (or the fixed QEMU slots)
+void virtio_init(void);
+
+// Claim the first unclaimed device of a type, or NULL
+virtio_dev_t *virtio_claim(uint32_t device_id);
+
+// Reset the device and accept the subset of wanted features it offers.
+// Returns false (and marks the device failed) if it rejects them.
+bool virtio_negotiate(virtio_dev_t *dev, uint64_t wanted);
+
+static inline bool virtio_has_feature(const virtio_dev_t *dev, unsigned int bit) {
+    return (dev->features & VIRTIO_FEATURE(bit)) != 0;
+}
+
+// Set up queue index with at most max_size entries (a power of two)
+virtqueue_t *virtqueue_create(virtio_dev_t *dev, unsigned int index, unsigned int max_size);
+
+// Tell the device the driver is ready, or that it gave up
+void virtio_driver_ok(virtio_dev_t *dev);
+void virtio_fail(virtio_dev_t *dev);
+
+// Read and acknowledge the interrupt status (VIRTIO_INT_*)
+uint32_t virtio_ack_irq(virtio_dev_t *dev);
+
+// Device-specific configuration space
+uint32_t virtio_config_read32(virtio_dev_t *dev, unsigned int offset);
+uint64_t virtio_config_read64(virtio_dev_t *dev, unsigned int offset);
+
+// --- Virtqueue operations ---
+//
+// None of these lock: each queue belongs to one driver, which serializes
+// them (with IRQs masked if its interrupt handler reaps completions).
+
+// Queue a chain of count buffers, device-readable ones first, one
+// descriptor each. Returns the head descriptor or -1 if the ring is full.
+int virtqueue_add(virtqueue_t *vq, const virtq_buf_t *bufs, unsigned int count, void *cookie);
+
+// Queue the buffers through the indirect table (count entries, owned by
+// the caller until completion): the chain takes one ring descriptor.
+int virtqueue_add_indirect(virtqueue_t *vq, virtq_desc_t *table, const virtq_buf_t *bufs,
+                           unsigned int count, void *cookie);
+
+// Publish every chain added since the last kick and notify the device
+// once, unless it asked not to be
+void virtqueue_kick(virtqueue_t *vq);
+
+// Next completed chain's cookie (and the bytes written to len), or NULL
+void *virtqueue_get_used(virtqueue_t *vq, uint32_t *len);
+
+bool virtqueue_has_used(virtqueue_t *vq);
+
+// Ask the device not to (or again to) interrupt on completions
+void virtqueue_disable_irq(virtqueue_t *vq);
+void virtqueue_enable_irq(virtqueue_t *vq);
+
+void virtio_print_info(void);
+
+#endif // VIRTIO_H
@@ -0,0 +1,117 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// virtio-blk disk driver
+//
+// Requests are submitted in batches: every request that fits goes on the
+// ring and the device is notified once per batch. Each request's header,
+// data segments and status byte go through one indirect descriptor table,
+// so it takes a single ring entry whatever its scatter-gather list.
+// Completions are reaped either by the interrupt handler or, in polling
+// mode, by whoever waits, with device interrupts suppressed.
+//
+// Buffers must lie in identity-mapped RAM (kmalloc or frames, not vmalloc).
+
+#define VIRTIO_BLK_SECTOR_SIZE  512
+#define VIRTIO_BLK_MAX_SEGS     16      // Data segments per request
+#define VIRTIO_BLK_QUEUE_SIZE   128     // Requests in flight at most
+
+// virtio-blk feature bits
+#define VIRTIO_BLK_F_SIZE_MAX   1
+#define VIRTIO_BLK_F_SEG_MAX    2
+#define VIRTIO_BLK_F_RO         5
+#define VIRTIO_BLK_F_BLK_SIZE   6
+#define VIRTIO_BLK_F_FLUSH      9
+
+typedef enum {
+    BLK_OP_READ,
+    BLK_OP_WRITE,
+    BLK_OP_FLUSH,
+} blk_op_t;
+
+// blk_request_t.status while the device owns the request
+#define BLK_STATUS_PENDING 1
+
+typedef struct {
+    void *buf;
+    uint32_t len;               // A multiple of VIRTIO_BLK_SECTOR_SIZE
+} blk_seg_t;
+
+typedef struct blk_request {
+    blk_op_t op;
+    uint64_t sector;
+    unsigned int nr_segs;
+    blk_seg_t segs[VIRTIO_BLK_MAX_SEGS];
+    volatile int status;        // BLK_STATUS_PENDING, then 0 or -1
+    // Called on completion from the IRQ handler or the polling thread,
+    // with status already set. A request with a callback must not be
+    // passed to virtio_blk_wait(); the callback may free it.
+    void (*done)(struct blk_request *req);
+    void *private;
+    // Driver use
+    struct blk_request *next;
+    int result;
+} blk_request_t;
+
+// What a cache or file system needs from a disk
+typedef struct block_device {
+    const char *name;
+    uint64_t sectors;
+    // Queue requests with one notification; returns how many were taken
+    unsigned int (*submit)(blk_request_t **reqs, unsigned int count);
+    // Wait for a request without a done callback; any number of threads
+    // may wait for the same one
+    int (*wait)(blk_request_t *req);
+} block_device_t;
+
+typedef enum {
+    VIRTIO_BLK_IRQ,             // Interrupt per batch of completions (default)
+    VIRTIO_BLK_POLL,            // No interrupts; waiters poll the used ring
+} virtio_blk_mode_t;
+
+// Find and set up the first virtio-blk device, if any
+void virtio_blk_init(void);
+
+bool virtio_blk_present(void);
+
+// The disk as "vda", or NULL without one
+block_device_t *virtio_blk_device(void);
+uint64_t virtio_blk_capacity(void);     // In sectors
+bool virtio_blk_read_only(void);
+
+// Switch completion modes; only with no request in flight
+void virtio_blk_set_mode(virtio_blk_mode_t mode);
+virtio_blk_mode_t virtio_blk_get_mode(void);
+
+// Queue up to count requests with one notification; returns how many were
+// taken (fewer once the ring is full). Rejected requests (bad range,
+// writes to a read-only disk) complete at once with status -1.
+unsigned int virtio_blk_submit(blk_request_t **reqs, unsigned int count);
+
+// Reap completed requests; returns how many
+unsigned int virtio_blk_poll(void);
+
+// Wait for a request without a done callback; returns its status
+int virtio_blk_wait(blk_request_t *req);
+
+// Synchronous whole-sector transfers; 0 on success, -1 on error
+int virtio_blk_read(uint64_t sector, void *buf, uint32_t sectors);
+int virtio_blk_write(uint64_t sector, const void *buf, uint32_t sectors);
+int virtio_blk_flush(void);
+
+typedef struct {
+    uint64_t requests;
+    uint64_t batches;           // virtio_blk_submit() calls that queued anything
+    uint64_t notifies;          // Doorbell writes
+    uint64_t interrupts;
+    uint64_t completions;
+    uint64_t errors;
+} virtio_blk_stats_t;
+
+void virtio_blk_get_stats(virtio_blk_stats_t *stats);
+void virtio_blk_print_info(void);
+
+#endif // VIRTIO_BLK_H
@@ -0,0 +1,58 @@
+#ifndef VIRTIO_CONSOLE_H
+#define VIRTIO_CONSOLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "lib/stdio.h"
+
+// virtio-console (virtio-serial port 0) as a fast console
+//
+// Output is copied into a ring of frames and handed to the device as one
+// descriptor per contiguous span (two when it wraps), with one doorbell
+// per write: a multi-kilobyte write is a single request rather than a
+// spin on the UART FIFO per byte. The transmit queue raises no
+// interrupts; every write first reaps what the device has consumed. If
+// the device stops consuming, for example when nothing is connected to
+// its chardev, writes give up after VIRTIO_CONSOLE_TX_TIMEOUT_US and drop
+// the rest, so the console can never wedge the kernel.
+//
+// Input arrives in a few posted buffers; the interrupt handler copies it
+// into a character ring and reposts them.
+
+#define VIRTIO_CONSOLE_TX_FRAMES        16      // 64 KB output ring
+#define VIRTIO_CONSOLE_QUEUE_SIZE       64
+#define VIRTIO_CONSOLE_RX_BUFS          8
+#define VIRTIO_CONSOLE_RX_BUF_SIZE      64
+#define VIRTIO_CONSOLE_RX_RING_SIZE     256     // A power of two
+#define VIRTIO_CONSOLE_TX_TIMEOUT_US    100000
+
+typedef struct {
+    uint64_t writes;
+    uint64_t bytes;
+    uint64_t chains;            // Descriptor chains queued
+    uint64_t notifies;          // Doorbell writes
+    uint64_t stalls;            // Writes that waited for ring space
+    uint64_t dropped;           // Bytes given up on
+    uint64_t rx_bytes;
+    uint64_t rx_dropped;        // Input lost to a full character ring
+} virtio_console_stats_t;
+
+// Find and set up the first virtio-console device, if any
+void virtio_console_init(void);
+
+bool virtio_console_present(void);
+
+// For console_bind(); NULL without a device
+const console_dev_t *virtio_console_device(void);
+
+// Queue len bytes for output; safe with IRQs off
+void virtio_console_write(const char *buf, size_t len);
+
+// A received character, or 0 if none is waiting
+char virtio_console_getc(void);
+
+void virtio_console_get_stats(virtio_console_stats_t *stats);
+void virtio_console_print_info(void);
+
+#endif // VIRTIO_CONSOLE_H
@@ -11,8 +11,29 @@ typedef struct {
     uint64_t spsr_el1;   // Saved Program Status Register
     uint64_t elr_el1;    // Exception Link Register
     uint64_t sp_el0;     // Stack Pointer for EL0
+    uint64_t sp_el1;     // Kernel SP; only saved by switch_to (sched/switch.S)
 } saved_registers_t;
 
+// ESR_EL1 exception classes of instruction and data aborts
+#define ESR_EC_SHIFT        26
+#define ESR_EC(esr)         (((esr) >> ESR_EC_SHIFT) & 0x3F)
+#define ESR_EC_IABT_LOWER   0x20
+#define ESR_EC_IABT_CUR     0x21
+#define ESR_EC_DABT_LOWER   0x24
+#define ESR_EC_DABT_CUR     0x25
+
+// Abort ISS fields
+#define ESR_ISS_FSC(esr)    ((esr) & 0x3F)  // Fault status code
+#define ESR_ISS_WNR         (1ULL << 6)     // Data abort caused by a write
+#define ESR_ISS_FNV         (1ULL << 10)    // FAR_EL1 is not valid
+
+// Fault status code: bits [5:2] give the kind, [1:0] the table level
+#define FSC_TYPE(fsc)       (((fsc) >> 2) & 0xF)
+#define FSC_LEVEL(fsc)      ((fsc) & 0x3)
+#define FSC_TRANSLATION     0x1
+#define FSC_ACCESS_FLAG     0x2
+#define FSC_PERMISSION      0x3
+
 // C-level exception handlers
 void handle_sync_exception(saved_registers_t *context);
 void handle_irq(saved_registers_t *context);
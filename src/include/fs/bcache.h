@@ -0,0 +1,97 @@
+#ifndef FS_BCACHE_H
+#define FS_BCACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "drivers/virtio_blk.h"
+#include "memory/frame_alloc.h"
+
+// Block buffer cache
+//
+// Disk blocks are cached one per PMM frame and found through a hash of
+// (device, block). Replacement is 2Q. A block seen once waits in a small
+// FIFO (A1in). Only a block touched again joins the main LRU (Am). Keys
+// pushed out of A1in are remembered for a while (A1out), so a quick second
+// access goes straight to Am. A one-off scan therefore cannot flush the
+// hot set. Frames come from the PMM on demand up to a limit, and are
+// reclaimed once it is reached or the PMM runs dry.
+//
+// Writes are write-back. A flusher thread writes buffers that have been
+// dirty for BCACHE_DIRTY_EXPIRE_MS, sorted by block, in batches that each
+// take one doorbell; bcache_sync() writes them all. Sequential reads grow
+// an asynchronous read-ahead window, and a random read drops it to zero.
+
+#define BCACHE_BLOCK_SIZE       PAGE_SIZE
+#define BCACHE_BLOCK_SECTORS    (BCACHE_BLOCK_SIZE / VIRTIO_BLK_SECTOR_SIZE)
+#define BCACHE_DEFAULT_FRAMES   1024    // 4 MB
+#define BCACHE_HASH_BITS        10
+#define BCACHE_RA_MIN           4       // Blocks read ahead once a read is sequential
+#define BCACHE_RA_MAX           64      // Window doubles per sequential read up to this
+#define BCACHE_FLUSH_BATCH      32
+#define BCACHE_FLUSH_INTERVAL_MS 1000
+#define BCACHE_DIRTY_EXPIRE_MS  5000
+#define BCACHE_MAX_DEVICES      4       // Devices with read-ahead state
+
+// bcache_buf_t.flags
+#define BCACHE_VALID        0x01    // data holds the block
+#define BCACHE_DIRTY        0x02    // data is newer than the disk
+#define BCACHE_IO           0x04    // req is in flight
+#define BCACHE_READAHEAD    0x08    // Read ahead and not used yet
+#define BCACHE_REDIRTY      0x10    // Dirtied again while being written
+
+typedef struct bcache_buf {
+    block_device_t *dev;
+    uint64_t block;
+    void *data;                 // One frame; NULL for an A1out entry
+    uint32_t flags;
+    uint32_t refs;              // Held buffers are never evicted
+    unsigned int queue;         // A1in, Am or A1out
+    uint64_t dirtied_at;        // Counter value when it was first dirtied
+    struct bcache_buf *hash_next;
+    struct bcache_buf *prev;    // Neighbours in its queue, head = most recent
+    struct bcache_buf *next;
+    blk_request_t req;          // Read or write in flight
+} bcache_buf_t;
+
+// Start the flusher thread
+void bcache_init(void);
+
+// The block, read from the disk unless cached, with a reference held;
+// NULL on an I/O error or out of memory
+bcache_buf_t *bcache_read(block_device_t *dev, uint64_t block);
+
+// The block without reading it, for a caller that overwrites all of it
+// before bcache_mark_dirty(); NULL if out of memory
+bcache_buf_t *bcache_get(block_device_t *dev, uint64_t block);
+
+// The caller changed buf->data: write it back later
+void bcache_mark_dirty(bcache_buf_t *buf);
+
+// Drop the reference from bcache_read()/bcache_get()
+void bcache_release(bcache_buf_t *buf);
+
+// Write every dirty buffer now; 0, or -1 if any write failed
+int bcache_sync(void);
+
+// Write back and free every unreferenced buffer (for cold-cache tests)
+void bcache_drop(void);
+
+// Cap the frames the cache may hold, shrinking it if needed
+void bcache_set_limit(uint64_t frames);
+
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;              // Found cached or already being read
+    uint64_t misses;
+    uint64_t ghost_hits;        // Misses on a block still in A1out
+    uint64_t evictions;
+    uint64_t readahead;         // Blocks read ahead
+    uint64_t readahead_hits;    // ... and then used
+    uint64_t writebacks;
+    uint64_t io_errors;
+} bcache_stats_t;
+
+void bcache_get_stats(bcache_stats_t *stats);
+void bcache_print_stats(void);
+
+#endif // FS_BCACHE_H
@@ -0,0 +1,66 @@
+#ifndef FS_INITRAMFS_H
+#define FS_INITRAMFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fs/vfs.h"
+
+// Read-only file system over the initrd archive
+//
+// QEMU loads the -initrd file into RAM and names its range in the device
+// tree's /chosen node. The archive (cpio "newc" or ustar tar, not
+// compressed) is indexed once at boot: one pass over its headers hashes
+// every path into a node pointing at the data in the image, and links it
+// under its directory. Nothing is copied, so a read is a pointer into the
+// archive. Directories missing from the archive are created implicitly,
+// and a later entry for the same path replaces an earlier one.
+
+#define INITRAMFS_HASH_BITS 9
+
+// initramfs_node_t.mode file types (as in st_mode)
+#define INITRAMFS_S_IFMT    0170000
+#define INITRAMFS_S_IFDIR   0040000
+#define INITRAMFS_S_IFREG   0100000
+#define INITRAMFS_S_IFLNK   0120000
+
+typedef struct initramfs_node {
+    const char *path;           // Without a leading '/'; "" for the root
+    const char *name;           // Last component of path
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+    uint64_t mtime;
+    const void *data;           // In the archive; a symlink's target
+    uint64_t size;
+    struct initramfs_node *hash_next;
+    struct initramfs_node *parent;
+    struct initramfs_node *children;    // Directories only
+    struct initramfs_node *sibling;
+} initramfs_node_t;
+
+// Index the initrd named in the device tree, if any
+void initramfs_init(void);
+
+bool initramfs_present(void);
+
+// The node for path (leading '/' and "./" optional, no "..") or NULL
+const initramfs_node_t *initramfs_lookup(const char *path);
+
+// Iterate over a directory: pass NULL as prev to start
+const initramfs_node_t *initramfs_next_child(const initramfs_node_t *dir,
+                                             const initramfs_node_t *prev);
+
+static inline bool initramfs_is_dir(const initramfs_node_t *node) {
+    return (node->mode & INITRAMFS_S_IFMT) == INITRAMFS_S_IFDIR;
+}
+
+// A pointer to the file's bytes from offset; returns how many there are
+// (0 at or past the end). The bytes are the archive's, so read only.
+uint64_t initramfs_read(const initramfs_node_t *node, uint64_t offset, const void **data);
+
+void initramfs_print_info(void);
+
+// For mounting it read-only; VFS reads copy out of the archive
+extern const vfs_ops_t initramfs_ops;
+
+#endif // FS_INITRAMFS_H
@@ -0,0 +1,40 @@
+#ifndef FS_RAMFS_H
+#define FS_RAMFS_H
+
+#include <stdint.h>
+#include "fs/vfs.h"
+#include "memory/frame_alloc.h"
+
+// Writable in-memory file system
+//
+// A file's pages are whole PMM frames held in a radix tree whose interior
+// nodes are frames of 512 pointers. The tree gains a level at the top
+// when the file outgrows it, so growth never moves data, and a missing
+// page reads as zeros, so holes cost nothing. The last leaf used is
+// cached, which makes appends O(1). truncate frees the pages past the new
+// end and the levels no longer needed. Full, page-aligned transfers go
+// through copy_page().
+//
+// One spinlock covers the namespace and all file data; an operation holds
+// it from start to end.
+
+#define RAMFS_RADIX_BITS    9                       // PAGE_SIZE / sizeof(void *) slots
+#define RAMFS_RADIX_SLOTS   (1u << RAMFS_RADIX_BITS)
+#define RAMFS_MAX_HEIGHT    4
+#define RAMFS_MAX_SIZE      ((uint64_t)PAGE_SIZE << (RAMFS_RADIX_BITS * RAMFS_MAX_HEIGHT))
+
+extern const vfs_ops_t ramfs_ops;
+
+void ramfs_init(void);
+
+typedef struct {
+    uint64_t files;
+    uint64_t dirs;
+    uint64_t data_frames;
+    uint64_t radix_frames;
+} ramfs_stats_t;
+
+void ramfs_get_stats(ramfs_stats_t *stats);
+void ramfs_print_info(void);
+
+#endif // FS_RAMFS_H
@@ -0,0 +1,116 @@
+#ifndef FS_VFS_H
+#define FS_VFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Virtual file system
+//
+// Absolute paths are resolved through a small mount table, where the
+// longest matching mount point wins, and the rest of the path goes to that
+// file system's ops. The kernel has no processes, so open files are slots
+// in one global descriptor table, each holding a node and an offset.
+//
+// vfs_init() mounts a ramfs on / and, if there is one, the initramfs on
+// /initrd.
+
+#define VFS_MAX_FDS     32
+#define VFS_MAX_MOUNTS  8
+#define VFS_NAME_MAX    64      // Including the NUL
+
+// vfs_open() flags
+#define O_RDONLY    0x000
+#define O_WRONLY    0x001
+#define O_RDWR      0x002
+#define O_ACCMODE   0x003
+#define O_CREAT     0x040
+#define O_TRUNC     0x200
+#define O_APPEND    0x400
+
+// vfs_seek() whence
+#define SEEK_SET    0
+#define SEEK_CUR    1
+#define SEEK_END    2
+
+// Errors, returned negative
+#define VFS_ENOENT      (-2)
+#define VFS_EBADF       (-9)
+#define VFS_ENOMEM      (-12)
+#define VFS_EBUSY       (-16)
+#define VFS_EEXIST      (-17)
+#define VFS_ENOTDIR     (-20)
+#define VFS_EISDIR      (-21)
+#define VFS_EINVAL      (-22)
+#define VFS_EMFILE      (-24)
+#define VFS_EFBIG       (-27)
+#define VFS_EROFS       (-30)
+#define VFS_ENAMETOOLONG (-36)
+#define VFS_ENOTEMPTY   (-39)
+
+typedef enum {
+    VFS_FILE,
+    VFS_DIR,
+    VFS_SYMLINK,
+} vfs_type_t;
+
+typedef struct {
+    vfs_type_t type;
+    uint32_t mode;              // Permission bits
+    uint64_t size;
+    uint64_t frames;            // Frames the file system holds for it
+} vfs_stat_t;
+
+typedef struct {
+    char name[VFS_NAME_MAX];
+    vfs_stat_t stat;
+} vfs_dirent_t;
+
+// What a file system provides. Nodes are opaque; lookup() and create()
+// return one with a reference that put() drops. Paths are relative to the
+// mount point, "" being its root. Write operations are NULL on a
+// read-only file system.
+typedef struct vfs_ops {
+    const char *name;
+    int (*lookup)(const char *path, void **node);
+    // A new file or directory; VFS_EEXIST if path exists
+    int (*create)(const char *path, vfs_type_t type, void **node);
+    // Remove a file or an empty directory
+    int (*unlink)(const char *path);
+    void (*put)(void *node);
+    void (*stat)(void *node, vfs_stat_t *st);
+    int64_t (*read)(void *node, uint64_t offset, void *buf, uint64_t len);
+    // Write at *offset, or at the end if append, and advance *offset
+    int64_t (*write)(void *node, uint64_t *offset, const void *buf, uint64_t len, bool append);
+    int (*truncate)(void *node, uint64_t size);
+    // The index'th entry of a directory; VFS_ENOENT past the last
+    int (*readdir)(void *node, uint64_t index, vfs_dirent_t *ent);
+    // Usage report for `df`; optional
+    void (*print_info)(void);
+} vfs_ops_t;
+
+void vfs_init(void);
+
+// Mount ops on path, which must be an existing directory (or "/")
+int vfs_mount(const char *path, const vfs_ops_t *ops);
+
+// A descriptor, or an error. A directory can be opened O_RDONLY for
+// vfs_readdir().
+int vfs_open(const char *path, int flags);
+int vfs_close(int fd);
+int64_t vfs_read(int fd, void *buf, uint64_t len);
+int64_t vfs_write(int fd, const void *buf, uint64_t len);
+int64_t vfs_seek(int fd, int64_t offset, int whence);
+int vfs_fstat(int fd, vfs_stat_t *st);
+int vfs_ftruncate(int fd, uint64_t size);
+// The next directory entry: 0, or VFS_ENOENT after the last
+int vfs_readdir(int fd, vfs_dirent_t *ent);
+
+int vfs_stat(const char *path, vfs_stat_t *st);
+int vfs_mkdir(const char *path);
+int vfs_unlink(const char *path);
+int vfs_truncate(const char *path, uint64_t size);
+
+const char *vfs_strerror(int err);
+void vfs_print_mounts(void);
+
+#endif // FS_VFS_H
@@ -22,6 +22,9 @@ extern char _pmm_bitmap_start;
 extern char _pmm_bitmap_end;
 extern char _kernel_end;
 
+// Device tree address passed by the loader in x0 (saved by boot.S)
+extern uint64_t boot_dtb;
+
 // Boot parameters structure (will be populated by bootloader)
 typedef struct {
     void* uefi_memory_map;      // Pointer to the UEFI memory map
@@ -36,7 +39,4 @@ typedef struct {
 // Main kernel entry point
 void kernel_main(KERNEL_BOOT_PARAMS *params);
 
-// Debug function called from boot_debug
-void boot_debug_copy(void *dest, void *src, size_t size);
-
 #endif // KERNEL_H
\ No newline at end of file
@@ -0,0 +1,59 @@
+#ifndef FDT_H
+#define FDT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Flattened device tree (DTB) as passed by the loader in x0
+
+#define FDT_MAGIC 0xd00dfeed
+
+// Node handles are offsets into the structure block; negative means none
+typedef int fdt_node_t;
+
+// Validate and remember the blob at addr. Returns false if it is not a DTB.
+bool fdt_init(uint64_t addr);
+
+bool fdt_available(void);
+
+// Address and total size of the blob, for reserving it
+uint64_t fdt_address(void);
+uint32_t fdt_total_size(void);
+
+// Look up a node by absolute path, e.g. "/psci" or "/memory". A path
+// component without a unit address also matches "name@unit".
+fdt_node_t fdt_find_node(const char *path);
+
+// Iterate over the direct children of a node: pass -1 as prev to start
+fdt_node_t fdt_next_child(fdt_node_t parent, fdt_node_t prev);
+
+// Next node after start (in document order) whose "compatible" list
+// contains compat; pass -1 as start to search from the root
+fdt_node_t fdt_find_compatible(fdt_node_t start, const char *compat);
+
+// Node name including any unit address
+const char *fdt_node_name(fdt_node_t node);
+
+// Property value and length in bytes, or NULL if absent
+const void *fdt_get_prop(fdt_node_t node, const char *name, uint32_t *len);
+
+// Property as a string, or NULL
+const char *fdt_get_string(fdt_node_t node, const char *name);
+
+// Read a big-endian value of ncells 32-bit cells
+uint64_t fdt_read_cells(const void *cells, int ncells);
+
+// First (address, size) pair of a node's "reg", using the root's
+// #address-cells/#size-cells. Returns false if there is none.
+bool fdt_get_reg(fdt_node_t node, int index, uint64_t *addr, uint64_t *size);
+
+// The initrd the loader placed in RAM, from /chosen "linux,initrd-start"
+// and "linux,initrd-end". Returns false if there is none.
+bool fdt_get_initrd(uint64_t *start, uint64_t *end);
+
+static inline uint32_t fdt32_to_cpu(uint32_t v) {
+    return __builtin_bswap32(v);
+}
+
+#endif // FDT_H
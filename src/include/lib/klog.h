@@ -0,0 +1,26 @@
+#ifndef KLOG_H
+#define KLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Kernel log: every console write, kept in a static ring
+//
+// The ring is in .bss, so it works from the first kprintf in kernel_main,
+// before any device is set up. Output written before the console starts
+// is only logged, and console_start() replays it. `dmesg` prints it again
+// later.
+
+#define KLOG_SIZE   (64 * 1024)     // A power of two
+
+// Append len bytes; under the console lock
+void klog_write(const char *buf, size_t len);
+
+// Bytes logged so far; the ring holds the last KLOG_SIZE of them
+uint64_t klog_end(void);
+
+// Copy out up to len logged bytes from *pos, which moves past them. A
+// position the ring has overwritten skips ahead to the oldest byte held.
+size_t klog_read(uint64_t *pos, char *buf, size_t len);
+
+#endif // KLOG_H
@@ -3,14 +3,52 @@
 
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdbool.h>
+
+#define CONSOLE_MAX_OUTPUTS 4
+
+// Receives every console write after the UART, under the console lock
+// with IRQs off
+typedef void (*console_output_t)(const char *buf, size_t len);
 
 // Basic printf-like function
 int kprintf(const char *format, ...);
 
+// Write len bytes as they are (no formatting, no NUL needed)
+void kwrite(const char *buf, size_t len);
+
+// Mirror console output to another device; false if the table is full
+bool console_add_output(console_output_t write);
+
+// Set up the UART and print everything logged so far. Until then
+// console output only goes to the kernel log (see lib/klog.h).
+void console_start(void);
+
+// A device the console can use in place of the PL011
+typedef struct {
+    const char *name;
+    void (*write)(const char *buf, size_t len);
+    char (*getc)(void);         // 0 when no input is waiting
+    bool (*wait_rx)(void);      // Sleep until input; false if it cannot
+} console_dev_t;
+
+// Send console output and take console input through dev, or through the
+// UART again with NULL. The UART still prints before any bind, for
+// writes nested in a fault, and after console_panic().
+void console_bind(const console_dev_t *dev);
+const char *console_name(void);
+
+// Print through the UART alone from here on, starting it if need be
+void console_panic(void);
+
+// Format into a caller-provided buffer (always NUL-terminated)
+int ksnprintf(char *buffer, size_t size, const char *format, ...);
+int kvsnprintf(char *buffer, size_t size, const char *format, va_list args);
+
 // Basic character input (will be implemented with UART)
 char kgetc(void);
 
 // Simple blocking character read
 char kgetc_blocking(void);
 
-#endif // STDIO_H
\ No newline at end of file
+#endif // STDIO_H
@@ -5,10 +5,16 @@
 
 void* memset(void *s, int c, size_t n);
 void* memcpy(void *dest, const void *src, size_t n);
+// Like memcpy, but dest and src may overlap
+void* memmove(void *dest, const void *src, size_t n);
+// One 4 KB page; dest and src page-aligned
+void copy_page(void *dest, const void *src);
+void clear_page(void *page);
 size_t strlen(const char *s);
 int strcmp(const char *s1, const char *s2);
 int strncmp(const char *s1, const char *s2, size_t n);
 char* strtok(char *str, const char *delim);
+char* strtok_r(char *str, const char *delim, char **saveptr);
 size_t strspn(const char *s, const char *accept);
 char* strpbrk(const char *s, const char *reject);
 
@@ -2,6 +2,7 @@
 #define UART_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 // Initialize UART (PL011 for QEMU virt)
 void uart_init(void);
@@ -15,4 +16,13 @@ char uart_getc(void);
 // Check if data is available to read
 int uart_is_data_available(void);
 
+// Switch input to the RX interrupt: characters are buffered in a ring by
+// the IRQ handler and uart_getc() reads from there. Needs the GIC, the
+// scheduler and workqueues.
+void uart_enable_rx_irq(void);
+
+// Block the calling thread until input may be available. Returns false
+// without waiting if input is still polled, so the caller must poll.
+bool uart_wait_rx(void);
+
 #endif // UART_H
\ No newline at end of file
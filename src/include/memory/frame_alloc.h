@@ -21,12 +21,31 @@ void frame_alloc_init(const KERNEL_BOOT_PARAMS *params);
 // Allocate a physical frame, returns NULL if no free frames
 void* alloc_frame(void);
 
-// Free a previously allocated physical frame
+// Drop a reference to a frame; it is freed when the last one goes
 void free_frame(void *frame);
 
+// Take an extra reference to an allocated frame (e.g. to share it)
+void frame_get(void *frame);
+
+// Current reference count of a frame, 0 if it is free
+uint32_t frame_refcount_get(void *frame);
+
+// Allocate count physically contiguous frames, returns NULL if no such run exists
+void* alloc_frames(size_t count);
+
+// Free count contiguous frames allocated with alloc_frames()
+void free_frames(void *base, size_t count);
+
 // Get information about memory
 uint64_t pmm_get_total_memory(void);
 uint64_t pmm_get_free_memory(void);
 uint64_t pmm_get_highest_usable_address(void);
 
+// Turn the per-CPU frame caches on or off (on by default). Frames already
+// cached stay there until reused or drained.
+void pmm_cache_enable(bool enable);
+
+// Return the executing CPU's cached frames to the global pool
+void pmm_cache_drain(void);
+
 #endif // FRAME_ALLOC_H
\ No newline at end of file
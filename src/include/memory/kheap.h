@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 // Initialize the kernel heap
 void kheap_init(void);
@@ -13,4 +14,10 @@ void *kmalloc(size_t size);
 // Free a previously allocated block
 void kfree(void *ptr);
 
+// Turn the per-CPU small-object caches on or off (on by default)
+void kheap_cache_enable(bool enable);
+
+// Return the executing CPU's cached objects to the heap
+void kheap_cache_drain(void);
+
 #endif // KHEAP_H
\ No newline at end of file
@@ -0,0 +1,82 @@
+#ifndef MM_H
+#define MM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory/mmu.h"
+#include "sync/spinlock.h"
+
+// Per-process range of the 39-bit TTBR0 space. Everything below it is
+// the shared kernel mapping, copied into each address space.
+#define MM_USER_BASE 0x4000000000ULL
+#define MM_USER_END  (1ULL << MMU_VA_BITS)
+
+// A range of an address space whose pages are allocated on first touch
+typedef struct vm_region {
+    uint64_t start;
+    uint64_t end;
+    uint64_t attrs;             // MMU_USER_* attributes of its pages
+    struct vm_region *next;
+} vm_region_t;
+
+// lock covers the regions and the page tables below MM_USER_END: faults,
+// mmap, munmap and clone. It is IRQ-safe because faults are taken with
+// interrupts masked, and a thread holding it must not be preempted by one
+// that faults in the same address space.
+typedef struct mm {
+    spinlock_t lock;
+    uint64_t *pgd;              // Level 1 table loaded into TTBR0
+    uint64_t context_id;        // ASID generation | ASID, 0 if never run
+    vm_region_t *regions;
+    uint64_t mmap_base;         // Next free address for mm_mmap()
+    uint64_t rss_pages;         // Private and shared frames mapped (not the zero page)
+    uint64_t faults;
+    uint64_t cow_copies;        // Write faults that copied a shared page
+    uint64_t cow_reuses;        // Write faults on a page with no other sharer
+} mm_t;
+
+// Detect the ASID width and set up the allocator
+void mm_init(void);
+
+// Create an empty address space sharing the kernel mappings
+mm_t *mm_create(void);
+
+// Duplicate an address space. Pages are shared copy-on-write: writable
+// pages become read-only in both and are copied on the first write.
+mm_t *mm_clone(mm_t *mm);
+
+// Free an address space, its pages and tables. No thread may be using it.
+void mm_destroy(mm_t *mm);
+
+// Reserve size bytes of demand-paged memory; returns the address or 0.
+// No frame is allocated until a page is first touched.
+uint64_t mm_mmap(mm_t *mm, uint64_t size, uint64_t attrs);
+
+// Unmap [addr, addr + size), rounded out to whole pages: regions are
+// trimmed or split and the pages' frames freed after one batched TLB
+// flush. Returns 0, or -1 for a range outside user space.
+int mm_munmap(mm_t *mm, uint64_t addr, uint64_t size);
+
+// Make mm the address space of the calling thread (NULL for the kernel's
+// own tables); the scheduler loads it whenever the thread runs. Costs a
+// TTBR0 write unless the ASIDs have rolled over.
+void mm_switch(mm_t *mm);
+
+// Load mm on the calling CPU without changing which thread owns it; for
+// the scheduler, with interrupts off
+void mm_activate(mm_t *mm);
+
+// Address space loaded on the calling CPU, NULL for the kernel's
+mm_t *mm_current(void);
+
+// Resolve a fault at far from the abort syndrome esr: translation faults
+// in a region (reads map the shared zero page, writes a fresh frame) and
+// write permission faults on copy-on-write pages. Returns true if the
+// access can be retried.
+bool mm_handle_fault(uint64_t far, uint64_t esr);
+
+// ASID allocator state
+void mm_print_info(void);
+
+#endif // MM_H
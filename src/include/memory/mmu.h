@@ -0,0 +1,143 @@
+#ifndef MMU_H
+#define MMU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Translation regime: 4 KB granule, 39-bit VA (TTBR0), walks start at level 1
+#define MMU_VA_BITS     39
+#define PT_ENTRIES      512
+#define L1_SHIFT        30
+#define L2_SHIFT        21
+#define L3_SHIFT        12
+#define PT_INDEX(va, shift) (((va) >> (shift)) & (PT_ENTRIES - 1))
+
+// ASID field of TTBR0_EL1 and of TLBI operands
+#define TTBR_ASID_SHIFT 48
+
+// Descriptor bits
+#define PTE_VALID       (1ULL << 0)
+#define PTE_TABLE       (1ULL << 1)     // Table descriptor (levels 1-2)
+#define PTE_PAGE        (1ULL << 1)     // Page descriptor (level 3)
+#define PTE_BLOCK       (0ULL << 1)     // Block descriptor (levels 1-2)
+#define PTE_ATTRINDX(n) ((uint64_t)(n) << 2)
+#define PTE_AP_RW_EL1   (0ULL << 6)
+#define PTE_AP_RW_ALL   (1ULL << 6)
+#define PTE_AP_RO_EL1   (2ULL << 6)
+#define PTE_AP_RO_ALL   (3ULL << 6)
+#define PTE_AP_MASK     (3ULL << 6)
+#define PTE_AP_RDONLY   (1ULL << 7)     // AP[2]: read-only at every level it is accessible
+#define PTE_SH_INNER    (3ULL << 8)
+#define PTE_AF          (1ULL << 10)
+#define PTE_NG          (1ULL << 11)
+#define PTE_PXN         (1ULL << 53)
+#define PTE_UXN         (1ULL << 54)
+#define PTE_SW_COW      (1ULL << 55)    // Software: read-only copy-on-write page
+#define PTE_ADDR_MASK   0x0000FFFFFFFFF000ULL
+#define PTE_ATTR_MASK   (~PTE_ADDR_MASK & ~(PTE_VALID | PTE_TABLE))
+
+// MAIR_EL1 attribute indices
+#define MT_DEVICE_nGnRE 0
+#define MT_NORMAL       1
+#define MT_NORMAL_NC    2
+
+// Mapping attributes for kernel memory
+#define MMU_KERNEL_TEXT   (PTE_ATTRINDX(MT_NORMAL) | PTE_SH_INNER | PTE_AF | PTE_AP_RO_EL1 | PTE_UXN)
+#define MMU_KERNEL_RODATA (PTE_ATTRINDX(MT_NORMAL) | PTE_SH_INNER | PTE_AF | PTE_AP_RO_EL1 | PTE_PXN | PTE_UXN)
+#define MMU_KERNEL_DATA   (PTE_ATTRINDX(MT_NORMAL) | PTE_SH_INNER | PTE_AF | PTE_AP_RW_EL1 | PTE_PXN | PTE_UXN)
+// Pages of per-process address spaces: not global, so they are tagged
+// with the address space's ASID in the TLB
+#define MMU_USER_DATA     (PTE_ATTRINDX(MT_NORMAL) | PTE_SH_INNER | PTE_AF | PTE_NG | PTE_AP_RW_ALL | PTE_PXN | PTE_UXN)
+#define MMU_USER_RODATA   (PTE_ATTRINDX(MT_NORMAL) | PTE_SH_INNER | PTE_AF | PTE_NG | PTE_AP_RO_ALL | PTE_PXN | PTE_UXN)
+#define MMU_USER_TEXT     (PTE_ATTRINDX(MT_NORMAL) | PTE_SH_INNER | PTE_AF | PTE_NG | PTE_AP_RO_ALL | PTE_PXN)
+#define MMU_DEVICE        (PTE_ATTRINDX(MT_DEVICE_nGnRE) | PTE_AF | PTE_AP_RW_EL1 | PTE_PXN | PTE_UXN)
+
+// Peripheral window of the QEMU virt machine (GIC, PL011, RTC, fw_cfg, virtio-mmio)
+#define MMU_DEVICE_BASE 0x08000000ULL
+#define MMU_DEVICE_SIZE 0x08000000ULL
+
+// Build the identity-mapped kernel tables and turn on the MMU and caches
+void mmu_init(void);
+
+// Program MAIR/TCR/TTBR0 and enable translation and caches on this CPU
+void mmu_enable(void);
+
+bool mmu_is_enabled(void);
+
+// Register values for another CPU to enter this translation regime
+// (with the kernel's tables and ASID 0) from its own boot code
+void mmu_get_cpu_config(uint64_t *mair, uint64_t *tcr, uint64_t *ttbr0, uint64_t *sctlr);
+
+// Root (level 1) table of the kernel address space
+uint64_t *mmu_kernel_table(void);
+
+// Allocate or free a single zeroed translation table page
+uint64_t *mmu_alloc_table(void);
+void mmu_free_table(uint64_t *table);
+
+// Load root into TTBR0 tagged with asid. TLB entries of other ASIDs stay valid.
+void mmu_switch_table(uint64_t *root, uint64_t asid);
+
+// ASID width in use (8 or 16 bits)
+unsigned int mmu_asid_bits(void);
+
+// Map [va, va + size) to [pa, pa + size) using the largest leaf that the
+// alignment allows: 1 GB and 2 MB blocks, 4 KB pages at unaligned edges.
+// All arguments must be page aligned. Returns 0 on success.
+int mmu_map_range(uint64_t *root, uint64_t va, uint64_t pa, uint64_t size, uint64_t attrs);
+
+// As mmu_map_range(), but always with 4 KB pages
+int mmu_map_pages(uint64_t *root, uint64_t va, uint64_t pa, uint64_t size, uint64_t attrs);
+
+// Remove the mappings of [va, va + size), freeing tables that become empty
+int mmu_unmap_range(uint64_t *root, uint64_t va, uint64_t size);
+
+// Clear the leaf entries of [va, va + size) but keep the tables and do no
+// TLB maintenance: the caller batches one flush for many ranges and must
+// not reuse the old frames until it has done so
+int mmu_clear_range(uint64_t *root, uint64_t va, uint64_t size);
+
+// Create the level 1 entries (and their level 2 tables) covering a range
+// up front, so that later mappings in it never change the root table
+int mmu_reserve_tables(uint64_t *root, uint64_t va, uint64_t size);
+
+// Replace the block mapping va with a table of the next smaller size
+// carrying the same attributes (break-before-make when the MMU is on).
+// Fails if va is unmapped, already a page, or the block maps the kernel
+// image, the current stack or the table being modified.
+int mmu_split_block(uint64_t *root, uint64_t va);
+
+// Tear down every mapping and table of [va, va + size) below root, passing
+// the physical address of each mapped page to release_page. Only for
+// address spaces no CPU is using; the caller handles TLB maintenance.
+void mmu_free_tables(uint64_t *root, uint64_t va, uint64_t size, void (*release_page)(uint64_t pa));
+
+// Change the attributes of [va, va + size), splitting blocks at the edges
+int mmu_protect_range(uint64_t *root, uint64_t va, uint64_t size, uint64_t attrs);
+
+// Level 3 entry for va, or NULL if no page table covers it
+uint64_t *mmu_lookup_pte(uint64_t *root, uint64_t va);
+
+// Call fn for every valid 4 KB page entry in [va, va + size), skipping
+// unmapped tables. Block mappings are not visited.
+void mmu_walk_pages(uint64_t *root, uint64_t va, uint64_t size,
+                    void (*fn)(uint64_t va, uint64_t *pte, void *arg), void *arg);
+
+// Translate va through the given tables; returns false if unmapped
+bool mmu_translate(uint64_t *root, uint64_t va, uint64_t *pa);
+
+// TLB maintenance for the kernel's own mappings
+void mmu_flush_tlb_all(void);
+void mmu_flush_tlb_page(uint64_t va);
+void mmu_flush_tlb_asid(uint64_t asid);   // Inner shareable, one ASID
+void mmu_flush_tlb_page_asid(uint64_t va, uint64_t asid);
+void mmu_flush_tlb_local(void);           // This CPU only, all ASIDs
+
+// Clean and invalidate the data cache over a range to the point of coherency
+void mmu_clean_dcache_range(uint64_t start, uint64_t size);
+
+// Print translation table usage
+void mmu_print_info(void);
+
+#endif // MMU_H
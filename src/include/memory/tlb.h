@@ -0,0 +1,76 @@
+#ifndef MEMORY_TLB_H
+#define MEMORY_TLB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Batched TLB shootdown
+//
+// Unmapping code clears entries first and notes each page in a
+// tlb_gather_t. One invalidation then covers the whole batch: a TLBI VAE1IS
+// per page between a single pair of barriers, or the whole ASID once the
+// range passes tlb_range_limit pages. Frames are only released after that
+// flush, so no CPU can still reach them through a stale entry.
+//
+// The IS forms broadcast to every CPU in hardware, so the default needs no
+// IPIs. The IPI modes instead run local (non-broadcast) invalidations on
+// every CPU through smp_call_function_many(), as a CPU without broadcast
+// maintenance would have to; `bench shootdown` compares them.
+
+// Default number of pages above which a range flush takes the whole ASID
+#define TLB_RANGE_LIMIT_DEFAULT 32
+
+// Frames a gather holds back before it flushes early to release them
+#define TLB_GATHER_BATCH 128
+
+// ASID value for global (kernel) mappings, or an address space whose ASID
+// is stale: invalidate by VA in every ASID
+#define TLB_ASID_ALL UINT64_MAX
+
+typedef enum {
+    TLB_FLUSH_BATCHED,          // Broadcast TLBI per gather (default)
+    TLB_FLUSH_EACH_PAGE,        // Broadcast TLBI and DSB as each page is unmapped
+    TLB_FLUSH_IPI_BATCHED,      // One cross-call per gather
+    TLB_FLUSH_IPI_EACH_PAGE,    // One cross-call per page
+} tlb_flush_mode_t;
+
+typedef struct {
+    uint64_t asid;
+    uint64_t start;             // Range of pages unmapped since the last flush
+    uint64_t end;
+    unsigned int nr_frames;
+    uint64_t frames[TLB_GATHER_BATCH];
+    void (*release)(uint64_t pa);
+} tlb_gather_t;
+
+// release (may be NULL) is called for every frame passed to
+// tlb_gather_page() once it is safe to reuse
+void tlb_gather_init(tlb_gather_t *tlb, uint64_t asid, void (*release)(uint64_t pa));
+
+// Record that va's entry was cleared; pa is its frame, or 0 if nothing
+// needs releasing
+void tlb_gather_page(tlb_gather_t *tlb, uint64_t va, uint64_t pa);
+
+// Invalidate everything gathered so far and release the frames
+void tlb_gather_finish(tlb_gather_t *tlb);
+
+// Invalidate [start, end) in asid on every CPU
+void tlb_flush_range(uint64_t asid, uint64_t start, uint64_t end);
+
+// Tuning and benchmark knobs
+void tlb_set_flush_mode(tlb_flush_mode_t mode);
+tlb_flush_mode_t tlb_get_flush_mode(void);
+void tlb_set_range_limit(uint64_t pages);
+uint64_t tlb_get_range_limit(void);
+
+typedef struct {
+    uint64_t range_flushes;     // Per-page invalidation sequences
+    uint64_t full_flushes;      // Whole-ASID (or all) invalidations
+    uint64_t pages;             // TLBI instructions issued by range flushes
+    uint64_t ipi_flushes;       // Flushes done by cross-call
+} tlb_stats_t;
+
+void tlb_get_stats(tlb_stats_t *stats);
+void tlb_print_stats(void);
+
+#endif // MEMORY_TLB_H
@@ -0,0 +1,39 @@
+#ifndef VMALLOC_H
+#define VMALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Kernel virtual range backing vmalloc(), above everything identity mapped
+#define VMALLOC_START 0x1000000000ULL
+#define VMALLOC_SIZE  0x40000000ULL     // 1 GB
+#define VMALLOC_END   (VMALLOC_START + VMALLOC_SIZE)
+
+// Freed areas stay mapped until this many pages are pending, then they are
+// torn down together behind a single TLB flush
+#define VMALLOC_LAZY_MAX_PAGES 1024
+
+// Set up the vmalloc range; needs the MMU and the kernel heap
+void vmalloc_init(void);
+
+// Allocate size bytes of virtually contiguous, zeroed kernel memory backed
+// by individual frames. Each area is followed by an unmapped guard page.
+void *vmalloc(size_t size);
+
+// Free an area returned by vmalloc(); safe with interrupts off
+void vfree(void *addr);
+
+// Whether addr lies in the vmalloc range
+bool is_vmalloc_addr(const void *addr);
+
+// Physical address behind a vmalloc address, or 0
+uint64_t vmalloc_to_phys(const void *addr);
+
+// Tear down all lazily freed areas now
+void vmalloc_purge(void);
+
+// Print area and page usage
+void vmalloc_print_info(void);
+
+#endif // VMALLOC_H
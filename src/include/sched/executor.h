@@ -0,0 +1,63 @@
+#ifndef SCHED_EXECUTOR_H
+#define SCHED_EXECUTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Work-stealing task executor
+//
+// Every CPU has a worker thread and a Chase-Lev deque of tasks. Tasks
+// spawned on a CPU go to the bottom of its deque, and its worker takes
+// them back LIFO; a CPU with nothing of its own steals FIFO from the top
+// of a random victim's deque, which hands out the largest, oldest pieces
+// of a recursive split. Workers with nothing to do block, so their CPU
+// drops into the idle loop's WFI; spawning wakes one of them with an IPI.
+//
+// Tasks must not be spawned or waited on from IRQ handlers.
+
+// Per-CPU deque capacity; task_spawn() runs the task itself when full
+#define EXECUTOR_DEQUE_SIZE 1024
+
+typedef void (*task_func_t)(void *arg);
+
+// Tasks that task_group_wait() waits for together
+typedef struct {
+    volatile uint32_t pending;
+} task_group_t;
+
+#define TASK_GROUP_INIT { 0 }
+
+// A spawned function call. The spawner owns the storage and must keep it
+// (and arg) alive until task_group_wait() on its group returns.
+typedef struct task {
+    task_func_t func;
+    void *arg;
+    task_group_t *group;
+} task_t;
+
+typedef struct {
+    uint64_t executed;          // Tasks run on this CPU
+    uint64_t stolen;            // Of those, taken from another CPU's deque
+    uint64_t inline_runs;       // Spawns run directly because the deque was full
+    uint64_t sleeps;            // Times the worker blocked for lack of work
+} executor_stats_t;
+
+// Start a worker on every CPU that schedules threads; call after smp_init()
+void executor_init(void);
+
+// Queue func(arg) as task, counted in group
+void task_spawn(task_group_t *group, task_t *task, task_func_t func, void *arg);
+
+// Wait until every task in group has finished, running queued or stolen
+// tasks in the meantime
+void task_group_wait(task_group_t *group);
+
+// Restrict spawning, stealing and wake-ups to CPUs 0 .. ncpus - 1 (clamped
+// to the online CPUs), for scaling measurements. Only while no tasks are
+// queued.
+void executor_set_cpus(unsigned int ncpus);
+unsigned int executor_cpus(void);
+
+void executor_get_stats(unsigned int cpu, executor_stats_t *stats);
+
+#endif // SCHED_EXECUTOR_H
@@ -0,0 +1,74 @@
+#ifndef SCHED_SOFTIRQ_H
+#define SCHED_SOFTIRQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Bottom halves
+//
+// A hard IRQ handler should only quiet its device and grab what cannot
+// wait (a FIFO's contents, a completion status), then raise a softirq or
+// schedule a tasklet for the rest. Softirqs raised during an interrupt run
+// on the same CPU when it exits, with IRQs enabled but preemption off, so
+// further device interrupts are taken while they run; work that may sleep
+// belongs on a workqueue (sched/workqueue.h) instead.
+
+// Vectors, run in this order; each is a bit in percpu_t.softirq_pending
+typedef enum {
+    SOFTIRQ_TASKLET,            // Scheduled tasklets
+    NR_SOFTIRQS
+} softirq_t;
+
+typedef void (*softirq_handler_t)(void);
+
+// Rounds of newly raised softirqs handled per IRQ exit; the rest waits for
+// the next interrupt so a flood cannot starve threads
+#define SOFTIRQ_MAX_RESTART 10
+
+// Install the handler of a vector; call during boot
+void open_softirq(softirq_t nr, softirq_handler_t handler);
+
+// Mark a vector pending on this CPU. From thread context with IRQs enabled
+// the handlers run before it returns; otherwise at the next IRQ exit.
+void raise_softirq(softirq_t nr);
+
+// Hard IRQ bracketing (handle_irq): time accounting, then softirqs on exit
+void irq_enter(void);
+void irq_exit(void);
+
+// True in hard IRQ or softirq context, where blocking is not allowed
+bool in_interrupt(void);
+
+// --- Tasklets ---
+//
+// A tasklet is a function run once from softirq context after
+// tasklet_schedule(), on the CPU that scheduled it. Scheduling it again
+// before it ran is a no-op, and one tasklet never runs on two CPUs at once.
+
+typedef void (*tasklet_func_t)(void *data);
+
+#define TASKLET_SCHEDULED 0x1   // Queued on some CPU
+#define TASKLET_RUNNING   0x2   // Its function is executing
+
+typedef struct tasklet {
+    struct tasklet *next;
+    volatile uint32_t state;
+    tasklet_func_t func;
+    void *data;
+    uint64_t runs;
+} tasklet_t;
+
+#define TASKLET_INIT(fn, arg) { NULL, 0, (fn), (arg), 0 }
+
+void tasklet_init(tasklet_t *tasklet, tasklet_func_t func, void *data);
+
+// Safe from any context
+void tasklet_schedule(tasklet_t *tasklet);
+
+// Set up the vectors; call before interrupts can raise any
+void softirq_init(void);
+
+// Per-CPU hard IRQ and softirq counts and times
+void softirq_print_stats(void);
+
+#endif // SCHED_SOFTIRQ_H
@@ -0,0 +1,103 @@
+#ifndef SCHED_THREAD_H
+#define SCHED_THREAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "exceptions/exceptions.h"
+#include "drivers/timer.h"
+
+// Kernel stack of each thread, in pages
+#define THREAD_STACK_PAGES 4
+
+#define THREAD_NAME_LEN 16
+
+// Round-robin time slice
+#define SCHED_SLICE_TICKS (TIMER_HZ / 100)
+
+// thread_create() picks the least loaded CPU
+#define THREAD_ANY_CPU (-1)
+
+typedef void (*thread_func_t)(void *arg);
+
+struct mm;
+
+typedef enum {
+    THREAD_RUNNING,
+    THREAD_READY,       // On its CPU's run queue
+    THREAD_SLEEPING,    // On its CPU's sleep list until wake_at
+    THREAD_BLOCKED,     // Waiting for thread_wake()
+    THREAD_DEAD,        // Exited; freed by the next thread on its CPU
+} thread_state_t;
+
+// Thread control block. context must stay the first member: switch_to
+// saves the callee-saved registers and SP of a switched-out thread there.
+typedef struct thread {
+    saved_registers_t context;
+    uint32_t tid;
+    char name[THREAD_NAME_LEN];
+    volatile thread_state_t state;
+    unsigned int cpu;               // Threads stay on the CPU they were created on
+    struct mm *mm;                  // Loaded into TTBR0 while it runs; NULL for the kernel's tables
+    void *stack_base;               // NULL for the idle threads (boot stacks)
+    uint64_t wake_at;               // Counter value a sleeping thread wakes at
+    uint64_t switches;              // Times switched in
+    uint64_t runtime;               // Counter ticks spent running
+    uint64_t last_run;              // Counter value when last switched in
+    struct thread *rq_next;         // Run queue or sleep list link
+    struct thread *all_next;        // List of all threads
+} thread_t;
+
+// Turn the boot CPU's current context into its idle thread and start
+// scheduling on it; call once timers and the heap are up
+void sched_init(void);
+
+// Same for a secondary CPU (from secondary_main)
+void sched_init_cpu(unsigned int cpu);
+
+// Idle loop of the calling CPU: run whatever is ready, otherwise WFI.
+// Does not return.
+void sched_idle_loop(void) __attribute__((noreturn));
+
+// True once the calling CPU schedules threads
+bool sched_active(void);
+
+// Pick the next ready thread on this CPU and switch to it
+void schedule(void);
+
+// Called at the end of IRQ handling: switch threads if the tick or a
+// wake-up asked for it and preemption is enabled
+void sched_irq_exit(void);
+
+// Start a thread running func(arg) on cpu (or THREAD_ANY_CPU). Returns
+// NULL if out of memory or cpu is offline.
+thread_t *thread_create(const char *name, thread_func_t func, void *arg, int cpu);
+
+// Give up the CPU to the next ready thread, if any
+void thread_yield(void);
+
+// Sleep for at least ms milliseconds. Busy-waits on CPUs that do not
+// schedule yet.
+void thread_sleep_ms(uint64_t ms);
+
+// Blocking is two steps so that a wake-up cannot be lost: mark the
+// calling thread blocked, publish it wherever its waker will look, then
+// call thread_block(). A thread_wake() in between just cancels the block.
+void thread_prepare_block(void);
+void thread_block(void);
+
+// thread_block() that also ends when the counter reaches wake_at. True if
+// it ended before then (woken, or a spurious return), false on timeout.
+bool thread_block_until(uint64_t wake_at);
+
+// Make a blocked or sleeping thread ready again; false if it was neither
+bool thread_wake(thread_t *thread);
+
+// End the calling thread; also what returning from its function does
+void thread_exit(void) __attribute__((noreturn));
+
+thread_t *thread_current(void);
+
+// List all threads
+void sched_print_info(void);
+
+#endif // SCHED_THREAD_H
@@ -0,0 +1,104 @@
+#ifndef SCHED_WAIT_H
+#define SCHED_WAIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sched/thread.h"
+#include "sync/spinlock.h"
+#include "drivers/timer.h"
+
+// Wait queues
+//
+// A thread waiting for a condition puts an entry (on its own stack) on the
+// condition's wait queue and blocks; whoever makes the condition true calls
+// wake_up(). Waiters take no CPU time until then. The wait_event macros
+// re-check the condition after every wake-up, so spurious or shared
+// wake-ups are harmless. Only threads may wait; wake_up() is safe from any
+// context, including hard IRQs.
+
+typedef struct wait_entry {
+    struct wait_entry *next;
+    struct wait_entry *prev;
+    thread_t *thread;
+    const volatile void *key;   // Address for wait_on_address(), else NULL
+    bool queued;
+    bool woken;                 // Removed by a waker rather than by finish_wait()
+} wait_entry_t;
+
+typedef struct {
+    spinlock_t lock;            // Taken with IRQs masked
+    wait_entry_t *head;         // FIFO of waiters
+    wait_entry_t *tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { SPINLOCK_INIT, NULL, NULL }
+
+void wait_queue_init(wait_queue_t *wq);
+void wait_entry_init(wait_entry_t *entry);
+
+// Queue the entry (if it is not already) and mark the caller blocked; the
+// caller then checks its condition and calls thread_block() if it is
+// still false. finish_wait() dequeues it and undoes the block.
+void prepare_to_wait(wait_queue_t *wq, wait_entry_t *entry);
+void finish_wait(wait_queue_t *wq, wait_entry_t *entry);
+
+// Wake every waiter, or the longest-waiting one; return how many woke
+unsigned int wake_up(wait_queue_t *wq);
+unsigned int wake_up_one(wait_queue_t *wq);
+
+// Block until cond is true
+#define wait_event(wq, cond) do {                                              \
+    wait_entry_t __wait;                                                       \
+    wait_entry_init(&__wait);                                                  \
+    while (1) {                                                                \
+        prepare_to_wait((wq), &__wait);                                        \
+        if (cond) {                                                            \
+            break;                                                             \
+        }                                                                      \
+        thread_block();                                                        \
+    }                                                                          \
+    finish_wait((wq), &__wait);                                                \
+} while (0)
+
+// Block until cond is true or ms milliseconds passed; evaluates to the
+// final value of cond as a bool
+#define wait_event_timeout(wq, cond, ms) ({                                    \
+    uint64_t __deadline = timer_read_counter() + timer_us_to_counter((ms) * 1000); \
+    wait_entry_t __wait;                                                       \
+    bool __done;                                                               \
+    wait_entry_init(&__wait);                                                  \
+    while (1) {                                                                \
+        prepare_to_wait((wq), &__wait);                                        \
+        if ((__done = (cond)) || timer_read_counter() >= __deadline) {         \
+            break;                                                             \
+        }                                                                      \
+        thread_block_until(__deadline);                                        \
+    }                                                                          \
+    finish_wait((wq), &__wait);                                                \
+    __done;                                                                    \
+})
+
+// --- Address waits ---
+//
+// Futex-style waiting on any 32-bit word without declaring a wait queue:
+// waiters hash to one of a fixed set of shared queues by address. The
+// value is compared under the queue lock, so a waker that changes the word
+// and then calls wake_address() cannot be missed.
+
+#define WAIT_HASH_BITS 6
+
+typedef enum {
+    WAIT_WOKEN,                 // Woken, or returned spuriously: re-check the word
+    WAIT_MISMATCH,              // *addr != expected on entry; did not block
+    WAIT_TIMEOUT,
+} wait_result_t;
+
+// Block while *addr == expected, until wake_address(addr) or timeout_ms
+// milliseconds (0 waits forever)
+wait_result_t wait_on_address(const volatile uint32_t *addr, uint32_t expected,
+                              uint64_t timeout_ms);
+
+// Wake up to count threads waiting on addr; returns how many woke
+unsigned int wake_address(const volatile uint32_t *addr, unsigned int count);
+
+#endif // SCHED_WAIT_H
@@ -0,0 +1,48 @@
+#ifndef SCHED_WORKQUEUE_H
+#define SCHED_WORKQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Workqueues: deferred work run by kernel threads
+//
+// A workqueue has a worker thread on every CPU. queue_work() appends to
+// the calling CPU's list and wakes its worker, which takes the whole list
+// at once, so work queued in a burst (one per interrupt, say) is handled
+// in a single wake-up. Unlike softirqs, work functions run in thread
+// context and may sleep.
+
+typedef void (*work_func_t)(void *data);
+
+typedef struct work {
+    struct work *next;
+    volatile uint32_t pending;  // Queued and not yet started
+    work_func_t func;
+    void *data;
+} work_t;
+
+#define WORK_INIT(fn, arg) { NULL, 0, (fn), (arg) }
+
+typedef struct workqueue workqueue_t;
+
+// General-purpose queue, created by workqueue_init()
+extern workqueue_t *system_wq;
+
+void work_init(work_t *work, work_func_t func, void *data);
+
+// Create a workqueue with a worker named "<name>/<cpu>" on every CPU that
+// schedules threads. Returns NULL if out of memory.
+workqueue_t *workqueue_create(const char *name);
+
+// Queue work on the calling CPU or on cpu. Safe from any context,
+// including hard IRQs. False if the work was still pending.
+bool queue_work(workqueue_t *wq, work_t *work);
+bool queue_work_on(unsigned int cpu, workqueue_t *wq, work_t *work);
+
+// Create system_wq; call after smp_init()
+void workqueue_init(void);
+
+// Per-queue item and batch counts
+void workqueue_print_stats(void);
+
+#endif // SCHED_WORKQUEUE_H
@@ -0,0 +1,181 @@
+#ifndef SYNC_ATOMIC_H
+#define SYNC_ATOMIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Atomic read-modify-write operations on naturally aligned 32- and 64-bit
+// words. Every operation is a full acquire/release pair, which is what the
+// lock code needs.
+//
+// ARMv8.0 only has exclusive load/store pairs (LDAXR/STLXR), which retry
+// whenever another CPU touches the line between the two. ARMv8.1 LSE adds
+// single-instruction atomics (CAS, LDADD, SWP) that the interconnect can
+// perform near the data, so they do not livelock under contention. The
+// kernel is built for v8.0, so LSE is picked at run time from
+// ID_AA64ISAR0_EL1 by atomics_init().
+
+// True when the CPU implements the LSE atomics
+extern bool cpu_has_lse;
+
+// Detect LSE; call once on the boot CPU before the secondaries start
+void atomics_init(void);
+
+// Generates name##32 and name##64 from one body; "w"/"x" select the
+// register width in the asm templates
+#define ATOMIC_FETCH_ADD(bits, type, r)                                         \
+static inline type atomic_fetch_add##bits(volatile type *p, type val) {         \
+    type old;                                                                   \
+    if (cpu_has_lse) {                                                          \
+        asm volatile(".arch_extension lse\n"                                    \
+                     "ldaddal %" r "2, %" r "0, %1"                             \
+                     : "=r" (old), "+Q" (*p) : "r" (val) : "memory");           \
+    } else {                                                                    \
+        type tmp;                                                               \
+        uint32_t fail;                                                          \
+        asm volatile("1: ldaxr %" r "0, %3\n"                                   \
+                     "   add %" r "1, %" r "0, %" r "4\n"                       \
+                     "   stlxr %w2, %" r "1, %3\n"                              \
+                     "   cbnz %w2, 1b"                                          \
+                     : "=&r" (old), "=&r" (tmp), "=&r" (fail), "+Q" (*p)        \
+                     : "r" (val) : "memory");                                   \
+    }                                                                           \
+    return old;                                                                 \
+}
+
+#define ATOMIC_XCHG(bits, type, r)                                              \
+static inline type atomic_xchg##bits(volatile type *p, type val) {              \
+    type old;                                                                   \
+    if (cpu_has_lse) {                                                          \
+        asm volatile(".arch_extension lse\n"                                    \
+                     "swpal %" r "2, %" r "0, %1"                               \
+                     : "=r" (old), "+Q" (*p) : "r" (val) : "memory");           \
+    } else {                                                                    \
+        uint32_t fail;                                                          \
+        asm volatile("1: ldaxr %" r "0, %2\n"                                   \
+                     "   stlxr %w1, %" r "3, %2\n"                              \
+                     "   cbnz %w1, 1b"                                          \
+                     : "=&r" (old), "=&r" (fail), "+Q" (*p)                     \
+                     : "r" (val) : "memory");                                   \
+    }                                                                           \
+    return old;                                                                 \
+}
+
+// Store new if *p == expected; returns the value found, so the exchange
+// happened iff the result equals expected
+#define ATOMIC_CMPXCHG(bits, type, r)                                           \
+static inline type atomic_cmpxchg##bits(volatile type *p, type expected,        \
+                                        type new_val) {                         \
+    type old;                                                                   \
+    if (cpu_has_lse) {                                                          \
+        old = expected;                                                         \
+        asm volatile(".arch_extension lse\n"                                    \
+                     "casal %" r "0, %" r "2, %1"                               \
+                     : "+r" (old), "+Q" (*p) : "r" (new_val) : "memory");       \
+    } else {                                                                    \
+        uint32_t fail;                                                          \
+        asm volatile("1: ldaxr %" r "0, %2\n"                                   \
+                     "   cmp %" r "0, %" r "3\n"                                \
+                     "   b.ne 2f\n"                                             \
+                     "   stlxr %w1, %" r "4, %2\n"                              \
+                     "   cbnz %w1, 1b\n"                                        \
+                     "2:"                                                       \
+                     : "=&r" (old), "=&r" (fail), "+Q" (*p)                     \
+                     : "r" (expected), "r" (new_val) : "cc", "memory");         \
+    }                                                                           \
+    return old;                                                                 \
+}
+
+// Bitwise OR and AND-NOT (clear); LSE has these as LDSET and LDCLR
+#define ATOMIC_FETCH_BITOP(name, lse_op, llsc_op, bits, type, r)                \
+static inline type atomic_fetch_##name##bits(volatile type *p, type mask) {     \
+    type old;                                                                   \
+    if (cpu_has_lse) {                                                          \
+        asm volatile(".arch_extension lse\n"                                    \
+                     lse_op " %" r "2, %" r "0, %1"                             \
+                     : "=r" (old), "+Q" (*p) : "r" (mask) : "memory");          \
+    } else {                                                                    \
+        type tmp;                                                               \
+        uint32_t fail;                                                          \
+        asm volatile("1: ldaxr %" r "0, %3\n"                                   \
+                     "   " llsc_op " %" r "1, %" r "0, %" r "4\n"               \
+                     "   stlxr %w2, %" r "1, %3\n"                              \
+                     "   cbnz %w2, 1b"                                          \
+                     : "=&r" (old), "=&r" (tmp), "=&r" (fail), "+Q" (*p)        \
+                     : "r" (mask) : "memory");                                  \
+    }                                                                           \
+    return old;                                                                 \
+}
+
+ATOMIC_FETCH_ADD(32, uint32_t, "w")
+ATOMIC_FETCH_ADD(64, uint64_t, "x")
+ATOMIC_XCHG(32, uint32_t, "w")
+ATOMIC_XCHG(64, uint64_t, "x")
+ATOMIC_CMPXCHG(32, uint32_t, "w")
+ATOMIC_CMPXCHG(64, uint64_t, "x")
+ATOMIC_FETCH_BITOP(or, "ldsetal", "orr", 32, uint32_t, "w")
+ATOMIC_FETCH_BITOP(or, "ldsetal", "orr", 64, uint64_t, "x")
+ATOMIC_FETCH_BITOP(andnot, "ldclral", "bic", 32, uint32_t, "w")
+ATOMIC_FETCH_BITOP(andnot, "ldclral", "bic", 64, uint64_t, "x")
+
+#undef ATOMIC_FETCH_ADD
+#undef ATOMIC_FETCH_BITOP
+#undef ATOMIC_XCHG
+#undef ATOMIC_CMPXCHG
+
+// --- Plain loads and stores with ordering ---
+
+static inline uint32_t atomic_load_acquire32(const volatile uint32_t *p) {
+    uint32_t val;
+    asm volatile("ldar %w0, %1" : "=r" (val) : "Q" (*p) : "memory");
+    return val;
+}
+
+static inline uint64_t atomic_load_acquire64(const volatile uint64_t *p) {
+    uint64_t val;
+    asm volatile("ldar %0, %1" : "=r" (val) : "Q" (*p) : "memory");
+    return val;
+}
+
+static inline void atomic_store_release32(volatile uint32_t *p, uint32_t val) {
+    asm volatile("stlr %w1, %0" : "=Q" (*p) : "r" (val) : "memory");
+}
+
+static inline void atomic_store_release64(volatile uint64_t *p, uint64_t val) {
+    asm volatile("stlr %1, %0" : "=Q" (*p) : "r" (val) : "memory");
+}
+
+// --- Waiting ---
+//
+// Spin until *p != val, sleeping in WFE between checks. The exclusive
+// load arms the monitor, so the store that changes *p generates the wake-up
+// event; the releasing CPU needs no explicit SEV.
+
+static inline uint32_t atomic_wait_while32(const volatile uint32_t *p, uint32_t val) {
+    uint32_t cur;
+    asm volatile("   sevl\n"
+                 "1: wfe\n"
+                 "   ldaxr %w0, %1\n"
+                 "   cmp %w0, %w2\n"
+                 "   b.eq 1b"
+                 : "=&r" (cur) : "Q" (*p), "r" (val) : "cc", "memory");
+    return cur;
+}
+
+static inline uint64_t atomic_wait_while64(const volatile uint64_t *p, uint64_t val) {
+    uint64_t cur;
+    asm volatile("   sevl\n"
+                 "1: wfe\n"
+                 "   ldaxr %0, %1\n"
+                 "   cmp %0, %2\n"
+                 "   b.eq 1b"
+                 : "=&r" (cur) : "Q" (*p), "r" (val) : "cc", "memory");
+    return cur;
+}
+
+// Busy-wait hint for loops that cannot use WFE
+static inline void cpu_relax(void) {
+    asm volatile("yield" : : : "memory");
+}
+
+#endif // SYNC_ATOMIC_H
@@ -0,0 +1,69 @@
+#ifndef SYNC_SPINLOCK_H
+#define SYNC_SPINLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sync/atomic.h"
+
+// --- Ticket spinlock ---
+//
+// A CPU takes the next ticket with one atomic add and waits until owner
+// reaches it, so the lock is handed out in FIFO order. Waiters sleep in
+// WFE on the owner half-word; the unlocking store wakes them. All waiters
+// spin on the same line, which is fine for short critical sections with a
+// few CPUs; use an MCS lock where many CPUs contend.
+//
+// Both lock types keep preemption disabled while held, so a holder is
+// never switched out by the scheduler; they must not be held across a
+// sleep or yield.
+
+typedef union {
+    volatile uint32_t val;
+    struct {
+        volatile uint16_t owner;    // Ticket being served (low half)
+        volatile uint16_t next;     // Next ticket to hand out (high half)
+    };
+} spinlock_t;
+
+#define SPINLOCK_INIT { .val = 0 }
+
+static inline void spin_lock_init(spinlock_t *lock) {
+    lock->val = 0;
+}
+
+void spin_lock(spinlock_t *lock);
+bool spin_trylock(spinlock_t *lock);
+void spin_unlock(spinlock_t *lock);
+bool spin_is_locked(spinlock_t *lock);
+
+// Variants that also mask IRQs on this CPU, for locks taken from
+// interrupt handlers. spin_lock_irqsave returns the DAIF value to restore.
+uint64_t spin_lock_irqsave(spinlock_t *lock);
+void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags);
+
+// --- MCS queue lock ---
+//
+// Waiters form a linked queue of nodes, usually on their own stacks, and
+// each spins on its own node; the holder hands the lock to its successor
+// by writing that node. Under contention only one cache line moves per
+// hand-off instead of every waiter re-reading the lock word.
+
+typedef struct mcs_node {
+    struct mcs_node *volatile next;
+    volatile uint32_t locked;       // Set by the predecessor on hand-off
+} mcs_node_t;
+
+typedef struct {
+    mcs_node_t *volatile tail;      // Last waiter, NULL when free
+} mcs_lock_t;
+
+#define MCS_LOCK_INIT { NULL }
+
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node);
+bool mcs_trylock(mcs_lock_t *lock, mcs_node_t *node);
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node);
+
+uint64_t mcs_lock_irqsave(mcs_lock_t *lock, mcs_node_t *node);
+void mcs_unlock_irqrestore(mcs_lock_t *lock, mcs_node_t *node, uint64_t flags);
+
+#endif // SYNC_SPINLOCK_H
@@ -0,0 +1,46 @@
+#ifndef UI_FBCON_H
+#define UI_FBCON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "drivers/ramfb.h"
+
+// Text console on a linear XRGB8888 framebuffer
+//
+// Every glyph is rasterized once at init into an atlas of ready-made
+// pixel rows, in the normal colours and inverted for the cursor. Writes
+// only update a shadow buffer of character cells and mark a dirty span
+// per text row. A flush then blits each dirty span a scanline at a time
+// with straight copies from the atlas, and a scroll moves the shadow and
+// the framebuffer with one memmove each instead of redrawing the screen.
+// Scrolls pending at the same flush are applied as one move.
+
+#define FBCON_CELL_WIDTH    8
+#define FBCON_CELL_HEIGHT   16      // The 8x8 font with every row doubled
+#define FBCON_TAB_WIDTH     8
+
+#define FBCON_FG            0x00c0c0c0
+#define FBCON_BG            0x00000000
+
+typedef struct {
+    uint64_t chars;             // Bytes written
+    uint64_t flushes;
+    uint64_t cells_drawn;
+    uint64_t scrolls;           // Lines scrolled
+    uint64_t scroll_moves;      // Framebuffer memmoves for them
+    uint64_t full_redraws;      // Scrolled a screen or more at once
+} fbcon_stats_t;
+
+// Take over the framebuffer; the caller registers fbcon_write as a console output
+bool fbcon_init(const framebuffer_t *framebuffer);
+
+bool fbcon_active(void);
+
+// Draw len bytes: printable ASCII, '\n', '\r', '\b' and '\t'. Not
+// reentrant; the console lock serialises callers.
+void fbcon_write(const char *buf, size_t len);
+
+void fbcon_get_stats(fbcon_stats_t *stats);
+
+#endif // UI_FBCON_H
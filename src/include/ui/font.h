@@ -0,0 +1,16 @@
+#ifndef UI_FONT_H
+#define UI_FONT_H
+
+#include <stdint.h>
+
+// Built-in bitmap font for printable ASCII
+
+#define FONT_FIRST      0x20
+#define FONT_LAST       0x7E
+#define FONT_GLYPHS     (FONT_LAST - FONT_FIRST + 1)
+#define FONT_WIDTH      8
+#define FONT_HEIGHT     8
+
+extern const uint8_t font8x8[FONT_GLYPHS][FONT_HEIGHT];
+
+#endif // UI_FONT_H
@@ -1,10 +1,17 @@
 #ifndef TUI_H
 #define TUI_H
 
-// Initialize the text user interface
+#include <stddef.h>
+
+// Mode asked of the ramfb display
+#define TUI_FB_WIDTH    1024
+#define TUI_FB_HEIGHT   768
+
+// Bring up the framebuffer console when QEMU has a ramfb device; the
+// serial console is used on its own otherwise
 int tui_init(void);
 
 // Write data to the TUI (terminal)
 void tui_write(const char *data, size_t len);
 
-#endif // TUI_H
\ No newline at end of file
+#endif // TUI_H
@@ -0,0 +1,307 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "lib/fdt.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+// Structure block tokens
+#define FDT_BEGIN_NODE  0x1
+#define FDT_END_NODE    0x2
+#define FDT_PROP        0x3
+#define FDT_NOP         0x4
+#define FDT_END         0x9
+
+typedef struct {
+    uint32_t magic;
+    uint32_t totalsize;
+    uint32_t off_dt_struct;
+    uint32_t off_dt_strings;
+    uint32_t off_mem_rsvmap;
+    uint32_t version;
+    uint32_t last_comp_version;
+    uint32_t boot_cpuid_phys;
+    uint32_t size_dt_strings;
+    uint32_t size_dt_struct;
+} fdt_header_t;
+
+static const uint8_t *fdt_blob = NULL;
+static const uint8_t *fdt_struct = NULL;
+static const char *fdt_strings = NULL;
+static uint32_t fdt_struct_size = 0;
+static uint32_t fdt_size = 0;
+static int root_address_cells = 2;
+static int root_size_cells = 1;
+
+static inline uint32_t fdt_token_at(int offset) {
+    return fdt32_to_cpu(*(const uint32_t *)(fdt_struct + offset));
+}
+
+static inline int fdt_align(int offset) {
+    return (offset + 3) & ~3;
+}
+
+// Offset of the token following the one at offset, or -1 at FDT_END
+static int fdt_next_token(int offset) {
+    uint32_t token = fdt_token_at(offset);
+    switch (token) {
+        case FDT_BEGIN_NODE: {
+            const char *name = (const char *)(fdt_struct + offset + 4);
+            return fdt_align(offset + 4 + (int)strlen(name) + 1);
+        }
+        case FDT_PROP: {
+            uint32_t len = fdt32_to_cpu(*(const uint32_t *)(fdt_struct + offset + 4));
+            return fdt_align(offset + 12 + (int)len);
+        }
+        case FDT_END_NODE:
+        case FDT_NOP:
+            return offset + 4;
+        default:
+            return -1;
+    }
+}
+
+// Offset just past the FDT_END_NODE matching the node at offset
+static int fdt_skip_node(int offset) {
+    int depth = 0;
+    while (offset >= 0 && (uint32_t)offset < fdt_struct_size) {
+        uint32_t token = fdt_token_at(offset);
+        int next = fdt_next_token(offset);
+        if (token == FDT_BEGIN_NODE) {
+            depth++;
+        } else if (token == FDT_END_NODE) {
+            if (--depth == 0) {
+                return next;
+            }
+        }
+        offset = next;
+    }
+    return -1;
+}
+
+bool fdt_init(uint64_t addr) {
+    const fdt_header_t *header = (const fdt_header_t *)addr;
+    if (!addr || fdt32_to_cpu(header->magic) != FDT_MAGIC) {
+        return false;
+    }
+
+    fdt_blob = (const uint8_t *)addr;
+    fdt_size = fdt32_to_cpu(header->totalsize);
+    fdt_struct = fdt_blob + fdt32_to_cpu(header->off_dt_struct);
+    fdt_strings = (const char *)fdt_blob + fdt32_to_cpu(header->off_dt_strings);
+    fdt_struct_size = fdt32_to_cpu(header->size_dt_struct);
+
+    fdt_node_t root = fdt_find_node("/");
+    const void *cells = fdt_get_prop(root, "#address-cells", NULL);
+    if (cells) {
+        root_address_cells = (int)fdt_read_cells(cells, 1);
+    }
+    cells = fdt_get_prop(root, "#size-cells", NULL);
+    if (cells) {
+        root_size_cells = (int)fdt_read_cells(cells, 1);
+    }
+
+    kprintf("FDT: Device tree at 0x%llx, %u bytes, version %u\n",
+            addr, fdt_size, fdt32_to_cpu(header->version));
+    return true;
+}
+
+bool fdt_available(void) {
+    return fdt_blob != NULL;
+}
+
+uint64_t fdt_address(void) {
+    return (uint64_t)fdt_blob;
+}
+
+uint32_t fdt_total_size(void) {
+    return fdt_size;
+}
+
+const char *fdt_node_name(fdt_node_t node) {
+    if (!fdt_blob || node < 0) {
+        return NULL;
+    }
+    return (const char *)(fdt_struct + node + 4);
+}
+
+// Whether a node name matches a path component (unit address optional)
+static bool fdt_name_matches(const char *name, const char *component, size_t len) {
+    if (strncmp(name, component, len) != 0) {
+        return false;
+    }
+    if (name[len] == '\0') {
+        return true;
+    }
+    // "memory" matches "memory@40000000" unless the component has a unit
+    for (size_t i = 0; i < len; i++) {
+        if (component[i] == '@') {
+            return false;
+        }
+    }
+    return name[len] == '@';
+}
+
+fdt_node_t fdt_next_child(fdt_node_t parent, fdt_node_t prev) {
+    if (!fdt_blob || parent < 0) {
+        return -1;
+    }
+
+    // Start after the parent's header, or after the previous child
+    int offset = prev < 0 ? fdt_next_token(parent) : fdt_skip_node(prev);
+    while (offset >= 0 && (uint32_t)offset < fdt_struct_size) {
+        uint32_t token = fdt_token_at(offset);
+        if (token == FDT_BEGIN_NODE) {
+            return offset;
+        }
+        if (token == FDT_END_NODE || token == FDT_END) {
+            return -1; // End of the parent
+        }
+        offset = fdt_next_token(offset);
+    }
+    return -1;
+}
+
+fdt_node_t fdt_find_node(const char *path) {
+    if (!fdt_blob || path[0] != '/') {
+        return -1;
+    }
+
+    // The root node is the first token after any leading NOPs
+    fdt_node_t node = 0;
+    while (fdt_token_at(node) == FDT_NOP) {
+        node += 4;
+    }
+
+    const char *p = path + 1;
+    while (*p) {
+        const char *end = p;
+        while (*end && *end != '/') {
+            end++;
+        }
+        size_t len = (size_t)(end - p);
+
+        fdt_node_t child = fdt_next_child(node, -1);
+        while (child >= 0 && !fdt_name_matches(fdt_node_name(child), p, len)) {
+            child = fdt_next_child(node, child);
+        }
+        if (child < 0) {
+            return -1;
+        }
+        node = child;
+        p = *end ? end + 1 : end;
+    }
+    return node;
+}
+
+const void *fdt_get_prop(fdt_node_t node, const char *name, uint32_t *len) {
+    if (!fdt_blob || node < 0) {
+        return NULL;
+    }
+
+    // Properties come before any subnode
+    int offset = fdt_next_token(node);
+    while (offset >= 0 && (uint32_t)offset < fdt_struct_size) {
+        uint32_t token = fdt_token_at(offset);
+        if (token == FDT_PROP) {
+            uint32_t prop_len = fdt32_to_cpu(*(const uint32_t *)(fdt_struct + offset + 4));
+            uint32_t name_off = fdt32_to_cpu(*(const uint32_t *)(fdt_struct + offset + 8));
+            if (strcmp(fdt_strings + name_off, name) == 0) {
+                if (len) {
+                    *len = prop_len;
+                }
+                return fdt_struct + offset + 12;
+            }
+        } else if (token != FDT_NOP) {
+            break;
+        }
+        offset = fdt_next_token(offset);
+    }
+    return NULL;
+}
+
+const char *fdt_get_string(fdt_node_t node, const char *name) {
+    uint32_t len;
+    const char *value = fdt_get_prop(node, name, &len);
+    if (!value || len == 0 || value[len - 1] != '\0') {
+        return NULL;
+    }
+    return value;
+}
+
+uint64_t fdt_read_cells(const void *cells, int ncells) {
+    const uint32_t *p = cells;
+    uint64_t value = 0;
+    for (int i = 0; i < ncells; i++) {
+        value = (value << 32) | fdt32_to_cpu(p[i]);
+    }
+    return value;
+}
+
+bool fdt_get_reg(fdt_node_t node, int index, uint64_t *addr, uint64_t *size) {
+    uint32_t len;
+    const uint32_t *reg = fdt_get_prop(node, "reg", &len);
+    int stride = root_address_cells + root_size_cells;
+    if (!reg || (uint32_t)((index + 1) * stride * 4) > len) {
+        return false;
+    }
+    reg += index * stride;
+    if (addr) {
+        *addr = fdt_read_cells(reg, root_address_cells);
+    }
+    if (size) {
+        *size = fdt_read_cells(reg + root_address_cells, root_size_cells);
+    }
+    return true;
+}
+
+bool fdt_get_initrd(uint64_t *start, uint64_t *end) {
+    fdt_node_t chosen = fdt_find_node("/chosen");
+    uint32_t start_len, end_len;
+    const void *start_prop = fdt_get_prop(chosen, "linux,initrd-start", &start_len);
+    const void *end_prop = fdt_get_prop(chosen, "linux,initrd-end", &end_len);
+    if (!start_prop || !end_prop) {
+        return false;
+    }
+    // Either property may be one or two cells
+    *start = fdt_read_cells(start_prop, (int)(start_len / 4));
+    *end = fdt_read_cells(end_prop, (int)(end_len / 4));
+    return *end > *start;
+}
+
+// Whether a "compatible" string list contains compat
+static bool fdt_is_compatible(fdt_node_t node, const char *compat) {
+    uint32_t len;
+    const char *list = fdt_get_prop(node, "compatible", &len);
+    if (!list) {
+        return false;
+    }
+    const char *end = list + len;
+    while (list < end) {
+        if (strcmp(list, compat) == 0) {
+            return true;
+        }
+        list += strlen(list) + 1;
+    }
+    return false;
+}
+
+fdt_node_t fdt_find_compatible(fdt_node_t start, const char *compat) {
+    if (!fdt_blob) {
+        return -1;
+    }
+
+    // Walk every node header after start in document order
+    int offset = start < 0 ? 0 : fdt_next_token(start);
+    while (offset >= 0 && (uint32_t)offset < fdt_struct_size) {
+        uint32_t token = fdt_token_at(offset);
+        if (token == FDT_END) {
+            break;
+        }
+        if (token == FDT_BEGIN_NODE && fdt_is_compatible(offset, compat)) {
+            return offset;
+        }
+        offset = fdt_next_token(offset);
+    }
+    return -1;
+}
@@ -0,0 +1,52 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "lib/klog.h"
+#include "lib/string.h"
+
+static char klog_buf[KLOG_SIZE];
+static volatile uint64_t klog_head = 0;
+
+void klog_write(const char *buf, size_t len) {
+    uint64_t end = klog_head + len;
+    if (len > KLOG_SIZE) {
+        // Only the tail survives
+        buf += len - KLOG_SIZE;
+        len = KLOG_SIZE;
+    }
+    uint64_t head = end - len;
+    size_t offset = head % KLOG_SIZE;
+    size_t first = KLOG_SIZE - offset;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(klog_buf + offset, buf, first);
+    memcpy(klog_buf, buf + first, len - first);
+    klog_head = end;
+}
+
+uint64_t klog_end(void) {
+    return klog_head;
+}
+
+size_t klog_read(uint64_t *pos, char *buf, size_t len) {
+    uint64_t head = klog_head;
+    uint64_t start = head > KLOG_SIZE ? head - KLOG_SIZE : 0;
+    if (*pos < start) {
+        *pos = start;
+    }
+    if (*pos >= head) {
+        return 0;
+    }
+    if (len > head - *pos) {
+        len = head - *pos;
+    }
+    size_t offset = *pos % KLOG_SIZE;
+    size_t first = KLOG_SIZE - offset;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(buf, klog_buf + offset, first);
+    memcpy(buf + first, klog_buf, len - first);
+    *pos += len;
+    return len;
+}
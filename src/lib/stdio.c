@@ -4,219 +4,356 @@
 #include <stdbool.h>
 #include "lib/stdio.h"
 #include "lib/uart.h"
+#include "lib/klog.h"
 #include "lib/string.h"
+#include "sync/spinlock.h"
+#include "arch/cpu.h"
+#include "sched/thread.h"
 
 // Buffer sizes
 #define PRINTF_BUFFER_SIZE 1024
-#define MAX_INT_DIGITS 21  // For 64-bit integer
+#define MAX_INT_DIGITS 24  // 64-bit integer in base 8+, sign and terminator
 
-// Forward declarations for printf helper functions
-static void print_string(const char *str);
-static void print_char(char c);
-static void print_int(int64_t value, int base, bool is_signed);
-static void print_uint(uint64_t value, int base);
-static void print_hex(uint64_t value, bool uppercase);
-static void print_pointer(void *ptr);
+// How often kgetc_blocking() polls for input when the console cannot sleep
+#define KGETC_POLL_MS 5
+
+// Convert value to digits, writing backwards from end. Returns the first digit.
+static char *format_number(char *end, uint64_t value, unsigned int base, bool uppercase) {
+    const char *digits = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
+    char *ptr = end;
+    *ptr = '\0';
+    do {
+        *--ptr = digits[value % base];
+        value /= base;
+    } while (value > 0);
+    return ptr;
+}
+
+// Append a converted field to the buffer, padding it to width
+static void emit_field(char **buf_ptr, char *buf_end, const char *str, size_t len,
+                       int width, bool left_align, char pad) {
+    size_t padding = (width > 0 && (size_t)width > len) ? (size_t)width - len : 0;
+
+    // Zero padding goes between the sign and the digits
+    if (!left_align && pad == '0' && len > 0 && str[0] == '-') {
+        if (*buf_ptr < buf_end) *(*buf_ptr)++ = '-';
+        str++;
+        len--;
+    }
+    if (!left_align) {
+        while (padding-- > 0 && *buf_ptr < buf_end) *(*buf_ptr)++ = pad;
+    }
+    while (len-- > 0 && *buf_ptr < buf_end) {
+        *(*buf_ptr)++ = *str++;
+    }
+    if (left_align) {
+        while (padding-- > 0 && *buf_ptr < buf_end) *(*buf_ptr)++ = ' ';
+    }
+}
+
+// Format into buffer (always NUL-terminated). Supports %c %s %d %i %u %x %X
+// %p %%, the '-' and '0' flags, a field width (or '*') and the h/l/ll/z
+// length modifiers.
+int kvsnprintf(char *buffer, size_t size, const char *format, va_list args) {
+    if (size == 0) {
+        return 0;
+    }
 
-// Basic kprintf implementation
-int kprintf(const char *format, ...) {
-    char buffer[PRINTF_BUFFER_SIZE];
     char *buf_ptr = buffer;
-    va_list args;
-    va_start(args, format);
-    
-    while (*format != '\0' && (size_t)(buf_ptr - buffer) < PRINTF_BUFFER_SIZE - 1) {
-        if (*format == '%') {
+    char *buf_end = buffer + size - 1; // Leave room for the terminator
+
+    while (*format != '\0' && buf_ptr < buf_end) {
+        if (*format != '%') {
+            *buf_ptr++ = *format++;
+            continue;
+        }
+        format++;
+
+        // Flags
+        bool left_align = false;
+        char pad = ' ';
+        while (*format == '-' || *format == '0') {
+            if (*format == '-') {
+                left_align = true;
+            } else {
+                pad = '0';
+            }
+            format++;
+        }
+
+        // Field width
+        int width = 0;
+        if (*format == '*') {
+            width = va_arg(args, int);
+            if (width < 0) {
+                left_align = true;
+                width = -width;
+            }
+            format++;
+        } else {
+            while (*format >= '0' && *format <= '9') {
+                width = width * 10 + (*format - '0');
+                format++;
+            }
+        }
+        if (left_align) {
+            pad = ' ';
+        }
+
+        // Length modifiers
+        bool is_long = false;
+        bool is_longlong = false;
+
+        if (*format == 'l') {
+            is_long = true;
             format++;
-            
-            // Check for length modifiers
-            bool is_long = false;
-            bool is_longlong = false;
-            
             if (*format == 'l') {
-                is_long = true;
+                is_longlong = true;
+                is_long = false;
                 format++;
-                if (*format == 'l') {
-                    is_longlong = true;
-                    is_long = false;
-                    format++;
-                }
             }
-            
-            // Process format specifier
-            switch (*format) {
-                case 'c':
-                    *buf_ptr++ = (char)va_arg(args, int);
-                    break;
-                case 's': {
-                    const char *str = va_arg(args, const char*);
-                    if (str == NULL) str = "(null)";
-                    size_t len = strlen(str);
-                    if (len > PRINTF_BUFFER_SIZE - (buf_ptr - buffer) - 1)
-                        len = PRINTF_BUFFER_SIZE - (buf_ptr - buffer) - 1;
-                    memcpy(buf_ptr, str, len);
-                    buf_ptr += len;
-                    break;
-                }
-                case 'd':
-                case 'i': {
-                    int64_t value;
-                    if (is_longlong)
-                        value = va_arg(args, int64_t);
-                    else if (is_long)
-                        value = va_arg(args, long);
-                    else
-                        value = va_arg(args, int);
-                    
-                    // Convert to string using helper function
-                    char num_buf[MAX_INT_DIGITS];
-                    char *num_ptr = num_buf + MAX_INT_DIGITS - 1;
-                    *num_ptr = '\0';
-                    
-                    bool is_negative = value < 0;
-                    uint64_t abs_value = is_negative ? -value : value;
-                    
-                    do {
-                        *--num_ptr = '0' + (abs_value % 10);
-                        abs_value /= 10;
-                    } while (abs_value > 0);
-                    
-                    if (is_negative) {
-                        *--num_ptr = '-';
-                    }
-                    
-                    size_t len = strlen(num_ptr);
-                    if (len > PRINTF_BUFFER_SIZE - (buf_ptr - buffer) - 1)
-                        len = PRINTF_BUFFER_SIZE - (buf_ptr - buffer) - 1;
-                    memcpy(buf_ptr, num_ptr, len);
-                    buf_ptr += len;
-                    break;
-                }
-                case 'u': {
-                    uint64_t value;
-                    if (is_longlong)
-                        value = va_arg(args, uint64_t);
-                    else if (is_long)
-                        value = va_arg(args, unsigned long);
-                    else
-                        value = va_arg(args, unsigned int);
-                    
-                    // Convert to string
-                    char num_buf[MAX_INT_DIGITS];
-                    char *num_ptr = num_buf + MAX_INT_DIGITS - 1;
-                    *num_ptr = '\0';
-                    
-                    do {
-                        *--num_ptr = '0' + (value % 10);
-                        value /= 10;
-                    } while (value > 0);
-                    
-                    size_t len = strlen(num_ptr);
-                    if (len > PRINTF_BUFFER_SIZE - (buf_ptr - buffer) - 1)
-                        len = PRINTF_BUFFER_SIZE - (buf_ptr - buffer) - 1;
-                    memcpy(buf_ptr, num_ptr, len);
-                    buf_ptr += len;
-                    break;
-                }
-                case 'x':
-                case 'X': {
-                    uint64_t value;
-                    if (is_longlong)
-                        value = va_arg(args, uint64_t);
-                    else if (is_long)
-                        value = va_arg(args, unsigned long);
-                    else
-                        value = va_arg(args, unsigned int);
-                    
-                    // Convert to hex string
-                    char num_buf[MAX_INT_DIGITS];
-                    char *num_ptr = num_buf + MAX_INT_DIGITS - 1;
-                    *num_ptr = '\0';
-                    
-                    const char *hex_chars = (*format == 'x') ? "0123456789abcdef" : "0123456789ABCDEF";
-                    
-                    do {
-                        *--num_ptr = hex_chars[value & 0xF];
-                        value >>= 4;
-                    } while (value > 0);
-                    
-                    size_t len = strlen(num_ptr);
-                    if (len > PRINTF_BUFFER_SIZE - (buf_ptr - buffer) - 1)
-                        len = PRINTF_BUFFER_SIZE - (buf_ptr - buffer) - 1;
-                    memcpy(buf_ptr, num_ptr, len);
-                    buf_ptr += len;
-                    break;
+        } else if (*format == 'z') {
+            is_longlong = true; // size_t is 64-bit
+            format++;
+        } else {
+            while (*format == 'h') {
+                format++; // Promoted to int anyway
+            }
+        }
+
+        char num_buf[MAX_INT_DIGITS];
+        char *num_end = num_buf + MAX_INT_DIGITS - 1;
+
+        // Process format specifier
+        switch (*format) {
+            case 'c': {
+                char c = (char)va_arg(args, int);
+                emit_field(&buf_ptr, buf_end, &c, 1, width, left_align, ' ');
+                break;
+            }
+            case 's': {
+                const char *str = va_arg(args, const char*);
+                if (str == NULL) str = "(null)";
+                emit_field(&buf_ptr, buf_end, str, strlen(str), width, left_align, ' ');
+                break;
+            }
+            case 'd':
+            case 'i': {
+                int64_t value;
+                if (is_longlong)
+                    value = va_arg(args, int64_t);
+                else if (is_long)
+                    value = va_arg(args, long);
+                else
+                    value = va_arg(args, int);
+
+                bool is_negative = value < 0;
+                uint64_t abs_value = is_negative ? -(uint64_t)value : (uint64_t)value;
+                char *num_ptr = format_number(num_end, abs_value, 10, false);
+                if (is_negative) {
+                    *--num_ptr = '-';
                 }
-                case 'p': {
-                    void *ptr = va_arg(args, void*);
-                    
-                    // Print "0x" prefix
-                    if (buf_ptr + 2 < buffer + PRINTF_BUFFER_SIZE - 1) {
-                        *buf_ptr++ = '0';
-                        *buf_ptr++ = 'x';
-                    }
-                    
-                    // Convert to hex string
-                    uint64_t value = (uint64_t)ptr;
-                    char num_buf[MAX_INT_DIGITS];
-                    char *num_ptr = num_buf + MAX_INT_DIGITS - 1;
-                    *num_ptr = '\0';
-                    
-                    // Always print full pointer width (16 hex digits for 64-bit)
-                    int digit_count = 0;
-                    do {
-                        *--num_ptr = "0123456789abcdef"[value & 0xF];
-                        value >>= 4;
-                        digit_count++;
-                    } while (value > 0 || digit_count < 16);
-                    
-                    size_t len = strlen(num_ptr);
-                    if (len > PRINTF_BUFFER_SIZE - (buf_ptr - buffer) - 1)
-                        len = PRINTF_BUFFER_SIZE - (buf_ptr - buffer) - 1;
-                    memcpy(buf_ptr, num_ptr, len);
-                    buf_ptr += len;
-                    break;
+                emit_field(&buf_ptr, buf_end, num_ptr, strlen(num_ptr), width, left_align, pad);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X': {
+                uint64_t value;
+                if (is_longlong)
+                    value = va_arg(args, uint64_t);
+                else if (is_long)
+                    value = va_arg(args, unsigned long);
+                else
+                    value = va_arg(args, unsigned int);
+
+                char *num_ptr = format_number(num_end, value, (*format == 'u') ? 10 : 16,
+                                              *format == 'X');
+                emit_field(&buf_ptr, buf_end, num_ptr, strlen(num_ptr), width, left_align, pad);
+                break;
+            }
+            case 'p': {
+                // "0x" followed by the full 16-digit pointer value
+                uint64_t value = (uint64_t)va_arg(args, void*);
+                char *num_ptr = format_number(num_end, value, 16, false);
+                while (num_ptr > num_end - 16) {
+                    *--num_ptr = '0';
                 }
-                case '%':
-                    *buf_ptr++ = '%';
-                    break;
-                default:
-                    // Unsupported format specifier, just copy it
-                    *buf_ptr++ = '%';
-                    *buf_ptr++ = *format;
-                    break;
+                *--num_ptr = 'x';
+                *--num_ptr = '0';
+                emit_field(&buf_ptr, buf_end, num_ptr, strlen(num_ptr), width, left_align, ' ');
+                break;
             }
-        } else {
-            *buf_ptr++ = *format;
+            case '%':
+                *buf_ptr++ = '%';
+                break;
+            case '\0':
+                // Trailing '%' at the end of the format string
+                format--;
+                break;
+            default:
+                // Unsupported format specifier, just copy it
+                *buf_ptr++ = '%';
+                if (buf_ptr < buf_end) {
+                    *buf_ptr++ = *format;
+                }
+                break;
         }
-        
+
         format++;
     }
-    
+
     // Null-terminate the buffer
     *buf_ptr = '\0';
-    
-    // Output the buffer through UART
-    char *output_ptr = buffer;
-    while (*output_ptr) {
-        uart_putc(*output_ptr++);
+    return buf_ptr - buffer;
+}
+
+int ksnprintf(char *buffer, size_t size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = kvsnprintf(buffer, size, format, args);
+    va_end(args);
+    return len;
+}
+
+// Serialises whole kprintf lines between CPUs. The owner lets a CPU that
+// faults while printing still report the fault instead of deadlocking.
+static spinlock_t console_lock = SPINLOCK_INIT;
+static volatile int console_owner = -1;
+
+// Extra outputs (e.g. the framebuffer console) besides the UART
+static console_output_t console_outputs[CONSOLE_MAX_OUTPUTS];
+static unsigned int nr_console_outputs = 0;
+
+// The bound console device; NULL for the UART
+static const console_dev_t *volatile console_dev = NULL;
+static volatile bool console_panicked = false;
+
+// Until console_start() output only goes to the kernel log
+static volatile bool console_up = false;
+
+// Set up the UART and print what was logged before it was there
+static void console_replay(void) {
+    uart_init();
+    char chunk[256];
+    uint64_t pos = 0;
+    size_t n;
+    while ((n = klog_read(&pos, chunk, sizeof(chunk))) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            uart_putc(chunk[i]);
+        }
     }
-    
+    console_up = true;
+}
+
+// Log len bytes and output them through the console device and the
+// extra outputs as one unit
+static void console_write(const char *buf, size_t len) {
+    uint64_t flags = local_irq_save();
+    bool nested = console_owner == (int)cpu_id();
+    if (!nested) {
+        spin_lock(&console_lock);
+        console_owner = cpu_id();
+    }
+
+    klog_write(buf, len);
+    const console_dev_t *dev = console_dev;
+    bool up = console_up;
+    if (up && dev && !nested && !console_panicked) {
+        dev->write(buf, len);
+    } else if (up) {
+        for (size_t i = 0; i < len; i++) {
+            uart_putc(buf[i]);
+        }
+    }
+
+    // A nested write may have interrupted one of the outputs midway, so
+    // it only goes to the UART
+    if (!nested) {
+        for (unsigned int i = 0; up && i < nr_console_outputs; i++) {
+            console_outputs[i](buf, len);
+        }
+        console_owner = -1;
+        spin_unlock(&console_lock);
+    }
+    local_irq_restore(flags);
+}
+
+// Basic kprintf implementation
+int kprintf(const char *format, ...) {
+    char buffer[PRINTF_BUFFER_SIZE];
+    va_list args;
+    va_start(args, format);
+    int len = kvsnprintf(buffer, sizeof(buffer), format, args);
     va_end(args);
-    return buf_ptr - buffer;
+
+    console_write(buffer, (size_t)len);
+    return len;
+}
+
+void kwrite(const char *buf, size_t len) {
+    console_write(buf, len);
+}
+
+bool console_add_output(console_output_t write) {
+    uint64_t flags = local_irq_save();
+    spin_lock(&console_lock);
+    bool added = nr_console_outputs < CONSOLE_MAX_OUTPUTS;
+    if (added) {
+        console_outputs[nr_console_outputs++] = write;
+    }
+    spin_unlock(&console_lock);
+    local_irq_restore(flags);
+    return added;
+}
+
+void console_start(void) {
+    uint64_t flags = local_irq_save();
+    spin_lock(&console_lock);
+    if (!console_up) {
+        console_replay();
+    }
+    spin_unlock(&console_lock);
+    local_irq_restore(flags);
+}
+
+void console_bind(const console_dev_t *dev) {
+    uint64_t flags = local_irq_save();
+    spin_lock(&console_lock);
+    console_dev = dev;
+    spin_unlock(&console_lock);
+    local_irq_restore(flags);
+}
+
+const char *console_name(void) {
+    const console_dev_t *dev = console_dev;
+    return dev ? dev->name : "uart";
+}
+
+// The console lock may be held by whoever is panicking, so this does not
+// take it
+void console_panic(void) {
+    console_panicked = true;
+    if (!console_up) {
+        console_replay();
+    }
 }
 
 // Get a character (non-blocking)
 char kgetc(void) {
-    return uart_getc();
+    const console_dev_t *dev = console_dev;
+    return dev ? dev->getc() : uart_getc();
 }
 
 // Simple blocking character read
 char kgetc_blocking(void) {
     char c;
-    while ((c = uart_getc()) == 0) {
-        // Wait for character
-        asm volatile("yield");
+    while ((c = kgetc()) == 0) {
+        // Wait for character, letting other threads run meanwhile
+        const console_dev_t *dev = console_dev;
+        if (!(dev ? dev->wait_rx() : uart_wait_rx())) {
+            thread_sleep_ms(KGETC_POLL_MS);
+        }
     }
     
     // Convert CR (Enter key) to LF for processing
@@ -225,4 +362,4 @@ char kgetc_blocking(void) {
     }
     
     return c;
-}
\ No newline at end of file
+}
@@ -3,23 +3,7 @@
 #include <stdbool.h>
 #include "lib/string.h"
 
-void* memset(void *s, int c, size_t n) {
-    unsigned char *p = (unsigned char *)s;
-    unsigned char uc = (unsigned char)c;
-    while (n-- > 0) {
-        *p++ = uc;
-    }
-    return s;
-}
-
-void* memcpy(void *dest, const void *src, size_t n) {
-    unsigned char *d = (unsigned char *)dest;
-    const unsigned char *s = (const unsigned char *)src;
-    while (n-- > 0) {
-        *d++ = *s++;
-    }
-    return dest;
-}
+// memset, memcpy, copy_page and clear_page are in memcpy.S
 
 size_t strlen(const char *s) {
     size_t len = 0;
@@ -49,14 +33,12 @@ int strncmp(const char *s1, const char *s2, size_t n) {
     return *(const unsigned char*)s1 - *(const unsigned char*)s2;
 }
 
-// Note: strtok is not re-entrant due to the static pointer!
-static char *strtok_last;
-
-char* strtok(char *str, const char *delim) {
+// Re-entrant tokenizer: the position between calls lives in *saveptr
+char* strtok_r(char *str, const char *delim, char **saveptr) {
     char *token;
 
     if (str == NULL) {
-        str = strtok_last;
+        str = *saveptr;
     }
     if (str == NULL) {
         return NULL; // No more tokens
@@ -65,7 +47,7 @@ char* strtok(char *str, const char *delim) {
     // Skip leading delimiters
     str += strspn(str, delim);
     if (*str == '\0') {
-        strtok_last = NULL;
+        *saveptr = NULL;
         return NULL;
     }
 
@@ -74,16 +56,24 @@ char* strtok(char *str, const char *delim) {
     str = strpbrk(token, delim);
     if (str == NULL) {
         // This token is the last one
-        strtok_last = NULL;
+        *saveptr = NULL;
     } else {
         // Terminate the token and save the position for the next call
         *str = '\0';
-        strtok_last = str + 1;
+        *saveptr = str + 1;
     }
 
     return token;
 }
 
+// Note: strtok is not re-entrant due to the static pointer; use strtok_r
+// anywhere that may run concurrently
+static char *strtok_last;
+
+char* strtok(char *str, const char *delim) {
+    return strtok_r(str, delim, &strtok_last);
+}
+
 // Helper for strtok: length of initial segment consisting of accept characters
 size_t strspn(const char *s, const char *accept) {
     size_t count = 0;
@@ -1,4 +1,12 @@
+#include <stdbool.h>
 #include "lib/uart.h"
+#include "lib/stdio.h"
+#include "drivers/gic.h"
+#include "sched/thread.h"
+#include "sched/softirq.h"
+#include "sched/workqueue.h"
+#include "sched/wait.h"
+#include "sync/atomic.h"
 
 // QEMU virt PL011 UART registers
 #define UART_BASE       0x09000000
@@ -9,6 +17,10 @@
 #define UART_LCRH       ((volatile uint32_t*)(UART_BASE + 0x2C))
 #define UART_CR         ((volatile uint32_t*)(UART_BASE + 0x30))
 #define UART_IMSC       ((volatile uint32_t*)(UART_BASE + 0x38))
+#define UART_ICR        ((volatile uint32_t*)(UART_BASE + 0x44))
+
+// SPI 1 on the QEMU virt machine
+#define UART_IRQ        33
 
 // Flag register bits
 #define UART_FR_RXFE    0x10    // Receive FIFO empty
@@ -23,6 +35,27 @@
 #define UART_CR_TXE     0x100   // Transmit enable
 #define UART_CR_RXE     0x200   // Receive enable
 
+// Interrupt mask/clear bits
+#define UART_INT_RX     0x10    // RX FIFO reached its trigger level
+#define UART_INT_RT     0x40    // RX timeout: data waiting below the level
+
+// Received characters between the IRQ handler and the reader; a power of two
+#define UART_RX_RING_SIZE 256
+
+// Filled by the IRQ handler only, drained by one reader at a time
+static volatile char rx_ring[UART_RX_RING_SIZE];
+static volatile uint32_t rx_head;   // Next slot the IRQ handler writes
+static volatile uint32_t rx_tail;   // Next slot the reader takes
+static volatile uint32_t rx_dropped;
+static uint32_t rx_dropped_reported;
+static bool rx_irq_enabled = false;
+
+// Readers blocked in uart_wait_rx(), woken by the RX tasklet
+static wait_queue_t rx_wait = WAIT_QUEUE_INIT;
+
+static tasklet_t rx_tasklet;
+static work_t rx_overrun_work;
+
 void uart_init(void) {
     // Disable UART while configuring
     *UART_CR = 0;
@@ -58,6 +91,16 @@ void uart_putc(char c) {
 }
 
 char uart_getc(void) {
+    if (rx_irq_enabled) {
+        uint32_t tail = rx_tail;
+        if (tail == atomic_load_acquire32(&rx_head)) {
+            return 0;
+        }
+        char c = rx_ring[tail % UART_RX_RING_SIZE];
+        atomic_store_release32(&rx_tail, tail + 1);
+        return c;
+    }
+
     // If receive FIFO is empty, return 0
     if (*UART_FR & UART_FR_RXFE) {
         return 0;
@@ -68,6 +111,73 @@ char uart_getc(void) {
 }
 
 int uart_is_data_available(void) {
+    if (rx_irq_enabled) {
+        return rx_tail != atomic_load_acquire32(&rx_head);
+    }
+
     // Check if receive FIFO is not empty
     return !(*UART_FR & UART_FR_RXFE);
+}
+
+// --- Interrupt-driven receive ---
+//
+// The hard IRQ handler only empties the FIFO into rx_ring. Waking the
+// reader is left to a tasklet, and reporting lost input (a kprintf, far
+// slower than the rest) to the system workqueue.
+
+static void uart_rx_overrun_work(void *data) {
+    (void)data;
+    uint32_t dropped = rx_dropped;
+    kprintf("UART: Input ring full, %u characters dropped\n", dropped - rx_dropped_reported);
+    rx_dropped_reported = dropped;
+}
+
+static void uart_rx_tasklet(void *data) {
+    (void)data;
+    wake_up(&rx_wait);
+    if (rx_dropped != rx_dropped_reported && system_wq) {
+        queue_work(system_wq, &rx_overrun_work);
+    }
+}
+
+static void uart_irq_handler(unsigned int irq, saved_registers_t *context, void *data) {
+    (void)irq;
+    (void)context;
+    (void)data;
+    uint32_t head = rx_head;
+    while (!(*UART_FR & UART_FR_RXFE)) {
+        char c = *UART_DR;
+        if (head - rx_tail < UART_RX_RING_SIZE) {
+            rx_ring[head % UART_RX_RING_SIZE] = c;
+            head++;
+        } else {
+            rx_dropped++;
+        }
+    }
+    atomic_store_release32(&rx_head, head);
+    *UART_ICR = UART_INT_RX | UART_INT_RT;
+    tasklet_schedule(&rx_tasklet);
+}
+
+void uart_enable_rx_irq(void) {
+    tasklet_init(&rx_tasklet, uart_rx_tasklet, NULL);
+    work_init(&rx_overrun_work, uart_rx_overrun_work, NULL);
+
+    // Characters typed before now are still in the FIFO and become the
+    // first ring entries on the first interrupt
+    rx_irq_enabled = true;
+    if (irq_register(UART_IRQ, uart_irq_handler, NULL) != 0) {
+        rx_irq_enabled = false;
+        return;
+    }
+    *UART_ICR = UART_INT_RX | UART_INT_RT;
+    *UART_IMSC = UART_INT_RX | UART_INT_RT;
+}
+
+bool uart_wait_rx(void) {
+    if (!rx_irq_enabled || !sched_active()) {
+        return false;
+    }
+    wait_event(&rx_wait, uart_is_data_available());
+    return true;
 }
\ No newline at end of file
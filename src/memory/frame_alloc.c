@@ -4,6 +4,11 @@
 #include "memory/frame_alloc.h"
 #include "lib/string.h"
 #include "lib/stdio.h"
+#include "lib/fdt.h"
+#include "sync/spinlock.h"
+#include "arch/cpu.h"
+#include "debug/trace.h"
+#include "debug/memprof.h"
 
 // For QEMU virt, RAM often starts at 0x40000000 and can be e.g., 128MB or more.
 // Let's assume a max manageable physical address space, e.g., 1GB beyond RAM start.
@@ -16,6 +21,37 @@
 // Size = Total Frames / 8 bits per byte
 static uint8_t *frame_bitmap = &_pmm_bitmap_start;
 
+// Reference count of every frame, allocated from the PMM itself at init.
+// alloc_frame() hands out frames with a count of 1 and free_frame() drops
+// one reference, so frames shared between mappings are freed last-out.
+static uint16_t *frame_refcount = NULL;
+static size_t frame_refcount_entries = 0;
+
+// Protects the bitmap, reference counts and free_memory. Every CPU faults
+// pages in through here, so it is a queue lock: waiters spin on their own
+// stack node rather than all hammering one line.
+static mcs_lock_t pmm_lock = MCS_LOCK_INIT;
+
+// --- Per-CPU frame caches ---
+//
+// Each CPU keeps a small stack of free frames in front of the bitmap.
+// alloc_frame() and a last-reference free_frame() only touch the local
+// stack with IRQs masked; the global pool and its lock are visited once
+// per FRAME_CACHE_BATCH frames to refill an empty stack or drain a full
+// one. Cached frames stay marked used in the bitmap with a reference
+// count of 0, and are counted as free by pmm_get_free_memory().
+
+#define FRAME_CACHE_SIZE  32
+#define FRAME_CACHE_BATCH 16
+
+typedef struct {
+    uint32_t count;
+    uint32_t frames[FRAME_CACHE_SIZE];  // Frame indices, most recently freed last
+} __attribute__((aligned(64))) frame_cache_t;
+
+static frame_cache_t frame_caches[MAX_CPUS];
+static bool frame_cache_enabled = true;
+
 static uint64_t total_memory = 0;
 static uint64_t free_memory = 0;
 static uint64_t highest_usable_address = 0;
@@ -124,39 +160,174 @@ void frame_alloc_init(const KERNEL_BOOT_PARAMS *params) {
         kprintf("PMM: Kernel boundaries from linker: 0x%llx - 0x%llx\n",
                 kernel_start, kernel_end);
                 
+        // Size RAM from the device tree's /memory node when there is one
+        uint64_t ram_base = PMM_RAM_BASE;
+        uint64_t ram_size = PMM_MANAGEABLE_SIZE;
+        uint64_t fdt_base, fdt_size;
+        if (fdt_get_reg(fdt_find_node("/memory"), 0, &fdt_base, &fdt_size)) {
+            kprintf("PMM: Device tree reports RAM 0x%llx - 0x%llx\n",
+                    fdt_base, fdt_base + fdt_size);
+            if (fdt_base >= PMM_RAM_BASE && fdt_base < PMM_MAX_ADDRESS) {
+                ram_base = fdt_base;
+                ram_size = fdt_size;
+                if (ram_base + ram_size > PMM_MAX_ADDRESS) {
+                    ram_size = PMM_MAX_ADDRESS - ram_base;
+                }
+            }
+        } else {
+            kprintf("PMM: No /memory node, assuming %llu MB of RAM\n",
+                    PMM_MANAGEABLE_SIZE >> 20);
+        }
+        
         // Mark all memory as free initially
-        mark_range_free(PMM_RAM_BASE, PMM_MANAGEABLE_SIZE);
+        mark_range_free(ram_base, ram_size);
         
         // Then mark kernel memory as used
         mark_range_used(kernel_start, kernel_end - kernel_start);
     }
     
+    // The loader put the device tree and any initrd in RAM; keep them
+    if (fdt_available()) {
+        mark_range_used(fdt_address(), fdt_total_size());
+        
+        uint64_t initrd_start, initrd_end;
+        if (fdt_get_initrd(&initrd_start, &initrd_end)) {
+            mark_range_used(initrd_start, initrd_end - initrd_start);
+        }
+    }
+    
     // Mark the bitmap itself as used (it lies within kernel memory, but just to be explicit)
     mark_range_used((uint64_t)frame_bitmap, bitmap_size);
     
+    // Reference counts for all usable frames. Frames allocated before
+    // this point (none yet) would have a count of 0 and are never freed.
+    size_t usable_frames = (highest_usable_address - PMM_RAM_BASE) / PAGE_SIZE;
+    size_t refcount_frames = (usable_frames * sizeof(uint16_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    frame_refcount = alloc_frames(refcount_frames);
+    if (frame_refcount) {
+        frame_refcount_entries = usable_frames;
+        kprintf("PMM: Reference counts: %zu KB at %p\n",
+                refcount_frames * PAGE_SIZE / 1024, frame_refcount);
+    } else {
+        kprintf("PMM: ERROR - No memory for frame reference counts!\n");
+    }
+    
     kprintf("PMM: Initialization complete. Total: %llu KB, Free: %llu KB\n",
             total_memory / 1024, free_memory / 1024);
 }
 
-void* alloc_frame(void) {
-    // Simple linear search for first free frame
-    for (size_t i = 0; i < PMM_TOTAL_FRAMES; i++) {
+// Move up to count free frames from the bitmap into out; returns how many
+static size_t pmm_take_frames(uint32_t *out, size_t count) {
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&pmm_lock, &node);
+    
+    // Simple linear search for free frames
+    size_t taken = 0;
+    for (size_t i = 0; i < PMM_TOTAL_FRAMES && taken < count; i++) {
         if (!test_bit(i)) {
             set_bit(i);
-            free_memory -= PAGE_SIZE;
-            
-            // Calculate the physical address
-            void *frame_addr = (void*)(PMM_RAM_BASE + i * PAGE_SIZE);
-            
-            // Zero the frame for security/predictability
-            memset(frame_addr, 0, PAGE_SIZE);
-            
-            return frame_addr;
+            out[taken++] = i;
+        }
+    }
+    free_memory -= taken * PAGE_SIZE;
+    
+    mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+    return taken;
+}
+
+// Return count frames with a reference count of 0 to the bitmap
+static void pmm_put_frames(const uint32_t *frames, size_t count) {
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&pmm_lock, &node);
+    for (size_t i = 0; i < count; i++) {
+        clear_bit(frames[i]);
+    }
+    free_memory += count * PAGE_SIZE;
+    mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+}
+
+void* alloc_frame(void) {
+    uint32_t frame_idx;
+    bool found;
+    
+    uint64_t flags = local_irq_save();
+    if (frame_cache_enabled) {
+        frame_cache_t *cache = &frame_caches[cpu_id()];
+        if (cache->count == 0) {
+            cache->count = pmm_take_frames(cache->frames, FRAME_CACHE_BATCH);
+        }
+        found = cache->count > 0;
+        if (found) {
+            frame_idx = cache->frames[--cache->count];
         }
+    } else {
+        found = pmm_take_frames(&frame_idx, 1) == 1;
+    }
+    local_irq_restore(flags);
+    
+    if (!found) {
+        kprintf("PMM: ERROR - Out of physical frames!\n");
+        return NULL; // No free frame found
     }
     
-    kprintf("PMM: ERROR - Out of physical frames!\n");
-    return NULL; // No free frame found
+    // The frame is ours now; nobody else reads its count until it is shared
+    if (frame_idx < frame_refcount_entries) frame_refcount[frame_idx] = 1;
+    
+    // Calculate the physical address
+    void *frame_addr = (void*)(PMM_RAM_BASE + (uint64_t)frame_idx * PAGE_SIZE);
+    
+    // Zero the frame for security/predictability
+    clear_page(frame_addr);
+    
+    TRACE(alloc_frame, frame_addr, 0);
+    MEMPROF_ALLOC(MEMPROF_FRAME, frame_addr, PAGE_SIZE);
+    return frame_addr;
+}
+
+void* alloc_frames(size_t count) {
+    if (count == 0) {
+        return NULL;
+    }
+
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&pmm_lock, &node);
+    
+    // Linear search for the first run of count free frames
+    size_t run_start = 0;
+    size_t run_length = 0;
+    for (size_t i = 0; i < PMM_TOTAL_FRAMES; i++) {
+        if (test_bit(i)) {
+            run_length = 0;
+            continue;
+        }
+        if (run_length == 0) {
+            run_start = i;
+        }
+        if (++run_length == count) {
+            for (size_t j = run_start; j < run_start + count; j++) {
+                set_bit(j);
+                if (j < frame_refcount_entries) frame_refcount[j] = 1;
+            }
+            free_memory -= count * PAGE_SIZE;
+            mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+
+            void *base = (void*)(PMM_RAM_BASE + run_start * PAGE_SIZE);
+            memset(base, 0, count * PAGE_SIZE);
+            // Profiled as one allocation, released with its base frame
+            MEMPROF_ALLOC(MEMPROF_FRAME, base, count * PAGE_SIZE);
+            return base;
+        }
+    }
+
+    mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+    kprintf("PMM: ERROR - No run of %zu contiguous free frames!\n", count);
+    return NULL;
+}
+
+void free_frames(void *base, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free_frame((uint8_t *)base + i * PAGE_SIZE);
+    }
 }
 
 void free_frame(void *frame) {
@@ -184,15 +355,99 @@ void free_frame(void *frame) {
         return;
     }
     
-    // Check if frame is currently marked as used
-    if (!test_bit(frame_idx)) {
+    // Fast path: with a count of 1 the caller holds the only reference,
+    // so no other CPU can change the count and the frame can go straight
+    // into this CPU's cache
+    if (frame_cache_enabled && frame_idx < frame_refcount_entries &&
+        frame_refcount[frame_idx] == 1 && test_bit(frame_idx)) {
+        frame_refcount[frame_idx] = 0;
+        
+        uint64_t flags = local_irq_save();
+        frame_cache_t *cache = &frame_caches[cpu_id()];
+        if (cache->count == FRAME_CACHE_SIZE) {
+            // Drain the oldest (coldest) half back to the bitmap
+            pmm_put_frames(cache->frames, FRAME_CACHE_BATCH);
+            memcpy(cache->frames, cache->frames + FRAME_CACHE_BATCH,
+                   (FRAME_CACHE_SIZE - FRAME_CACHE_BATCH) * sizeof(cache->frames[0]));
+            cache->count -= FRAME_CACHE_BATCH;
+        }
+        TRACE(free_frame, frame, 0);
+        MEMPROF_FREE(frame);
+        cache->frames[cache->count++] = frame_idx;
+        local_irq_restore(flags);
+        return;
+    }
+    
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&pmm_lock, &node);
+    
+    // Check if frame is currently marked as used. Cached frames are marked
+    // used but have no references left.
+    if (!test_bit(frame_idx) ||
+        (frame_idx < frame_refcount_entries && frame_refcount[frame_idx] == 0)) {
+        mcs_unlock_irqrestore(&pmm_lock, &node, flags);
         kprintf("PMM: Warning - double free detected for frame %p\n", frame);
         return;
     }
     
+    // Shared frames stay allocated until the last reference is dropped
+    if (frame_idx < frame_refcount_entries) {
+        if (frame_refcount[frame_idx] > 1) {
+            uint32_t refs = --frame_refcount[frame_idx];
+            mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+            TRACE(free_frame, frame, refs);
+            return;
+        }
+        frame_refcount[frame_idx] = 0;
+    }
+    
     // Mark as free
+    // Recorded before the bit is clear and another CPU can take the frame
+    TRACE(free_frame, frame, 0);
+    MEMPROF_FREE(frame);
     clear_bit(frame_idx);
     free_memory += PAGE_SIZE;
+    mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+}
+
+// Index of an allocated frame, or -1 if addr is not one; pmm_lock held
+static int64_t frame_index(void *frame) {
+    uint64_t addr = (uint64_t)frame;
+    if (addr < PMM_RAM_BASE || addr >= PMM_MAX_ADDRESS || addr % PAGE_SIZE != 0) {
+        return -1;
+    }
+    size_t frame_idx = (addr - PMM_RAM_BASE) / PAGE_SIZE;
+    if (frame_idx >= frame_refcount_entries || !test_bit(frame_idx)) {
+        return -1;
+    }
+    return (int64_t)frame_idx;
+}
+
+void frame_get(void *frame) {
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&pmm_lock, &node);
+    int64_t frame_idx = frame_index(frame);
+    if (frame_idx < 0) {
+        mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+        kprintf("PMM: Attempt to reference invalid frame at %p\n", frame);
+        return;
+    }
+    if (frame_refcount[frame_idx] == UINT16_MAX) {
+        mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+        kprintf("PMM: Reference count overflow for frame %p\n", frame);
+        return;
+    }
+    frame_refcount[frame_idx]++;
+    mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+}
+
+uint32_t frame_refcount_get(void *frame) {
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&pmm_lock, &node);
+    int64_t frame_idx = frame_index(frame);
+    uint32_t count = frame_idx < 0 ? 0 : frame_refcount[frame_idx];
+    mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+    return count;
 }
 
 uint64_t pmm_get_total_memory(void) {
@@ -200,7 +455,23 @@ uint64_t pmm_get_total_memory(void) {
 }
 
 uint64_t pmm_get_free_memory(void) {
-    return free_memory;
+    uint64_t cached = 0;
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        cached += frame_caches[cpu].count;
+    }
+    return free_memory + cached * PAGE_SIZE;
+}
+
+void pmm_cache_enable(bool enable) {
+    frame_cache_enabled = enable;
+}
+
+void pmm_cache_drain(void) {
+    uint64_t flags = local_irq_save();
+    frame_cache_t *cache = &frame_caches[cpu_id()];
+    pmm_put_frames(cache->frames, cache->count);
+    cache->count = 0;
+    local_irq_restore(flags);
 }
 
 uint64_t pmm_get_highest_usable_address(void) {
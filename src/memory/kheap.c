@@ -5,17 +5,26 @@
 #include "memory/frame_alloc.h"
 #include "lib/string.h"
 #include "lib/stdio.h"
+#include "sync/spinlock.h"
+#include "arch/cpu.h"
+#include "debug/trace.h"
+#include "debug/memprof.h"
 
 // Header for memory blocks (both allocated and free)
 typedef struct heap_block {
     size_t size;          // Size of the data area *excluding* this header
     bool is_free;         // True if block is free, false if allocated
+    bool is_cached;       // True while parked in a per-CPU kmalloc cache
     struct heap_block *next; // Pointer to the next block in the heap (physical order)
     struct heap_block *prev; // Pointer to the previous block in the heap (physical order)
     struct heap_block *next_free; // Pointer to the next free block in the free list
     struct heap_block *prev_free; // Pointer to the previous free block in the free list
 } heap_block_t;
 
+// Tracing of every block list operation; very chatty, so off by default
+#define KHEAP_TRACE 0
+#define kheap_trace(...) do { if (KHEAP_TRACE) kprintf(__VA_ARGS__); } while (0)
+
 #define HEAP_HEADER_SIZE sizeof(heap_block_t)
 #define HEAP_MIN_BLOCK_SIZE (HEAP_HEADER_SIZE * 2) // Minimum size to allow splitting
 
@@ -24,6 +33,31 @@ static heap_block_t *free_list_head = NULL;
 static heap_block_t *heap_start = NULL;
 static heap_block_t *heap_end = NULL;
 
+// Protects the block list and free list
+static spinlock_t heap_lock = SPINLOCK_INIT;
+
+// --- Per-CPU object caches ---
+//
+// Small allocations are rounded up to a power-of-two size class and served
+// from a per-CPU magazine of blocks of that class, so the common kmalloc()
+// and kfree() touch no shared data. An empty magazine is refilled, and a
+// full one half drained, with KMALLOC_CACHE_BATCH blocks per trip to the
+// heap lock. Cached blocks remain allocated as far as the block list knows.
+
+#define KMALLOC_MIN_CLASS     16
+#define KMALLOC_CACHE_CLASSES 6     // 16, 32, ... 512 bytes
+#define KMALLOC_MAX_CLASS     (KMALLOC_MIN_CLASS << (KMALLOC_CACHE_CLASSES - 1))
+#define KMALLOC_CACHE_SIZE    16
+#define KMALLOC_CACHE_BATCH   8
+
+typedef struct {
+    uint32_t count[KMALLOC_CACHE_CLASSES];
+    void *objects[KMALLOC_CACHE_CLASSES][KMALLOC_CACHE_SIZE];
+} __attribute__((aligned(64))) kmalloc_cache_t;
+
+static kmalloc_cache_t kmalloc_caches[MAX_CPUS];
+static bool kmalloc_cache_enabled = true;
+
 // --- Free List Management ---
 
 static void add_to_free_list(heap_block_t *block) {
@@ -57,7 +91,7 @@ static bool expand_heap(size_t min_expand_size) {
     size_t pages_needed = (min_expand_size + HEAP_HEADER_SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
     if (pages_needed == 0) pages_needed = 1;
 
-    kprintf("KHeap: Expanding heap by %zu pages\n", pages_needed);
+    kheap_trace("KHeap: Expanding heap by %zu pages\n", pages_needed);
 
     heap_block_t *new_block = NULL;
     for (size_t i = 0; i < pages_needed; ++i) {
@@ -72,6 +106,7 @@ static bool expand_heap(size_t min_expand_size) {
         heap_block_t *current_block = (heap_block_t *)frame;
         current_block->size = PAGE_SIZE - HEAP_HEADER_SIZE;
         current_block->is_free = true;
+        current_block->is_cached = false;
         current_block->next = NULL; // Will be linked below or by coalesce
 
         if (!new_block) {
@@ -123,7 +158,7 @@ static heap_block_t* coalesce(heap_block_t *block) {
     // Coalesce with next block if it's free
     if (current->next && current->next->is_free) {
         heap_block_t *next_block = current->next;
-        kprintf("KHeap: Coalescing forward %p (%zu) with %p (%zu)\n", 
+        kheap_trace("KHeap: Coalescing forward %p (%zu) with %p (%zu)\n", 
                 current, current->size, next_block, next_block->size);
         remove_from_free_list(next_block); // Remove next block from free list
         current->size += next_block->size + HEAP_HEADER_SIZE;
@@ -141,7 +176,7 @@ static heap_block_t* coalesce(heap_block_t *block) {
     // Coalesce with previous block if it's free
     if (current->prev && current->prev->is_free) {
         heap_block_t *prev_block = current->prev;
-        kprintf("KHeap: Coalescing backward %p (%zu) with %p (%zu)\n", 
+        kheap_trace("KHeap: Coalescing backward %p (%zu) with %p (%zu)\n", 
                 prev_block, prev_block->size, current, current->size);
         remove_from_free_list(prev_block); // Previous block is already in free list, remove it
         prev_block->size += current->size + HEAP_HEADER_SIZE;
@@ -173,7 +208,8 @@ void kheap_init() {
     kprintf("KHeap: Initialized.\n");
 }
 
-void* kmalloc(size_t size) {
+// Called with heap_lock held
+static void* kmalloc_locked(size_t size) {
     if (size == 0) {
         return NULL;
     }
@@ -231,6 +267,7 @@ void* kmalloc(size_t size) {
 
         new_free_block->size = remaining_size;
         new_free_block->is_free = true; // Will be added to free list
+        new_free_block->is_cached = false;
         new_free_block->next = best_fit->next;
         new_free_block->prev = best_fit;
 
@@ -245,16 +282,17 @@ void* kmalloc(size_t size) {
 
         // Add the new smaller free block to the free list
         add_to_free_list(new_free_block);
-        kprintf("KHeap: Split block %p. Allocated %zu, remaining %zu at %p\n", 
+        kheap_trace("KHeap: Split block %p. Allocated %zu, remaining %zu at %p\n", 
                 best_fit, best_fit->size, new_free_block->size, new_free_block);
 
     } else {
         // Cannot split, allocate the whole block
-        kprintf("KHeap: Allocated whole block %p (%zu) for size %zu\n", 
+        kheap_trace("KHeap: Allocated whole block %p (%zu) for size %zu\n", 
                 best_fit, best_fit->size, size);
     }
 
     best_fit->is_free = false;
+    best_fit->is_cached = false;
 
     // Return pointer to the data area (after the header)
     void *data_ptr = (void *)((uint8_t *)best_fit + HEAP_HEADER_SIZE);
@@ -265,9 +303,10 @@ void* kmalloc(size_t size) {
     return data_ptr;
 }
 
-void kfree(void *ptr) {
+// False if ptr was rejected rather than freed
+static bool kfree_locked(void *ptr) {
     if (!ptr) {
-        return;
+        return false;
     }
 
     // Get the header from the pointer
@@ -276,13 +315,14 @@ void kfree(void *ptr) {
     // Basic validation
     if (block->is_free) {
         kprintf("KHeap Warning: Double free detected for pointer %p\n", ptr);
-        return;
+        return false;
     }
     // More robust validation would involve checking magic numbers in the header
     // or ensuring the block pointer is within the known heap range [heap_start, heap_end].
 
-    kprintf("KHeap: kfree(%p) - block %p, size %zu\n", ptr, block, block->size);
+    kheap_trace("KHeap: kfree(%p) - block %p, size %zu\n", ptr, block, block->size);
     block->is_free = true;
+    block->is_cached = false;
 
     // Attempt to coalesce with neighbors
     heap_block_t *coalesced_block = coalesce(block);
@@ -291,12 +331,131 @@ void kfree(void *ptr) {
     // Check if it wasn't already added by coalesce (if coalesce returned the same block)
     if (coalesced_block == block) {
          add_to_free_list(coalesced_block);
-         kprintf("KHeap: Added block %p (%zu) to free list\n", 
+         kheap_trace("KHeap: Added block %p (%zu) to free list\n", 
                  coalesced_block, coalesced_block->size);
     } else {
          // Coalesce already handled adding the merged block (prev_block)
          add_to_free_list(coalesced_block); // Ensure the final coalesced block is on the list
-         kprintf("KHeap: Added coalesced block %p (%zu) to free list\n", 
+         kheap_trace("KHeap: Added coalesced block %p (%zu) to free list\n", 
                  coalesced_block, coalesced_block->size);
     }
+    return true;
+}
+
+// Smallest class that holds size bytes
+static int kmalloc_class(size_t size) {
+    int cls = 0;
+    while ((size_t)(KMALLOC_MIN_CLASS << cls) < size) {
+        cls++;
+    }
+    return cls;
+}
+
+void* kmalloc(size_t size) {
+    if (size == 0 || size > KMALLOC_MAX_CLASS || !kmalloc_cache_enabled) {
+        uint64_t flags = spin_lock_irqsave(&heap_lock);
+        void *ptr = kmalloc_locked(size);
+        spin_unlock_irqrestore(&heap_lock, flags);
+        TRACE(kmalloc, size, ptr);
+        MEMPROF_ALLOC(MEMPROF_KMALLOC, ptr, size);
+        return ptr;
+    }
+
+    int cls = kmalloc_class(size);
+    size_t class_size = KMALLOC_MIN_CLASS << cls;
+
+    uint64_t flags = local_irq_save();
+    kmalloc_cache_t *cache = &kmalloc_caches[cpu_id()];
+    if (cache->count[cls] == 0) {
+        spin_lock(&heap_lock);
+        while (cache->count[cls] < KMALLOC_CACHE_BATCH) {
+            void *obj = kmalloc_locked(class_size);
+            if (!obj) {
+                break;
+            }
+            ((heap_block_t *)((uint8_t *)obj - HEAP_HEADER_SIZE))->is_cached = true;
+            cache->objects[cls][cache->count[cls]++] = obj;
+        }
+        spin_unlock(&heap_lock);
+    }
+    void *ptr = NULL;
+    if (cache->count[cls] > 0) {
+        ptr = cache->objects[cls][--cache->count[cls]];
+        ((heap_block_t *)((uint8_t *)ptr - HEAP_HEADER_SIZE))->is_cached = false;
+    }
+    local_irq_restore(flags);
+
+    if (ptr) {
+        memset(ptr, 0, class_size);
+    }
+    TRACE(kmalloc, size, ptr);
+    MEMPROF_ALLOC(MEMPROF_KMALLOC, ptr, size);
+    return ptr;
+}
+
+void kfree(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    // A block is cached in the largest class it can hold; blocks that are
+    // free already go to kfree_locked() to be reported
+    heap_block_t *block = (heap_block_t *)((uint8_t *)ptr - HEAP_HEADER_SIZE);
+    if (block->is_cached) {
+        kprintf("KHeap Warning: Double free detected for pointer %p\n", ptr);
+        return;
+    }
+    size_t block_size = block->size;
+    if (!kmalloc_cache_enabled || block->is_free ||
+        block_size < KMALLOC_MIN_CLASS || block_size >= 2 * KMALLOC_MAX_CLASS) {
+        // Hooks run under the lock, before another CPU can reuse the block
+        uint64_t flags = spin_lock_irqsave(&heap_lock);
+        if (kfree_locked(ptr)) {
+            TRACE(kfree, ptr, 0);
+            MEMPROF_FREE(ptr);
+        }
+        spin_unlock_irqrestore(&heap_lock, flags);
+        return;
+    }
+
+    int cls = kmalloc_class(block_size);
+    if ((size_t)(KMALLOC_MIN_CLASS << cls) > block_size) {
+        cls--;
+    }
+
+    uint64_t flags = local_irq_save();
+    kmalloc_cache_t *cache = &kmalloc_caches[cpu_id()];
+    if (cache->count[cls] == KMALLOC_CACHE_SIZE) {
+        // Drain the oldest half back to the heap
+        spin_lock(&heap_lock);
+        for (int i = 0; i < KMALLOC_CACHE_BATCH; i++) {
+            kfree_locked(cache->objects[cls][i]);
+        }
+        spin_unlock(&heap_lock);
+        memcpy(cache->objects[cls], cache->objects[cls] + KMALLOC_CACHE_BATCH,
+               (KMALLOC_CACHE_SIZE - KMALLOC_CACHE_BATCH) * sizeof(void *));
+        cache->count[cls] -= KMALLOC_CACHE_BATCH;
+    }
+    TRACE(kfree, ptr, 0);
+    MEMPROF_FREE(ptr);
+    block->is_cached = true;
+    cache->objects[cls][cache->count[cls]++] = ptr;
+    local_irq_restore(flags);
+}
+
+void kheap_cache_enable(bool enable) {
+    kmalloc_cache_enabled = enable;
+}
+
+void kheap_cache_drain(void) {
+    uint64_t flags = local_irq_save();
+    kmalloc_cache_t *cache = &kmalloc_caches[cpu_id()];
+    spin_lock(&heap_lock);
+    for (int cls = 0; cls < KMALLOC_CACHE_CLASSES; cls++) {
+        for (uint32_t i = 0; i < cache->count[cls]; i++) {
+            kfree_locked(cache->objects[cls][i]);
+        }
+        cache->count[cls] = 0;
+    }
+    spin_unlock(&heap_lock);
+    local_irq_restore(flags);
 }
\ No newline at end of file
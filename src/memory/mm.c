@@ -0,0 +1,572 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory/mm.h"
+#include "memory/mmu.h"
+#include "memory/frame_alloc.h"
+#include "memory/kheap.h"
+#include "memory/tlb.h"
+#include "exceptions/exceptions.h"
+#include "arch/cpu.h"
+#include "arch/smp.h"
+#include "sched/thread.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+#include "sync/spinlock.h"
+#include "sync/atomic.h"
+
+// --- ASID allocation ---
+//
+// context_id holds a generation in the bits above the ASID. An address
+// space whose generation is current keeps its ASID and switching to it is
+// just a TTBR0 write. When the ASIDs run out the generation is bumped,
+// the map is cleared and every CPU flushes its TLB once before it next
+// switches; the ASID each CPU is running is carried over as reserved.
+// ASID 0 is the kernel's own tables and is never handed out.
+//
+// Everything below is protected by asid_lock except the fast path in
+// mm_switch(), which only swaps the CPU's own active_asids entry; a
+// rollover zeroes every entry with an atomic exchange, so a racing fast
+// path either lands before it (and is reserved) or fails and takes the lock.
+
+#define ASID_MAX_BITS 16
+
+static unsigned int asid_bits;
+static uint64_t asid_mask;
+static uint64_t asid_generation;
+static uint64_t asid_next = 1;
+static uint64_t asid_map[(1 << ASID_MAX_BITS) / 64];
+static uint64_t active_asids[MAX_CPUS];
+static uint64_t reserved_asids[MAX_CPUS];
+static bool tlb_flush_pending[MAX_CPUS];
+static uint64_t asid_rollovers = 0;
+static spinlock_t asid_lock = SPINLOCK_INIT;
+
+static mm_t *current_mm[MAX_CPUS];
+
+// Shared all-zero frame mapped read-only for reads of untouched memory.
+// It is never freed, so its reference count is not maintained.
+static uint64_t zero_page;
+
+static inline bool asid_test_and_set(uint64_t asid) {
+    uint64_t bit = 1ULL << (asid % 64);
+    bool was_set = (asid_map[asid / 64] & bit) != 0;
+    asid_map[asid / 64] |= bit;
+    return was_set;
+}
+
+static inline bool asid_gen_match(uint64_t context_id) {
+    return ((context_id ^ asid_generation) >> asid_bits) == 0;
+}
+
+// Start a new generation: keep only the ASIDs CPUs are running right now
+static void asid_flush_context(void) {
+    memset(asid_map, 0, sizeof(asid_map));
+    asid_test_and_set(0);
+
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        uint64_t asid = atomic_xchg64(&active_asids[cpu], 0);
+        // A CPU that already went through a rollover without switching
+        // is still running its reserved ASID
+        if (asid == 0) {
+            asid = reserved_asids[cpu];
+        }
+        asid_test_and_set(asid & asid_mask);
+        reserved_asids[cpu] = asid;
+        tlb_flush_pending[cpu] = true;
+    }
+    asid_rollovers++;
+}
+
+// If context_id is reserved by some CPU, move it into the new generation
+static bool asid_check_update_reserved(uint64_t context_id, uint64_t new_id) {
+    bool hit = false;
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (reserved_asids[cpu] == context_id) {
+            reserved_asids[cpu] = new_id;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+static uint64_t asid_new_context(mm_t *mm) {
+    uint64_t context_id = mm->context_id;
+
+    if (context_id != 0) {
+        // Try to keep the old ASID in the new generation
+        uint64_t new_id = asid_generation | (context_id & asid_mask);
+        if (asid_check_update_reserved(context_id, new_id)) {
+            return new_id;
+        }
+        if (!asid_test_and_set(context_id & asid_mask)) {
+            return new_id;
+        }
+    }
+
+    uint64_t asid;
+    for (asid = asid_next; asid <= asid_mask; asid++) {
+        if (!asid_test_and_set(asid)) {
+            break;
+        }
+    }
+    if (asid > asid_mask) {
+        asid_generation += 1ULL << asid_bits;
+        asid_flush_context();
+        for (asid = 1; asid_test_and_set(asid); asid++) {
+        }
+    }
+    asid_next = asid + 1;
+    return asid_generation | asid;
+}
+
+// --- Address spaces ---
+
+void mm_init(void) {
+    asid_bits = mmu_asid_bits();
+    asid_mask = (1ULL << asid_bits) - 1;
+    asid_generation = 1ULL << asid_bits;
+    asid_test_and_set(0);
+
+    zero_page = (uint64_t)alloc_frame();
+    if (!zero_page) {
+        panic("MM: Unable to allocate the zero page");
+    }
+
+    kprintf("MM: %u-bit ASIDs, user space 0x%llx - 0x%llx\n",
+            asid_bits, MM_USER_BASE, MM_USER_END);
+}
+
+mm_t *mm_create(void) {
+    mm_t *mm = kmalloc(sizeof(mm_t));
+    if (!mm) {
+        return NULL;
+    }
+    memset(mm, 0, sizeof(mm_t));
+    spin_lock_init(&mm->lock);
+
+    // Share the kernel's level 2 tables by copying its level 1 entries
+    mm->pgd = mmu_alloc_table();
+    uint64_t *kernel_pgd = mmu_kernel_table();
+    for (uint64_t i = 0; i < PT_INDEX(MM_USER_BASE, L1_SHIFT); i++) {
+        mm->pgd[i] = kernel_pgd[i];
+    }
+    dsb(ishst);
+
+    mm->mmap_base = MM_USER_BASE;
+    return mm;
+}
+
+static void mm_release_page(uint64_t pa) {
+    if (pa != zero_page) {
+        free_frame((void *)pa);
+    }
+}
+
+// Invalidate every TLB entry of an address space
+static void mm_flush_tlb(mm_t *mm) {
+    if (mm->context_id && asid_gen_match(mm->context_id)) {
+        mmu_flush_tlb_asid(mm->context_id & asid_mask);
+    } else {
+        mmu_flush_tlb_all();
+    }
+}
+
+void mm_destroy(mm_t *mm) {
+    if (!mm) {
+        return;
+    }
+    if (mm_current() == mm) {
+        mm_switch(NULL);
+    }
+
+    // Drop the ASID's translations before its pages can be reused
+    mm_flush_tlb(mm);
+
+    mmu_free_tables(mm->pgd, MM_USER_BASE, MM_USER_END - MM_USER_BASE, mm_release_page);
+    mmu_free_table(mm->pgd);
+
+    vm_region_t *region = mm->regions;
+    while (region) {
+        vm_region_t *next = region->next;
+        kfree(region);
+        region = next;
+    }
+    kfree(mm);
+}
+
+// Share one page of the parent with the child, making it copy-on-write
+static void mm_clone_page(uint64_t va, uint64_t *pte, void *arg) {
+    mm_t *child = arg;
+    uint64_t entry = *pte;
+    uint64_t pa = entry & PTE_ADDR_MASK;
+
+    if (!(entry & PTE_AP_RDONLY)) {
+        // Removing write permission needs no break-before-make; the
+        // parent's TLB entries are flushed once the walk is done
+        entry |= PTE_AP_RDONLY | PTE_SW_COW;
+        *pte = entry;
+    }
+    if (pa != zero_page) {
+        frame_get((void *)pa);
+        child->rss_pages++;
+    }
+    mmu_map_pages(child->pgd, va, pa, PAGE_SIZE, entry & PTE_ATTR_MASK);
+}
+
+mm_t *mm_clone(mm_t *mm) {
+    mm_t *child = mm_create();
+    if (!child) {
+        return NULL;
+    }
+
+    // The child is not visible to anyone yet, so only the parent is locked
+    uint64_t flags = spin_lock_irqsave(&mm->lock);
+
+    // Regions are copied in order so the child's list matches the parent's
+    vm_region_t **tail = &child->regions;
+    for (vm_region_t *region = mm->regions; region; region = region->next) {
+        vm_region_t *copy = kmalloc(sizeof(vm_region_t));
+        if (!copy) {
+            spin_unlock_irqrestore(&mm->lock, flags);
+            mm_destroy(child);
+            return NULL;
+        }
+        *copy = *region;
+        copy->next = NULL;
+        *tail = copy;
+        tail = &copy->next;
+    }
+    child->mmap_base = mm->mmap_base;
+
+    mmu_walk_pages(mm->pgd, MM_USER_BASE, MM_USER_END - MM_USER_BASE, mm_clone_page, child);
+    mm_flush_tlb(mm);
+    spin_unlock_irqrestore(&mm->lock, flags);
+    return child;
+}
+
+uint64_t mm_mmap(mm_t *mm, uint64_t size, uint64_t attrs) {
+    uint64_t bytes = (size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    vm_region_t *region = kmalloc(sizeof(vm_region_t));
+    if (!region) {
+        return 0;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&mm->lock);
+    if (bytes == 0 || bytes > MM_USER_END - mm->mmap_base) {
+        spin_unlock_irqrestore(&mm->lock, flags);
+        kfree(region);
+        return 0;
+    }
+    region->start = mm->mmap_base;
+    region->end = region->start + bytes;
+    region->attrs = attrs;
+    region->next = mm->regions;
+    mm->regions = region;
+
+    // Leave an unmapped page between regions
+    mm->mmap_base = region->end + PAGE_SIZE;
+    uint64_t start = region->start;
+    spin_unlock_irqrestore(&mm->lock, flags);
+    return start;
+}
+
+typedef struct {
+    mm_t *mm;
+    tlb_gather_t tlb;
+} mm_unmap_t;
+
+// Clear one page of an unmapped range; its frame is freed by the gather
+static void mm_unmap_page(uint64_t va, uint64_t *pte, void *arg) {
+    mm_unmap_t *unmap = arg;
+    uint64_t pa = *pte & PTE_ADDR_MASK;
+    *pte = 0;
+    if (pa != zero_page) {
+        unmap->mm->rss_pages--;
+    } else {
+        pa = 0;
+    }
+    tlb_gather_page(&unmap->tlb, va, pa);
+}
+
+int mm_munmap(mm_t *mm, uint64_t addr, uint64_t size) {
+    uint64_t start = addr & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t end = (addr + size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    if (size == 0 || start < MM_USER_BASE || end > MM_USER_END || end <= start) {
+        return -1;
+    }
+
+    // At most one region is split in two, and it needs a new descriptor;
+    // taking it up front means nothing can fail half way through
+    vm_region_t *spare = kmalloc(sizeof(vm_region_t));
+    if (!spare) {
+        return -1;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&mm->lock);
+    vm_region_t **link = &mm->regions;
+    while (*link) {
+        vm_region_t *region = *link;
+        if (region->end <= start || region->start >= end) {
+            link = &region->next;
+        } else if (region->start >= start && region->end <= end) {
+            *link = region->next;
+            kfree(region);
+        } else if (region->start >= start) {
+            region->start = end;
+            link = &region->next;
+        } else if (region->end <= end) {
+            region->end = start;
+            link = &region->next;
+        } else {
+            *spare = *region;
+            spare->start = end;
+            region->end = start;
+            region->next = spare;
+            spare = NULL;
+            link = &region->next->next;
+        }
+    }
+
+    // Clear the entries, then one flush covers the range on every CPU
+    // before any frame goes back to the allocator. With the regions gone
+    // no fault can map the range again, so the final flush is done without
+    // the lock. (A full batch flushes early, under it: the IPI flush modes
+    // are for `bench shootdown`, not for address spaces others fault in.)
+    mm_unmap_t unmap;
+    uint64_t asid = TLB_ASID_ALL;
+    if (mm->context_id && asid_gen_match(mm->context_id)) {
+        asid = mm->context_id & asid_mask;
+    }
+    unmap.mm = mm;
+    tlb_gather_init(&unmap.tlb, asid, mm_release_page);
+    mmu_walk_pages(mm->pgd, start, end - start, mm_unmap_page, &unmap);
+    spin_unlock_irqrestore(&mm->lock, flags);
+    tlb_gather_finish(&unmap.tlb);
+    kfree(spare);
+    return 0;
+}
+
+void mm_activate(mm_t *mm) {
+    uint64_t flags = local_irq_save();
+    unsigned int cpu = cpu_id();
+
+    if (!mm) {
+        mmu_switch_table(mmu_kernel_table(), 0);
+        current_mm[cpu] = NULL;
+        local_irq_restore(flags);
+        return;
+    }
+
+    uint64_t context_id = mm->context_id;
+    uint64_t old_active = active_asids[cpu];
+    if (old_active == 0 || !asid_gen_match(context_id) ||
+        atomic_cmpxchg64(&active_asids[cpu], old_active, context_id) != old_active) {
+        // Slow path: ASID is from an old generation or a rollover happened
+        spin_lock(&asid_lock);
+        context_id = mm->context_id;
+        if (!asid_gen_match(context_id)) {
+            context_id = asid_new_context(mm);
+            mm->context_id = context_id;
+        }
+        if (tlb_flush_pending[cpu]) {
+            tlb_flush_pending[cpu] = false;
+            mmu_flush_tlb_local();
+        }
+        active_asids[cpu] = context_id;
+        spin_unlock(&asid_lock);
+    }
+
+    mmu_switch_table(mm->pgd, context_id & asid_mask);
+    current_mm[cpu] = mm;
+    local_irq_restore(flags);
+}
+
+void mm_switch(mm_t *mm) {
+    // Interrupts stay off so a preemption cannot come between the two
+    uint64_t flags = local_irq_save();
+    thread_t *self = this_cpu() ? thread_current() : NULL;
+    if (self) {
+        self->mm = mm;
+    }
+    mm_activate(mm);
+    local_irq_restore(flags);
+}
+
+mm_t *mm_current(void) {
+    return current_mm[cpu_id()];
+}
+
+// --- Demand paging ---
+
+static vm_region_t *mm_find_region(mm_t *mm, uint64_t addr) {
+    for (vm_region_t *region = mm->regions; region; region = region->next) {
+        if (addr >= region->start && addr < region->end) {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+// Map a page on first touch: reads share the zero page, writes get a frame
+static bool mm_map_fault(mm_t *mm, vm_region_t *region, uint64_t page, bool write) {
+    uint64_t attrs = region->attrs;
+    uint64_t pa;
+
+    if (!write) {
+        pa = zero_page;
+        if (!(attrs & PTE_AP_RDONLY)) {
+            attrs |= PTE_AP_RDONLY | PTE_SW_COW;
+        }
+    } else {
+        void *frame = alloc_frame(); // Zeroed
+        if (!frame) {
+            kprintf("MM: Out of memory paging in 0x%llx\n", page);
+            return false;
+        }
+        pa = (uint64_t)frame;
+    }
+
+    // Another CPU may have mapped it first; retrying is all that is left
+    uint64_t *pte = mmu_lookup_pte(mm->pgd, page);
+    if (pte && (*pte & PTE_VALID)) {
+        if (pa != zero_page) {
+            free_frame((void *)pa);
+        }
+        return true;
+    }
+
+    if (mmu_map_pages(mm->pgd, page, pa, PAGE_SIZE, attrs) != 0) {
+        if (pa != zero_page) {
+            free_frame((void *)pa);
+        }
+        return false;
+    }
+    // An invalid entry is never cached in the TLB, so no invalidation is needed
+    if (pa != zero_page) {
+        mm->rss_pages++;
+    }
+    return true;
+}
+
+// Write to a copy-on-write page: copy it, or take it over if no one else
+// shares it any more
+static bool mm_cow_fault(mm_t *mm, uint64_t page) {
+    uint64_t *pte = mmu_lookup_pte(mm->pgd, page);
+    if (!pte || !(*pte & PTE_VALID)) {
+        return false;
+    }
+
+    uint64_t asid = mm->context_id & asid_mask;
+    uint64_t entry = *pte;
+    if (!(entry & PTE_AP_RDONLY)) {
+        // Already made writable, e.g. by another CPU: stale TLB entry
+        mmu_flush_tlb_page_asid(page, asid);
+        return true;
+    }
+    if (!(entry & PTE_SW_COW)) {
+        return false; // Genuinely read-only
+    }
+
+    uint64_t old_pa = entry & PTE_ADDR_MASK;
+    uint64_t attrs = entry & PTE_ATTR_MASK & ~(PTE_AP_RDONLY | PTE_SW_COW);
+
+    if (old_pa != zero_page && frame_refcount_get((void *)old_pa) == 1) {
+        // Last sharer: only the permission changes, no copy and no break-before-make
+        *pte = old_pa | attrs | PTE_PAGE | PTE_VALID;
+        mmu_flush_tlb_page_asid(page, asid);
+        mm->cow_reuses++;
+        return true;
+    }
+
+    void *frame = alloc_frame(); // Zeroed, which is all the zero page needs
+    if (!frame) {
+        kprintf("MM: Out of memory copying 0x%llx\n", page);
+        return false;
+    }
+    if (old_pa != zero_page) {
+        copy_page(frame, (void *)old_pa);
+    }
+
+    // The output address changes, so break-before-make
+    *pte = 0;
+    mmu_flush_tlb_page_asid(page, asid);
+    *pte = (uint64_t)frame | attrs | PTE_PAGE | PTE_VALID;
+    dsb(ishst);
+    isb();
+
+    if (old_pa != zero_page) {
+        free_frame((void *)old_pa);
+    } else {
+        mm->rss_pages++;
+    }
+    mm->cow_copies++;
+    return true;
+}
+
+bool mm_handle_fault(uint64_t far, uint64_t esr) {
+    uint32_t ec = ESR_EC(esr);
+    if (ec != ESR_EC_DABT_CUR && ec != ESR_EC_DABT_LOWER &&
+        ec != ESR_EC_IABT_CUR && ec != ESR_EC_IABT_LOWER) {
+        return false;
+    }
+    uint32_t fsc = ESR_ISS_FSC(esr);
+    uint32_t type = FSC_TYPE(fsc);
+    if ((esr & ESR_ISS_FNV) || (type != FSC_TRANSLATION && type != FSC_PERMISSION)) {
+        return false;
+    }
+    bool is_data = ec == ESR_EC_DABT_CUR || ec == ESR_EC_DABT_LOWER;
+    bool write = is_data && (esr & ESR_ISS_WNR);
+
+    mm_t *mm = mm_current();
+    if (!mm) {
+        return false;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&mm->lock);
+    bool handled = false;
+    if (far < MM_USER_BASE) {
+        // Kernel level 1 entry created after this address space was
+        // copied (e.g. a benchmark window): pick it up now
+        uint64_t index = PT_INDEX(far, L1_SHIFT);
+        uint64_t kernel_entry = mmu_kernel_table()[index];
+        if (type == FSC_TRANSLATION && FSC_LEVEL(fsc) == 1 &&
+            (kernel_entry & PTE_VALID) && !(mm->pgd[index] & PTE_VALID)) {
+            mm->pgd[index] = kernel_entry;
+            dsb(ishst);
+            isb();
+            handled = true;
+        }
+        spin_unlock_irqrestore(&mm->lock, flags);
+        return handled;
+    }
+
+    vm_region_t *region = mm_find_region(mm, far);
+    uint64_t page = far & ~(uint64_t)(PAGE_SIZE - 1);
+    if (!region) {
+        handled = false;
+    } else if (type == FSC_TRANSLATION) {
+        handled = mm_map_fault(mm, region, page, write);
+    } else if (write) {
+        handled = mm_cow_fault(mm, page);
+    }
+    if (handled) {
+        mm->faults++;
+    }
+    spin_unlock_irqrestore(&mm->lock, flags);
+    return handled;
+}
+
+void mm_print_info(void) {
+    kprintf("Address Spaces:\n");
+    kprintf("  ASID bits:       %u\n", asid_bits);
+    kprintf("  Generation:      %llu\n", asid_generation >> asid_bits);
+    kprintf("  Rollovers:       %llu\n", asid_rollovers);
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        mm_t *mm = current_mm[cpu];
+        if (mm) {
+            kprintf("  CPU%d: ASID %llu, %llu pages resident, %llu faults (%llu COW copies)\n",
+                    cpu, mm->context_id & asid_mask, mm->rss_pages, mm->faults, mm->cow_copies);
+        }
+    }
+}
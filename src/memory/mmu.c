@@ -0,0 +1,597 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "kernel.h"
+#include "memory/mmu.h"
+#include "memory/frame_alloc.h"
+#include "exceptions/exceptions.h"
+#include "arch/cpu.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+// MAIR_EL1: one byte per attribute index
+#define MAIR_DEVICE_nGnRE 0x04ULL
+#define MAIR_NORMAL_WB    0xFFULL     // Inner/outer write-back, read/write-allocate
+#define MAIR_NORMAL_NC    0x44ULL     // Inner/outer non-cacheable
+#define MAIR_VALUE ((MAIR_DEVICE_nGnRE << (8 * MT_DEVICE_nGnRE)) | \
+                    (MAIR_NORMAL_WB << (8 * MT_NORMAL)) |          \
+                    (MAIR_NORMAL_NC << (8 * MT_NORMAL_NC)))
+
+// TCR_EL1 fields
+#define TCR_T0SZ        (64 - MMU_VA_BITS)
+#define TCR_IRGN0_WBWA  (1ULL << 8)
+#define TCR_ORGN0_WBWA  (1ULL << 10)
+#define TCR_SH0_INNER   (3ULL << 12)
+#define TCR_TG0_4K      (0ULL << 14)
+#define TCR_EPD1        (1ULL << 23)   // No TTBR1 walks: the kernel lives in TTBR0
+#define TCR_IPS_SHIFT   32
+#define TCR_AS          (1ULL << 36)   // 16-bit ASIDs
+
+// SCTLR_EL1 bits
+#define SCTLR_M         (1ULL << 0)    // MMU enable
+#define SCTLR_A         (1ULL << 1)    // Alignment checking
+#define SCTLR_C         (1ULL << 2)    // Data cache enable
+#define SCTLR_I         (1ULL << 12)   // Instruction cache enable
+
+static uint64_t *kernel_pgd = NULL;
+static uint64_t table_pages = 0;
+static uint64_t mapped_blocks_1g = 0;
+static uint64_t mapped_blocks_2m = 0;
+static uint64_t mapped_pages = 0;
+static uint64_t split_count = 0;
+static uint64_t tcr_value = 0;
+static unsigned int asid_bits = 8;
+
+// --- Table management ---
+
+uint64_t *mmu_alloc_table(void) {
+    uint64_t *table = alloc_frame(); // Zeroed: all entries invalid
+    if (!table) {
+        panic("MMU: Out of memory for translation tables");
+    }
+    table_pages++;
+    return table;
+}
+
+void mmu_free_table(uint64_t *table) {
+    free_frame(table);
+    table_pages--;
+}
+
+static bool mmu_table_empty(const uint64_t *table) {
+    for (int i = 0; i < PT_ENTRIES; i++) {
+        if (table[i] & PTE_VALID) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline bool pte_is_table(uint64_t entry, int shift) {
+    return shift > L3_SHIFT && (entry & (PTE_VALID | PTE_TABLE)) == (PTE_VALID | PTE_TABLE);
+}
+
+static inline bool pte_is_block(uint64_t entry, int shift) {
+    return shift > L3_SHIFT && (entry & (PTE_VALID | PTE_TABLE)) == PTE_VALID;
+}
+
+// Leaf descriptor for the given level: block at levels 1-2, page at level 3
+static inline uint64_t mmu_make_leaf(uint64_t pa, uint64_t attrs, int shift) {
+    return (pa & PTE_ADDR_MASK) | attrs | (shift == L3_SHIFT ? PTE_PAGE : PTE_BLOCK) | PTE_VALID;
+}
+
+static void mmu_count_leaf(int shift, int delta) {
+    if (shift == L1_SHIFT) {
+        mapped_blocks_1g += delta;
+    } else if (shift == L2_SHIFT) {
+        mapped_blocks_2m += delta;
+    } else {
+        mapped_pages += delta;
+    }
+}
+
+// Replace a live descriptor following the break-before-make sequence:
+// invalidate it, flush the TLB for the range, then write the new one.
+// Nothing in the affected range may be touched in between, so IRQs are
+// masked and the caller guarantees the code, stack and table are elsewhere.
+static void mmu_replace_entry(uint64_t *entry, uint64_t new_entry) {
+    if (!mmu_is_enabled()) {
+        *entry = new_entry;
+        return;
+    }
+
+    uint64_t flags = local_irq_save();
+    *entry = 0;
+    mmu_flush_tlb_all();
+    *entry = new_entry;
+    dsb(ishst);
+    isb();
+    local_irq_restore(flags);
+}
+
+int mmu_split_block(uint64_t *root, uint64_t va) {
+    uint64_t *table = root;
+    for (int shift = L1_SHIFT; shift > L3_SHIFT; shift -= 9) {
+        uint64_t *entry = &table[PT_INDEX(va, shift)];
+        if (!(*entry & PTE_VALID)) {
+            return -1;
+        }
+        if (pte_is_table(*entry, shift)) {
+            table = (uint64_t *)(*entry & PTE_ADDR_MASK);
+            continue;
+        }
+
+        // Found the block covering va. Refuse to break a block the split
+        // itself depends on: it would fault between break and make.
+        uint64_t block_size = 1ULL << shift;
+        uint64_t block_va = va & ~(block_size - 1);
+        uint64_t sp;
+        asm volatile("mov %0, sp" : "=r" (sp));
+        uint64_t kernel_start = (uint64_t)&_kernel_start;
+        uint64_t kernel_end = (uint64_t)&_kernel_end;
+        if (mmu_is_enabled() &&
+            (((uint64_t)entry - block_va) < block_size ||
+             (sp - block_va) < block_size ||
+             (kernel_start < block_va + block_size && block_va < kernel_end))) {
+            kprintf("MMU: Cannot split live block at 0x%llx that maps the kernel or its tables\n",
+                    block_va);
+            return -1;
+        }
+
+        // Fill the next-level table with the same attributes, then swap it in
+        int next_shift = shift - 9;
+        uint64_t attrs = *entry & PTE_ATTR_MASK;
+        uint64_t pa = *entry & PTE_ADDR_MASK & ~(block_size - 1);
+        uint64_t *next = mmu_alloc_table();
+        for (int i = 0; i < PT_ENTRIES; i++) {
+            next[i] = mmu_make_leaf(pa + ((uint64_t)i << next_shift), attrs, next_shift);
+        }
+        if (mmu_is_enabled()) {
+            dsb(ishst);
+        }
+        mmu_replace_entry(entry, (uint64_t)next | PTE_TABLE | PTE_VALID);
+
+        mmu_count_leaf(shift, -1);
+        mmu_count_leaf(next_shift, PT_ENTRIES);
+        split_count++;
+        return 0;
+    }
+    return -1; // Already mapped with pages
+}
+
+// Return the next-level table under entry, creating it or splitting a block
+static uint64_t *mmu_next_table(uint64_t *root, uint64_t *entry, uint64_t va, int shift) {
+    if (!(*entry & PTE_VALID)) {
+        uint64_t *next = mmu_alloc_table();
+        *entry = (uint64_t)next | PTE_TABLE | PTE_VALID;
+    } else if (pte_is_block(*entry, shift)) {
+        if (mmu_split_block(root, va) != 0) {
+            return NULL;
+        }
+    }
+    return (uint64_t *)(*entry & PTE_ADDR_MASK);
+}
+
+// Map with the largest leaf that fits: a 1 GB or 2 MB block when va, pa and
+// the remaining size are aligned to it, otherwise descend to 4 KB pages.
+// max_shift caps the leaf size (L3_SHIFT forces pages).
+static int mmu_map(uint64_t *root, uint64_t va, uint64_t pa, uint64_t size,
+                   uint64_t attrs, int max_shift) {
+    if ((va | pa | size) & (PAGE_SIZE - 1)) {
+        kprintf("MMU: Unaligned mapping 0x%llx -> 0x%llx (%llu bytes)\n", va, pa, size);
+        return -1;
+    }
+
+    while (size > 0) {
+        uint64_t *table = root;
+        for (int shift = L1_SHIFT; shift >= L3_SHIFT; shift -= 9) {
+            uint64_t *entry = &table[PT_INDEX(va, shift)];
+            uint64_t leaf_size = 1ULL << shift;
+            bool fits = shift <= max_shift && ((va | pa) & (leaf_size - 1)) == 0 && size >= leaf_size;
+
+            if (shift == L3_SHIFT || (fits && !pte_is_table(*entry, shift))) {
+                if (*entry & PTE_VALID) {
+                    mmu_count_leaf(shift, -1);
+                }
+                *entry = mmu_make_leaf(pa, attrs, shift);
+                mmu_count_leaf(shift, 1);
+                va += leaf_size;
+                pa += leaf_size;
+                size -= leaf_size;
+                break;
+            }
+
+            table = mmu_next_table(root, entry, va, shift);
+            if (!table) {
+                return -1;
+            }
+        }
+    }
+
+    if (mmu_is_enabled()) {
+        // Make the new entries visible to the table walker
+        dsb(ishst);
+        isb();
+    }
+    return 0;
+}
+
+int mmu_map_range(uint64_t *root, uint64_t va, uint64_t pa, uint64_t size, uint64_t attrs) {
+    return mmu_map(root, va, pa, size, attrs, L1_SHIFT);
+}
+
+int mmu_map_pages(uint64_t *root, uint64_t va, uint64_t pa, uint64_t size, uint64_t attrs) {
+    return mmu_map(root, va, pa, size, attrs, L3_SHIFT);
+}
+
+// Clear [va, end) below table, splitting blocks that are partly covered.
+// With free_tables, level 3 and level 2 tables that end up empty are
+// freed. Level 1 entries are kept once created: other address spaces
+// share the kernel's level 2 tables through copies of them.
+static int mmu_unmap_level(uint64_t *root, uint64_t *table, int shift, uint64_t va, uint64_t end,
+                           bool free_tables) {
+    uint64_t span = 1ULL << shift;
+    while (va < end) {
+        uint64_t *entry = &table[PT_INDEX(va, shift)];
+        uint64_t entry_end = (va & ~(span - 1)) + span;
+        uint64_t chunk_end = entry_end < end ? entry_end : end;
+        bool whole = (va & (span - 1)) == 0 && chunk_end == entry_end;
+
+        if (*entry & PTE_VALID) {
+            if (!pte_is_table(*entry, shift)) {
+                if (whole) {
+                    *entry = 0;
+                    mmu_count_leaf(shift, -1);
+                } else if (mmu_split_block(root, va) != 0) {
+                    return -1;
+                }
+            }
+            if (pte_is_table(*entry, shift)) {
+                uint64_t *next = (uint64_t *)(*entry & PTE_ADDR_MASK);
+                if (mmu_unmap_level(root, next, shift - 9, va, chunk_end, free_tables) != 0) {
+                    return -1;
+                }
+                if (free_tables && shift != L1_SHIFT && mmu_table_empty(next)) {
+                    *entry = 0;
+                    mmu_free_table(next);
+                }
+            }
+        }
+        va = chunk_end;
+    }
+    return 0;
+}
+
+int mmu_unmap_range(uint64_t *root, uint64_t va, uint64_t size) {
+    if ((va | size) & (PAGE_SIZE - 1)) {
+        return -1;
+    }
+    int ret = mmu_unmap_level(root, root, L1_SHIFT, va, va + size, true);
+    if (mmu_is_enabled()) {
+        // Also drops cached walks through the freed tables
+        mmu_flush_tlb_all();
+    }
+    return ret;
+}
+
+int mmu_clear_range(uint64_t *root, uint64_t va, uint64_t size) {
+    if ((va | size) & (PAGE_SIZE - 1)) {
+        return -1;
+    }
+    return mmu_unmap_level(root, root, L1_SHIFT, va, va + size, false);
+}
+
+int mmu_reserve_tables(uint64_t *root, uint64_t va, uint64_t size) {
+    uint64_t span = 1ULL << L1_SHIFT;
+    for (uint64_t addr = va & ~(span - 1); addr < va + size; addr += span) {
+        uint64_t *entry = &root[PT_INDEX(addr, L1_SHIFT)];
+        if (pte_is_block(*entry, L1_SHIFT)) {
+            return -1;
+        }
+        if (!(*entry & PTE_VALID)) {
+            uint64_t *next = mmu_alloc_table();
+            if (mmu_is_enabled()) {
+                dsb(ishst);
+            }
+            *entry = (uint64_t)next | PTE_TABLE | PTE_VALID;
+        }
+    }
+    if (mmu_is_enabled()) {
+        dsb(ishst);
+        isb();
+    }
+    return 0;
+}
+
+static void mmu_free_level(uint64_t *table, int shift, uint64_t va, uint64_t end,
+                           void (*release_page)(uint64_t pa)) {
+    uint64_t span = 1ULL << shift;
+    for (uint64_t addr = va; addr < end; addr = (addr & ~(span - 1)) + span) {
+        uint64_t *entry = &table[PT_INDEX(addr, shift)];
+        if (!(*entry & PTE_VALID)) {
+            continue;
+        }
+        if (pte_is_table(*entry, shift)) {
+            uint64_t *next = (uint64_t *)(*entry & PTE_ADDR_MASK);
+            uint64_t next_end = (addr & ~(span - 1)) + span;
+            mmu_free_level(next, shift - 9, addr, next_end < end ? next_end : end, release_page);
+            mmu_free_table(next);
+        } else {
+            if (shift == L3_SHIFT && release_page) {
+                release_page(*entry & PTE_ADDR_MASK);
+            }
+            mmu_count_leaf(shift, -1);
+        }
+        *entry = 0;
+    }
+}
+
+void mmu_free_tables(uint64_t *root, uint64_t va, uint64_t size, void (*release_page)(uint64_t pa)) {
+    mmu_free_level(root, L1_SHIFT, va, va + size, release_page);
+}
+
+int mmu_protect_range(uint64_t *root, uint64_t va, uint64_t size, uint64_t attrs) {
+    if ((va | size) & (PAGE_SIZE - 1)) {
+        return -1;
+    }
+
+    uint64_t end = va + size;
+    while (va < end) {
+        uint64_t *table = root;
+        for (int shift = L1_SHIFT; shift >= L3_SHIFT; shift -= 9) {
+            uint64_t *entry = &table[PT_INDEX(va, shift)];
+            uint64_t span = 1ULL << shift;
+            if (!(*entry & PTE_VALID)) {
+                kprintf("MMU: protect of unmapped address 0x%llx\n", va);
+                return -1;
+            }
+            if (pte_is_table(*entry, shift)) {
+                table = (uint64_t *)(*entry & PTE_ADDR_MASK);
+                continue;
+            }
+            if ((va & (span - 1)) == 0 && end - va >= span) {
+                // Only the attributes change, which needs no break-before-make
+                *entry = mmu_make_leaf(*entry & PTE_ADDR_MASK, attrs, shift);
+                va += span;
+                break;
+            }
+            // Partial block: split and retry this level
+            if (mmu_split_block(root, va) != 0) {
+                return -1;
+            }
+            shift += 9;
+        }
+    }
+
+    if (mmu_is_enabled()) {
+        mmu_flush_tlb_all();
+    }
+    return 0;
+}
+
+uint64_t *mmu_lookup_pte(uint64_t *root, uint64_t va) {
+    uint64_t *table = root;
+    for (int shift = L1_SHIFT; shift > L3_SHIFT; shift -= 9) {
+        uint64_t entry = table[PT_INDEX(va, shift)];
+        if (!pte_is_table(entry, shift)) {
+            return NULL;
+        }
+        table = (uint64_t *)(entry & PTE_ADDR_MASK);
+    }
+    return &table[PT_INDEX(va, L3_SHIFT)];
+}
+
+static void mmu_walk_level(uint64_t *table, int shift, uint64_t va, uint64_t end,
+                           void (*fn)(uint64_t va, uint64_t *pte, void *arg), void *arg) {
+    uint64_t span = 1ULL << shift;
+    for (uint64_t addr = va; addr < end; addr = (addr & ~(span - 1)) + span) {
+        uint64_t *entry = &table[PT_INDEX(addr, shift)];
+        if (shift == L3_SHIFT) {
+            if (*entry & PTE_VALID) {
+                fn(addr, entry, arg);
+            }
+        } else if (pte_is_table(*entry, shift)) {
+            uint64_t next_end = (addr & ~(span - 1)) + span;
+            mmu_walk_level((uint64_t *)(*entry & PTE_ADDR_MASK), shift - 9, addr,
+                           next_end < end ? next_end : end, fn, arg);
+        }
+    }
+}
+
+void mmu_walk_pages(uint64_t *root, uint64_t va, uint64_t size,
+                    void (*fn)(uint64_t va, uint64_t *pte, void *arg), void *arg) {
+    mmu_walk_level(root, L1_SHIFT, va, va + size, fn, arg);
+}
+
+bool mmu_translate(uint64_t *root, uint64_t va, uint64_t *pa) {
+    uint64_t *table = root;
+    for (int shift = L1_SHIFT; shift >= L3_SHIFT; shift -= 9) {
+        uint64_t entry = table[PT_INDEX(va, shift)];
+        if (!(entry & PTE_VALID)) {
+            return false;
+        }
+        if (!pte_is_table(entry, shift)) {
+            // Page (level 3) or block (levels 1-2): output address + offset
+            uint64_t mask = (1ULL << shift) - 1;
+            if (pa) {
+                *pa = (entry & PTE_ADDR_MASK & ~mask) | (va & mask);
+            }
+            return true;
+        }
+        table = (uint64_t *)(entry & PTE_ADDR_MASK);
+    }
+    return false;
+}
+
+// --- Cache and TLB maintenance ---
+
+static uint64_t dcache_line_size(void) {
+    // CTR_EL0.DminLine: log2 of the smallest line size in words
+    return 4ULL << ((read_sysreg(ctr_el0) >> 16) & 0xF);
+}
+
+void mmu_clean_dcache_range(uint64_t start, uint64_t size) {
+    uint64_t line = dcache_line_size();
+    for (uint64_t addr = start & ~(line - 1); addr < start + size; addr += line) {
+        asm volatile("dc civac, %0" : : "r" (addr) : "memory");
+    }
+    dsb(sy);
+}
+
+// Push every table page of a tree out to memory before the walker reads it
+static void mmu_clean_tables(uint64_t *table, int shift) {
+    mmu_clean_dcache_range((uint64_t)table, PAGE_SIZE);
+    if (shift == L3_SHIFT) {
+        return;
+    }
+    for (int i = 0; i < PT_ENTRIES; i++) {
+        uint64_t entry = table[i];
+        if (pte_is_table(entry, shift)) {
+            mmu_clean_tables((uint64_t *)(entry & PTE_ADDR_MASK), shift - 9);
+        }
+    }
+}
+
+void mmu_flush_tlb_all(void) {
+    dsb(ishst);
+    asm volatile("tlbi vmalle1is" : : : "memory");
+    dsb(ish);
+    isb();
+}
+
+void mmu_flush_tlb_page(uint64_t va) {
+    dsb(ishst);
+    asm volatile("tlbi vaae1is, %0" : : "r" (va >> PAGE_SHIFT) : "memory");
+    dsb(ish);
+    isb();
+}
+
+void mmu_flush_tlb_asid(uint64_t asid) {
+    dsb(ishst);
+    asm volatile("tlbi aside1is, %0" : : "r" (asid << TTBR_ASID_SHIFT) : "memory");
+    dsb(ish);
+    isb();
+}
+
+void mmu_flush_tlb_page_asid(uint64_t va, uint64_t asid) {
+    dsb(ishst);
+    asm volatile("tlbi vae1is, %0" : : "r" ((va >> PAGE_SHIFT) | (asid << TTBR_ASID_SHIFT)) : "memory");
+    dsb(ish);
+    isb();
+}
+
+void mmu_flush_tlb_local(void) {
+    dsb(nshst);
+    asm volatile("tlbi vmalle1" : : : "memory");
+    dsb(nsh);
+    isb();
+}
+
+// --- Enabling ---
+
+unsigned int mmu_asid_bits(void) {
+    return asid_bits;
+}
+
+void mmu_switch_table(uint64_t *root, uint64_t asid) {
+    write_sysreg(ttbr0_el1, (uint64_t)root | (asid << TTBR_ASID_SHIFT));
+    isb();
+}
+
+bool mmu_is_enabled(void) {
+    return (read_sysreg(sctlr_el1) & SCTLR_M) != 0;
+}
+
+uint64_t *mmu_kernel_table(void) {
+    return kernel_pgd;
+}
+
+void mmu_enable(void) {
+    write_sysreg(mair_el1, MAIR_VALUE);
+    write_sysreg(tcr_el1, tcr_value);
+    write_sysreg(ttbr0_el1, (uint64_t)kernel_pgd);
+    isb();
+
+    // Discard stale translations and instructions fetched with the MMU off
+    asm volatile("tlbi vmalle1" : : : "memory");
+    asm volatile("ic iallu" : : : "memory");
+    dsb(nsh);
+    isb();
+
+    uint64_t sctlr = read_sysreg(sctlr_el1);
+    sctlr |= SCTLR_M | SCTLR_C | SCTLR_I;
+    sctlr &= ~SCTLR_A;
+    write_sysreg(sctlr_el1, sctlr);
+    isb();
+}
+
+void mmu_get_cpu_config(uint64_t *mair, uint64_t *tcr, uint64_t *ttbr0, uint64_t *sctlr) {
+    *mair = MAIR_VALUE;
+    *tcr = tcr_value;
+    *ttbr0 = (uint64_t)kernel_pgd;
+    *sctlr = read_sysreg(sctlr_el1);
+}
+
+void mmu_init(void) {
+    // Physical address size supported by the CPU (ID_AA64MMFR0_EL1.PARange),
+    // capped at 48 bits which is all the 4 KB granule can address here
+    uint64_t parange = read_sysreg(id_aa64mmfr0_el1) & 0xF;
+    if (parange > 5) {
+        parange = 5;
+    }
+    tcr_value = TCR_T0SZ | TCR_IRGN0_WBWA | TCR_ORGN0_WBWA | TCR_SH0_INNER |
+                TCR_TG0_4K | TCR_EPD1 | (parange << TCR_IPS_SHIFT);
+
+    // ID_AA64MMFR0_EL1.ASIDBits: 0b0010 means 16-bit ASIDs are available
+    if (((read_sysreg(id_aa64mmfr0_el1) >> 4) & 0xF) == 2) {
+        asid_bits = 16;
+        tcr_value |= TCR_AS;
+    }
+
+    kernel_pgd = mmu_alloc_table();
+
+    uint64_t ram_end = pmm_get_highest_usable_address();
+    uint64_t kernel_start = (uint64_t)&_kernel_start;
+    uint64_t text_end = (uint64_t)&_text_end;
+    uint64_t rodata_start = (uint64_t)&_rodata_start;
+    uint64_t rodata_end = ((uint64_t)&_rodata_end + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+
+    kprintf("MMU: Mapping devices 0x%llx - 0x%llx\n",
+            MMU_DEVICE_BASE, MMU_DEVICE_BASE + MMU_DEVICE_SIZE);
+    mmu_map_range(kernel_pgd, MMU_DEVICE_BASE, MMU_DEVICE_BASE, MMU_DEVICE_SIZE, MMU_DEVICE);
+
+    kprintf("MMU: Mapping RAM 0x%llx - 0x%llx (text 0x%llx - 0x%llx RX, rodata RO)\n",
+            (uint64_t)PMM_RAM_BASE, ram_end, kernel_start, text_end);
+    mmu_map_range(kernel_pgd, PMM_RAM_BASE, PMM_RAM_BASE,
+                  kernel_start - PMM_RAM_BASE, MMU_KERNEL_DATA);
+    mmu_map_range(kernel_pgd, kernel_start, kernel_start,
+                  text_end - kernel_start, MMU_KERNEL_TEXT);
+    mmu_map_range(kernel_pgd, rodata_start, rodata_start,
+                  rodata_end - rodata_start, MMU_KERNEL_RODATA);
+    mmu_map_range(kernel_pgd, rodata_end, rodata_end,
+                  ram_end - rodata_end, MMU_KERNEL_DATA);
+
+    // The tables were written with the caches off; make sure no stale
+    // cache lines shadow them once walks become cacheable
+    mmu_clean_tables(kernel_pgd, L1_SHIFT);
+
+    mmu_enable();
+
+    kprintf("MMU: Enabled with caches: %llu x 1G, %llu x 2M, %llu x 4K mappings in %llu table pages\n",
+            mapped_blocks_1g, mapped_blocks_2m, mapped_pages, table_pages);
+}
+
+void mmu_print_info(void) {
+    kprintf("MMU Info:\n");
+    kprintf("  Enabled:       %s\n", mmu_is_enabled() ? "yes (M, C, I)" : "no");
+    kprintf("  Kernel table:  %p\n", kernel_pgd);
+    kprintf("  TCR_EL1:       0x%016llx\n", read_sysreg(tcr_el1));
+    kprintf("  ASID bits:     %u\n", asid_bits);
+    kprintf("  Table pages:   %llu (%llu KB)\n", table_pages, table_pages * PAGE_SIZE / 1024);
+    kprintf("  1 GB blocks:   %llu\n", mapped_blocks_1g);
+    kprintf("  2 MB blocks:   %llu\n", mapped_blocks_2m);
+    kprintf("  4 KB pages:    %llu\n", mapped_pages);
+    kprintf("  Mapped:        %llu MB\n",
+            (mapped_blocks_1g << 10) + (mapped_blocks_2m << 1) + mapped_pages * PAGE_SIZE / (1024 * 1024));
+    kprintf("  Block splits:  %llu\n", split_count);
+}
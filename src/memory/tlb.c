@@ -0,0 +1,186 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory/tlb.h"
+#include "memory/mmu.h"
+#include "memory/frame_alloc.h"
+#include "arch/cpu.h"
+#include "arch/smp.h"
+#include "sync/atomic.h"
+#include "lib/stdio.h"
+
+static tlb_flush_mode_t flush_mode = TLB_FLUSH_BATCHED;
+static uint64_t range_limit = TLB_RANGE_LIMIT_DEFAULT;
+static tlb_stats_t stats;
+
+// --- Invalidation ---
+
+// TLBI operands: VA[55:12] in bits [43:0], ASID in bits [63:48]
+static inline uint64_t tlbi_operand(uint64_t va, uint64_t asid) {
+    return (va >> PAGE_SHIFT) | (asid << TTBR_ASID_SHIFT);
+}
+
+// Broadcast (IS) forms reach every CPU; the local forms only this one.
+// The caller supplies the barriers around a whole sequence.
+static void tlb_invalidate(uint64_t asid, uint64_t start, uint64_t end, bool broadcast) {
+    uint64_t pages = (end - start) >> PAGE_SHIFT;
+    if (pages > range_limit) {
+        if (asid == TLB_ASID_ALL) {
+            if (broadcast) {
+                asm volatile("tlbi vmalle1is" : : : "memory");
+            } else {
+                asm volatile("tlbi vmalle1" : : : "memory");
+            }
+        } else {
+            uint64_t op = asid << TTBR_ASID_SHIFT;
+            if (broadcast) {
+                asm volatile("tlbi aside1is, %0" : : "r" (op) : "memory");
+            } else {
+                asm volatile("tlbi aside1, %0" : : "r" (op) : "memory");
+            }
+        }
+        return;
+    }
+
+    for (uint64_t va = start; va < end; va += PAGE_SIZE) {
+        if (asid == TLB_ASID_ALL) {
+            uint64_t op = tlbi_operand(va, 0);
+            if (broadcast) {
+                asm volatile("tlbi vaae1is, %0" : : "r" (op) : "memory");
+            } else {
+                asm volatile("tlbi vaae1, %0" : : "r" (op) : "memory");
+            }
+        } else {
+            uint64_t op = tlbi_operand(va, asid);
+            if (broadcast) {
+                asm volatile("tlbi vae1is, %0" : : "r" (op) : "memory");
+            } else {
+                asm volatile("tlbi vae1, %0" : : "r" (op) : "memory");
+            }
+        }
+    }
+}
+
+typedef struct {
+    uint64_t asid;
+    uint64_t start;
+    uint64_t end;
+} tlb_flush_args_t;
+
+// Runs on every CPU in the IPI modes
+static void tlb_flush_local(void *arg) {
+    tlb_flush_args_t *args = arg;
+    tlb_invalidate(args->asid, args->start, args->end, false);
+    dsb(nsh);
+    isb();
+}
+
+static void tlb_flush(uint64_t asid, uint64_t start, uint64_t end, bool ipi) {
+    uint64_t pages = (end - start) >> PAGE_SHIFT;
+    if (pages > range_limit) {
+        atomic_fetch_add64(&stats.full_flushes, 1);
+    } else {
+        atomic_fetch_add64(&stats.range_flushes, 1);
+        atomic_fetch_add64(&stats.pages, pages);
+    }
+
+    // The cleared entries must be visible to every table walker first
+    dsb(ishst);
+    if (ipi) {
+        atomic_fetch_add64(&stats.ipi_flushes, 1);
+        tlb_flush_args_t args = { asid, start, end };
+        smp_call_function_many(smp_online_mask(), tlb_flush_local, &args, true);
+        tlb_flush_local(&args);
+        return;
+    }
+    tlb_invalidate(asid, start, end, true);
+    dsb(ish);
+    isb();
+}
+
+static bool tlb_mode_uses_ipi(tlb_flush_mode_t mode) {
+    return mode == TLB_FLUSH_IPI_BATCHED || mode == TLB_FLUSH_IPI_EACH_PAGE;
+}
+
+void tlb_flush_range(uint64_t asid, uint64_t start, uint64_t end) {
+    if (end > start) {
+        tlb_flush(asid, start, end, tlb_mode_uses_ipi(flush_mode));
+    }
+}
+
+// --- Gathering ---
+
+void tlb_gather_init(tlb_gather_t *tlb, uint64_t asid, void (*release)(uint64_t pa)) {
+    tlb->asid = asid;
+    tlb->start = 0;
+    tlb->end = 0;
+    tlb->nr_frames = 0;
+    tlb->release = release;
+}
+
+static void tlb_gather_flush(tlb_gather_t *tlb) {
+    tlb_flush_range(tlb->asid, tlb->start, tlb->end);
+    tlb->start = 0;
+    tlb->end = 0;
+
+    for (unsigned int i = 0; i < tlb->nr_frames; i++) {
+        if (tlb->release) {
+            tlb->release(tlb->frames[i]);
+        }
+    }
+    tlb->nr_frames = 0;
+}
+
+void tlb_gather_page(tlb_gather_t *tlb, uint64_t va, uint64_t pa) {
+    va &= ~(uint64_t)(PAGE_SIZE - 1);
+    if (flush_mode == TLB_FLUSH_EACH_PAGE || flush_mode == TLB_FLUSH_IPI_EACH_PAGE) {
+        tlb_flush_range(tlb->asid, va, va + PAGE_SIZE);
+    } else if (tlb->start == tlb->end) {
+        tlb->start = va;
+        tlb->end = va + PAGE_SIZE;
+    } else {
+        if (va < tlb->start) tlb->start = va;
+        if (va + PAGE_SIZE > tlb->end) tlb->end = va + PAGE_SIZE;
+    }
+
+    if (pa) {
+        if (tlb->nr_frames == TLB_GATHER_BATCH) {
+            tlb_gather_flush(tlb);
+        }
+        tlb->frames[tlb->nr_frames++] = pa;
+    }
+}
+
+void tlb_gather_finish(tlb_gather_t *tlb) {
+    tlb_gather_flush(tlb);
+}
+
+// --- Knobs and statistics ---
+
+void tlb_set_flush_mode(tlb_flush_mode_t mode) {
+    flush_mode = mode;
+}
+
+tlb_flush_mode_t tlb_get_flush_mode(void) {
+    return flush_mode;
+}
+
+void tlb_set_range_limit(uint64_t pages) {
+    range_limit = pages;
+}
+
+uint64_t tlb_get_range_limit(void) {
+    return range_limit;
+}
+
+void tlb_get_stats(tlb_stats_t *out) {
+    *out = stats;
+}
+
+void tlb_print_stats(void) {
+    kprintf("TLB Shootdown:\n");
+    kprintf("  Range limit:     %llu pages\n", range_limit);
+    kprintf("  Range flushes:   %llu (%llu pages)\n", stats.range_flushes, stats.pages);
+    kprintf("  Full flushes:    %llu\n", stats.full_flushes);
+    kprintf("  By cross-call:   %llu\n", stats.ipi_flushes);
+}
@@ -0,0 +1,441 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory/vmalloc.h"
+#include "memory/mmu.h"
+#include "memory/frame_alloc.h"
+#include "memory/kheap.h"
+#include "exceptions/exceptions.h"
+#include "sync/spinlock.h"
+#include "lib/stdio.h"
+
+// A range of the vmalloc space. Free ranges and allocated ("busy") ranges
+// are kept in two AVL trees ordered by start address. In the free tree
+// every node also caches the largest free size in its subtree, which lets
+// an allocation find the lowest-addressed range that fits in O(log n).
+typedef struct vmap_area {
+    uint64_t start;
+    uint64_t size;              // Bytes, including the guard page for busy areas
+    uint64_t subtree_max;       // Largest size in this subtree (free tree)
+    int height;
+    struct vmap_area *left;
+    struct vmap_area *right;
+    struct vmap_area *next_lazy; // Purge list link
+} vmap_area_t;
+
+// vmap_lock covers both trees, the lazy list and the counters below. The
+// page tables of the range are reserved at init, so an area is mapped and
+// unmapped without it by whoever owns the area: the allocating vmalloc(),
+// or the purge that took it off the lazy list. vfree() may be called with
+// interrupts off, so the lock is IRQ-safe; kmalloc and kfree are called
+// under it (vmap_lock before heap_lock).
+static spinlock_t vmap_lock = SPINLOCK_INIT;
+static vmap_area_t *free_root = NULL;
+static vmap_area_t *busy_root = NULL;
+static vmap_area_t *lazy_list = NULL;
+static uint64_t lazy_pages = 0;
+
+static uint64_t busy_areas = 0;
+static uint64_t mapped_pages = 0;
+static uint64_t purge_count = 0;
+static bool vmalloc_ready = false;
+
+// --- AVL tree ---
+
+static inline int vmap_height(const vmap_area_t *n) {
+    return n ? n->height : 0;
+}
+
+static inline uint64_t vmap_subtree_max(const vmap_area_t *n) {
+    return n ? n->subtree_max : 0;
+}
+
+static void vmap_update(vmap_area_t *n) {
+    int hl = vmap_height(n->left);
+    int hr = vmap_height(n->right);
+    n->height = 1 + (hl > hr ? hl : hr);
+
+    uint64_t max = n->size;
+    if (vmap_subtree_max(n->left) > max) max = vmap_subtree_max(n->left);
+    if (vmap_subtree_max(n->right) > max) max = vmap_subtree_max(n->right);
+    n->subtree_max = max;
+}
+
+static vmap_area_t *vmap_rotate_right(vmap_area_t *n) {
+    vmap_area_t *l = n->left;
+    n->left = l->right;
+    l->right = n;
+    vmap_update(n);
+    vmap_update(l);
+    return l;
+}
+
+static vmap_area_t *vmap_rotate_left(vmap_area_t *n) {
+    vmap_area_t *r = n->right;
+    n->right = r->left;
+    r->left = n;
+    vmap_update(n);
+    vmap_update(r);
+    return r;
+}
+
+static vmap_area_t *vmap_balance(vmap_area_t *n) {
+    vmap_update(n);
+    int balance = vmap_height(n->left) - vmap_height(n->right);
+    if (balance > 1) {
+        if (vmap_height(n->left->left) < vmap_height(n->left->right)) {
+            n->left = vmap_rotate_left(n->left);
+        }
+        return vmap_rotate_right(n);
+    }
+    if (balance < -1) {
+        if (vmap_height(n->right->right) < vmap_height(n->right->left)) {
+            n->right = vmap_rotate_right(n->right);
+        }
+        return vmap_rotate_left(n);
+    }
+    return n;
+}
+
+static vmap_area_t *vmap_insert(vmap_area_t *root, vmap_area_t *node) {
+    if (!root) {
+        node->left = node->right = NULL;
+        vmap_update(node);
+        return node;
+    }
+    if (node->start < root->start) {
+        root->left = vmap_insert(root->left, node);
+    } else {
+        root->right = vmap_insert(root->right, node);
+    }
+    return vmap_balance(root);
+}
+
+// Detach the lowest node of a subtree into *min
+static vmap_area_t *vmap_remove_min(vmap_area_t *root, vmap_area_t **min) {
+    if (!root->left) {
+        *min = root;
+        return root->right;
+    }
+    root->left = vmap_remove_min(root->left, min);
+    return vmap_balance(root);
+}
+
+static vmap_area_t *vmap_remove(vmap_area_t *root, uint64_t start) {
+    if (!root) {
+        return NULL;
+    }
+    if (start < root->start) {
+        root->left = vmap_remove(root->left, start);
+    } else if (start > root->start) {
+        root->right = vmap_remove(root->right, start);
+    } else {
+        if (!root->left || !root->right) {
+            return root->left ? root->left : root->right;
+        }
+        vmap_area_t *successor;
+        vmap_area_t *right = vmap_remove_min(root->right, &successor);
+        successor->left = root->left;
+        successor->right = right;
+        return vmap_balance(successor);
+    }
+    return vmap_balance(root);
+}
+
+// Node with the greatest start <= addr
+static vmap_area_t *vmap_find_floor(vmap_area_t *n, uint64_t addr) {
+    vmap_area_t *best = NULL;
+    while (n) {
+        if (n->start <= addr) {
+            best = n;
+            n = n->right;
+        } else {
+            n = n->left;
+        }
+    }
+    return best;
+}
+
+// Lowest-addressed free area of at least size bytes
+static vmap_area_t *vmap_find_lowest_fit(vmap_area_t *n, uint64_t size) {
+    while (n) {
+        if (vmap_subtree_max(n->left) >= size) {
+            n = n->left;
+        } else if (n->size >= size) {
+            return n;
+        } else if (vmap_subtree_max(n->right) >= size) {
+            n = n->right;
+        } else {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// --- Free space management ---
+
+// Return [start, start + size) to the free tree, merging with neighbours.
+// node is reused for the merged area.
+static void vmap_free_range(vmap_area_t *node, uint64_t start, uint64_t size) {
+    vmap_area_t *prev = start > VMALLOC_START ? vmap_find_floor(free_root, start - 1) : NULL;
+    if (prev && prev->start + prev->size == start) {
+        free_root = vmap_remove(free_root, prev->start);
+        start = prev->start;
+        size += prev->size;
+        kfree(prev);
+    }
+
+    vmap_area_t *next = vmap_find_floor(free_root, start + size);
+    if (next && next->start == start + size) {
+        free_root = vmap_remove(free_root, next->start);
+        size += next->size;
+        kfree(next);
+    }
+
+    node->start = start;
+    node->size = size;
+    free_root = vmap_insert(free_root, node);
+}
+
+// Carve size bytes from the lowest free area that fits; returns its start
+static uint64_t vmap_alloc_range(uint64_t size) {
+    vmap_area_t *area = vmap_find_lowest_fit(free_root, size);
+    if (!area) {
+        return 0;
+    }
+
+    uint64_t start = area->start;
+    free_root = vmap_remove(free_root, start);
+    if (area->size == size) {
+        kfree(area);
+    } else {
+        area->start += size;
+        area->size -= size;
+        free_root = vmap_insert(free_root, area);
+    }
+    return start;
+}
+
+// --- Lazy teardown ---
+
+// Unmap the pages of [start, start + mapped) and thread their frames onto
+// *chain. The list is stored in the frames themselves through the identity
+// map, so collecting them needs no allocation. Returns the pages unmapped.
+static uint64_t vmalloc_unmap_area(uint64_t start, uint64_t mapped, uint64_t *chain) {
+    uint64_t *root = mmu_kernel_table();
+    uint64_t pages = 0;
+    for (uint64_t off = 0; off < mapped; off += PAGE_SIZE) {
+        uint64_t pa;
+        if (mmu_translate(root, start + off, &pa)) {
+            *(uint64_t *)pa = *chain;
+            *chain = pa;
+            pages++;
+        }
+    }
+    mmu_clear_range(root, start, mapped);
+    return pages;
+}
+
+// Return a frame chain built by vmalloc_unmap_area(); only safe after the TLB flush
+static void vmalloc_free_chain(uint64_t chain) {
+    while (chain) {
+        uint64_t next = *(uint64_t *)chain;
+        free_frame((void *)chain);
+        chain = next;
+    }
+}
+
+// Tear down the areas of a list taken off lazy_list, without vmap_lock
+// held across the unmap and the TLB flush
+static void vmalloc_purge_list(vmap_area_t *list) {
+    // Unmap every pending area, then invalidate the TLB once. Frames are
+    // only released after the flush so no stale translation can reach them.
+    uint64_t chain = 0;
+    uint64_t pages = 0;
+    for (vmap_area_t *area = list; area; area = area->next_lazy) {
+        pages += vmalloc_unmap_area(area->start, area->size - PAGE_SIZE, &chain);
+    }
+    mmu_flush_tlb_all();
+    vmalloc_free_chain(chain);
+
+    uint64_t flags = spin_lock_irqsave(&vmap_lock);
+    vmap_area_t *area = list;
+    while (area) {
+        vmap_area_t *next = area->next_lazy;
+        vmap_free_range(area, area->start, area->size);
+        area = next;
+    }
+    mapped_pages -= pages;
+    purge_count++;
+    spin_unlock_irqrestore(&vmap_lock, flags);
+}
+
+// Take the whole lazy list; vmap_lock held
+static vmap_area_t *vmalloc_take_lazy(void) {
+    vmap_area_t *list = lazy_list;
+    lazy_list = NULL;
+    lazy_pages = 0;
+    return list;
+}
+
+void vmalloc_purge(void) {
+    uint64_t flags = spin_lock_irqsave(&vmap_lock);
+    vmap_area_t *list = vmalloc_take_lazy();
+    spin_unlock_irqrestore(&vmap_lock, flags);
+    if (list) {
+        vmalloc_purge_list(list);
+    }
+}
+
+// --- Public interface ---
+
+void vmalloc_init(void) {
+    if (mmu_reserve_tables(mmu_kernel_table(), VMALLOC_START, VMALLOC_SIZE) != 0) {
+        panic("vmalloc: Unable to reserve page tables");
+    }
+
+    vmap_area_t *all = kmalloc(sizeof(vmap_area_t));
+    if (!all) {
+        panic("vmalloc: Out of memory");
+    }
+    vmap_free_range(all, VMALLOC_START, VMALLOC_SIZE);
+    vmalloc_ready = true;
+
+    kprintf("vmalloc: 0x%llx - 0x%llx (%llu MB)\n",
+            VMALLOC_START, VMALLOC_END, VMALLOC_SIZE >> 20);
+}
+
+void *vmalloc(size_t size) {
+    if (!vmalloc_ready || size == 0 || size > VMALLOC_SIZE) {
+        return NULL;
+    }
+
+    uint64_t bytes = (size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t area_size = bytes + PAGE_SIZE; // Trailing guard page
+
+    vmap_area_t *area = kmalloc(sizeof(vmap_area_t));
+    if (!area) {
+        return NULL;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&vmap_lock);
+    uint64_t start = vmap_alloc_range(area_size);
+    if (!start && lazy_list) {
+        // Lazily freed ranges may be enough once merged back
+        vmap_area_t *list = vmalloc_take_lazy();
+        spin_unlock_irqrestore(&vmap_lock, flags);
+        vmalloc_purge_list(list);
+        flags = spin_lock_irqsave(&vmap_lock);
+        start = vmap_alloc_range(area_size);
+    }
+    spin_unlock_irqrestore(&vmap_lock, flags);
+    if (!start) {
+        kprintf("vmalloc: No virtual space for %llu bytes\n", (uint64_t)size);
+        kfree(area);
+        return NULL;
+    }
+
+    // The range is ours now. Back it one frame at a time: no physical
+    // contiguity needed
+    uint64_t *root = mmu_kernel_table();
+    for (uint64_t off = 0; off < bytes; off += PAGE_SIZE) {
+        void *frame = alloc_frame();
+        if (!frame || mmu_map_pages(root, start + off, (uint64_t)frame, PAGE_SIZE, MMU_KERNEL_DATA) != 0) {
+            if (frame) {
+                free_frame(frame);
+            }
+            uint64_t chain = 0;
+            vmalloc_unmap_area(start, off, &chain);
+            mmu_flush_tlb_all();
+            vmalloc_free_chain(chain);
+            flags = spin_lock_irqsave(&vmap_lock);
+            vmap_free_range(area, start, area_size);
+            spin_unlock_irqrestore(&vmap_lock, flags);
+            return NULL;
+        }
+    }
+
+    area->start = start;
+    area->size = area_size;
+    area->next_lazy = NULL;
+    flags = spin_lock_irqsave(&vmap_lock);
+    busy_root = vmap_insert(busy_root, area);
+    busy_areas++;
+    mapped_pages += bytes / PAGE_SIZE;
+    spin_unlock_irqrestore(&vmap_lock, flags);
+
+    return (void *)start;
+}
+
+void vfree(void *addr) {
+    if (!addr) {
+        return;
+    }
+
+    uint64_t start = (uint64_t)addr;
+    uint64_t flags = spin_lock_irqsave(&vmap_lock);
+    vmap_area_t *area = vmap_find_floor(busy_root, start);
+    if (!area || area->start != start) {
+        spin_unlock_irqrestore(&vmap_lock, flags);
+        kprintf("vfree: 0x%llx is not a vmalloc area\n", start);
+        return;
+    }
+
+    busy_root = vmap_remove(busy_root, start);
+    busy_areas--;
+
+    // Defer the unmap and TLB flush so many frees share one invalidation
+    area->next_lazy = lazy_list;
+    lazy_list = area;
+    lazy_pages += (area->size - PAGE_SIZE) / PAGE_SIZE;
+    vmap_area_t *list = NULL;
+    if (lazy_pages >= VMALLOC_LAZY_MAX_PAGES) {
+        list = vmalloc_take_lazy();
+    }
+    spin_unlock_irqrestore(&vmap_lock, flags);
+    if (list) {
+        vmalloc_purge_list(list);
+    }
+}
+
+bool is_vmalloc_addr(const void *addr) {
+    uint64_t va = (uint64_t)addr;
+    return va >= VMALLOC_START && va < VMALLOC_END;
+}
+
+uint64_t vmalloc_to_phys(const void *addr) {
+    uint64_t pa;
+    if (!is_vmalloc_addr(addr) || !mmu_translate(mmu_kernel_table(), (uint64_t)addr, &pa)) {
+        return 0;
+    }
+    return pa;
+}
+
+static void vmap_count_free(const vmap_area_t *n, uint64_t *count, uint64_t *bytes) {
+    if (!n) {
+        return;
+    }
+    (*count)++;
+    *bytes += n->size;
+    vmap_count_free(n->left, count, bytes);
+    vmap_count_free(n->right, count, bytes);
+}
+
+void vmalloc_print_info(void) {
+    uint64_t free_count = 0, free_bytes = 0;
+    uint64_t flags = spin_lock_irqsave(&vmap_lock);
+    vmap_count_free(free_root, &free_count, &free_bytes);
+    uint64_t largest = vmap_subtree_max(free_root);
+    uint64_t busy = busy_areas, mapped = mapped_pages;
+    uint64_t lazy = lazy_pages, purges = purge_count;
+    spin_unlock_irqrestore(&vmap_lock, flags);
+
+    kprintf("vmalloc Info:\n");
+    kprintf("  Range:          0x%llx - 0x%llx\n", VMALLOC_START, VMALLOC_END);
+    kprintf("  Busy areas:     %llu\n", busy);
+    kprintf("  Mapped pages:   %llu (%llu KB)\n", mapped, mapped * PAGE_SIZE / 1024);
+    kprintf("  Lazy pages:     %llu (purge at %u)\n", lazy, VMALLOC_LAZY_MAX_PAGES);
+    kprintf("  Purges:         %llu\n", purges);
+    kprintf("  Free areas:     %llu (%llu KB, largest %llu KB)\n",
+            free_count, free_bytes / 1024, largest / 1024);
+}
@@ -0,0 +1,289 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sched/executor.h"
+#include "sched/thread.h"
+#include "arch/cpu.h"
+#include "arch/smp.h"
+#include "sync/atomic.h"
+#include "lib/stdio.h"
+
+// --- Chase-Lev deques ---
+//
+// bottom is only written by the owning CPU, top only advanced by CAS, and
+// the entries between them are the queued tasks. The owner pushes and
+// pops at bottom without atomics unless a single task is left, when it
+// races the thieves for it through top like they do. Indices only grow,
+// so a slot is reused only after top has moved past it; with a fixed
+// buffer that is all the ABA protection needed.
+//
+// "Owner" means code running on the deque's CPU with preemption disabled,
+// so the worker and any other thread on that CPU (a shell command waiting
+// on a group, say) can share the deque.
+
+#define DEQUE_MASK (EXECUTOR_DEQUE_SIZE - 1)
+
+// Steal attempts per idle pass before the worker considers sleeping
+#define STEAL_ATTEMPTS_PER_CPU 2
+
+typedef struct {
+    volatile uint64_t top __attribute__((aligned(64)));     // Thieves' end
+    volatile uint64_t bottom __attribute__((aligned(64)));  // Owner's end
+    task_t *volatile tasks[EXECUTOR_DEQUE_SIZE];
+    thread_t *worker;
+    uint32_t rng;               // xorshift32 state for victim selection
+    executor_stats_t stats;
+} __attribute__((aligned(64))) executor_cpu_t;
+
+static executor_cpu_t executors[MAX_CPUS];
+
+// CPUs whose worker is blocked (or about to block) for lack of work
+static volatile uint32_t idle_workers;
+
+// CPUs 0 .. active_cpus - 1 take part
+static volatile uint32_t active_cpus;
+
+static bool deque_push(executor_cpu_t *ex, task_t *task) {
+    uint64_t b = ex->bottom;
+    uint64_t t = atomic_load_acquire64(&ex->top);
+    if ((int64_t)(b - t) >= EXECUTOR_DEQUE_SIZE) {
+        return false;
+    }
+    ex->tasks[b & DEQUE_MASK] = task;
+    // Publish the entry before the new bottom that makes it stealable
+    atomic_store_release64(&ex->bottom, b + 1);
+    return true;
+}
+
+static task_t *deque_pop(executor_cpu_t *ex) {
+    uint64_t b = ex->bottom - 1;
+    ex->bottom = b;
+    // The claim on slot b must be visible before top is read, or a thief
+    // and the owner could both take the last task
+    dmb(ish);
+    uint64_t t = ex->top;
+
+    if ((int64_t)(b - t) < 0) {
+        // Empty
+        ex->bottom = b + 1;
+        return NULL;
+    }
+    task_t *task = ex->tasks[b & DEQUE_MASK];
+    if (b == t) {
+        // Last task: whoever advances top gets it
+        if (atomic_cmpxchg64(&ex->top, t, t + 1) != t) {
+            task = NULL;
+        }
+        ex->bottom = b + 1;
+    }
+    return task;
+}
+
+static task_t *deque_steal(executor_cpu_t *ex) {
+    uint64_t t = atomic_load_acquire64(&ex->top);
+    dmb(ish);
+    uint64_t b = atomic_load_acquire64(&ex->bottom);
+    if ((int64_t)(b - t) <= 0) {
+        return NULL;
+    }
+    task_t *task = ex->tasks[t & DEQUE_MASK];
+    if (atomic_cmpxchg64(&ex->top, t, t + 1) != t) {
+        // Lost to the owner or another thief
+        return NULL;
+    }
+    return task;
+}
+
+static bool deque_empty(executor_cpu_t *ex) {
+    return (int64_t)(ex->bottom - ex->top) <= 0;
+}
+
+// --- Scheduling tasks ---
+
+static uint32_t executor_random(executor_cpu_t *ex) {
+    uint32_t x = ex->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ex->rng = x;
+    return x;
+}
+
+// Own deque first, then random victims
+static task_t *executor_find_task(executor_cpu_t *ex, unsigned int cpu) {
+    preempt_disable();
+    task_t *task = deque_pop(ex);
+    preempt_enable();
+    if (task) {
+        return task;
+    }
+
+    unsigned int ncpus = active_cpus;
+    if (ncpus < 2) {
+        return NULL;
+    }
+    for (unsigned int i = 0; i < STEAL_ATTEMPTS_PER_CPU * ncpus; i++) {
+        unsigned int victim = executor_random(ex) % ncpus;
+        if (victim == cpu) {
+            continue;
+        }
+        task = deque_steal(&executors[victim]);
+        if (task) {
+            ex->stats.stolen++;
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static bool executor_work_queued(void) {
+    unsigned int ncpus = active_cpus;
+    for (unsigned int cpu = 0; cpu < ncpus; cpu++) {
+        if (!deque_empty(&executors[cpu])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void executor_run(executor_cpu_t *ex, task_t *task) {
+    task_group_t *group = task->group;
+    task->func(task->arg);
+    ex->stats.executed++;
+    // Last touch of the task: the spawner may free it once pending drops
+    atomic_fetch_add32(&group->pending, -1U);
+}
+
+// Wake one sleeping worker other than the caller's, starting after it so
+// wake-ups spread across CPUs. The woken worker steals the new task and
+// wakes the next one when it spawns in turn.
+static void executor_wake_idle(unsigned int self) {
+    // Order the push before reading the idle mask; pairs with the barrier
+    // a worker has between setting its bit and checking for work
+    dmb(ish);
+    unsigned int ncpus = active_cpus;
+    uint32_t candidates = atomic_load_acquire32(&idle_workers) & ((1U << ncpus) - 1);
+    candidates &= ~(1U << self);
+
+    for (unsigned int i = 1; candidates && i <= ncpus; i++) {
+        unsigned int cpu = (self + i) % ncpus;
+        uint32_t bit = 1U << cpu;
+        if (!(candidates & bit)) {
+            continue;
+        }
+        // Claim it so two spawners do not wake the same worker
+        if (atomic_fetch_andnot32(&idle_workers, bit) & bit) {
+            thread_wake(executors[cpu].worker);
+            return;
+        }
+        candidates &= ~bit;
+    }
+}
+
+static void executor_worker(void *arg) {
+    (void)arg;
+    unsigned int cpu = cpu_id();
+    executor_cpu_t *ex = &executors[cpu];
+    uint32_t bit = 1U << cpu;
+
+    while (1) {
+        task_t *task = NULL;
+        if (cpu < active_cpus) {
+            task = executor_find_task(ex, cpu);
+        }
+        if (task) {
+            executor_run(ex, task);
+            continue;
+        }
+
+        // Advertise as idle, then look once more: a spawner that pushed
+        // before seeing the bit is seen here instead
+        thread_prepare_block();
+        atomic_fetch_or32(&idle_workers, bit);
+        dmb(ish);
+        if (cpu < active_cpus && executor_work_queued()) {
+            atomic_fetch_andnot32(&idle_workers, bit);
+            thread_wake(thread_current());  // Cancels the block
+            continue;
+        }
+        ex->stats.sleeps++;
+        thread_block();
+        atomic_fetch_andnot32(&idle_workers, bit);
+    }
+}
+
+// --- Public interface ---
+
+void task_spawn(task_group_t *group, task_t *task, task_func_t func, void *arg) {
+    task->func = func;
+    task->arg = arg;
+    task->group = group;
+    atomic_fetch_add32(&group->pending, 1);
+
+    preempt_disable();
+    unsigned int cpu = cpu_id();
+    executor_cpu_t *ex = &executors[cpu];
+    bool queued = deque_push(ex, task);
+    preempt_enable();
+
+    if (!queued) {
+        ex->stats.inline_runs++;
+        executor_run(ex, task);
+        return;
+    }
+    if (idle_workers) {
+        executor_wake_idle(cpu);
+    }
+}
+
+void task_group_wait(task_group_t *group) {
+    unsigned int cpu = cpu_id();
+    executor_cpu_t *ex = &executors[cpu];
+    while (atomic_load_acquire32(&group->pending) != 0) {
+        task_t *task = executor_find_task(ex, cpu);
+        if (task) {
+            executor_run(ex, task);
+        } else {
+            // The rest is running elsewhere; let this CPU's worker in
+            cpu_relax();
+            thread_yield();
+        }
+    }
+}
+
+void executor_set_cpus(unsigned int ncpus) {
+    unsigned int online = smp_num_cpus();
+    if (ncpus == 0 || ncpus > online) {
+        ncpus = online;
+    }
+    active_cpus = ncpus;
+}
+
+unsigned int executor_cpus(void) {
+    return active_cpus;
+}
+
+void executor_get_stats(unsigned int cpu, executor_stats_t *stats) {
+    *stats = executors[cpu].stats;
+}
+
+void executor_init(void) {
+    unsigned int started = 0;
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!cpu_online(cpu)) {
+            continue;
+        }
+        char name[THREAD_NAME_LEN];
+        ksnprintf(name, sizeof(name), "worker/%u", cpu);
+        executors[cpu].rng = 0x9E3779B9U * (cpu + 1);
+        executors[cpu].worker = thread_create(name, executor_worker, NULL, cpu);
+        if (!executors[cpu].worker) {
+            kprintf("Executor: No worker on CPU%u\n", cpu);
+            break;
+        }
+        started++;
+    }
+    // Online CPUs are numbered from 0, so the first started ones take part
+    executor_set_cpus(started);
+    kprintf("Executor: %u workers, %u-entry deques\n", started, EXECUTOR_DEQUE_SIZE);
+}
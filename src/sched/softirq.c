@@ -0,0 +1,209 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sched/softirq.h"
+#include "arch/cpu.h"
+#include "arch/smp.h"
+#include "drivers/timer.h"
+#include "sync/atomic.h"
+#include "lib/stdio.h"
+
+// DAIF.I: IRQs masked
+#define DAIF_IRQ_MASKED (1U << 7)
+
+typedef struct {
+    uint64_t enter_ticks;       // Counter at irq_enter() of the current IRQ
+    uint64_t hardirqs;
+    uint64_t hardirq_ticks;
+    uint64_t hardirq_max;
+    uint64_t runs[NR_SOFTIRQS];
+    uint64_t ticks[NR_SOFTIRQS];
+    uint64_t max[NR_SOFTIRQS];
+    uint64_t deferred;          // IRQ exits that hit SOFTIRQ_MAX_RESTART
+} __attribute__((aligned(64))) irq_stats_t;
+
+// Tasklets scheduled on a CPU; only touched by that CPU with IRQs masked
+typedef struct {
+    tasklet_t *head;
+    tasklet_t *tail;
+} __attribute__((aligned(64))) tasklet_list_t;
+
+static softirq_handler_t softirq_vec[NR_SOFTIRQS];
+static const char *const softirq_names[NR_SOFTIRQS] = {
+    [SOFTIRQ_TASKLET] = "tasklet",
+};
+
+static irq_stats_t irq_stats[MAX_CPUS];
+static tasklet_list_t tasklet_lists[MAX_CPUS];
+
+// --- Softirqs ---
+
+// Entered and left with IRQs masked; each round runs with them enabled
+static void do_softirq(percpu_t *self) {
+    irq_stats_t *stats = &irq_stats[self->cpu];
+    self->in_softirq = true;
+    preempt_disable();
+
+    int restart = 0;
+    uint32_t pending;
+    while ((pending = self->softirq_pending) != 0) {
+        if (restart++ == SOFTIRQ_MAX_RESTART) {
+            stats->deferred++;
+            break;
+        }
+        self->softirq_pending = 0;
+        local_irq_enable();
+
+        for (unsigned int nr = 0; nr < NR_SOFTIRQS; nr++) {
+            if (!(pending & (1U << nr)) || !softirq_vec[nr]) {
+                continue;
+            }
+            uint64_t start = timer_read_counter();
+            softirq_vec[nr]();
+            uint64_t ticks = timer_read_counter() - start;
+            stats->runs[nr]++;
+            stats->ticks[nr] += ticks;
+            if (ticks > stats->max[nr]) {
+                stats->max[nr] = ticks;
+            }
+        }
+
+        local_irq_disable();
+    }
+
+    preempt_enable();
+    self->in_softirq = false;
+}
+
+void open_softirq(softirq_t nr, softirq_handler_t handler) {
+    softirq_vec[nr] = handler;
+}
+
+void raise_softirq(softirq_t nr) {
+    uint64_t flags = local_irq_save();
+    percpu_t *self = this_cpu();
+    self->softirq_pending |= 1U << nr;
+    // From a thread with IRQs enabled no interrupt exit may come for a
+    // while, so do not wait for one
+    if (!(flags & DAIF_IRQ_MASKED) && self->irq_depth == 0 && !self->in_softirq) {
+        do_softirq(self);
+    }
+    local_irq_restore(flags);
+}
+
+void irq_enter(void) {
+    percpu_t *self = this_cpu();
+    self->irq_depth++;
+    irq_stats[self->cpu].enter_ticks = timer_read_counter();
+}
+
+void irq_exit(void) {
+    percpu_t *self = this_cpu();
+    irq_stats_t *stats = &irq_stats[self->cpu];
+    uint64_t ticks = timer_read_counter() - stats->enter_ticks;
+    stats->hardirqs++;
+    stats->hardirq_ticks += ticks;
+    if (ticks > stats->hardirq_max) {
+        stats->hardirq_max = ticks;
+    }
+    self->irq_depth--;
+
+    // An IRQ that interrupted softirq handlers returns to them instead
+    if (self->softirq_pending && !self->in_softirq) {
+        do_softirq(self);
+    }
+}
+
+bool in_interrupt(void) {
+    percpu_t *self = this_cpu();
+    return self->irq_depth != 0 || self->in_softirq;
+}
+
+// --- Tasklets ---
+
+static void tasklet_enqueue(tasklet_list_t *list, tasklet_t *tasklet) {
+    tasklet->next = NULL;
+    if (list->tail) {
+        list->tail->next = tasklet;
+    } else {
+        list->head = tasklet;
+    }
+    list->tail = tasklet;
+}
+
+static void tasklet_action(void) {
+    local_irq_disable();
+    tasklet_list_t *list = &tasklet_lists[cpu_id()];
+    tasklet_t *tasklet = list->head;
+    list->head = NULL;
+    list->tail = NULL;
+    local_irq_enable();
+
+    while (tasklet) {
+        tasklet_t *next = tasklet->next;
+        if (atomic_fetch_or32(&tasklet->state, TASKLET_RUNNING) & TASKLET_RUNNING) {
+            // Rescheduled here while still running elsewhere: try again
+            // on a later round
+            local_irq_disable();
+            tasklet_enqueue(list, tasklet);
+            this_cpu()->softirq_pending |= 1U << SOFTIRQ_TASKLET;
+            local_irq_enable();
+        } else {
+            // Cleared first, so scheduling it from its own function
+            // queues it again
+            atomic_fetch_andnot32(&tasklet->state, TASKLET_SCHEDULED);
+            tasklet->func(tasklet->data);
+            tasklet->runs++;
+            atomic_fetch_andnot32(&tasklet->state, TASKLET_RUNNING);
+        }
+        tasklet = next;
+    }
+}
+
+void tasklet_init(tasklet_t *tasklet, tasklet_func_t func, void *data) {
+    tasklet->next = NULL;
+    tasklet->state = 0;
+    tasklet->func = func;
+    tasklet->data = data;
+    tasklet->runs = 0;
+}
+
+void tasklet_schedule(tasklet_t *tasklet) {
+    if (atomic_fetch_or32(&tasklet->state, TASKLET_SCHEDULED) & TASKLET_SCHEDULED) {
+        return;
+    }
+    uint64_t flags = local_irq_save();
+    tasklet_enqueue(&tasklet_lists[cpu_id()], tasklet);
+    local_irq_restore(flags);
+    raise_softirq(SOFTIRQ_TASKLET);
+}
+
+// --- Setup and statistics ---
+
+void softirq_init(void) {
+    open_softirq(SOFTIRQ_TASKLET, tasklet_action);
+}
+
+void softirq_print_stats(void) {
+    kprintf("CPU  hard IRQs   avg us   max us");
+    for (unsigned int nr = 0; nr < NR_SOFTIRQS; nr++) {
+        kprintf("  %8s runs   avg us   max us", softirq_names[nr]);
+    }
+    kprintf("  deferred\n");
+
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!cpu_online(cpu)) {
+            continue;
+        }
+        const irq_stats_t *stats = &irq_stats[cpu];
+        kprintf("%3u %10llu %8llu %8llu", cpu, stats->hardirqs,
+                stats->hardirqs ? timer_counter_to_us(stats->hardirq_ticks / stats->hardirqs) : 0,
+                timer_counter_to_us(stats->hardirq_max));
+        for (unsigned int nr = 0; nr < NR_SOFTIRQS; nr++) {
+            kprintf("  %13llu %8llu %8llu", stats->runs[nr],
+                    stats->runs[nr] ? timer_counter_to_us(stats->ticks[nr] / stats->runs[nr]) : 0,
+                    timer_counter_to_us(stats->max[nr]));
+        }
+        kprintf("  %8llu\n", stats->deferred);
+    }
+}
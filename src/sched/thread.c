@@ -0,0 +1,464 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sched/thread.h"
+#include "arch/cpu.h"
+#include "arch/smp.h"
+#include "drivers/gic.h"
+#include "drivers/timer.h"
+#include "memory/frame_alloc.h"
+#include "memory/kheap.h"
+#include "memory/mm.h"
+#include "sync/spinlock.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+// --- Run queues ---
+//
+// Every CPU has its own FIFO of ready threads and its own sleep list,
+// protected by the run queue lock and only ever dequeued by that CPU, so
+// a thread never migrates. The lock is held across switch_to and released
+// by the thread switched to (sched_finish_switch), which keeps a switch
+// atomic with respect to wake-ups from other CPUs.
+
+typedef struct {
+    spinlock_t lock;
+    thread_t *head;             // Ready threads, FIFO
+    thread_t *tail;
+    thread_t *sleepers;         // Sorted by wake_at
+    thread_t *idle;             // NULL until the CPU schedules
+    uint32_t nr_ready;
+    uint32_t slice_left;        // Ticks left for the running thread
+    volatile bool need_resched;
+    uint64_t switches;
+    uint64_t preemptions;
+} __attribute__((aligned(64))) runqueue_t;
+
+extern thread_t *switch_to(thread_t *prev, thread_t *next);
+extern char thread_start;
+
+static runqueue_t runqueues[MAX_CPUS];
+static thread_t idle_threads[MAX_CPUS];
+
+// All threads, for sched_print_info()
+static thread_t *all_threads = NULL;
+static spinlock_t all_threads_lock = SPINLOCK_INIT;
+static uint32_t next_tid = 1;
+
+static void rq_enqueue(runqueue_t *rq, thread_t *thread) {
+    thread->rq_next = NULL;
+    if (rq->tail) {
+        rq->tail->rq_next = thread;
+    } else {
+        rq->head = thread;
+    }
+    rq->tail = thread;
+    rq->nr_ready++;
+}
+
+static thread_t *rq_dequeue(runqueue_t *rq) {
+    thread_t *thread = rq->head;
+    if (thread) {
+        rq->head = thread->rq_next;
+        if (!rq->head) {
+            rq->tail = NULL;
+        }
+        thread->rq_next = NULL;
+        rq->nr_ready--;
+    }
+    return thread;
+}
+
+static void rq_add_sleeper(runqueue_t *rq, thread_t *thread) {
+    thread_t **link = &rq->sleepers;
+    while (*link && (*link)->wake_at <= thread->wake_at) {
+        link = &(*link)->rq_next;
+    }
+    thread->rq_next = *link;
+    *link = thread;
+}
+
+static bool rq_remove_sleeper(runqueue_t *rq, thread_t *thread) {
+    for (thread_t **link = &rq->sleepers; *link; link = &(*link)->rq_next) {
+        if (*link == thread) {
+            *link = thread->rq_next;
+            thread->rq_next = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Make a thread ready on its CPU and kick that CPU if it is idle;
+// rq->lock held
+static void rq_make_ready(runqueue_t *rq, thread_t *thread) {
+    thread->state = THREAD_READY;
+    rq_enqueue(rq, thread);
+    if (percpu(thread->cpu)->current == rq->idle) {
+        rq->need_resched = true;
+        if (thread->cpu != cpu_id()) {
+            gic_send_sgi(IPI_RESCHEDULE, percpu(thread->cpu)->gic_mask);
+        }
+    }
+}
+
+// --- Switching ---
+
+// Completes a switch on the new thread's stack: drop the run queue lock
+// taken by __schedule() and free the previous thread if it exited.
+// Also the first thing a new thread runs (see thread_start in switch.S).
+void sched_finish_switch(thread_t *prev) {
+    runqueue_t *rq = &runqueues[cpu_id()];
+    spin_unlock(&rq->lock);
+
+    if (prev->state == THREAD_DEAD) {
+        free_frames(prev->stack_base, THREAD_STACK_PAGES);
+        kfree(prev);
+    }
+}
+
+// preempt: the thread is being switched out at IRQ exit and stays ready
+// whatever state it had set, so a thread preempted half-way into blocking
+// runs again and re-checks its condition
+static void __schedule(bool preempt) {
+    uint64_t flags = local_irq_save();
+    percpu_t *self = this_cpu();
+    runqueue_t *rq = &runqueues[self->cpu];
+    thread_t *prev = self->current;
+
+    spin_lock(&rq->lock);
+    rq->need_resched = false;
+
+    uint64_t now = timer_read_counter();
+    prev->runtime += now - prev->last_run;
+    if (prev != rq->idle && prev->state != THREAD_DEAD &&
+        (preempt || prev->state == THREAD_RUNNING)) {
+        prev->state = THREAD_READY;
+        rq_enqueue(rq, prev);
+    }
+
+    thread_t *next = rq_dequeue(rq);
+    if (!next) {
+        next = rq->idle;
+    }
+    next->state = THREAD_RUNNING;
+    next->last_run = now;
+    rq->slice_left = SCHED_SLICE_TICKS;
+
+    if (next == prev) {
+        spin_unlock(&rq->lock);
+        local_irq_restore(flags);
+        return;
+    }
+
+    if (preempt) {
+        rq->preemptions++;
+    }
+    rq->switches++;
+    next->switches++;
+    // The address space belongs to the thread, not the CPU
+    if (next->mm != mm_current()) {
+        mm_activate(next->mm);
+    }
+    self->current = next;
+    prev = switch_to(prev, next);
+    sched_finish_switch(prev);
+    local_irq_restore(flags);
+}
+
+void schedule(void) {
+    __schedule(false);
+}
+
+void sched_irq_exit(void) {
+    percpu_t *self = this_cpu();
+    if (!self || self->preempt_count != 0) {
+        return;
+    }
+    runqueue_t *rq = &runqueues[self->cpu];
+    if (rq->idle && rq->need_resched) {
+        __schedule(true);
+    }
+}
+
+// Tick on every CPU: wake expired sleepers and end the time slice
+static void sched_tick(saved_registers_t *context) {
+    (void)context;
+    percpu_t *self = this_cpu();
+    runqueue_t *rq = &runqueues[self->cpu];
+    if (!rq->idle) {
+        return;
+    }
+
+    spin_lock(&rq->lock);
+    uint64_t now = timer_read_counter();
+    while (rq->sleepers && rq->sleepers->wake_at <= now) {
+        thread_t *thread = rq->sleepers;
+        rq->sleepers = thread->rq_next;
+        rq_make_ready(rq, thread);
+    }
+    if (self->current == rq->idle) {
+        if (rq->head) {
+            rq->need_resched = true;
+        }
+    } else if (rq->slice_left > 0 && --rq->slice_left == 0 && rq->head) {
+        rq->need_resched = true;
+    }
+    spin_unlock(&rq->lock);
+}
+
+// The work is done by sched_irq_exit(); the IPI only gets us there
+static void sched_ipi_handler(unsigned int irq, saved_registers_t *context, void *data) {
+    (void)irq;
+    (void)context;
+    (void)data;
+    runqueues[cpu_id()].need_resched = true;
+}
+
+// --- Idle ---
+
+void sched_init_cpu(unsigned int cpu) {
+    thread_t *idle = &idle_threads[cpu];
+    ksnprintf(idle->name, sizeof(idle->name), "idle/%u", cpu);
+    idle->cpu = cpu;
+    idle->state = THREAD_RUNNING;
+    idle->last_run = timer_read_counter();
+
+    runqueue_t *rq = &runqueues[cpu];
+    spin_lock_init(&rq->lock);
+    percpu(cpu)->current = idle;
+    rq->idle = idle;
+
+    // SGI enables are banked per CPU
+    gic_enable_irq(IPI_RESCHEDULE);
+}
+
+void sched_init(void) {
+    irq_register(IPI_RESCHEDULE, sched_ipi_handler, NULL);
+    timer_add_tick_handler(sched_tick);
+    sched_init_cpu(0);
+    kprintf("Sched: Round-robin, %u ms slices, %u-page thread stacks\n",
+            SCHED_SLICE_TICKS * 1000 / TIMER_HZ, THREAD_STACK_PAGES);
+}
+
+bool sched_active(void) {
+    percpu_t *self = this_cpu();
+    return self && runqueues[self->cpu].idle != NULL;
+}
+
+void sched_idle_loop(void) {
+    runqueue_t *rq = &runqueues[cpu_id()];
+    while (1) {
+        if (rq->head) {
+            schedule();
+            continue;
+        }
+        // Check again with IRQs masked so a wake-up cannot slip in between
+        // the check and the WFI; a pending IRQ still ends the WFI
+        local_irq_disable();
+        if (!rq->head) {
+            asm volatile("wfi");
+        }
+        local_irq_enable();
+    }
+}
+
+// --- Threads ---
+
+thread_t *thread_current(void) {
+    return this_cpu()->current;
+}
+
+// Online CPU with the fewest ready threads
+static unsigned int sched_pick_cpu(void) {
+    unsigned int best = cpu_id();
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpu_online(cpu) && runqueues[cpu].idle &&
+            runqueues[cpu].nr_ready < runqueues[best].nr_ready) {
+            best = cpu;
+        }
+    }
+    return best;
+}
+
+thread_t *thread_create(const char *name, thread_func_t func, void *arg, int cpu) {
+    if (cpu == THREAD_ANY_CPU) {
+        cpu = sched_pick_cpu();
+    }
+    if (cpu < 0 || cpu >= MAX_CPUS || !cpu_online(cpu) || !runqueues[cpu].idle) {
+        kprintf("Sched: CPU%d cannot run threads\n", cpu);
+        return NULL;
+    }
+
+    thread_t *thread = kmalloc(sizeof(thread_t));
+    if (!thread) {
+        return NULL;
+    }
+    thread->stack_base = alloc_frames(THREAD_STACK_PAGES);
+    if (!thread->stack_base) {
+        kfree(thread);
+        return NULL;
+    }
+
+    ksnprintf(thread->name, sizeof(thread->name), "%s", name);
+    thread->cpu = cpu;
+    thread->mm = NULL;
+
+    // First switch_to "returns" into thread_start with the entry point in
+    // callee-saved registers; a zero frame pointer ends stack walks
+    memset(&thread->context, 0, sizeof(thread->context));
+    thread->context.regs[19] = (uint64_t)func;
+    thread->context.regs[20] = (uint64_t)arg;
+    thread->context.regs[30] = (uint64_t)&thread_start;
+    thread->context.sp_el1 = (uint64_t)thread->stack_base + THREAD_STACK_PAGES * PAGE_SIZE;
+
+    uint64_t flags = spin_lock_irqsave(&all_threads_lock);
+    thread->tid = next_tid++;
+    thread->all_next = all_threads;
+    all_threads = thread;
+    spin_unlock_irqrestore(&all_threads_lock, flags);
+
+    runqueue_t *rq = &runqueues[cpu];
+    flags = spin_lock_irqsave(&rq->lock);
+    rq_make_ready(rq, thread);
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return thread;
+}
+
+void thread_yield(void) {
+    schedule();
+}
+
+void thread_sleep_ms(uint64_t ms) {
+    uint64_t wake_at = timer_read_counter() + timer_us_to_counter(ms * 1000);
+    if (!sched_active() || thread_current() == runqueues[cpu_id()].idle) {
+        while (timer_read_counter() < wake_at) {
+            asm volatile("yield");
+        }
+        return;
+    }
+
+    // IRQs stay masked until switched out, so the tick cannot wake us early
+    uint64_t flags = local_irq_save();
+    thread_t *self = thread_current();
+    runqueue_t *rq = &runqueues[self->cpu];
+    spin_lock(&rq->lock);
+    self->wake_at = wake_at;
+    self->state = THREAD_SLEEPING;
+    rq_add_sleeper(rq, self);
+    spin_unlock(&rq->lock);
+    schedule();
+    local_irq_restore(flags);
+}
+
+void thread_prepare_block(void) {
+    thread_current()->state = THREAD_BLOCKED;
+    dmb(ish);
+}
+
+void thread_block(void) {
+    schedule();
+}
+
+bool thread_block_until(uint64_t wake_at) {
+    uint64_t flags = local_irq_save();
+    thread_t *self = thread_current();
+    runqueue_t *rq = &runqueues[self->cpu];
+    spin_lock(&rq->lock);
+    if (self->state != THREAD_BLOCKED) {
+        // Woken (or preempted, which also counts) since preparing
+        spin_unlock(&rq->lock);
+        local_irq_restore(flags);
+        return true;
+    }
+    // A sleeper that thread_wake() can take off the sleep list early
+    self->wake_at = wake_at;
+    self->state = THREAD_SLEEPING;
+    rq_add_sleeper(rq, self);
+    spin_unlock(&rq->lock);
+    schedule();
+    local_irq_restore(flags);
+    return timer_read_counter() < wake_at;
+}
+
+bool thread_wake(thread_t *thread) {
+    runqueue_t *rq = &runqueues[thread->cpu];
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+    bool woken = true;
+    if (thread->state == THREAD_BLOCKED && percpu(thread->cpu)->current == thread) {
+        // Not switched out yet: cancel the block
+        thread->state = THREAD_RUNNING;
+    } else if (thread->state == THREAD_BLOCKED) {
+        rq_make_ready(rq, thread);
+    } else if (thread->state == THREAD_SLEEPING) {
+        rq_remove_sleeper(rq, thread);
+        rq_make_ready(rq, thread);
+    } else {
+        woken = false;
+    }
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return woken;
+}
+
+void thread_exit(void) {
+    thread_t *self = thread_current();
+
+    uint64_t flags = spin_lock_irqsave(&all_threads_lock);
+    for (thread_t **link = &all_threads; *link; link = &(*link)->all_next) {
+        if (*link == self) {
+            *link = self->all_next;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&all_threads_lock, flags);
+
+    // The next thread on this CPU frees the stack we are still running on
+    local_irq_disable();
+    self->state = THREAD_DEAD;
+    schedule();
+    panic("thread_exit: dead thread was scheduled");
+}
+
+// --- Diagnostics ---
+
+static const char *thread_state_name(thread_state_t state) {
+    switch (state) {
+    case THREAD_RUNNING:  return "running";
+    case THREAD_READY:    return "ready";
+    case THREAD_SLEEPING: return "sleeping";
+    case THREAD_BLOCKED:  return "blocked";
+    case THREAD_DEAD:     return "dead";
+    }
+    return "?";
+}
+
+static void sched_print_thread(const thread_t *thread) {
+    kprintf("  %-4u %-16s %-9s %-4u %10llu %10llu\n", thread->tid, thread->name,
+            thread_state_name(thread->state), thread->cpu, thread->switches,
+            timer_counter_to_us(thread->runtime) / 1000);
+}
+
+void sched_print_info(void) {
+    kprintf("  %-4s %-16s %-9s %-4s %10s %10s\n", "TID", "Name", "State", "CPU",
+            "Switches", "Run (ms)");
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (runqueues[cpu].idle) {
+            sched_print_thread(&idle_threads[cpu]);
+        }
+    }
+
+    uint64_t flags = spin_lock_irqsave(&all_threads_lock);
+    for (thread_t *thread = all_threads; thread; thread = thread->all_next) {
+        sched_print_thread(thread);
+    }
+    spin_unlock_irqrestore(&all_threads_lock, flags);
+
+    kprintf("Run queues:\n");
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        runqueue_t *rq = &runqueues[cpu];
+        if (rq->idle) {
+            kprintf("  CPU%u: %u ready, %llu switches (%llu preemptions)\n", cpu,
+                    rq->nr_ready, rq->switches, rq->preemptions);
+        }
+    }
+}
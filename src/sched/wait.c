@@ -0,0 +1,163 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sched/wait.h"
+#include "sched/thread.h"
+#include "drivers/timer.h"
+#include "sync/spinlock.h"
+
+// --- Wait queues ---
+
+static void wait_enqueue(wait_queue_t *wq, wait_entry_t *entry) {
+    entry->next = NULL;
+    entry->prev = wq->tail;
+    if (wq->tail) {
+        wq->tail->next = entry;
+    } else {
+        wq->head = entry;
+    }
+    wq->tail = entry;
+    entry->queued = true;
+}
+
+static void wait_dequeue(wait_queue_t *wq, wait_entry_t *entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        wq->head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        wq->tail = entry->prev;
+    }
+    entry->next = NULL;
+    entry->prev = NULL;
+    entry->queued = false;
+}
+
+// wq->lock held. The entry may vanish as soon as the lock is dropped, so
+// it is not touched after the wake.
+static void wait_wake_entry(wait_queue_t *wq, wait_entry_t *entry) {
+    wait_dequeue(wq, entry);
+    entry->woken = true;
+    thread_wake(entry->thread);
+}
+
+void wait_queue_init(wait_queue_t *wq) {
+    spin_lock_init(&wq->lock);
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+void wait_entry_init(wait_entry_t *entry) {
+    entry->next = NULL;
+    entry->prev = NULL;
+    entry->thread = thread_current();
+    entry->key = NULL;
+    entry->queued = false;
+    entry->woken = false;
+}
+
+void prepare_to_wait(wait_queue_t *wq, wait_entry_t *entry) {
+    uint64_t flags = spin_lock_irqsave(&wq->lock);
+    if (!entry->queued) {
+        wait_enqueue(wq, entry);
+    }
+    // Blocked before the lock is dropped: a wake_up() from here on either
+    // finds the entry or has already run, and the caller's check of its
+    // condition comes after both
+    thread_prepare_block();
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+void finish_wait(wait_queue_t *wq, wait_entry_t *entry) {
+    thread_t *self = thread_current();
+    if (self->state == THREAD_BLOCKED) {
+        thread_wake(self);      // Condition held without blocking
+    }
+    uint64_t flags = spin_lock_irqsave(&wq->lock);
+    if (entry->queued) {
+        wait_dequeue(wq, entry);
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+unsigned int wake_up(wait_queue_t *wq) {
+    unsigned int woken = 0;
+    uint64_t flags = spin_lock_irqsave(&wq->lock);
+    while (wq->head) {
+        wait_wake_entry(wq, wq->head);
+        woken++;
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return woken;
+}
+
+unsigned int wake_up_one(wait_queue_t *wq) {
+    unsigned int woken = 0;
+    uint64_t flags = spin_lock_irqsave(&wq->lock);
+    if (wq->head) {
+        wait_wake_entry(wq, wq->head);
+        woken = 1;
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return woken;
+}
+
+// --- Address waits ---
+
+static wait_queue_t wait_table[1U << WAIT_HASH_BITS];
+
+// Fibonacci hashing of the word address
+static wait_queue_t *wait_bucket(const volatile void *addr) {
+    uint64_t hash = ((uint64_t)addr >> 2) * 0x9E3779B97F4A7C15ULL;
+    return &wait_table[hash >> (64 - WAIT_HASH_BITS)];
+}
+
+wait_result_t wait_on_address(const volatile uint32_t *addr, uint32_t expected,
+                              uint64_t timeout_ms) {
+    uint64_t deadline = timer_read_counter() + timer_us_to_counter(timeout_ms * 1000);
+    wait_queue_t *bucket = wait_bucket(addr);
+    wait_entry_t entry;
+    wait_entry_init(&entry);
+    entry.key = addr;
+
+    uint64_t flags = spin_lock_irqsave(&bucket->lock);
+    if (*addr != expected) {
+        spin_unlock_irqrestore(&bucket->lock, flags);
+        return WAIT_MISMATCH;
+    }
+    wait_enqueue(bucket, &entry);
+    thread_prepare_block();
+    spin_unlock_irqrestore(&bucket->lock, flags);
+
+    if (timeout_ms) {
+        thread_block_until(deadline);
+    } else {
+        thread_block();
+    }
+
+    finish_wait(bucket, &entry);
+    if (!entry.woken && timeout_ms && timer_read_counter() >= deadline) {
+        return WAIT_TIMEOUT;
+    }
+    return WAIT_WOKEN;
+}
+
+unsigned int wake_address(const volatile uint32_t *addr, unsigned int count) {
+    wait_queue_t *bucket = wait_bucket(addr);
+    unsigned int woken = 0;
+    uint64_t flags = spin_lock_irqsave(&bucket->lock);
+    wait_entry_t *entry = bucket->head;
+    while (entry && woken < count) {
+        wait_entry_t *next = entry->next;
+        if (entry->key == addr) {
+            wait_wake_entry(bucket, entry);
+            woken++;
+        }
+        entry = next;
+    }
+    spin_unlock_irqrestore(&bucket->lock, flags);
+    return woken;
+}
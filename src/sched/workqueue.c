@@ -0,0 +1,156 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sched/workqueue.h"
+#include "sched/thread.h"
+#include "arch/cpu.h"
+#include "arch/smp.h"
+#include "memory/kheap.h"
+#include "sync/spinlock.h"
+#include "sync/atomic.h"
+#include "lib/string.h"
+#include "lib/stdio.h"
+
+#define WORKQUEUE_NAME_LEN 12
+
+typedef struct {
+    spinlock_t lock;            // Taken with IRQs masked: IRQs queue work
+    work_t *head;
+    work_t *tail;
+    thread_t *worker;
+    bool sleeping;              // Worker is blocked waiting for work
+    uint64_t executed;
+    uint64_t batches;           // Lists taken by the worker
+} worker_pool_t;
+
+struct workqueue {
+    char name[WORKQUEUE_NAME_LEN];
+    struct workqueue *next;
+    worker_pool_t pools[MAX_CPUS];
+};
+
+workqueue_t *system_wq = NULL;
+
+// Every workqueue, for workqueue_print_stats()
+static workqueue_t *workqueues = NULL;
+static spinlock_t workqueues_lock = SPINLOCK_INIT;
+
+static void worker_thread(void *arg) {
+    worker_pool_t *pool = arg;
+    while (1) {
+        uint64_t flags = spin_lock_irqsave(&pool->lock);
+        work_t *work = pool->head;
+        if (!work) {
+            // Blocked before the lock is dropped, so a queue_work() that
+            // sees sleeping set cannot lose its wake-up
+            thread_prepare_block();
+            pool->sleeping = true;
+            spin_unlock_irqrestore(&pool->lock, flags);
+            thread_block();
+            continue;
+        }
+        pool->head = NULL;
+        pool->tail = NULL;
+        pool->batches++;
+        spin_unlock_irqrestore(&pool->lock, flags);
+
+        while (work) {
+            // Read before func: the work may be freed or requeued by it
+            work_t *next = work->next;
+            work_func_t func = work->func;
+            void *data = work->data;
+            atomic_store_release32(&work->pending, 0);
+            func(data);
+            pool->executed++;
+            work = next;
+        }
+    }
+}
+
+void work_init(work_t *work, work_func_t func, void *data) {
+    work->next = NULL;
+    work->pending = 0;
+    work->func = func;
+    work->data = data;
+}
+
+bool queue_work_on(unsigned int cpu, workqueue_t *wq, work_t *work) {
+    worker_pool_t *pool = &wq->pools[cpu];
+    if (!pool->worker || atomic_xchg32(&work->pending, 1)) {
+        return false;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&pool->lock);
+    work->next = NULL;
+    if (pool->tail) {
+        pool->tail->next = work;
+    } else {
+        pool->head = work;
+    }
+    pool->tail = work;
+    bool wake = pool->sleeping;
+    pool->sleeping = false;
+    spin_unlock_irqrestore(&pool->lock, flags);
+
+    if (wake) {
+        thread_wake(pool->worker);
+    }
+    return true;
+}
+
+bool queue_work(workqueue_t *wq, work_t *work) {
+    preempt_disable();
+    bool queued = queue_work_on(cpu_id(), wq, work);
+    preempt_enable();
+    return queued;
+}
+
+workqueue_t *workqueue_create(const char *name) {
+    workqueue_t *wq = kmalloc(sizeof(workqueue_t));
+    if (!wq) {
+        return NULL;
+    }
+    memset(wq, 0, sizeof(*wq));
+    ksnprintf(wq->name, sizeof(wq->name), "%s", name);
+
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        worker_pool_t *pool = &wq->pools[cpu];
+        spin_lock_init(&pool->lock);
+        if (!cpu_online(cpu)) {
+            continue;
+        }
+        char thread_name[THREAD_NAME_LEN];
+        ksnprintf(thread_name, sizeof(thread_name), "%s/%u", wq->name, cpu);
+        pool->worker = thread_create(thread_name, worker_thread, pool, cpu);
+        if (!pool->worker) {
+            kprintf("Workqueue: No %s worker on CPU%u\n", wq->name, cpu);
+        }
+    }
+
+    uint64_t flags = spin_lock_irqsave(&workqueues_lock);
+    wq->next = workqueues;
+    workqueues = wq;
+    spin_unlock_irqrestore(&workqueues_lock, flags);
+    return wq;
+}
+
+void workqueue_init(void) {
+    system_wq = workqueue_create("events");
+    if (!system_wq) {
+        kprintf("Workqueue: Failed to create the system workqueue\n");
+    }
+}
+
+void workqueue_print_stats(void) {
+    kprintf("Workqueue     CPU      items  batches\n");
+    uint64_t flags = spin_lock_irqsave(&workqueues_lock);
+    for (workqueue_t *wq = workqueues; wq; wq = wq->next) {
+        for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+            const worker_pool_t *pool = &wq->pools[cpu];
+            if (pool->worker) {
+                kprintf("%-12s %4u %10llu %8llu\n", wq->name, cpu, pool->executed, pool->batches);
+            }
+        }
+    }
+    spin_unlock_irqrestore(&workqueues_lock, flags);
+}
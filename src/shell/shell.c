@@ -5,13 +5,43 @@
 #include "shell/shell.h"
 #include "lib/stdio.h"
 #include "lib/string.h"
+#include "lib/klog.h"
 #include "lib/stdlib_stubs.h"
 #include "memory/frame_alloc.h"
 #include "memory/kheap.h"
+#include "memory/mmu.h"
+#include "memory/vmalloc.h"
+#include "memory/mm.h"
+#include "memory/tlb.h"
+#include "drivers/timer.h"
+#include "drivers/pmu.h"
+#include "debug/profiler.h"
+#include "debug/trace.h"
+#include "debug/memprof.h"
+#include "debug/bootchart.h"
+#include "arch/smp.h"
+#include "sched/thread.h"
+#include "sched/softirq.h"
+#include "sched/workqueue.h"
+#include "drivers/gic.h"
+#include "drivers/virtio.h"
+#include "drivers/virtio_blk.h"
+#include "drivers/virtio_console.h"
+#include "fs/bcache.h"
+#include "fs/vfs.h"
+#include "bench/bench.h"
 
 #define MAX_CMD_LEN 128
 #define MAX_ARGS 10
 
+// Table of command handlers
+typedef struct {
+    const char *name;
+    void (*func)(int argc, char **argv);
+} command_t;
+
+static command_t *shell_find_command(const char *name);
+
 // --- Address Validation ---
 // Needs access to PMM's knowledge of valid RAM regions.
 // This is a simplified check against the highest known usable address.
@@ -261,6 +291,29 @@ void cmd_help(int argc, char **argv) {
     kprintf("  alloc <size>  - Allocate memory of given size\n");
     kprintf("  free <addr>   - Free previously allocated memory\n");
     kprintf("  pmm_info      - Display Physical Memory Manager info\n");
+    kprintf("  prof start [hz] [-g] | stop | report [n] - Sampling profiler\n");
+    kprintf("  memprof start [bytes] [-g] | stop | top [n] - Allocation profiler\n");
+    kprintf("  trace [on|off <event...|all> | clear | dump] - Tracepoints (no args: status)\n");
+    kprintf("  dmesg         - Print the kernel log\n");
+    kprintf("  bootchart     - Show how long each boot phase took\n");
+    kprintf("  perf [-e ev,...] <cmd> [args] - Count PMU events for a command\n");
+    kprintf("  perf list     - List PMU events\n");
+    kprintf("  mmu_info      - Display MMU, page table and ASID info\n");
+    kprintf("  vmalloc_info  - Display vmalloc area usage\n");
+    kprintf("  cpus          - List online CPUs and IPI round-trip times\n");
+    kprintf("  threads       - List kernel threads and run queues\n");
+    kprintf("  irqstat       - Interrupt counts, hard IRQ and softirq times, workqueues\n");
+    kprintf("  virtio        - List virtio devices and disk and console queue statistics\n");
+    kprintf("  console [uart | virtio] - Show or move the console (output and shell input)\n");
+    kprintf("  ls [path]     - List a directory\n");
+    kprintf("  cat <path>    - Print a file\n");
+    kprintf("  stat <path>   - Show a file's type, size, mode and frames\n");
+    kprintf("  mkdir <path> | rm <path> - Create a directory, remove a file or empty directory\n");
+    kprintf("  write [-a] <path> [text...] - Write (or append) a line to a file\n");
+    kprintf("  truncate <path> <size> - Set a file's size\n");
+    kprintf("  df            - List mounted file systems and their usage\n");
+    kprintf("  bcache [sync | drop | limit <frames> | read <block> [n]] - Buffer cache\n");
+    kprintf("  bench [name] [args] - Run a benchmark (no name lists them)\n");
 }
 
 void cmd_pmm_info(int argc, char **argv) {
@@ -270,17 +323,598 @@ void cmd_pmm_info(int argc, char **argv) {
     kprintf("  Highest Usable Addr: 0x%llx\n", pmm_get_highest_usable_address());
 }
 
+void cmd_mmu_info(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    mmu_print_info();
+    mm_print_info();
+    tlb_print_stats();
+}
+
+void cmd_vmalloc_info(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    vmalloc_print_info();
+}
+
+void cmd_cpus(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    smp_print_info();
+}
+
+void cmd_threads(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    sched_print_info();
+}
+
+void cmd_irqstat(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    kprintf("IRQ         count\n");
+    for (unsigned int irq = 0; irq < GIC_MAX_IRQS; irq++) {
+        uint64_t count = gic_get_irq_count(irq);
+        if (count) {
+            kprintf("%4u %12llu\n", irq, count);
+        }
+    }
+    kprintf("\n");
+    softirq_print_stats();
+    kprintf("\n");
+    workqueue_print_stats();
+}
+
+void cmd_virtio(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    virtio_print_info();
+    virtio_blk_print_info();
+    virtio_console_print_info();
+}
+
+void cmd_console(int argc, char **argv) {
+    if (argc < 2) {
+        kprintf("Console: %s\n", console_name());
+        return;
+    }
+    if (strcmp(argv[1], "uart") == 0) {
+        console_bind(NULL);
+    } else if (strcmp(argv[1], "virtio") == 0) {
+        const console_dev_t *dev = virtio_console_device();
+        if (!dev) {
+            kprintf("No virtio-console device\n");
+            return;
+        }
+        kprintf("Console moving to virtio-console\n");
+        console_bind(dev);
+    } else {
+        kprintf("Usage: console [uart | virtio]\n");
+        return;
+    }
+    kprintf("Console: %s\n", console_name());
+}
+
+void cmd_bcache(int argc, char **argv) {
+    if (argc < 2) {
+        bcache_print_stats();
+        return;
+    }
+
+    char *endptr;
+    if (strcmp(argv[1], "sync") == 0) {
+        if (bcache_sync() != 0) {
+            kprintf("Write-back failed\n");
+        }
+    } else if (strcmp(argv[1], "drop") == 0) {
+        bcache_drop();
+    } else if (strcmp(argv[1], "limit") == 0 && argc > 2) {
+        uint64_t frames = simple_strtoull(argv[2], &endptr, 0);
+        if (*endptr != '\0' || frames == 0) {
+            kprintf("Invalid frame count: %s\n", argv[2]);
+            return;
+        }
+        bcache_set_limit(frames);
+    } else if (strcmp(argv[1], "read") == 0 && argc > 2) {
+        block_device_t *dev = virtio_blk_device();
+        if (!dev) {
+            kprintf("No virtio-blk disk (make qemu DISK=disk.img)\n");
+            return;
+        }
+        uint64_t block = simple_strtoull(argv[2], &endptr, 0);
+        if (*endptr != '\0') {
+            kprintf("Invalid block: %s\n", argv[2]);
+            return;
+        }
+        uint64_t count = 1;
+        if (argc > 3) {
+            count = simple_strtoull(argv[3], &endptr, 0);
+            if (*endptr != '\0' || count == 0) {
+                kprintf("Invalid count: %s\n", argv[3]);
+                return;
+            }
+        }
+
+        bcache_stats_t before, after;
+        bcache_get_stats(&before);
+        uint64_t start = timer_read_counter();
+        uint64_t done = 0;
+        for (; done < count; done++) {
+            bcache_buf_t *buf = bcache_read(dev, block + done);
+            if (!buf) {
+                kprintf("Read of block %llu failed\n", block + done);
+                break;
+            }
+            bcache_release(buf);
+        }
+        uint64_t us = timer_counter_to_us(timer_read_counter() - start);
+        bcache_get_stats(&after);
+        kprintf("%llu blocks in %llu us: %llu hits, %llu misses, %llu read ahead\n",
+                done, us, after.hits - before.hits, after.misses - before.misses,
+                after.readahead - before.readahead);
+    } else {
+        kprintf("Usage: bcache [sync | drop | limit <frames> | read <block> [count]]\n");
+    }
+}
+
+static char file_type_char(vfs_type_t type) {
+    switch (type) {
+        case VFS_DIR:
+            return 'd';
+        case VFS_SYMLINK:
+            return 'l';
+        default:
+            return '-';
+    }
+}
+
+// Report a failed file operation; true if there was one
+static bool vfs_failed(const char *path, int64_t err) {
+    if (err >= 0) {
+        return false;
+    }
+    kprintf("%s: %s\n", path, vfs_strerror((int)err));
+    return true;
+}
+
+void cmd_ls(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "/";
+    vfs_stat_t st;
+    if (vfs_failed(path, vfs_stat(path, &st))) {
+        return;
+    }
+    if (st.type != VFS_DIR) {
+        kprintf("%c %10llu %s\n", file_type_char(st.type), st.size, path);
+        return;
+    }
+    int fd = vfs_open(path, O_RDONLY);
+    if (vfs_failed(path, fd)) {
+        return;
+    }
+    vfs_dirent_t ent;
+    while (vfs_readdir(fd, &ent) == 0) {
+        kprintf("%c %10llu %s%s\n", file_type_char(ent.stat.type), ent.stat.size, ent.name,
+                ent.stat.type == VFS_DIR ? "/" : "");
+    }
+    vfs_close(fd);
+}
+
+void cmd_cat(int argc, char **argv) {
+    if (argc < 2) {
+        kprintf("Usage: cat <path>\n");
+        return;
+    }
+    int fd = vfs_open(argv[1], O_RDONLY);
+    if (vfs_failed(argv[1], fd)) {
+        return;
+    }
+    // A page-aligned buffer, so whole pages go through copy_page()
+    char *buf = alloc_frame();
+    if (!buf) {
+        kprintf("Out of memory\n");
+        vfs_close(fd);
+        return;
+    }
+    int64_t n;
+    while ((n = vfs_read(fd, buf, PAGE_SIZE)) > 0) {
+        kwrite(buf, (size_t)n);
+    }
+    vfs_failed(argv[1], n);
+    free_frame(buf);
+    vfs_close(fd);
+}
+
+void cmd_stat(int argc, char **argv) {
+    if (argc < 2) {
+        kprintf("Usage: stat <path>\n");
+        return;
+    }
+    vfs_stat_t st;
+    if (vfs_failed(argv[1], vfs_stat(argv[1], &st))) {
+        return;
+    }
+    const char *type = "file";
+    if (st.type == VFS_DIR) {
+        type = "directory";
+    } else if (st.type == VFS_SYMLINK) {
+        type = "symlink";
+    }
+    kprintf("  Path:   %s\n", argv[1]);
+    kprintf("  Type:   %s\n", type);
+    kprintf("  Size:   %llu\n", st.size);
+    // kprintf has no %o
+    kprintf("  Mode:   0%u%u%u%u\n", (st.mode >> 9) & 7, (st.mode >> 6) & 7,
+            (st.mode >> 3) & 7, st.mode & 7);
+    kprintf("  Frames: %llu\n", st.frames);
+}
+
+void cmd_mkdir(int argc, char **argv) {
+    if (argc < 2) {
+        kprintf("Usage: mkdir <path>\n");
+        return;
+    }
+    vfs_failed(argv[1], vfs_mkdir(argv[1]));
+}
+
+void cmd_rm(int argc, char **argv) {
+    if (argc < 2) {
+        kprintf("Usage: rm <path>\n");
+        return;
+    }
+    vfs_failed(argv[1], vfs_unlink(argv[1]));
+}
+
+void cmd_write(int argc, char **argv) {
+    int arg = 1;
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (argc > 1 && strcmp(argv[1], "-a") == 0) {
+        flags = O_WRONLY | O_CREAT | O_APPEND;
+        arg++;
+    }
+    if (argc <= arg) {
+        kprintf("Usage: write [-a] <path> [text...]\n");
+        return;
+    }
+    const char *path = argv[arg++];
+    int fd = vfs_open(path, flags);
+    if (vfs_failed(path, fd)) {
+        return;
+    }
+    for (; arg < argc; arg++) {
+        if (vfs_failed(path, vfs_write(fd, argv[arg], strlen(argv[arg]))) ||
+            vfs_failed(path, vfs_write(fd, arg + 1 < argc ? " " : "\n", 1))) {
+            break;
+        }
+    }
+    vfs_close(fd);
+}
+
+void cmd_truncate(int argc, char **argv) {
+    if (argc < 3) {
+        kprintf("Usage: truncate <path> <size>\n");
+        return;
+    }
+    char *endptr;
+    uint64_t size = simple_strtoull(argv[2], &endptr, 0);
+    if (*endptr != '\0') {
+        kprintf("Invalid size: %s\n", argv[2]);
+        return;
+    }
+    int fd = vfs_open(argv[1], O_WRONLY | O_CREAT);
+    if (vfs_failed(argv[1], fd)) {
+        return;
+    }
+    vfs_failed(argv[1], vfs_ftruncate(fd, size));
+    vfs_close(fd);
+}
+
+void cmd_df(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    vfs_print_mounts();
+}
+
+void cmd_bench(int argc, char **argv) {
+    bench_run(argc, argv);
+}
+
+void cmd_prof(int argc, char **argv) {
+    if (argc < 2) {
+        kprintf("Usage: prof start [hz] [-g] | prof stop | prof report [top_n]\n");
+        return;
+    }
+
+    char *endptr;
+    if (strcmp(argv[1], "start") == 0) {
+        unsigned int hz = TIMER_HZ;
+        bool callstacks = false;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "-g") == 0) {
+                callstacks = true;
+                continue;
+            }
+            hz = (unsigned int)simple_strtoul(argv[i], &endptr, 0);
+            if (*endptr != '\0' || hz == 0) {
+                kprintf("Error: Invalid sampling rate '%s'\n", argv[i]);
+                return;
+            }
+        }
+        profiler_start(hz, callstacks);
+    } else if (strcmp(argv[1], "stop") == 0) {
+        profiler_stop();
+    } else if (strcmp(argv[1], "report") == 0) {
+        unsigned int top_n = 20;
+        if (argc > 2) {
+            top_n = (unsigned int)simple_strtoul(argv[2], &endptr, 0);
+            if (*endptr != '\0') {
+                kprintf("Error: Invalid count '%s'\n", argv[2]);
+                return;
+            }
+        }
+        profiler_report(top_n);
+    } else {
+        kprintf("Unknown prof subcommand: %s\n", argv[1]);
+    }
+}
+
+void cmd_memprof(int argc, char **argv) {
+    if (argc < 2) {
+        kprintf("Usage: memprof start [sample_bytes] [-g] | memprof stop | memprof top [n]\n");
+        return;
+    }
+
+    char *endptr;
+    if (strcmp(argv[1], "start") == 0) {
+        uint64_t sample_bytes = 0;
+        bool callstacks = false;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "-g") == 0) {
+                callstacks = true;
+                continue;
+            }
+            sample_bytes = simple_strtoull(argv[i], &endptr, 0);
+            if (*endptr != '\0') {
+                kprintf("Error: Invalid sample interval '%s'\n", argv[i]);
+                return;
+            }
+        }
+        memprof_start(sample_bytes, callstacks);
+    } else if (strcmp(argv[1], "stop") == 0) {
+        memprof_stop();
+    } else if (strcmp(argv[1], "top") == 0) {
+        unsigned int top_n = 20;
+        if (argc > 2) {
+            top_n = (unsigned int)simple_strtoul(argv[2], &endptr, 0);
+            if (*endptr != '\0') {
+                kprintf("Error: Invalid count '%s'\n", argv[2]);
+                return;
+            }
+        }
+        memprof_report(top_n);
+    } else {
+        kprintf("Unknown memprof subcommand: %s\n", argv[1]);
+    }
+}
+
+void cmd_trace(int argc, char **argv) {
+    if (argc < 2) {
+        trace_print_status();
+        return;
+    }
+    bool on = strcmp(argv[1], "on") == 0;
+    if ((on || strcmp(argv[1], "off") == 0) && argc > 2) {
+        for (int i = 2; i < argc; i++) {
+            if (!trace_set_enabled(argv[i], on)) {
+                kprintf("Unknown trace event: %s\n", argv[i]);
+            }
+        }
+    } else if (strcmp(argv[1], "clear") == 0) {
+        trace_clear();
+    } else if (strcmp(argv[1], "dump") == 0) {
+        trace_dump();
+    } else {
+        kprintf("Usage: trace [on <event...|all> | off <event...|all> | clear | dump]\n");
+    }
+}
+
+// Print the kernel log as it was when the command started; what dmesg
+// itself prints is logged too
+void cmd_dmesg(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    uint64_t end = klog_end();
+    uint64_t pos = 0;
+    char chunk[256];
+    while (pos < end) {
+        size_t len = sizeof(chunk);
+        if (len > end - pos) {
+            len = end - pos;
+        }
+        size_t n = klog_read(&pos, chunk, len);
+        if (n == 0) {
+            break;
+        }
+        kwrite(chunk, n);
+    }
+}
+
+void cmd_bootchart(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    bootchart_print();
+}
+
+// Events counted by 'perf' when no -e list is given (if implemented)
+static const uint16_t perf_default_events[] = {
+    PMU_EVENT_INST_RETIRED,
+    PMU_EVENT_L1D_CACHE_REFILL,
+    PMU_EVENT_L1I_CACHE_REFILL,
+    PMU_EVENT_L1D_TLB_REFILL,
+    PMU_EVENT_L1I_TLB_REFILL,
+    PMU_EVENT_L2D_CACHE_REFILL,
+    PMU_EVENT_BR_MIS_PRED,
+};
+
+static void perf_list_events(void) {
+    kprintf("PMU events (%u hardware counters + cycle counter):\n", pmu_num_counters());
+    for (int event = 0; event < 64; event++) {
+        const char *name = pmu_event_name((uint16_t)event);
+        if (name) {
+            kprintf("  0x%02x  %-16s %s\n", event, name,
+                    pmu_event_supported((uint16_t)event) ? "" : "(not supported)");
+        }
+    }
+}
+
+// Parse a comma-separated list of event names or numbers into the session
+static bool perf_parse_events(pmu_session_t *session, char *list) {
+    while (*list) {
+        char *name = list;
+        while (*list && *list != ',') list++;
+        if (*list == ',') *list++ = '\0';
+        if (*name == '\0') continue;
+
+        int event = pmu_event_by_name(name);
+        if (event < 0) {
+            char *endptr;
+            event = (int)simple_strtoul(name, &endptr, 0);
+            if (*endptr != '\0') {
+                kprintf("Error: Unknown event '%s' (see 'perf list')\n", name);
+                return false;
+            }
+        }
+        if (pmu_session_add_event(session, (uint16_t)event) != 0) {
+            kprintf("Error: At most %d events per run\n", PMU_MAX_EVENTS);
+            return false;
+        }
+    }
+    return true;
+}
+
+void cmd_perf(int argc, char **argv) {
+    if (argc < 2) {
+        kprintf("Usage: perf [-e event,...] <command> [args] | perf list\n");
+        return;
+    }
+    if (!pmu_available()) {
+        kprintf("Error: No PMU available on this CPU\n");
+        return;
+    }
+    if (strcmp(argv[1], "list") == 0) {
+        perf_list_events();
+        return;
+    }
+
+    pmu_session_t session;
+    memset(&session, 0, sizeof(session));
+
+    int first = 1;
+    if (strcmp(argv[1], "-e") == 0) {
+        if (argc < 4) {
+            kprintf("Usage: perf -e event,... <command> [args]\n");
+            return;
+        }
+        if (!perf_parse_events(&session, argv[2])) {
+            return;
+        }
+        first = 3;
+    } else {
+        for (size_t i = 0; i < sizeof(perf_default_events) / sizeof(perf_default_events[0]); i++) {
+            if (pmu_event_supported(perf_default_events[i])) {
+                pmu_session_add_event(&session, perf_default_events[i]);
+            }
+        }
+    }
+
+    command_t *cmd = shell_find_command(argv[first]);
+    if (!cmd) {
+        kprintf("Unknown command: %s\n", argv[first]);
+        return;
+    }
+    if (cmd->func == cmd_perf) {
+        kprintf("Error: perf cannot measure itself\n");
+        return;
+    }
+
+    uint64_t start = timer_read_counter();
+    if (pmu_session_start(&session) != 0) {
+        kprintf("Error: Could not start PMU session\n");
+        return;
+    }
+    cmd->func(argc - first, argv + first);
+    pmu_session_stop(&session);
+    uint64_t elapsed_us = timer_counter_to_us(timer_read_counter() - start);
+
+    kprintf("\nPerformance counter stats for '");
+    for (int i = first; i < argc; i++) {
+        kprintf(i > first ? " %s" : "%s", argv[i]);
+    }
+    kprintf("' (CPU %u):\n\n", session.cpu);
+
+    kprintf("  %16llu  cycles\n", session.cycles);
+    for (int i = 0; i < session.num_events; i++) {
+        uint16_t event = session.events[i];
+        const char *name = pmu_event_name(event);
+        char fallback[16];
+        if (!name) {
+            ksnprintf(fallback, sizeof(fallback), "raw-0x%x", event);
+            name = fallback;
+        }
+
+        if (!pmu_event_supported(event)) {
+            kprintf("  %16s  %s\n", "<not supported>", name);
+            continue;
+        }
+
+        bool scaled;
+        uint64_t value = pmu_session_value(&session, i, &scaled);
+        kprintf("  %16llu  %-16s", value, name);
+        if (event == PMU_EVENT_INST_RETIRED && session.cycles) {
+            uint64_t ipc = value * 100 / session.cycles;
+            kprintf("  # %llu.%02llu insn per cycle", ipc / 100, ipc % 100);
+        }
+        if (scaled && session.cycles) {
+            kprintf("  (counted %llu%% of the time)",
+                    session.enabled[i] * 100 / session.cycles);
+        }
+        kprintf("\n");
+    }
+    kprintf("\n  %llu.%03llu ms elapsed\n", elapsed_us / 1000, elapsed_us % 1000);
+}
+
 
 // --- Shell Main Loop ---
 
-// Table of command handlers
-typedef struct {
-    const char *name;
-    void (*func)(int argc, char **argv);
-} command_t;
+#define MAX_COMMANDS 32
+
+// Static command array, NULL-terminated
+static command_t commands[MAX_COMMANDS + 1];
+static int num_commands = 0;
+
+// Append a command to the table
+static void register_command(const char *name, void (*func)(int argc, char **argv)) {
+    if (num_commands >= MAX_COMMANDS) {
+        kprintf("Shell: Command table full, dropping '%s'\n", name);
+        return;
+    }
+    commands[num_commands].name = name;
+    commands[num_commands].func = func;
+    num_commands++;
 
-// Static command array with initialized function pointers
-static command_t commands[8];
+    // Sentinel
+    commands[num_commands].name = NULL;
+    commands[num_commands].func = NULL;
+}
+
+// Look up a command by name without any debug output
+static command_t *shell_find_command(const char *name) {
+    for (int i = 0; commands[i].name != NULL; i++) {
+        if (strcmp(name, commands[i].name) == 0) {
+            return &commands[i];
+        }
+    }
+    return NULL;
+}
 
 // Runtime initialization of the command table to work around section initialization issues
 static void init_command_table(void) {
@@ -291,34 +925,64 @@ static void init_command_table(void) {
     static char alloc_cmd[] = "alloc";
     static char free_cmd[] = "free";
     static char pmm_info_cmd[] = "pmm_info";
+    static char prof_cmd[] = "prof";
+    static char memprof_cmd[] = "memprof";
+    static char trace_cmd[] = "trace";
+    static char dmesg_cmd[] = "dmesg";
+    static char bootchart_cmd[] = "bootchart";
+    static char perf_cmd[] = "perf";
+    static char mmu_info_cmd[] = "mmu_info";
+    static char vmalloc_info_cmd[] = "vmalloc_info";
+    static char cpus_cmd[] = "cpus";
+    static char threads_cmd[] = "threads";
+    static char irqstat_cmd[] = "irqstat";
+    static char virtio_cmd[] = "virtio";
+    static char console_cmd[] = "console";
+    static char bcache_cmd[] = "bcache";
+    static char ls_cmd[] = "ls";
+    static char cat_cmd[] = "cat";
+    static char stat_cmd[] = "stat";
+    static char mkdir_cmd[] = "mkdir";
+    static char rm_cmd[] = "rm";
+    static char write_cmd[] = "write";
+    static char truncate_cmd[] = "truncate";
+    static char df_cmd[] = "df";
+    static char bench_cmd[] = "bench";
     
-    commands[0].name = help_cmd;
-    commands[0].func = cmd_help;
-    
-    commands[1].name = memdump_cmd;
-    commands[1].func = cmd_memdump;
-    
-    commands[2].name = peek_cmd;
-    commands[2].func = cmd_peek;
-    
-    commands[3].name = poke_cmd;
-    commands[3].func = cmd_poke;
-    
-    commands[4].name = alloc_cmd;
-    commands[4].func = cmd_alloc;
-    
-    commands[5].name = free_cmd;
-    commands[5].func = cmd_free;
-    
-    commands[6].name = pmm_info_cmd;
-    commands[6].func = cmd_pmm_info;
-    
-    // Sentinel
-    commands[7].name = NULL;
-    commands[7].func = NULL;
+    num_commands = 0;
+    register_command(help_cmd, cmd_help);
+    register_command(memdump_cmd, cmd_memdump);
+    register_command(peek_cmd, cmd_peek);
+    register_command(poke_cmd, cmd_poke);
+    register_command(alloc_cmd, cmd_alloc);
+    register_command(free_cmd, cmd_free);
+    register_command(pmm_info_cmd, cmd_pmm_info);
+    register_command(prof_cmd, cmd_prof);
+    register_command(memprof_cmd, cmd_memprof);
+    register_command(trace_cmd, cmd_trace);
+    register_command(dmesg_cmd, cmd_dmesg);
+    register_command(bootchart_cmd, cmd_bootchart);
+    register_command(perf_cmd, cmd_perf);
+    register_command(mmu_info_cmd, cmd_mmu_info);
+    register_command(vmalloc_info_cmd, cmd_vmalloc_info);
+    register_command(cpus_cmd, cmd_cpus);
+    register_command(threads_cmd, cmd_threads);
+    register_command(irqstat_cmd, cmd_irqstat);
+    register_command(virtio_cmd, cmd_virtio);
+    register_command(console_cmd, cmd_console);
+    register_command(bcache_cmd, cmd_bcache);
+    register_command(ls_cmd, cmd_ls);
+    register_command(cat_cmd, cmd_cat);
+    register_command(stat_cmd, cmd_stat);
+    register_command(mkdir_cmd, cmd_mkdir);
+    register_command(rm_cmd, cmd_rm);
+    register_command(write_cmd, cmd_write);
+    register_command(truncate_cmd, cmd_truncate);
+    register_command(df_cmd, cmd_df);
+    register_command(bench_cmd, cmd_bench);
     
     kprintf("Command table initialized:\n");
-    for (int i = 0; i < 7; i++) {
+    for (int i = 0; i < num_commands; i++) {
         kprintf("  [%d] name at %p: '%s', len=%d\n", 
                 i, commands[i].name, commands[i].name, 
                 strlen(commands[i].name));
@@ -373,12 +1037,13 @@ void shell_loop() {
             continue; // Empty command
         }
 
-        // Parse command and arguments using strtok
+        // Parse command and arguments using strtok_r
         argc = 0;
-        char *token = strtok(cmd_buffer, " ");
+        char *saveptr = NULL;
+        char *token = strtok_r(cmd_buffer, " ", &saveptr);
         while (token != NULL && argc < MAX_ARGS) {
             argv[argc++] = token;
-            token = strtok(NULL, " ");
+            token = strtok_r(NULL, " ", &saveptr);
         }
 
         if (argc == 0) {
@@ -0,0 +1,134 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sync/spinlock.h"
+#include "sync/atomic.h"
+#include "arch/cpu.h"
+#include "arch/smp.h"
+#include "lib/stdio.h"
+
+bool cpu_has_lse = false;
+
+void atomics_init(void) {
+    // ID_AA64ISAR0_EL1.Atomic, bits [23:20]: 2 = LSE implemented
+    uint64_t isar0 = read_sysreg(id_aa64isar0_el1);
+    cpu_has_lse = ((isar0 >> 20) & 0xF) >= 2;
+    kprintf("Sync: Using %s atomics\n", cpu_has_lse ? "LSE" : "LDXR/STXR");
+}
+
+// --- Ticket spinlock ---
+
+#define TICKET_SHIFT 16
+
+void spin_lock(spinlock_t *lock) {
+    preempt_disable();
+    uint32_t old = atomic_fetch_add32(&lock->val, 1U << TICKET_SHIFT);
+    uint16_t ticket = old >> TICKET_SHIFT;
+    if ((uint16_t)old == ticket) {
+        return;
+    }
+
+    // The exclusive load arms the monitor on the lock word, so the
+    // releasing STLRH wakes us from WFE
+    uint32_t owner;
+    asm volatile("   sevl\n"
+                 "1: wfe\n"
+                 "   ldaxrh %w0, %1\n"
+                 "   cmp %w0, %w2\n"
+                 "   b.ne 1b"
+                 : "=&r" (owner) : "Q" (lock->owner), "r" ((uint32_t)ticket)
+                 : "cc", "memory");
+}
+
+bool spin_trylock(spinlock_t *lock) {
+    uint32_t old = atomic_load_acquire32(&lock->val);
+    if ((old >> TICKET_SHIFT) != (old & 0xFFFF)) {
+        return false;
+    }
+    preempt_disable();
+    uint32_t new_val = old + (1U << TICKET_SHIFT);
+    if (atomic_cmpxchg32(&lock->val, old, new_val) != old) {
+        preempt_enable();
+        return false;
+    }
+    return true;
+}
+
+void spin_unlock(spinlock_t *lock) {
+    // Only the holder writes owner, so a plain read is enough
+    uint16_t owner = lock->owner + 1;
+    asm volatile("stlrh %w1, %0" : "=Q" (lock->owner) : "r" ((uint32_t)owner) : "memory");
+    preempt_enable();
+}
+
+bool spin_is_locked(spinlock_t *lock) {
+    uint32_t val = atomic_load_acquire32(&lock->val);
+    return (val >> TICKET_SHIFT) != (val & 0xFFFF);
+}
+
+uint64_t spin_lock_irqsave(spinlock_t *lock) {
+    uint64_t flags = local_irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags) {
+    spin_unlock(lock);
+    local_irq_restore(flags);
+}
+
+// --- MCS queue lock ---
+
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node) {
+    preempt_disable();
+    node->next = NULL;
+    node->locked = 0;
+
+    mcs_node_t *prev = (mcs_node_t *)atomic_xchg64((volatile uint64_t *)&lock->tail,
+                                                   (uint64_t)node);
+    if (!prev) {
+        return;
+    }
+
+    // Queue behind prev and wait for it to hand the lock over
+    atomic_store_release64((volatile uint64_t *)&prev->next, (uint64_t)node);
+    atomic_wait_while32(&node->locked, 0);
+}
+
+bool mcs_trylock(mcs_lock_t *lock, mcs_node_t *node) {
+    preempt_disable();
+    node->next = NULL;
+    node->locked = 0;
+    if (atomic_cmpxchg64((volatile uint64_t *)&lock->tail, 0, (uint64_t)node) != 0) {
+        preempt_enable();
+        return false;
+    }
+    return true;
+}
+
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node) {
+    mcs_node_t *next = node->next;
+    if (!next) {
+        // No known successor: release the lock if we are still the tail
+        if (atomic_cmpxchg64((volatile uint64_t *)&lock->tail, (uint64_t)node, 0) ==
+            (uint64_t)node) {
+            preempt_enable();
+            return;
+        }
+        // A waiter swapped itself in but has not linked to us yet
+        next = (mcs_node_t *)atomic_wait_while64((volatile uint64_t *)&node->next, 0);
+    }
+    atomic_store_release32(&next->locked, 1);
+    preempt_enable();
+}
+
+uint64_t mcs_lock_irqsave(mcs_lock_t *lock, mcs_node_t *node) {
+    uint64_t flags = local_irq_save();
+    mcs_lock(lock, node);
+    return flags;
+}
+
+void mcs_unlock_irqrestore(mcs_lock_t *lock, mcs_node_t *node, uint64_t flags) {
+    mcs_unlock(lock, node);
+    local_irq_restore(flags);
+}
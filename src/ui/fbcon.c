@@ -0,0 +1,257 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "ui/fbcon.h"
+#include "ui/font.h"
+#include "memory/kheap.h"
+#include "memory/vmalloc.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+
+#define FBCON_GLYPH_PIXELS  (FBCON_CELL_WIDTH * FBCON_CELL_HEIGHT)
+#define FBCON_GLYPH_WORDS   (FBCON_CELL_WIDTH * 4 / 8)  // uint64_t per glyph row
+#define FBCON_ATLAS_BYTES   (2 * FONT_GLYPHS * FBCON_GLYPH_PIXELS * 4)
+
+static framebuffer_t fb;
+static bool fbcon_on = false;
+static uint32_t cols;
+static uint32_t rows;
+
+// [normal, inverted][glyph][pixel row][pixel]. Only the CPU reads it, so
+// it comes from vmalloc rather than a physically contiguous run.
+static uint32_t *atlas;
+
+// One glyph index per cell, 0 (a space) when blank
+static uint8_t *cells;
+
+// Per text row, the cells [lo, hi) that changed since the last flush
+static uint16_t *dirty_lo;
+static uint16_t *dirty_hi;
+
+// The atlas glyph of each cell in the row being blitted
+static const uint64_t **row_glyphs;
+
+// The cursor may sit at cols until the next character wraps the line
+static uint32_t cur_x = 0;
+static uint32_t cur_y = 0;
+static bool cursor_drawn = false;
+static uint32_t drawn_x;
+static uint32_t drawn_y;
+
+// Lines scrolled in the shadow but not yet on the framebuffer
+static uint32_t pending_scroll = 0;
+
+static fbcon_stats_t stats;
+
+static const uint32_t *fbcon_glyph(uint8_t glyph, bool inverted) {
+    return atlas + ((size_t)(inverted ? FONT_GLYPHS : 0) + glyph) * FBCON_GLYPH_PIXELS;
+}
+
+static void fbcon_build_atlas(void) {
+    for (unsigned int inverted = 0; inverted < 2; inverted++) {
+        for (unsigned int g = 0; g < FONT_GLYPHS; g++) {
+            uint32_t *px = (uint32_t *)fbcon_glyph(g, inverted);
+            for (unsigned int y = 0; y < FBCON_CELL_HEIGHT; y++) {
+                uint8_t bits = font8x8[g][y * FONT_HEIGHT / FBCON_CELL_HEIGHT];
+                for (unsigned int x = 0; x < FBCON_CELL_WIDTH; x++) {
+                    bool on = ((bits >> x) & 1) != inverted;
+                    *px++ = on ? FBCON_FG : FBCON_BG;
+                }
+            }
+        }
+    }
+}
+
+static void fbcon_mark(uint32_t row, uint32_t lo, uint32_t hi) {
+    if (dirty_lo[row] > lo) {
+        dirty_lo[row] = lo;
+    }
+    if (dirty_hi[row] < hi) {
+        dirty_hi[row] = hi;
+    }
+}
+
+// Move the shadow and its dirty spans up a line; the framebuffer follows
+// at the next flush
+static void fbcon_scroll(void) {
+    memmove(cells, cells + cols, (size_t)(rows - 1) * cols);
+    memset(cells + (size_t)(rows - 1) * cols, 0, cols);
+    memmove(dirty_lo, dirty_lo + 1, (rows - 1) * sizeof(*dirty_lo));
+    memmove(dirty_hi, dirty_hi + 1, (rows - 1) * sizeof(*dirty_hi));
+    dirty_lo[rows - 1] = 0;
+    dirty_hi[rows - 1] = cols;
+
+    if (cursor_drawn) {
+        if (drawn_y == 0) {
+            cursor_drawn = false;
+        } else {
+            drawn_y--;
+        }
+    }
+    pending_scroll++;
+    stats.scrolls++;
+}
+
+static void fbcon_newline(void) {
+    cur_x = 0;
+    if (cur_y + 1 < rows) {
+        cur_y++;
+    } else {
+        fbcon_scroll();
+    }
+}
+
+static void fbcon_putc(char c) {
+    switch (c) {
+        case '\n':
+            fbcon_newline();
+            break;
+        case '\r':
+            cur_x = 0;
+            break;
+        case '\b':
+            if (cur_x > 0) {
+                cur_x--;
+            }
+            break;
+        case '\t':
+            cur_x = (cur_x + FBCON_TAB_WIDTH) & ~(FBCON_TAB_WIDTH - 1);
+            if (cur_x > cols) {
+                cur_x = cols;
+            }
+            break;
+        default: {
+            if (cur_x == cols) {
+                fbcon_newline();
+            }
+            uint8_t ch = (uint8_t)c;
+            if (ch < FONT_FIRST || ch > FONT_LAST) {
+                ch = '?';
+            }
+            cells[(size_t)cur_y * cols + cur_x] = ch - FONT_FIRST;
+            fbcon_mark(cur_y, cur_x, cur_x + 1);
+            cur_x++;
+            break;
+        }
+    }
+}
+
+// Copy cells [lo, hi) of a row from the atlas, one scanline at a time
+static void fbcon_blit_row(uint32_t row, uint32_t lo, uint32_t hi, uint32_t cursor_x) {
+    const uint8_t *line = cells + (size_t)row * cols;
+    for (uint32_t c = lo; c < hi; c++) {
+        bool inverted = row == cur_y && c == cursor_x;
+        row_glyphs[c] = (const uint64_t *)fbcon_glyph(line[c], inverted);
+    }
+
+    size_t pitch = fb.stride / sizeof(uint32_t);
+    uint32_t *dst = fb.pixels + (size_t)row * FBCON_CELL_HEIGHT * pitch + lo * FBCON_CELL_WIDTH;
+    for (unsigned int y = 0; y < FBCON_CELL_HEIGHT; y++, dst += pitch) {
+        uint64_t *d = (uint64_t *)dst;
+        size_t offset = y * FBCON_GLYPH_WORDS;
+        for (uint32_t c = lo; c < hi; c++, d += FBCON_GLYPH_WORDS) {
+            const uint64_t *s = row_glyphs[c] + offset;
+            d[0] = s[0];
+            d[1] = s[1];
+            d[2] = s[2];
+            d[3] = s[3];
+        }
+    }
+    stats.cells_drawn += hi - lo;
+}
+
+static void fbcon_flush(void) {
+    uint32_t cursor_x = cur_x < cols ? cur_x : cols - 1;
+    if (!cursor_drawn || drawn_x != cursor_x || drawn_y != cur_y) {
+        if (cursor_drawn) {
+            fbcon_mark(drawn_y, drawn_x, drawn_x + 1);
+        }
+        fbcon_mark(cur_y, cursor_x, cursor_x + 1);
+    }
+
+    // Rows scrolled in are already dirty, so a screen or more is a redraw
+    if (pending_scroll > 0) {
+        if (pending_scroll < rows) {
+            size_t line = (size_t)FBCON_CELL_HEIGHT * fb.stride;
+            memmove(fb.pixels, (uint8_t *)fb.pixels + pending_scroll * line,
+                    (rows - pending_scroll) * line);
+            stats.scroll_moves++;
+        } else {
+            stats.full_redraws++;
+        }
+        pending_scroll = 0;
+    }
+
+    for (uint32_t row = 0; row < rows; row++) {
+        if (dirty_lo[row] < dirty_hi[row]) {
+            fbcon_blit_row(row, dirty_lo[row], dirty_hi[row], cursor_x);
+            dirty_lo[row] = cols;
+            dirty_hi[row] = 0;
+        }
+    }
+    cursor_drawn = true;
+    drawn_x = cursor_x;
+    drawn_y = cur_y;
+    stats.flushes++;
+}
+
+bool fbcon_init(const framebuffer_t *framebuffer) {
+    uint32_t c = framebuffer->width / FBCON_CELL_WIDTH;
+    uint32_t r = framebuffer->height / FBCON_CELL_HEIGHT;
+    if (c == 0 || r == 0 || c > UINT16_MAX) {
+        return false;
+    }
+
+    atlas = vmalloc(FBCON_ATLAS_BYTES);
+    size_t shadow = c * sizeof(*row_glyphs) + 2 * r * sizeof(uint16_t) + (size_t)r * c;
+    uint8_t *mem = kmalloc(shadow);
+    if (!atlas || !mem) {
+        kprintf("fbcon: Out of memory\n");
+        if (atlas) {
+            vfree(atlas);
+        }
+        if (mem) {
+            kfree(mem);
+        }
+        return false;
+    }
+
+    fb = *framebuffer;
+    cols = c;
+    rows = r;
+    row_glyphs = (const uint64_t **)mem;
+    dirty_lo = (uint16_t *)(mem + c * sizeof(*row_glyphs));
+    dirty_hi = dirty_lo + r;
+    cells = (uint8_t *)(dirty_hi + r);
+    memset(cells, 0, (size_t)r * c);
+    for (uint32_t row = 0; row < rows; row++) {
+        dirty_lo[row] = 0;
+        dirty_hi[row] = cols;
+    }
+    fbcon_build_atlas();
+
+    fbcon_flush();
+    fbcon_on = true;
+    kprintf("fbcon: %ux%u cells, %u KB glyph atlas\n", cols, rows,
+            (unsigned int)(FBCON_ATLAS_BYTES / 1024));
+    return true;
+}
+
+bool fbcon_active(void) {
+    return fbcon_on;
+}
+
+void fbcon_write(const char *buf, size_t len) {
+    if (!fbcon_on) {
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        fbcon_putc(buf[i]);
+    }
+    stats.chars += len;
+    fbcon_flush();
+}
+
+void fbcon_get_stats(fbcon_stats_t *out) {
+    *out = stats;
+}
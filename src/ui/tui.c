@@ -2,22 +2,30 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "ui/tui.h"
+#include "ui/fbcon.h"
+#include "drivers/ramfb.h"
 #include "lib/stdio.h"
 
-// This is a placeholder implementation for the TUI
-// In the full version, this would integrate with a framebuffer
+// The framebuffer console is a console output, so everything printed
+// from here on, kprintf included, reaches both the UART and the screen
 
 int tui_init(void) {
-    kprintf("TUI: Initializing...\n");
-    kprintf("TUI: Using fallback console mode (no framebuffer)\n");
-    
-    // Return success for now - we'll just use UART output
+    framebuffer_t fb;
+    if (!ramfb_init(TUI_FB_WIDTH, TUI_FB_HEIGHT, &fb)) {
+        kprintf("TUI: No framebuffer, using the serial console\n");
+        return 0;
+    }
+    if (!fbcon_init(&fb)) {
+        return -1;
+    }
+    if (!console_add_output(fbcon_write)) {
+        kprintf("TUI: No free console output slot\n");
+        return -1;
+    }
     return 0;
 }
 
 void tui_write(const char *data, size_t len) {
-    // For now, just forward to UART output via kprintf
-    for (size_t i = 0; i < len; i++) {
-        kprintf("%c", data[i]);
-    }
-}
\ No newline at end of file
+    // One console write for the whole span
+    kwrite(data, len);
+}